@@ -0,0 +1,201 @@
+/*! ----------------------------------------------------------------------------
+ * @file    frame_schema.h
+ * @brief   Declarative frame layouts with generated fixed-offset encoders and decoders
+ *
+ *          A frame layout is written once as a list of fields, each with a wire type and, for arrays, a count:
+ *
+ *              #define MY_FRAME_FIELDS(FIELD, ARRAY, s)  \
+ *                  FIELD(s, type, fs_u8)                 \
+ *                  FIELD(s, count, fs_u32)               \
+ *                  ARRAY(s, values, fs_f64, 4)
+ *
+ *              FRAME_SCHEMA(my_frame, MY_FRAME_FIELDS)
+ *
+ *          FRAME_SCHEMA() then generates, for the schema s:
+ *          - s_t, the decoded frame as a C struct,
+ *          - s_OFF_<field>, the byte offset of each field, and s_SIZE, the length on air, as enum constants,
+ *          - s_put()/s_get(), which encode/decode a whole frame,
+ *          - s_set_<field>()/s_get_<field>() for single fields, and s_put_<field>()/s_get_<field>() copying arrays from
+ *            and to C arrays.
+ *          FRAME_SCHEMA_FOR() does the same for an existing struct type whose members have the field names.
+ *
+ *          Fields are packed in list order without padding, multi-byte values least significant byte first, doubles as
+ *          IEEE 754 binary64, whatever the compiler and target. Offsets are compile-time constants and the accessors are
+ *          static inline, so encoding a frame compiles to straight-line stores at fixed offsets.
+ *
+ *          The wire types are fs_u8, fs_u16, fs_u32, fs_u64 and fs_f64, plus any schema declared earlier, which is then
+ *          nested in place.
+ */
+
+#ifndef FRAME_SCHEMA_H_
+#define FRAME_SCHEMA_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+/* Fails to compile when cond is false. tag names the check in the error message. */
+#define FS_STATIC_ASSERT(cond, tag) typedef char fs_assert_##tag[(cond) ? 1 : -1]
+
+    /* Primitive wire types */
+    typedef uint8_t fs_u8_t;
+    typedef uint16_t fs_u16_t;
+    typedef uint32_t fs_u32_t;
+    typedef uint64_t fs_u64_t;
+    typedef double fs_f64_t;
+
+    enum
+    {
+        fs_u8_SIZE = 1,
+        fs_u16_SIZE = 2,
+        fs_u32_SIZE = 4,
+        fs_u64_SIZE = 8,
+        fs_f64_SIZE = 8
+    };
+
+    static inline void fs_u8_put(uint8_t *p, const fs_u8_t *v)
+    {
+        p[0] = *v;
+    }
+
+    static inline void fs_u8_get(const uint8_t *p, fs_u8_t *v)
+    {
+        *v = p[0];
+    }
+
+    static inline void fs_u16_put(uint8_t *p, const fs_u16_t *v)
+    {
+        p[0] = (uint8_t)*v;
+        p[1] = (uint8_t)(*v >> 8);
+    }
+
+    static inline void fs_u16_get(const uint8_t *p, fs_u16_t *v)
+    {
+        *v = (uint16_t)(p[0] | (p[1] << 8));
+    }
+
+    static inline void fs_u32_put(uint8_t *p, const fs_u32_t *v)
+    {
+        p[0] = (uint8_t)*v;
+        p[1] = (uint8_t)(*v >> 8);
+        p[2] = (uint8_t)(*v >> 16);
+        p[3] = (uint8_t)(*v >> 24);
+    }
+
+    static inline void fs_u32_get(const uint8_t *p, fs_u32_t *v)
+    {
+        *v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    static inline void fs_u64_put(uint8_t *p, const fs_u64_t *v)
+    {
+        uint32_t lo = (uint32_t)*v, hi = (uint32_t)(*v >> 32);
+
+        fs_u32_put(p, &lo);
+        fs_u32_put(p + 4, &hi);
+    }
+
+    static inline void fs_u64_get(const uint8_t *p, fs_u64_t *v)
+    {
+        uint32_t lo, hi;
+
+        fs_u32_get(p, &lo);
+        fs_u32_get(p + 4, &hi);
+        *v = ((uint64_t)hi << 32) | lo;
+    }
+
+    /* Both targets store doubles in the byte order of their 64-bit integers */
+    static inline void fs_f64_put(uint8_t *p, const fs_f64_t *v)
+    {
+        uint64_t bits;
+
+        memcpy(&bits, v, sizeof(bits));
+        fs_u64_put(p, &bits);
+    }
+
+    static inline void fs_f64_get(const uint8_t *p, fs_f64_t *v)
+    {
+        uint64_t bits;
+
+        fs_u64_get(p, &bits);
+        memcpy(v, &bits, sizeof(bits));
+    }
+
+/* Generators applied to the field list of a schema */
+#define FS_MEMBER_FIELD(s, f, t)    t##_t f;
+#define FS_MEMBER_ARRAY(s, f, t, n) t##_t f[n];
+
+/* Each field gets its offset and the offset of its last byte, so the next field's offset follows implicitly */
+#define FS_OFFSET_FIELD(s, f, t)    s##_OFF_##f, s##_LAST_##f = s##_OFF_##f + t##_SIZE - 1,
+#define FS_OFFSET_ARRAY(s, f, t, n) s##_OFF_##f, s##_LAST_##f = s##_OFF_##f + (n) * t##_SIZE - 1,
+
+#define FS_PUT_FIELD(s, f, t)    t##_put(&p[s##_OFF_##f], &v->f);
+#define FS_PUT_ARRAY(s, f, t, n) s##_put_##f(p, v->f);
+#define FS_GET_FIELD(s, f, t)    t##_get(&p[s##_OFF_##f], &v->f);
+#define FS_GET_ARRAY(s, f, t, n) s##_get_##f(p, v->f);
+
+#define FS_ACCESSORS_FIELD(s, f, t)                                                                                                                           \
+    static inline void s##_set_##f(uint8_t *p, t##_t v)                                                                                                      \
+    {                                                                                                                                                         \
+        t##_put(&p[s##_OFF_##f], &v);                                                                                                                        \
+    }                                                                                                                                                         \
+    static inline t##_t s##_get_##f(const uint8_t *p)                                                                                                        \
+    {                                                                                                                                                         \
+        t##_t v;                                                                                                                                              \
+        t##_get(&p[s##_OFF_##f], &v);                                                                                                                        \
+        return v;                                                                                                                                             \
+    }
+#define FS_ACCESSORS_ARRAY(s, f, t, n)                                                                                                                        \
+    static inline void s##_put_##f(uint8_t *p, const t##_t *v)                                                                                               \
+    {                                                                                                                                                         \
+        for (int i = 0; i < (n); i++)                                                                                                                         \
+        {                                                                                                                                                     \
+            t##_put(&p[s##_OFF_##f + i * t##_SIZE], &v[i]);                                                                                                  \
+        }                                                                                                                                                     \
+    }                                                                                                                                                         \
+    static inline void s##_get_##f(const uint8_t *p, t##_t *v)                                                                                               \
+    {                                                                                                                                                         \
+        for (int i = 0; i < (n); i++)                                                                                                                         \
+        {                                                                                                                                                     \
+            t##_get(&p[s##_OFF_##f + i * t##_SIZE], &v[i]);                                                                                                  \
+        }                                                                                                                                                     \
+    }
+
+/* Offsets, accessors and whole-frame codec of schema s, whose decoded type s_t is already declared */
+#define FS_CODEC(s, FIELDS)                                                                                                                                   \
+    enum                                                                                                                                                      \
+    {                                                                                                                                                         \
+        FIELDS(FS_OFFSET_FIELD, FS_OFFSET_ARRAY, s) s##_SIZE                                                                                                  \
+    };                                                                                                                                                        \
+    FIELDS(FS_ACCESSORS_FIELD, FS_ACCESSORS_ARRAY, s)                                                                                                         \
+    static inline void s##_put(uint8_t *p, const s##_t *v)                                                                                                    \
+    {                                                                                                                                                         \
+        FIELDS(FS_PUT_FIELD, FS_PUT_ARRAY, s)                                                                                                                 \
+    }                                                                                                                                                         \
+    static inline void s##_get(const uint8_t *p, s##_t *v)                                                                                                    \
+    {                                                                                                                                                         \
+        FIELDS(FS_GET_FIELD, FS_GET_ARRAY, s)                                                                                                                 \
+    }
+
+/* Declares schema s: its decoded struct s_t and its codec */
+#define FRAME_SCHEMA(s, FIELDS)                                                                                                                               \
+    typedef struct                                                                                                                                            \
+    {                                                                                                                                                         \
+        FIELDS(FS_MEMBER_FIELD, FS_MEMBER_ARRAY, s)                                                                                                           \
+    } s##_t;                                                                                                                                                  \
+    FS_CODEC(s, FIELDS)
+
+/* Declares schema s for an existing struct type, whose members must carry the names of the fields */
+#define FRAME_SCHEMA_FOR(s, FIELDS, type)                                                                                                                     \
+    typedef type s##_t;                                                                                                                                       \
+    FS_CODEC(s, FIELDS)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FRAME_SCHEMA_H_ */
@@ -11,10 +11,34 @@
  */
 #include <deca_device_api.h>
 #include <mac_802_15_4.h>
+#include <port.h>
 #include <string.h>
 
 dwt_mic_size_e dwt_mic_size_from_bytes(uint8_t mic_size_in_bytes);
 
+/* Key and configuration last written to the DW IC AES block, so that unchanged ones are not written again */
+static dwt_aes_key_t aes_loaded_key;
+static dwt_aes_config_t aes_loaded_config;
+static uint8_t aes_key_valid = 0;
+static uint8_t aes_config_valid = 0;
+static mac_aes_stats_t aes_stats;
+
+/* Replay window of a peer: bit n of seen is set when the frame counter highest - n has been accepted */
+typedef struct
+{
+    uint64_t src_addr;
+    uint32_t highest;
+    uint64_t seen;
+    uint8_t used;
+} replay_window_t;
+
+static replay_window_t replay_windows[MAC_REPLAY_PEERS];
+static uint8_t replay_next_victim = 0;
+static mac_replay_stats_t replay_stats;
+
+/* Lowest security level accepted on receive */
+static aux_security_level_e rx_min_level = MAC_RX_MIN_SECURITY_LEVEL_DEFAULT;
+
 /*Set the pan id src + dst and src and dst addresses*/
 void mac_frame_set_pan_ids_and_addresses_802_15_4(
     mac_frame_802_15_4_format_t *mac_frame_ptr, uint16_t dest_pan_id, uint64_t dest_addr /*,uint16_t src_pan_id*/, uint64_t src_addr)
@@ -61,11 +85,11 @@ void mac_frame_update_sequence_number(mac_frame_802_15_4_format_t *mac_frame_ptr
 }
 
 /* Set the security control in the Auxiliary security header */
-/* Security control -  Security level MIC 16(data conf OFF, data Auth Yes), key determine from key index, has frame cnt, frame cnt gen nonce */
-void mac_frame_set_AUX_security_control(mac_frame_802_15_4_format_t *mac_frame_ptr)
+/* Security control -  given security level, key determine from key index, has frame cnt, frame cnt gen nonce */
+void mac_frame_set_aux_security_control(mac_frame_802_15_4_format_t *mac_frame_ptr, aux_security_level_e level)
 {
     MAC_FRAME_AUX_SECURITY_CTRL_802_15_4(mac_frame_ptr)
-        = (AUX_SEC_LEVEL_DATA_CONF_ON_MIC_16 << AUX_SECURITY_LEVEL_SHIFT_VALUE) | (AUX_KEY_IDEN_MODE_KEY_INDEX << AUX_KEY_IDENTIFIER_MODE_SHIFT_VALUE)
+        = (level << AUX_SECURITY_LEVEL_SHIFT_VALUE) | (AUX_KEY_IDEN_MODE_KEY_INDEX << AUX_KEY_IDENTIFIER_MODE_SHIFT_VALUE)
           | (AUX_FRAME_CNT_SUPPRESS_OFF << AUX_FRAME_CNT_SUPPRESSION_SHIFT_VALUE) | (AUX_ASN_IN_NOUNCE_FRAME_CNT_GEN_NONCE << AUX_ASN_IN_NONCE);
 }
 
@@ -153,6 +177,364 @@ uint8_t mac_frame_get_aux_mic_size(mac_frame_802_15_4_format_t *mac_frame_ptr)
     }
 }
 
+/* @fn      mac_frame_set_tx_aes_job
+ * @brief   Points a TX AES job at the MHR and payload of a frame and sets its MIC size, following the security level
+ *          of the MHR. With data confidentiality (levels 5-7) the MHR is the header and the payload is encrypted. Without
+ *          it (levels 1-3) the payload is sent in clear: the MHR and payload are copied one after the other into
+ *          auth_buf and given to the AES engine as the header, so the engine only computes the MIC over them and has
+ *          no payload to encrypt.
+ *
+ * @param   mac_frame_ptr - frame pointer, holding the MHR to send
+ * @param   aes_job       - TX job, its ports, mode and nonce are left as set by the caller
+ * @param   payload       - plain-text payload
+ * @param   payload_len   - payload length
+ * @param   auth_buf      - at least MAC_FRAME_HEADER_SIZE() + payload_len bytes, only used without data confidentiality
+ * @return  the length of the frame on air, MIC and FCS included, for dwt_writetxfctrl()
+ */
+uint16_t mac_frame_set_tx_aes_job(mac_frame_802_15_4_format_t *mac_frame_ptr, dwt_aes_job_t *aes_job, uint8_t *payload, uint16_t payload_len, uint8_t *auth_buf)
+{
+    uint8_t header_len = MAC_FRAME_HEADER_SIZE(mac_frame_ptr);
+
+    aes_job->mic_size = mac_frame_get_aux_mic_size(mac_frame_ptr);
+    if (AUX_SEC_LEVEL_HAS_CONFIDENTIALITY(AUX_SECURITY_LEVEL(MAC_FRAME_AUX_SECURITY_CTRL_802_15_4(mac_frame_ptr))))
+    {
+        aes_job->header = (uint8_t *)MHR_802_15_4_PTR(mac_frame_ptr);
+        aes_job->header_len = header_len;
+        aes_job->payload = payload;
+        aes_job->payload_len = payload_len;
+    }
+    else
+    {
+        memcpy(auth_buf, MHR_802_15_4_PTR(mac_frame_ptr), header_len);
+        memcpy(&auth_buf[header_len], payload, payload_len);
+        aes_job->header = auth_buf;
+        aes_job->header_len = (uint8_t)(header_len + payload_len);
+        aes_job->payload = NULL;
+        aes_job->payload_len = 0;
+    }
+    return header_len + payload_len + aes_job->mic_size + FCS_LEN;
+}
+
+/* @fn      replay_home_slot
+ * @brief   Hashes a 64-bit source address to the first slot of the replay table it may occupy.
+ *
+ * @param   src_addr - source address
+ * @return  slot index
+ */
+static uint8_t replay_home_slot(uint64_t src_addr)
+{
+    uint32_t h = (uint32_t)src_addr ^ (uint32_t)(src_addr >> 32);
+
+    h ^= h >> 16;
+    h *= 0x45D9F3B;
+    h ^= h >> 16;
+    return (uint8_t)(h & (MAC_REPLAY_PEERS - 1));
+}
+
+/* @fn      replay_find
+ * @brief   Looks up the replay window of a source address. Only MAC_REPLAY_PROBES slots are ever examined, so the
+ *          cost does not depend on the number of peers. When create is set and the address has no window, one is
+ *          taken: a free slot if there is one, otherwise one of the probed slots in turn.
+ *
+ * @param   src_addr - source address
+ * @param   create   - whether to allocate a window for an unknown address
+ * @return  the window, or NULL if the address is unknown and create is not set
+ */
+static replay_window_t *replay_find(uint64_t src_addr, int create)
+{
+    uint8_t home = replay_home_slot(src_addr);
+    replay_window_t *free_slot = NULL;
+    replay_window_t *w;
+    uint8_t i;
+
+    for (i = 0; i < MAC_REPLAY_PROBES; i++)
+    {
+        w = &replay_windows[(home + i) & (MAC_REPLAY_PEERS - 1)];
+        if (w->used && (w->src_addr == src_addr))
+        {
+            return w;
+        }
+        if (!w->used && (free_slot == NULL))
+        {
+            free_slot = w;
+        }
+    }
+
+    if (!create)
+    {
+        return NULL;
+    }
+
+    if (free_slot == NULL)
+    {
+        free_slot = &replay_windows[(home + replay_next_victim) & (MAC_REPLAY_PEERS - 1)];
+        replay_next_victim = (replay_next_victim + 1) % MAC_REPLAY_PROBES;
+        replay_stats.evictions++;
+    }
+    free_slot->src_addr = src_addr;
+    free_slot->used = 0;
+    return free_slot;
+}
+
+/* @fn      replay_check
+ * @brief   Checks a frame counter against the replay window of the sender without changing the window.
+ *          Counters are compared with serial number arithmetic, so the window follows the counter across a wrap.
+ *
+ * @param   w         - window of the sender, NULL for a sender not heard from yet
+ * @param   frame_cnt - frame counter of the received frame
+ * @return  AES_RES_OK if the frame may be accepted, AES_RES_ERROR_REPLAY otherwise
+ */
+static aes_results_e replay_check(const replay_window_t *w, uint32_t frame_cnt)
+{
+    uint32_t behind;
+
+    if ((w == NULL) || ((int32_t)(frame_cnt - w->highest) > 0))
+    {
+        return AES_RES_OK;
+    }
+
+    behind = w->highest - frame_cnt;
+    if (behind >= MAC_REPLAY_WINDOW)
+    {
+        replay_stats.too_old++;
+        return AES_RES_ERROR_REPLAY;
+    }
+    if (w->seen & ((uint64_t)1 << behind))
+    {
+        replay_stats.replays++;
+        return AES_RES_ERROR_REPLAY;
+    }
+    return AES_RES_OK;
+}
+
+/* @fn      replay_accept
+ * @brief   Records a frame counter in the replay window of the sender, once the frame has passed replay_check()
+ *          and its MIC has been verified, so that forged frames cannot move the window.
+ *
+ * @param   src_addr  - source address of the frame
+ * @param   frame_cnt - frame counter of the frame
+ * @return  None
+ */
+static void replay_accept(uint64_t src_addr, uint32_t frame_cnt)
+{
+    replay_window_t *w = replay_find(src_addr, 1);
+    int32_t ahead = (int32_t)(frame_cnt - w->highest);
+
+    if (!w->used)
+    {
+        w->highest = frame_cnt;
+        w->seen = 1;
+        w->used = 1;
+    }
+    else if (ahead > 0)
+    {
+        w->seen = (ahead < MAC_REPLAY_WINDOW) ? ((w->seen << ahead) | 1) : 1;
+        w->highest = frame_cnt;
+    }
+    else
+    {
+        w->seen |= (uint64_t)1 << (uint32_t)(-ahead);
+    }
+    replay_stats.accepted++;
+}
+
+/* @fn      mac_replay_reset
+ * @brief   Forgets the frame counters received from all peers, e.g. after the keys have been replaced.
+ *
+ * @return  None
+ */
+void mac_replay_reset(void)
+{
+    memset(replay_windows, 0, sizeof(replay_windows));
+    replay_next_victim = 0;
+}
+
+/* @fn      mac_replay_get_stats
+ * @brief   Returns the number of frames accepted and rejected by the replay check.
+ *
+ * @return  pointer to the statistics
+ */
+const mac_replay_stats_t *mac_replay_get_stats(void)
+{
+    return &replay_stats;
+}
+
+/* @fn      ccm_star_decrypt
+ * @brief   Decrypts a payload in place and checks its MIC with AES-128 CCM* the way the DW IC AES engine does: 2-byte
+ *          length field, the MHR authenticated, the payload encrypted and authenticated, the encrypted MIC following the
+ *          payload. The blocks are encrypted by the host (port_aes_ecb_encrypt()) with the key set beforehand. The
+ *          payload is decrypted block by block and fed to the CBC-MAC as it goes, so nothing is buffered.
+ *          For a security level without data confidentiality the caller passes the MHR and the clear payload as the
+ *          header and an empty payload, only the MIC is then checked.
+ *
+ * @param   nonce       - 13-byte nonce
+ * @param   header      - MHR
+ * @param   header_len  - MHR length
+ * @param   payload     - encrypted payload followed by the MIC, decrypted in place
+ * @param   payload_len - payload length, without the MIC
+ * @param   mic_size    - MIC length in bytes
+ * @return  AES_RES_OK, or AES_RES_ERROR when the MIC does not match
+ */
+static aes_results_e ccm_star_decrypt(const uint8_t *nonce, const uint8_t *header, uint8_t header_len, uint8_t *payload, uint16_t payload_len, uint8_t mic_size)
+{
+    uint8_t x[16], ctr[16], ks[16];
+    uint8_t diff = 0;
+    uint16_t i, n, blk;
+
+    /* Without a MIC there is nothing to compare, and nothing would be authenticated */
+    if (mic_size == 0)
+    {
+        return AES_RES_ERROR;
+    }
+
+    /* B0 */
+    x[0] = (uint8_t)((header_len ? 0x40 : 0) | (mic_size ? (((mic_size - 2) / 2) << 3) : 0) | 1);
+    memcpy(&x[1], nonce, 13);
+    x[14] = (uint8_t)(payload_len >> 8);
+    x[15] = (uint8_t)payload_len;
+    port_aes_ecb_encrypt(x, x);
+
+    /* MHR, prefixed with its length and zero-padded to a whole block */
+    if (header_len)
+    {
+        x[1] ^= header_len;
+        n = 2;
+        for (i = 0; i < header_len; i++)
+        {
+            x[n++] ^= header[i];
+            if (n == 16)
+            {
+                port_aes_ecb_encrypt(x, x);
+                n = 0;
+            }
+        }
+        if (n)
+        {
+            port_aes_ecb_encrypt(x, x);
+        }
+    }
+
+    /* Payload: decrypt with A1, A2... and authenticate the plain text */
+    ctr[0] = 1; /* L - 1 */
+    memcpy(&ctr[1], nonce, 13);
+    for (i = 0, blk = 1; i < payload_len; i += 16, blk++)
+    {
+        uint16_t j, len = ((payload_len - i) < 16) ? (payload_len - i) : 16;
+
+        ctr[14] = (uint8_t)(blk >> 8);
+        ctr[15] = (uint8_t)blk;
+        port_aes_ecb_encrypt(ctr, ks);
+        for (j = 0; j < len; j++)
+        {
+            payload[i + j] ^= ks[j];
+            x[j] ^= payload[i + j];
+        }
+        port_aes_ecb_encrypt(x, x);
+    }
+
+    /* The MIC is the CBC-MAC encrypted with A0, compared without an early exit */
+    ctr[14] = 0;
+    ctr[15] = 0;
+    port_aes_ecb_encrypt(ctr, ks);
+    for (i = 0; i < mic_size; i++)
+    {
+        diff |= payload[payload_len + i] ^ x[i] ^ ks[i];
+    }
+
+    return diff ? AES_RES_ERROR : AES_RES_OK;
+}
+
+/* @fn      mac_set_rx_min_security_level
+ * @brief   Sets the lowest security level rx_aes_802_15_4() and rx_aes_802_15_4_in_place() accept. A frame is accepted
+ *          when its MIC is at least as long as the level's, and its payload encrypted if the level's is. The level of a
+ *          received frame is chosen by its sender, so the receiver must not simply take it.
+ *
+ * @param   level - lowest level, one with a MIC
+ * @return  None
+ */
+void mac_set_rx_min_security_level(aux_security_level_e level)
+{
+    rx_min_level = level;
+}
+
+/* @fn      rx_level_allowed
+ * @brief   Checks a received security level against the minimum. Levels 0 and 4 carry no MIC and are never allowed.
+ *
+ * @param   level - security level of the frame
+ * @return  1 if the frame may be accepted at this level
+ */
+static int rx_level_allowed(aux_security_level_e level)
+{
+    uint8_t mic = (uint8_t)(2u << (level & 0x3));
+    uint8_t min_mic = (uint8_t)(2u << (rx_min_level & 0x3));
+
+    if ((level & 0x3) == 0)
+    {
+        return 0;
+    }
+    if (AUX_SEC_LEVEL_HAS_CONFIDENTIALITY(rx_min_level) && !AUX_SEC_LEVEL_HAS_CONFIDENTIALITY(level))
+    {
+        return 0;
+    }
+    return mic >= min_mic;
+}
+
+/* @fn      check_secured_header
+ * @brief   Checks the MHR of a received frame before it is decrypted: security enabled, expected addresses, a
+ *          security level with a MIC and at least the minimum, valid key index, payload length, and that the frame is
+ *          not a replay.
+ *
+ * @param   mac_frame_ptr - frame pointer, holding the received MHR
+ * @param   frame_length  - length of data that was received in bytes
+ * @param   header_len    - MHR length
+ * @param   max_payload   - max allow size
+ * @param   exp_src_addr  - expected src addr
+ * @param   exp_dst_addr  - expected dest addr
+ * @param   mic_size      - receives the MIC length
+ * @param   payload_len   - receives the payload length
+ * @param   src_addr      - receives the source address
+ * @param   frame_cnt     - receives the frame counter
+ * @return  AES_RES_OK, or the aes_results_e to return for the frame
+ */
+static aes_results_e check_secured_header(mac_frame_802_15_4_format_t *mac_frame_ptr, uint16_t frame_length, uint8_t header_len, uint16_t max_payload,
+    uint64_t exp_src_addr, uint64_t exp_dst_addr, uint8_t *mic_size, int16_t *payload_len, uint64_t *src_addr, uint32_t *frame_cnt)
+{
+    uint64_t dst_addr;
+    uint8_t key_index;
+
+    get_src_and_dst_frame_addr(mac_frame_ptr, src_addr, &dst_addr);
+    // Check if we got a secure frame with the right destination and source addresses
+    if ((get_security_state(mac_frame_ptr) != SECURITY_STATE_SECURE) || (exp_src_addr != *src_addr) || (exp_dst_addr != dst_addr))
+    {
+        return AES_RES_ERROR_IGNORE_FRAME; // This is not for us
+    }
+
+    /* next get the MIC size */
+    *mic_size = mac_frame_get_aux_mic_size(mac_frame_ptr);
+    key_index = MAC_FRAME_AUX_KEY_IDENTIFY_802_15_4(mac_frame_ptr);
+    if ((*mic_size == MIC_ERROR) || (key_index == 0) || (key_index > NUM_OF_KEY_OPTIONS))
+    {
+        return AES_RES_ERROR_FRAME;
+    }
+
+    /* A frame that only claims security (level 0) or a weaker level than required must not reach the replay window */
+    if (!rx_level_allowed(AUX_SECURITY_LEVEL(MAC_FRAME_AUX_SECURITY_CTRL_802_15_4(mac_frame_ptr))))
+    {
+        return AES_RES_ERROR_FRAME;
+    }
+
+    *payload_len = frame_length - (header_len + *mic_size + FCS_LEN); /* to get unencrypted payload length subtract MIC, FCS and MHR lengths */
+    /* Check if payload_len is valid */
+    if ((*payload_len < 0) || (*payload_len > max_payload))
+    {
+        return AES_RES_ERROR_FRAME;
+    }
+
+    /* Reject a replayed frame before spending the AES engine on it */
+    *frame_cnt = mac_frame_get_aux_frame_cnt(mac_frame_ptr);
+    return replay_check(replay_find(*src_addr, 0), *frame_cnt);
+}
+
 /* @fn      rx_aes_802_15_4
  * @brief   Decrypts received frame, the frame type needs to match the structure defined in mac_802_15_4.h - mac_frame_802_15_4_format_t.
  *          Note, the register key AES128 should be set before 1st call to this function.
@@ -164,6 +546,11 @@ uint8_t mac_frame_get_aux_mic_size(mac_frame_802_15_4_format_t *mac_frame_ptr)
  *          exp_src_addr  - expected src addr,
  *          exp_dst_addr  - expected dest addr
  *
+ *          A frame whose counter was already received from the same source, or is more than MAC_REPLAY_WINDOW behind
+ *          the highest one received, is rejected with AES_RES_ERROR_REPLAY before it is decrypted.
+ *          A frame whose security level has no data confidentiality only has its MIC checked by the AES engine, then
+ *          its clear payload is read into aes_job->payload.
+ *
  * @return aes_results_e
  * */
 aes_results_e rx_aes_802_15_4(mac_frame_802_15_4_format_t *mac_frame_ptr, uint16_t frame_length, dwt_aes_job_t *aes_job, uint16_t max_payload,
@@ -171,9 +558,11 @@ aes_results_e rx_aes_802_15_4(mac_frame_802_15_4_format_t *mac_frame_ptr, uint16
 {
     uint8_t nonce[13];
     int8_t status;
+    aes_results_e result;
     int16_t payload_len;
-    uint64_t src_addr, dst_addr;
-    security_state_e security_state;
+    uint64_t src_addr;
+    uint32_t frame_cnt;
+    uint8_t header_len, auth_only;
 
     /* the length of frame needs to be at least == header */
     if ((frame_length - FCS_LEN) >= aes_job->header_len)
@@ -183,45 +572,35 @@ aes_results_e rx_aes_802_15_4(mac_frame_802_15_4_format_t *mac_frame_ptr, uint16
 
         /* Place a breakpoint here to see an unencrypted header */
 
-        get_src_and_dst_frame_addr(mac_frame_ptr, &src_addr, &dst_addr);
-        security_state = get_security_state(mac_frame_ptr);
-        // Check if we got a secure frame with the right destination and source addresses
-        if ((security_state != SECURITY_STATE_SECURE) || (exp_src_addr != src_addr) || (exp_dst_addr != dst_addr))
+        result = check_secured_header(
+            mac_frame_ptr, frame_length, aes_job->header_len, max_payload, exp_src_addr, exp_dst_addr, &aes_job->mic_size, &payload_len, &src_addr, &frame_cnt);
+        if (result != AES_RES_OK)
         {
-            return AES_RES_ERROR_IGNORE_FRAME; // This is not for us
-        }
-
-        /* next get the MIC size */
-        aes_job->mic_size = mac_frame_get_aux_mic_size(mac_frame_ptr);
-        if (aes_job->mic_size == MIC_ERROR)
-        {
-            return AES_RES_ERROR_FRAME;
-        }
-
-        payload_len
-            = frame_length - (aes_job->header_len + aes_job->mic_size + FCS_LEN); /* to get unencrypted payload length subtract MIC, FCS and MHR lengths */
-        /* Check if payload_len is valid */
-        if ((payload_len < 0) || (payload_len > max_payload))
-        {
-            return AES_RES_ERROR_FRAME;
+            return result;
         }
 
         /* next get the nonce (SS-TWR AES example uses 13-byte nonce*/
         mac_frame_get_nonce(mac_frame_ptr, nonce);
 
-        /* Fill AES job to decrypt the received packet */
+        /* Fill AES job to decrypt the received packet. Without data confidentiality the payload is authenticated
+         * as part of the header, in the RX buffer, and there is nothing to decrypt. */
+        auth_only = !AUX_SEC_LEVEL_HAS_CONFIDENTIALITY(AUX_SECURITY_LEVEL(MAC_FRAME_AUX_SECURITY_CTRL_802_15_4(mac_frame_ptr)));
+        header_len = aes_job->header_len;
         aes_job->nonce = nonce;
-        aes_job->payload_len = payload_len;
+        aes_job->header_len = auth_only ? (uint8_t)(header_len + payload_len) : header_len;
+        aes_job->payload_len = auth_only ? 0 : payload_len;
         aes_job->header = NULL; /* not used for decryption*/
         aes_config->mic = dwt_mic_size_from_bytes(aes_job->mic_size);
         // aes_config->aes_core_type=AES_core_type_CCM;
-        dwt_configure_aes(aes_config);
+        mac_aes_configure(aes_config);
 
-        /* program the correct 128-bit key into DW3000 AES block*/
-        dwt_set_keyreg_128(&aes_key_ptr[MAC_FRAME_AUX_KEY_IDENTIFY_802_15_4(mac_frame_ptr) - 1]);
+        /* program the correct 128-bit key into DW3000 AES block, unless it is already loaded */
+        mac_aes_load_key(&aes_key_ptr[MAC_FRAME_AUX_KEY_IDENTIFY_802_15_4(mac_frame_ptr) - 1]);
 
         /* perform the decryption job, the unencrypted payload will be stored in aes_job->payload */
         status = dwt_do_aes(aes_job, aes_config->aes_core_type);
+        aes_job->header_len = header_len;
+        aes_job->payload_len = payload_len;
 
         /* "status" represents a last read of AES_STS_ID register.
          * See DW3000 User Manual for details.
@@ -238,6 +617,12 @@ aes_results_e rx_aes_802_15_4(mac_frame_802_15_4_format_t *mac_frame_ptr, uint16
             }
             else
             {
+                if (auth_only)
+                {
+                    /* The MIC is good, the clear payload is read as it is */
+                    dwt_readrxdata(aes_job->payload, payload_len, header_len);
+                }
+                replay_accept(src_addr, frame_cnt);
                 return AES_RES_OK;
             }
         }
@@ -248,6 +633,85 @@ aes_results_e rx_aes_802_15_4(mac_frame_802_15_4_format_t *mac_frame_ptr, uint16
     }
 }
 
+/* @fn      rx_aes_802_15_4_in_place
+ * @brief   Receives a secured frame with a single SPI read and decrypts it in the caller's buffer.
+ *          The MHR, payload and MIC are read in one burst, the checks of rx_aes_802_15_4() run on that copy, then the
+ *          payload is decrypted and its MIC verified by the host (ccm_star_decrypt()) instead of the DW IC AES engine,
+ *          which would need the nonce, DMA set-up, start, status polling and a second read of the payload over SPI.
+ *          On AES_RES_OK the MHR is in mac_frame_ptr and its payload pointer points to the plain text in frame_buf.
+ *          Without data confidentiality the payload is not decrypted, only the MIC is computed over the MHR and payload.
+ *
+ * @param   mac_frame_ptr - frame pointer, receives the MHR
+ * @param   frame_buf     - buffer receiving the frame without its FCS
+ * @param   frame_length  - length of data that was received in bytes
+ * @param   buf_size      - size of frame_buf
+ * @param   aes_key_ptr   - pointer for keys
+ * @param   exp_src_addr  - expected src addr
+ * @param   exp_dst_addr  - expected dest addr
+ * @param   payload_len   - receives the length of the decrypted payload
+ *
+ * @return aes_results_e
+ * */
+aes_results_e rx_aes_802_15_4_in_place(mac_frame_802_15_4_format_t *mac_frame_ptr, uint8_t *frame_buf, uint16_t frame_length, uint16_t buf_size,
+    dwt_aes_key_t *aes_key_ptr, uint64_t exp_src_addr, uint64_t exp_dst_addr, uint16_t *payload_len)
+{
+    uint8_t header_len = MAC_FRAME_HEADER_SIZE(mac_frame_ptr);
+    uint8_t nonce[13], key[16], mic_size, i;
+    uint32_t words[4];
+    const dwt_aes_key_t *k;
+    aes_results_e result;
+    int16_t len;
+    uint64_t src_addr;
+    uint32_t frame_cnt;
+
+    if ((frame_length < header_len + FCS_LEN) || ((frame_length - FCS_LEN) > buf_size))
+    {
+        return AES_RES_ERROR_FRAME;
+    }
+
+    /* The whole frame in one burst, the MHR is then taken from the buffer */
+    dwt_readrxdata(frame_buf, frame_length - FCS_LEN, 0);
+    memcpy(MHR_802_15_4_PTR(mac_frame_ptr), frame_buf, header_len);
+
+    result = check_secured_header(mac_frame_ptr, frame_length, header_len, buf_size, exp_src_addr, exp_dst_addr, &mic_size, &len, &src_addr, &frame_cnt);
+    if (result != AES_RES_OK)
+    {
+        return result;
+    }
+
+    /* The key register holds the key as one 128-bit number, key3 being its most significant word */
+    k = &aes_key_ptr[MAC_FRAME_AUX_KEY_IDENTIFY_802_15_4(mac_frame_ptr) - 1];
+    words[0] = k->key3;
+    words[1] = k->key2;
+    words[2] = k->key1;
+    words[3] = k->key0;
+    for (i = 0; i < sizeof(key); i++)
+    {
+        key[i] = (uint8_t)(words[i / 4] >> (24 - 8 * (i % 4)));
+    }
+    port_aes_ecb_set_key(key);
+
+    mac_frame_get_nonce(mac_frame_ptr, nonce);
+    if (AUX_SEC_LEVEL_HAS_CONFIDENTIALITY(AUX_SECURITY_LEVEL(MAC_FRAME_AUX_SECURITY_CTRL_802_15_4(mac_frame_ptr))))
+    {
+        result = ccm_star_decrypt(nonce, frame_buf, header_len, &frame_buf[header_len], (uint16_t)len, mic_size);
+    }
+    else
+    {
+        /* Authentication only: the payload is already plain text, its MIC follows it */
+        result = ccm_star_decrypt(nonce, frame_buf, (uint8_t)(header_len + len), &frame_buf[header_len + len], 0, mic_size);
+    }
+    if (result != AES_RES_OK)
+    {
+        return result;
+    }
+
+    replay_accept(src_addr, frame_cnt);
+    PAYLOAD_PTR_802_15_4(mac_frame_ptr) = &frame_buf[header_len];
+    *payload_len = (uint16_t)len;
+    return AES_RES_OK;
+}
+
 /* @fn      get_security_state
  * @brief   This function checks if the security bit is set in the frame header corresponding security_state_e value.
  *
@@ -288,3 +752,90 @@ void get_src_and_dst_frame_addr(mac_frame_802_15_4_format_t *mac_frame_ptr, uint
         *dst |= (uint64_t)(dst_ptr[cnt1]) << (8 * cnt1);
     }
 }
+
+/* @fn      mac_aes_invalidate
+ * @brief   Forgets the key and configuration cached by mac_aes_load_key() and mac_aes_configure().
+ *          Must be called after every DW IC reset/initialisation, or after writing the AES block directly.
+ *
+ * @return  None
+ */
+void mac_aes_invalidate(void)
+{
+    aes_key_valid = 0;
+    aes_config_valid = 0;
+}
+
+/* @fn      mac_aes_load_key
+ * @brief   Programs a 128-bit key into the DW IC AES key register, unless the same key is already loaded.
+ *
+ * @param   key - key to load
+ * @return  None
+ */
+void mac_aes_load_key(const dwt_aes_key_t *key)
+{
+    if (aes_key_valid && (key->key0 == aes_loaded_key.key0) && (key->key1 == aes_loaded_key.key1) && (key->key2 == aes_loaded_key.key2)
+        && (key->key3 == aes_loaded_key.key3))
+    {
+        aes_stats.key_skips++;
+        return;
+    }
+
+    dwt_set_keyreg_128(key);
+    aes_loaded_key = *key;
+    aes_key_valid = 1;
+    aes_stats.key_loads++;
+}
+
+/* @fn      mac_aes_configure
+ * @brief   Writes the AES configuration to the DW IC, unless the same configuration is already active.
+ *          With the CCM* core and AES_KEY_Load the write is what loads the key into the engine, and it must be done
+ *          before every operation (see NOTE 15 of ss_aes_twr_initiator.c), so it is never skipped in that case.
+ *
+ * @param   aes_config - AES configuration
+ * @return  None
+ */
+void mac_aes_configure(const dwt_aes_config_t *aes_config)
+{
+    /* Compare field by field, the structure has padding */
+    if (aes_config_valid && !((aes_config->aes_core_type == AES_core_type_CCM) && (aes_config->key_load == AES_KEY_Load))
+        && (aes_config->aes_otp_sel_key_block == aes_loaded_config.aes_otp_sel_key_block)
+        && (aes_config->aes_key_otp_type == aes_loaded_config.aes_key_otp_type) && (aes_config->aes_core_type == aes_loaded_config.aes_core_type)
+        && (aes_config->mic == aes_loaded_config.mic) && (aes_config->key_src == aes_loaded_config.key_src)
+        && (aes_config->key_load == aes_loaded_config.key_load) && (aes_config->key_addr == aes_loaded_config.key_addr)
+        && (aes_config->key_size == aes_loaded_config.key_size) && (aes_config->mode == aes_loaded_config.mode))
+    {
+        aes_stats.config_skips++;
+        return;
+    }
+
+    dwt_configure_aes(aes_config);
+    aes_loaded_config = *aes_config;
+    aes_config_valid = 1;
+    aes_stats.config_loads++;
+
+    /* A key loaded from RAM/OTP replaces the contents of the key register */
+    if (aes_config->key_src != AES_KEY_Src_Register)
+    {
+        aes_key_valid = 0;
+    }
+}
+
+/* @fn      mac_aes_get_stats
+ * @brief   Returns the number of AES key and configuration writes done and skipped.
+ *
+ * @return  pointer to the statistics
+ */
+const mac_aes_stats_t *mac_aes_get_stats(void)
+{
+    return &aes_stats;
+}
+
+/* @fn      mac_aes_spi_bytes_saved
+ * @brief   Estimates the SPI bytes saved by the skipped AES key and configuration writes.
+ *
+ * @return  bytes saved since boot
+ */
+uint32_t mac_aes_spi_bytes_saved(void)
+{
+    return aes_stats.key_skips * MAC_AES_KEY_SPI_BYTES + aes_stats.config_skips * MAC_AES_CFG_SPI_BYTES;
+}
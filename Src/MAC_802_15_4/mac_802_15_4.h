@@ -106,6 +106,15 @@ extern "C"
 #define AUX_FRAME_CNT_SUPPRESSION_SHIFT_VALUE 5
 #define AUX_ASN_IN_NONCE                      6
 
+/* Security level of an aux security control byte, and whether the level encrypts the payload (levels 5-7) or only
+ * authenticates it (levels 1-3, the payload is sent in clear and covered by the MIC) */
+#define AUX_SECURITY_LEVEL(security_ctrl)         ((aux_security_level_e)((security_ctrl) & 0x7))
+#define AUX_SEC_LEVEL_HAS_CONFIDENTIALITY(level) (((level) & 0x4) != 0)
+
+/* Lowest security level rx_aes_802_15_4() accepts until mac_set_rx_min_security_level() is called. Levels without a MIC
+ * (0 and the reserved 4) are never accepted. */
+#define MAC_RX_MIN_SECURITY_LEVEL_DEFAULT AUX_SEC_LEVEL_DATA_CONF_ON_MIC_16
+
 #define AUX_FRAME_CNT_SIZE 4
 
     /* This is the frame type - bits 0-2 that reside in the first byte of frame control */
@@ -244,13 +253,56 @@ extern "C"
     uint8_t mac_frame_get_aux_key_identifier(mac_frame_802_15_4_format_t *mac_frame_ptr);
     uint32_t mac_frame_get_aux_frame_cnt(mac_frame_802_15_4_format_t *mac_frame_ptr);
     void mac_frame_get_nonce(mac_frame_802_15_4_format_t *mac_frame_ptr, uint8_t *aes_iv);
-    void mac_frame_set_aux_security_control(mac_frame_802_15_4_format_t *mac_frame_ptr);
+    void mac_frame_set_aux_security_control(mac_frame_802_15_4_format_t *mac_frame_ptr, aux_security_level_e level);
     uint8_t mac_frame_get_aux_mic_size(mac_frame_802_15_4_format_t *mac_frame_ptr);
+    uint16_t mac_frame_set_tx_aes_job(mac_frame_802_15_4_format_t *mac_frame_ptr, dwt_aes_job_t *aes_job, uint8_t *payload, uint16_t payload_len, uint8_t *auth_buf);
     aes_results_e rx_aes_802_15_4(mac_frame_802_15_4_format_t *mac_frame_ptr, uint16_t frame_length, dwt_aes_job_t *aes_job, uint16_t max_payload,
         dwt_aes_key_t *aes_key_ptr, uint64_t exp_src_addr, uint64_t exp_dst_addr, dwt_aes_config_t *aes_config);
+    aes_results_e rx_aes_802_15_4_in_place(mac_frame_802_15_4_format_t *mac_frame_ptr, uint8_t *frame_buf, uint16_t frame_length, uint16_t buf_size,
+        dwt_aes_key_t *aes_key_ptr, uint64_t exp_src_addr, uint64_t exp_dst_addr, uint16_t *payload_len);
+    void mac_set_rx_min_security_level(aux_security_level_e level);
     security_state_e get_security_state(mac_frame_802_15_4_format_t *mac_frame_ptr);
     void get_src_and_dst_frame_addr(mac_frame_802_15_4_format_t *mac_frame_ptr, uint64_t *src, uint64_t *dst);
 
+/* Estimated SPI bytes of the AES block writes skipped by the cache below: the 128-bit key is four 32-bit register writes,
+ * the AES configuration one 16-bit register write, each with a 2-byte SPI header */
+#define MAC_AES_KEY_SPI_BYTES (4 * (2 + 4))
+#define MAC_AES_CFG_SPI_BYTES (2 + 2)
+
+    /* Number of AES block writes done and skipped by mac_aes_load_key() and mac_aes_configure() */
+    typedef struct
+    {
+        uint32_t key_loads;
+        uint32_t key_skips;
+        uint32_t config_loads;
+        uint32_t config_skips;
+    } mac_aes_stats_t;
+
+    void mac_aes_invalidate(void);
+    void mac_aes_load_key(const dwt_aes_key_t *key);
+    void mac_aes_configure(const dwt_aes_config_t *aes_config);
+    const mac_aes_stats_t *mac_aes_get_stats(void);
+    uint32_t mac_aes_spi_bytes_saved(void);
+
+/* Replay protection done by rx_aes_802_15_4(): number of source addresses tracked (a power of two), how many slots
+ * from its home slot an address may be placed in, and how far behind the highest frame counter received from a peer a
+ * frame may arrive and still be accepted once */
+#define MAC_REPLAY_PEERS  16
+#define MAC_REPLAY_PROBES 4
+#define MAC_REPLAY_WINDOW 64
+
+    /* Frames accepted and rejected by the replay check, and peers whose window was dropped to make room for another */
+    typedef struct
+    {
+        uint32_t accepted;
+        uint32_t replays;
+        uint32_t too_old;
+        uint32_t evictions;
+    } mac_replay_stats_t;
+
+    void mac_replay_reset(void);
+    const mac_replay_stats_t *mac_replay_get_stats(void);
+
 #ifdef __cplusplus
 }
 #endif
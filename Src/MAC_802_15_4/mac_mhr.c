@@ -0,0 +1,237 @@
+/*! ----------------------------------------------------------------------------
+ * @file    mac_mhr.c
+ * @brief   Zero-copy parser and builder for IEEE 802.15.4 MAC headers of any layout
+ *
+ *          See mac_mhr.h for an overview.
+ */
+
+#include <mac_mhr.h>
+
+/* Frame control bits of a mac_mhr_layouts[] index, see MAC_MHR_LAYOUT_INDEX() */
+#define L_SS(i)  ((i) & 1)
+#define L_PC(i)  (((i) >> 1) & 1)
+#define L_DM(i)  (((i) >> 2) & 3)
+#define L_VER(i) (((i) >> 4) & 3)
+#define L_SM(i)  (((i) >> 6) & 3)
+
+#define L_ADDR_LEN(mode) (((mode) == MAC_MHR_ADDR_EXT) ? 8 : ((mode) == MAC_MHR_ADDR_SHORT) ? 2 : 0)
+
+/* The sequence number can only be suppressed in 2015 frames */
+#define L_SEQ_LEN(i) ((L_VER(i) == MAC_MHR_VERSION_2015 && L_SS(i)) ? 0 : 1)
+
+/* Presence of the PAN IDs. 2003/2006 frames (7.2.1.1.5 of 802.15.4-2006): a PAN ID for each address, the source one
+ * omitted when compressed. 2015 frames follow table 7-2 of 802.15.4-2015. */
+#define L_BOTH_EXT(i) (L_DM(i) == MAC_MHR_ADDR_EXT && L_SM(i) == MAC_MHR_ADDR_EXT)
+#define L_DEST_PAN(i)                                                                                                                                         \
+    ((L_VER(i) == MAC_MHR_VERSION_2015)                                                                                                                      \
+            ? ((L_DM(i) == 0) ? ((L_SM(i) == 0) ? L_PC(i) : 0) : ((L_SM(i) == 0 || L_BOTH_EXT(i)) ? !L_PC(i) : 1))                                          \
+            : (L_DM(i) != 0))
+#define L_SRC_PAN(i)                                                                                                                                          \
+    ((L_VER(i) == MAC_MHR_VERSION_2015) ? ((L_SM(i) == 0 || L_BOTH_EXT(i)) ? 0 : !L_PC(i)) : (L_SM(i) != 0 && !L_PC(i)))
+
+/* Address mode 1 and frame version 3 are reserved; before 2015, PAN ID compression needs both addresses */
+#define L_VALID(i)                                                                                                                                            \
+    (L_DM(i) != 1 && L_SM(i) != 1 && L_VER(i) != 3 && (L_VER(i) == MAC_MHR_VERSION_2015 || !L_PC(i) || (L_DM(i) != 0 && L_SM(i) != 0)))
+
+/* Offsets of the fields, each following the previous one when present */
+#define L_O_DEST_PAN(i)  (2 + L_SEQ_LEN(i))
+#define L_O_DEST_ADDR(i) (L_O_DEST_PAN(i) + 2 * L_DEST_PAN(i))
+#define L_O_SRC_PAN(i)   (L_O_DEST_ADDR(i) + L_ADDR_LEN(L_DM(i)))
+#define L_O_SRC_ADDR(i)  (L_O_SRC_PAN(i) + 2 * L_SRC_PAN(i))
+#define L_O_AUX(i)       (L_O_SRC_ADDR(i) + L_ADDR_LEN(L_SM(i)))
+
+#define L_FIELD(present, offset) ((present) ? (offset) : MAC_MHR_ABSENT)
+
+#define L(i)                                                                                                                                                  \
+    {                                                                                                                                                         \
+        L_FIELD(L_SEQ_LEN(i), 2), L_FIELD(L_DEST_PAN(i), L_O_DEST_PAN(i)), L_FIELD(L_DM(i), L_O_DEST_ADDR(i)), L_FIELD(L_SRC_PAN(i), L_O_SRC_PAN(i)),       \
+            L_FIELD(L_SM(i), L_O_SRC_ADDR(i)), L_O_AUX(i), L_ADDR_LEN(L_DM(i)), L_ADDR_LEN(L_SM(i)), L_VALID(i)                                              \
+    }
+#define L4(i)  L(i), L((i) + 1), L((i) + 2), L((i) + 3)
+#define L16(i) L4(i), L4((i) + 4), L4((i) + 8), L4((i) + 12)
+#define L64(i) L16(i), L16((i) + 16), L16((i) + 32), L16((i) + 48)
+
+const mac_mhr_layout_t mac_mhr_layouts[256] = { L64(0), L64(64), L64(128), L64(192) };
+
+/* Length of the key identifier field for each key identifier mode */
+static const uint8_t key_id_len[4] = { 0, 1, 5, 9 };
+
+/* Header IE element IDs that end the header IEs */
+#define IE_ID_HT1 0x7E
+#define IE_ID_HT2 0x7F
+
+/* @fn      mac_mhr_read_addr
+ * @brief   Reads a little-endian address or PAN ID of len bytes from a frame.
+ *
+ * @return  the value, 0 when len is 0
+ */
+uint64_t mac_mhr_read_addr(const uint8_t *p, uint8_t len)
+{
+    uint64_t v = 0;
+
+    while (len--)
+    {
+        v = (v << 8) | p[len];
+    }
+    return v;
+}
+
+/* Writes the len low bytes of v, least significant first */
+static void write_le(uint8_t *p, uint64_t v, uint8_t len)
+{
+    while (len--)
+    {
+        *p++ = (uint8_t)v;
+        v >>= 8;
+    }
+}
+
+/* @fn      mac_mhr_parse
+ * @brief   Parses the MHR at the start of a frame without copying it. The fixed part comes from mac_mhr_layouts[];
+ *          only the auxiliary security header and the header IEs, whose lengths are in the frame, are walked.
+ *
+ * @param   mhr       - receives the parsed header
+ * @param   frame     - received frame
+ * @param   frame_len - length of the frame, without the FCS
+ * @return  the MHR length (where the payload starts), or 0 if the header is malformed or does not fit in frame_len
+ */
+uint16_t mac_mhr_parse(mac_mhr_t *mhr, const uint8_t *frame, uint16_t frame_len)
+{
+    const mac_mhr_layout_t *layout;
+    uint16_t fc, pos;
+
+    if (frame_len < 2)
+    {
+        return 0;
+    }
+    fc = (uint16_t)(frame[0] | (frame[1] << 8));
+    layout = &mac_mhr_layouts[MAC_MHR_LAYOUT_INDEX(fc)];
+    if (!layout->valid || layout->aux > frame_len)
+    {
+        return 0;
+    }
+
+    pos = layout->aux;
+    mhr->aux_len = 0;
+    if (fc & MAC_MHR_FC_SECURITY)
+    {
+        uint8_t sc;
+
+        /* The 2003 auxiliary security header has another format */
+        if (((fc >> MAC_MHR_FC_VERSION_SHIFT) & 3) == MAC_MHR_VERSION_2003 || pos >= frame_len)
+        {
+            return 0;
+        }
+        sc = frame[pos];
+        mhr->aux_len = (uint8_t)(1 + ((sc & 0x20) ? 0 : 4) + key_id_len[(sc >> 3) & 3]);
+        pos += mhr->aux_len;
+    }
+
+    /* Header IEs run until a termination IE, or until the end of the frame when there is no payload */
+    mhr->ie_len = 0;
+    if ((fc & MAC_MHR_FC_IE_PRESENT) && ((fc >> MAC_MHR_FC_VERSION_SHIFT) & 3) == MAC_MHR_VERSION_2015)
+    {
+        uint16_t start = pos;
+
+        while (pos + 2 <= frame_len)
+        {
+            uint16_t desc = (uint16_t)(frame[pos] | (frame[pos + 1] << 8));
+            uint8_t id = (uint8_t)((desc >> 7) & 0xFF);
+
+            pos += 2 + (desc & 0x7F);
+            if (id == IE_ID_HT1 || id == IE_ID_HT2)
+            {
+                break;
+            }
+        }
+        mhr->ie_len = (uint16_t)(pos - start);
+    }
+
+    if (pos > frame_len)
+    {
+        return 0;
+    }
+
+    mhr->frame = frame;
+    mhr->layout = layout;
+    mhr->fc = fc;
+    mhr->header_len = pos;
+    return pos;
+}
+
+/* @fn      mac_mhr_build
+ * @brief   Writes an MHR for the given fields. PAN ID compression is used whenever both addresses are present and
+ *          the PAN IDs are equal, so the header is the shortest the fields allow.
+ *
+ * @param   buf    - destination, at least MAC_MHR_MAX_LEN bytes
+ * @param   fields - header fields
+ * @return  the MHR length, 0 if the combination of fields is not valid
+ */
+uint8_t mac_mhr_build(uint8_t *buf, const mac_mhr_fields_t *fields)
+{
+    const mac_mhr_layout_t *layout;
+    uint16_t fc;
+    uint8_t len, compress = 0;
+
+    if (fields->dest_mode && fields->src_mode)
+    {
+        if (fields->version == MAC_MHR_VERSION_2015 && fields->dest_mode == MAC_MHR_ADDR_EXT && fields->src_mode == MAC_MHR_ADDR_EXT)
+        {
+            /* Only the destination PAN ID can be carried, the source one is implied */
+            if (fields->dest_pan != fields->src_pan)
+            {
+                return 0;
+            }
+        }
+        else
+        {
+            compress = (fields->dest_pan == fields->src_pan);
+        }
+    }
+
+    fc = (uint16_t)((fields->frame_type & MAC_MHR_FC_TYPE_MASK) | (fields->security ? MAC_MHR_FC_SECURITY : 0)
+                    | (fields->frame_pending ? MAC_MHR_FC_FRAME_PENDING : 0) | (fields->ack_request ? MAC_MHR_FC_ACK_REQUEST : 0)
+                    | (compress ? MAC_MHR_FC_PAN_ID_COMPRESS : 0) | (fields->seq_suppress ? MAC_MHR_FC_SEQ_SUPPRESS : 0)
+                    | ((fields->dest_mode & 3) << MAC_MHR_FC_DEST_MODE_SHIFT) | ((fields->version & 3) << MAC_MHR_FC_VERSION_SHIFT)
+                    | ((fields->src_mode & 3) << MAC_MHR_FC_SRC_MODE_SHIFT));
+    layout = &mac_mhr_layouts[MAC_MHR_LAYOUT_INDEX(fc)];
+    if (!layout->valid || (fields->security && (fields->version == MAC_MHR_VERSION_2003 || fields->key_id_mode > 1)))
+    {
+        return 0;
+    }
+
+    write_le(buf, fc, 2);
+    if (layout->seq != MAC_MHR_ABSENT)
+    {
+        buf[layout->seq] = fields->seq;
+    }
+    if (layout->dest_pan != MAC_MHR_ABSENT)
+    {
+        write_le(&buf[layout->dest_pan], fields->dest_pan, 2);
+    }
+    if (layout->dest_addr != MAC_MHR_ABSENT)
+    {
+        write_le(&buf[layout->dest_addr], fields->dest_addr, layout->dest_addr_len);
+    }
+    if (layout->src_pan != MAC_MHR_ABSENT)
+    {
+        write_le(&buf[layout->src_pan], fields->src_pan, 2);
+    }
+    if (layout->src_addr != MAC_MHR_ABSENT)
+    {
+        write_le(&buf[layout->src_addr], fields->src_addr, layout->src_addr_len);
+    }
+
+    len = layout->aux;
+    if (fields->security)
+    {
+        buf[len++] = (uint8_t)((fields->sec_level & 7) | (fields->key_id_mode << 3));
+        write_le(&buf[len], fields->frame_counter, 4);
+        len += 4;
+        if (fields->key_id_mode == 1)
+        {
+            buf[len++] = fields->key_index;
+        }
+    }
+    return len;
+}
@@ -0,0 +1,161 @@
+/*! ----------------------------------------------------------------------------
+ * @file    mac_mhr.h
+ * @brief   Zero-copy parser and builder for IEEE 802.15.4 MAC headers of any layout
+ *
+ *          mac_802_15_4.h handles the one MHR of the AES examples (64-bit addresses, no source PAN ID). This module
+ *          handles every combination of frame version (2003/2006/2015), address modes, PAN ID compression, sequence
+ *          number suppression, auxiliary security header and header IEs, so that a protocol can use the shortest
+ *          header it can afford (e.g. 16-bit short addresses) and still parse received frames without copying them.
+ *
+ *          The position of every field up to the auxiliary security header only depends on 8 bits of the frame
+ *          control field (frame version, both address modes, PAN ID compression and sequence number suppression).
+ *          mac_mhr_layouts[] holds the offsets for the 256 combinations, computed at compile time, so parsing a frame
+ *          is one table lookup plus the security header and IE walk when those are present.
+ */
+
+#ifndef MAC_MHR_H_
+#define MAC_MHR_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+
+/* Frame control field, byte 0 */
+#define MAC_MHR_FC_TYPE_MASK       0x0007
+#define MAC_MHR_FC_SECURITY        0x0008
+#define MAC_MHR_FC_FRAME_PENDING   0x0010
+#define MAC_MHR_FC_ACK_REQUEST     0x0020
+#define MAC_MHR_FC_PAN_ID_COMPRESS 0x0040
+/* Frame control field, byte 1 */
+#define MAC_MHR_FC_SEQ_SUPPRESS    0x0100
+#define MAC_MHR_FC_IE_PRESENT      0x0200
+#define MAC_MHR_FC_DEST_MODE_SHIFT 10
+#define MAC_MHR_FC_VERSION_SHIFT   12
+#define MAC_MHR_FC_SRC_MODE_SHIFT  14
+
+/* Address modes */
+#define MAC_MHR_ADDR_NONE  0
+#define MAC_MHR_ADDR_SHORT 2
+#define MAC_MHR_ADDR_EXT   3
+
+/* Frame types */
+#define MAC_MHR_TYPE_BEACON  0
+#define MAC_MHR_TYPE_DATA    1
+#define MAC_MHR_TYPE_ACK     2
+#define MAC_MHR_TYPE_COMMAND 3
+
+/* Frame versions */
+#define MAC_MHR_VERSION_2003 0
+#define MAC_MHR_VERSION_2006 1
+#define MAC_MHR_VERSION_2015 2
+
+/* Offset of a field that is not present in the frame */
+#define MAC_MHR_ABSENT 0xFF
+
+/* Longest MHR the builder writes: frame control, sequence number, two PAN IDs, two extended addresses and the
+ * longest auxiliary security header */
+#define MAC_MHR_MAX_LEN (2 + 1 + 2 + 8 + 2 + 8 + 14)
+
+    /* Field offsets of one frame control combination, MAC_MHR_ABSENT for the fields it does not have.
+     * valid is 0 when the combination is reserved or not allowed. */
+    typedef struct
+    {
+        uint8_t seq;
+        uint8_t dest_pan;
+        uint8_t dest_addr;
+        uint8_t src_pan;
+        uint8_t src_addr;
+        uint8_t aux; /* Offset of the auxiliary security header, or of what follows the addresses */
+        uint8_t dest_addr_len;
+        uint8_t src_addr_len;
+        uint8_t valid;
+    } mac_mhr_layout_t;
+
+    extern const mac_mhr_layout_t mac_mhr_layouts[256];
+
+    /* Parsed MHR, pointing into the frame it was parsed from */
+    typedef struct
+    {
+        const uint8_t *frame;
+        const mac_mhr_layout_t *layout;
+        uint16_t fc;         /* Frame control field */
+        uint8_t aux_len;     /* Length of the auxiliary security header, 0 when security is off */
+        uint16_t ie_len;     /* Length of the header IEs including the termination IE */
+        uint16_t header_len; /* Length of the whole MHR, the payload starts there */
+    } mac_mhr_t;
+
+    /* Fields of an MHR to build. MAC_MHR_ADDR_NONE omits an address and its PAN ID, PAN ID compression is decided
+     * by the builder. */
+    typedef struct
+    {
+        uint8_t frame_type;
+        uint8_t version;
+        uint8_t dest_mode;
+        uint8_t src_mode;
+        uint8_t seq_suppress;
+        uint8_t frame_pending;
+        uint8_t ack_request;
+        uint8_t seq;
+        uint16_t dest_pan;
+        uint16_t src_pan;
+        uint64_t dest_addr;
+        uint64_t src_addr;
+        uint8_t security; /* Adds an auxiliary security header with the fields below */
+        uint8_t sec_level;
+        uint8_t key_id_mode; /* Only key identifier modes 0 and 1 are written by the builder */
+        uint8_t key_index;
+        uint32_t frame_counter;
+    } mac_mhr_fields_t;
+
+/* Index of the layout of a frame control field in mac_mhr_layouts[]: byte 1 with the IE present bit replaced by the
+ * PAN ID compression bit */
+#define MAC_MHR_LAYOUT_INDEX(fc) ((uint8_t)((((fc) >> 8) & ~0x02) | (((fc) >> 5) & 0x02)))
+
+    /* @fn      mac_mhr_parse
+     * @brief   Parses the MHR at the start of a frame without copying it.
+     *
+     * @param   mhr       - receives the parsed header
+     * @param   frame     - received frame
+     * @param   frame_len - length of the frame, without the FCS
+     * @return  the MHR length (where the payload starts), or 0 if the header is malformed or does not fit in frame_len
+     */
+    uint16_t mac_mhr_parse(mac_mhr_t *mhr, const uint8_t *frame, uint16_t frame_len);
+
+    /* @fn      mac_mhr_build
+     * @brief   Writes an MHR for the given fields, compressing the PAN IDs whenever possible.
+     *
+     * @param   buf    - destination, at least MAC_MHR_MAX_LEN bytes
+     * @param   fields - header fields
+     * @return  the MHR length, 0 if the combination of fields is not valid
+     */
+    uint8_t mac_mhr_build(uint8_t *buf, const mac_mhr_fields_t *fields);
+
+    /* @fn      mac_mhr_read_addr
+     * @brief   Reads a little-endian address or PAN ID of len bytes from a frame.
+     *
+     * @return  the value, 0 when len is 0
+     */
+    uint64_t mac_mhr_read_addr(const uint8_t *p, uint8_t len);
+
+/* Accessors of a parsed header. The source PAN ID is the destination one when it was compressed away. */
+#define MAC_MHR_FRAME_TYPE(mhr)  ((mhr)->fc & MAC_MHR_FC_TYPE_MASK)
+#define MAC_MHR_SECURED(mhr)     (((mhr)->fc & MAC_MHR_FC_SECURITY) != 0)
+#define MAC_MHR_HAS_SEQ(mhr)     ((mhr)->layout->seq != MAC_MHR_ABSENT)
+#define MAC_MHR_SEQ(mhr)         ((mhr)->frame[(mhr)->layout->seq])
+#define MAC_MHR_DEST_ADDR(mhr)   mac_mhr_read_addr(&(mhr)->frame[(mhr)->layout->dest_addr], (mhr)->layout->dest_addr_len)
+#define MAC_MHR_SRC_ADDR(mhr)    mac_mhr_read_addr(&(mhr)->frame[(mhr)->layout->src_addr], (mhr)->layout->src_addr_len)
+#define MAC_MHR_DEST_PAN(mhr)                                                                                                                                 \
+    (((mhr)->layout->dest_pan == MAC_MHR_ABSENT) ? 0xFFFF : (uint16_t)mac_mhr_read_addr(&(mhr)->frame[(mhr)->layout->dest_pan], 2))
+#define MAC_MHR_SRC_PAN(mhr)                                                                                                                                  \
+    (((mhr)->layout->src_pan == MAC_MHR_ABSENT) ? MAC_MHR_DEST_PAN(mhr) : (uint16_t)mac_mhr_read_addr(&(mhr)->frame[(mhr)->layout->src_pan], 2))
+#define MAC_MHR_AUX_PTR(mhr)     (&(mhr)->frame[(mhr)->layout->aux])
+#define MAC_MHR_PAYLOAD_PTR(mhr) (&(mhr)->frame[(mhr)->header_len])
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MAC_MHR_H_ */
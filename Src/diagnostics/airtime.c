@@ -0,0 +1,200 @@
+/*! ----------------------------------------------------------------------------
+ * @file    airtime.c
+ * @brief   Airtime and channel utilisation accounting
+ *
+ *          See airtime.h for an overview.
+ */
+
+#include <airtime.h>
+#include <port.h>
+#include <stdio.h>
+
+/* Active PHY configuration, and preamble length of the frames accounted when it differs from the configuration's */
+static const dwt_config_t *active_config = NULL;
+static uint16_t preamble_override = 0;
+
+/* Accumulators for the current window, in nanoseconds */
+static uint64_t tx_ns = 0;
+static uint64_t rx_listen_ns = 0;
+static uint64_t rx_useful_ns = 0;
+
+static uint32_t window_start_ms = 0;
+
+/* Start of the current receiver-on window, in CPU cycles, and whether one is open */
+static uint32_t rx_start_cycles = 0;
+static uint8_t rx_open = 0;
+
+/* Totals of the last closed window */
+static airtime_report_t report;
+
+uint16_t airtime_preamble_symbols(dwt_tx_plen_e plen)
+{
+    switch (plen)
+    {
+    case DWT_PLEN_32:
+        return 32;
+    case DWT_PLEN_64:
+        return 64;
+    case DWT_PLEN_72:
+        return 72;
+    case DWT_PLEN_128:
+        return 128;
+    case DWT_PLEN_256:
+        return 256;
+    case DWT_PLEN_512:
+        return 512;
+    case DWT_PLEN_1024:
+        return 1024;
+    case DWT_PLEN_1536:
+        return 1536;
+    case DWT_PLEN_2048:
+        return 2048;
+    case DWT_PLEN_4096:
+    default:
+        return 4096;
+    }
+}
+
+uint32_t airtime_frame_duration_ns(const dwt_config_t *cfg, uint16_t frame_len)
+{
+    return airtime_frame_duration_plen_ns(cfg, airtime_preamble_symbols(cfg->txPreambLength), frame_len);
+}
+
+uint32_t airtime_frame_duration_plen_ns(const dwt_config_t *cfg, uint16_t preamble_symbols, uint16_t frame_len)
+{
+    uint64_t duration_ps;
+    uint32_t shr_symbols;
+    uint32_t data_symbol_ps;
+
+    /* Synchronisation header: preamble then SFD (16 symbols for the DW 16-symbol SFD, 8 for all others) */
+    shr_symbols = preamble_symbols + ((cfg->sfdType == DWT_SFD_DW_16) ? DWT_SFD_LEN16 : DWT_SFD_LEN8);
+    duration_ps = (uint64_t)shr_symbols * AIRTIME_PREAMBLE_SYMBOL_PS;
+
+    /* STS, (1 << (stsLength + 2)) * 8 symbols, see set_delayed_rx_time() */
+    if ((cfg->stsMode & DWT_STS_CONFIG_MASK_NO_SDC) != DWT_STS_MODE_OFF)
+    {
+        duration_ps += (uint64_t)((1 << (cfg->stsLength + 2)) * 8) * AIRTIME_PREAMBLE_SYMBOL_PS;
+    }
+
+    /* SP3 packets carry no PHR and no payload */
+    if ((cfg->stsMode & DWT_STS_CONFIG_MASK_NO_SDC) == DWT_STS_MODE_ND)
+    {
+        return (uint32_t)(duration_ps / 1000);
+    }
+
+    data_symbol_ps = (cfg->dataRate == DWT_BR_6M8) ? AIRTIME_DATA_SYMBOL_6M8_PS : AIRTIME_DATA_SYMBOL_850K_PS;
+
+    /* PHY header, sent at 850 kb/s unless PHR at data rate is selected */
+    duration_ps += (uint64_t)AIRTIME_PHR_SYMBOLS * ((cfg->phrRate == DWT_PHRRATE_DTA) ? data_symbol_ps : AIRTIME_DATA_SYMBOL_850K_PS);
+
+    /* Payload with Reed-Solomon parity, one bit per symbol */
+    duration_ps += (uint64_t)AIRTIME_DATA_BITS(frame_len) * data_symbol_ps;
+
+    return (uint32_t)(duration_ps / 1000);
+}
+
+void airtime_set_config(const dwt_config_t *cfg)
+{
+    active_config = cfg;
+}
+
+void airtime_set_preamble(uint16_t symbols)
+{
+    preamble_override = symbols;
+}
+
+/* Duration of a frame accounted now, with the preamble length set by airtime_set_preamble() if any */
+static uint32_t accounted_ns(uint16_t frame_len)
+{
+    return preamble_override ? airtime_frame_duration_plen_ns(active_config, preamble_override, frame_len)
+                             : airtime_frame_duration_ns(active_config, frame_len);
+}
+
+void airtime_note_tx(uint16_t frame_len)
+{
+    if (active_config)
+    {
+        tx_ns += accounted_ns(frame_len);
+    }
+}
+
+void airtime_rx_begin(uint32_t offset_us)
+{
+    rx_start_cycles = port_get_cycles() + offset_us * (SystemCoreClock / 1000000);
+    rx_open = 1;
+}
+
+uint32_t airtime_rx_end(void)
+{
+    int32_t listened;
+    uint32_t listened_ns;
+
+    if (!rx_open)
+    {
+        return 0;
+    }
+    rx_open = 0;
+
+    /* Negative when the window ended before the receiver was due to turn on, e.g. a failed delayed TX */
+    listened = (int32_t)(port_get_cycles() - rx_start_cycles);
+    if (listened <= 0)
+    {
+        return 0;
+    }
+    listened_ns = (uint32_t)(((uint64_t)listened * 1000) / (SystemCoreClock / 1000000));
+    rx_listen_ns += listened_ns;
+    return listened_ns / 1000;
+}
+
+void airtime_note_rx_useful(uint16_t frame_len)
+{
+    if (active_config)
+    {
+        rx_useful_ns += accounted_ns(frame_len);
+    }
+}
+
+int airtime_poll(void)
+{
+    uint32_t now = port_get_tick_ms();
+    uint32_t elapsed = now - window_start_ms;
+
+    if (elapsed < AIRTIME_WINDOW_MS)
+    {
+        return 0;
+    }
+
+    /* ns accumulated over elapsed ms -> us per second */
+    report.tx_us = (uint32_t)(tx_ns / elapsed);
+    report.rx_listen_us = (uint32_t)(rx_listen_ns / elapsed);
+    report.rx_useful_us = (uint32_t)(rx_useful_ns / elapsed);
+
+    tx_ns = 0;
+    rx_listen_ns = 0;
+    rx_useful_ns = 0;
+    window_start_ms = now;
+
+    return 1;
+}
+
+const airtime_report_t *airtime_get_report(void)
+{
+    return &report;
+}
+
+void airtime_print_network(const airtime_report_t *reports, int num_nodes)
+{
+    uint32_t network_tx_us = 0;
+    int i;
+
+    for (i = 0; i < num_nodes; i++)
+    {
+        printf("AIR node=%d tx=%luus/s listen=%luus/s useful=%luus/s\n", i, (unsigned long)reports[i].tx_us,
+            (unsigned long)reports[i].rx_listen_us, (unsigned long)reports[i].rx_useful_us);
+        network_tx_us += reports[i].tx_us;
+    }
+
+    /* Transmissions are what occupies the channel, listening nodes overlap with them */
+    printf("AIR net util=%lu/1000 free=%luus/s\n", (unsigned long)(network_tx_us / 1000),
+        (unsigned long)((network_tx_us < 1000000) ? (1000000 - network_tx_us) : 0));
+}
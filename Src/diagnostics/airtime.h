@@ -0,0 +1,183 @@
+/*! ----------------------------------------------------------------------------
+ * @file    airtime.h
+ * @brief   Airtime and channel utilisation accounting
+ *
+ *          Every transmitted frame is charged its on-air duration, computed from the active dwt_config_t. Every
+ *          receiver-on window is charged the time the receiver actually listened, and frames that were useful to this
+ *          node are charged their on-air duration as "useful RX". The totals are closed once per second into a report
+ *          that nodes exchange so that the whole network's channel occupancy is known.
+ */
+
+#ifndef AIRTIME_H_
+#define AIRTIME_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <deca_device_api.h>
+#include <stdint.h>
+
+/* Length of an accounting window, in milliseconds. */
+#define AIRTIME_WINDOW_MS 1000
+
+/* Symbol durations for the 64 MHz PRF used by the DW3000, in picoseconds. */
+#define AIRTIME_PREAMBLE_SYMBOL_PS 1017630 /* Preamble, SFD and STS symbols */
+#define AIRTIME_DATA_SYMBOL_850K_PS 1025640 /* PHR (standard rate) and payload at 850 kb/s */
+#define AIRTIME_DATA_SYMBOL_6M8_PS 128210   /* Payload (and PHR at data rate) at 6.8 Mb/s */
+
+/* The PHR is 19 bits plus 2 tail bits. */
+#define AIRTIME_PHR_SYMBOLS 21
+
+/* Payload bits on air, Reed-Solomon adding 48 parity bits per block of up to 330 data bits. A constant expression, so
+ * that timings can be worked out at compile time. */
+#define AIRTIME_DATA_BITS(frame_len) ((uint32_t)(frame_len) * 8 + (((uint32_t)(frame_len) * 8 + 329) / 330) * 48)
+
+    /* Airtime totals of one node, normalised to one second */
+    typedef struct
+    {
+        uint32_t tx_us;        /* Time spent transmitting, in us per second */
+        uint32_t rx_listen_us; /* Time the receiver was on, in us per second */
+        uint32_t rx_useful_us; /* On-air time of received frames that were useful to the node, in us per second */
+    } airtime_report_t;
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn airtime_frame_duration_ns()
+     *
+     * @brief Computes the on-air duration of a frame: preamble, SFD, STS, PHR and Reed-Solomon coded payload.
+     *
+     * @param cfg       - PHY configuration the frame is sent with
+     * @param frame_len - frame length in bytes, including the 2-byte FCS
+     *
+     * @return duration in nanoseconds
+     */
+    uint32_t airtime_frame_duration_ns(const dwt_config_t *cfg, uint16_t frame_len);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn airtime_frame_duration_plen_ns()
+     *
+     * @brief As airtime_frame_duration_ns(), for a frame sent with another preamble length than the configuration's
+     *        (dwt_setplenfine()).
+     *
+     * @param cfg              - PHY configuration the frame is sent with
+     * @param preamble_symbols - preamble length, in symbols
+     * @param frame_len        - frame length in bytes, including the 2-byte FCS
+     *
+     * @return duration in nanoseconds
+     */
+    uint32_t airtime_frame_duration_plen_ns(const dwt_config_t *cfg, uint16_t preamble_symbols, uint16_t frame_len);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn airtime_preamble_symbols()
+     *
+     * @brief Converts the preamble length register encoding into a number of symbols.
+     *
+     * @param plen - preamble length of a dwt_config_t
+     *
+     * @return preamble length, in symbols
+     */
+    uint16_t airtime_preamble_symbols(dwt_tx_plen_e plen);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn airtime_set_config()
+     *
+     * @brief Sets the PHY configuration used to compute the duration of the frames accounted from now on.
+     *
+     * @param cfg - active configuration, must stay valid while in use
+     *
+     * @return none
+     */
+    void airtime_set_config(const dwt_config_t *cfg);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn airtime_set_preamble()
+     *
+     * @brief Sets the preamble length of the frames accounted from now on, when a link uses another one than the
+     *        configuration's.
+     *
+     * @param symbols - preamble length in symbols, 0 to go back to the configuration's
+     *
+     * @return none
+     */
+    void airtime_set_preamble(uint16_t symbols);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn airtime_note_tx()
+     *
+     * @brief Accounts one transmitted frame.
+     *
+     * @param frame_len - length passed to dwt_writetxfctrl(), including the FCS
+     *
+     * @return none
+     */
+    void airtime_note_tx(uint16_t frame_len);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn airtime_rx_begin()
+     *
+     * @brief Marks the start of a receiver-on window.
+     *
+     * @param offset_us - delay between this call and the receiver actually turning on, e.g. the TX frame duration plus the
+     *                    RX-after-TX delay when the receiver is enabled automatically after a transmission
+     *
+     * @return none
+     */
+    void airtime_rx_begin(uint32_t offset_us);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn airtime_rx_end()
+     *
+     * @brief Closes the receiver-on window opened by airtime_rx_begin() (on frame reception, error or timeout).
+     *
+     * @return time the receiver was on, in microseconds, 0 if no window was open
+     */
+    uint32_t airtime_rx_end(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn airtime_note_rx_useful()
+     *
+     * @brief Accounts a received frame that was useful to this node (addressed to it and processed).
+     *
+     * @param frame_len - received frame length, including the FCS
+     *
+     * @return none
+     */
+    void airtime_note_rx_useful(uint16_t frame_len);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn airtime_poll()
+     *
+     * @brief Background service. Closes the accounting window once AIRTIME_WINDOW_MS has elapsed.
+     *
+     * @return 1 if a window was closed, 0 otherwise
+     */
+    int airtime_poll(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn airtime_get_report()
+     *
+     * @brief Returns the totals of the last closed window, normalised to one second.
+     *
+     * @return pointer to the report
+     */
+    const airtime_report_t *airtime_get_report(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn airtime_print_network()
+     *
+     * @brief Prints one "AIR" line per node and a network summary: total channel occupancy (sum of all nodes' TX time,
+     *        in 1/1000) and the remaining free airtime per second.
+     *
+     * @param reports   - per-node reports, indexed by device ID
+     * @param num_nodes - number of entries in reports
+     *
+     * @return none
+     */
+    void airtime_print_network(const airtime_report_t *reports, int num_nodes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AIRTIME_H_ */
@@ -0,0 +1,140 @@
+/*! ----------------------------------------------------------------------------
+ * @file    console.c
+ * @brief   Minimal command console on the RTT down-channel
+ *
+ *          See console.h for an overview.
+ */
+
+#include <SEGGER/SEGGER_RTT.h>
+#include <console.h>
+#include <event_counters.h>
+#include <mem_usage.h>
+#include <phy_profile.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    const char *name;
+    void (*handler)(const char *args);
+    const char *help;
+} console_command_t;
+
+static void cmd_help(const char *args);
+
+static void cmd_mem(const char *args)
+{
+    (void)args;
+    mem_print();
+}
+
+static void cmd_evc(const char *args)
+{
+    (void)args;
+    evc_print();
+}
+
+static void cmd_phy(const char *args)
+{
+    unsigned long option;
+
+    if (*args == '\0')
+    {
+        phy_profile_print_table();
+        phy_profile_print();
+        return;
+    }
+    option = strtoul(args, NULL, 10);
+    if (option > PHY_PROFILE_COUNT || phy_profile_request((uint8_t)option) != 0)
+    {
+        printf("unknown radio profile '%s', 1 to %d\n", args, PHY_PROFILE_COUNT);
+        return;
+    }
+    phy_profile_print();
+}
+
+static const console_command_t commands[] = {
+    { "help", cmd_help, "list the commands" },
+    { "mem", cmd_mem, "stack high-water marks per role and static RAM totals" },
+    { "evc", cmd_evc, "latest DW3000 event counter rates" },
+    { "phy", cmd_phy, "radio profiles; 'phy N' switches the network to profile N" },
+};
+
+#define NUM_COMMANDS (sizeof(commands) / sizeof(commands[0]))
+
+static char line[CONSOLE_LINE_LEN];
+static uint8_t line_len = 0;
+static uint8_t overflow = 0;
+
+static void cmd_help(const char *args)
+{
+    unsigned i;
+
+    (void)args;
+    for (i = 0; i < NUM_COMMANDS; i++)
+    {
+        printf("%-8s %s\n", commands[i].name, commands[i].help);
+    }
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn run_line()
+ *
+ * @brief Splits the line into command name and arguments and runs the command.
+ */
+static void run_line(void)
+{
+    const char *args;
+    size_t name_len;
+    unsigned i;
+
+    line[line_len] = '\0';
+    args = strchr(line, ' ');
+    name_len = args ? (size_t)(args - line) : line_len;
+    args = args ? args + 1 : "";
+
+    for (i = 0; i < NUM_COMMANDS; i++)
+    {
+        if (strlen(commands[i].name) == name_len && strncmp(commands[i].name, line, name_len) == 0)
+        {
+            commands[i].handler(args);
+            return;
+        }
+    }
+    printf("unknown command '%s', type help\n", line);
+}
+
+int console_poll(void)
+{
+    int c;
+
+    while ((c = SEGGER_RTT_GetKey()) >= 0)
+    {
+        if (c == '\r' || c == '\n')
+        {
+            int ran = (line_len > 0) && !overflow;
+
+            if (ran)
+            {
+                run_line();
+            }
+            line_len = 0;
+            overflow = 0;
+            if (ran)
+            {
+                return 1;
+            }
+        }
+        else if (line_len < CONSOLE_LINE_LEN - 1)
+        {
+            line[line_len++] = (char)c;
+        }
+        else
+        {
+            overflow = 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,35 @@
+/*! ----------------------------------------------------------------------------
+ * @file    console.h
+ * @brief   Minimal command console on the RTT down-channel
+ *
+ *          Characters typed in the RTT terminal (e.g. J-Link RTT Viewer or `telnet localhost 19021` while a J-Link
+ *          session is open) are collected without blocking. When a line is complete the matching command from the
+ *          command table in console.c is run and its output is printed on the normal RTT output. Type "help" for the
+ *          list of commands.
+ */
+
+#ifndef CONSOLE_H_
+#define CONSOLE_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Longest command line accepted, longer lines are discarded */
+#define CONSOLE_LINE_LEN 48
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn console_poll()
+     *
+     * @brief Background service. Reads the pending input characters and runs a command once a full line was received.
+     *
+     * @return 1 if a command was run, 0 otherwise
+     */
+    int console_poll(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONSOLE_H_ */
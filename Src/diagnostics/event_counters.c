@@ -0,0 +1,190 @@
+/*! ----------------------------------------------------------------------------
+ * @file    event_counters.c
+ * @brief   Periodic sampler for the DW3000 event counters
+ *
+ *          See event_counters.h for an overview.
+ */
+
+#include <event_counters.h>
+#include <port.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Width mask of each hardware counter, in evc_counter_e order (see dwt_deviceentcnts_t) */
+static const uint16_t counter_mask[EVC_NUM_COUNTERS] = {
+    0x0FFF, /* PHE */
+    0x0FFF, /* RSL */
+    0x0FFF, /* CRCG */
+    0x0FFF, /* CRCB */
+    0x00FF, /* ARFE */
+    0x00FF, /* OVER */
+    0x0FFF, /* SFDTO */
+    0x0FFF, /* PTO */
+    0x00FF, /* RTO */
+    0x0FFF, /* TXF */
+    0x00FF, /* HPW */
+    0x00FF, /* CRCE */
+    0x0FFF, /* PREJ */
+    0x0FFF, /* SFDD */
+    0x00FF  /* STSE */
+};
+
+static evc_stats_t stats;
+
+/* Raw counter values at the previous sample, used to compute deltas */
+static uint16_t last_raw[EVC_NUM_COUNTERS];
+
+/* Time of the previous sample */
+static uint32_t last_sample_ms;
+
+/* Set once each smoothed ratio has been seeded with a first sample. The miss ratio is seeded again by every
+ * evc_start(), see miss_permille in event_counters.h. */
+static uint8_t crc_ratio_valid = 0;
+static uint8_t miss_ratio_valid = 0;
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn counters_to_array()
+ *
+ * @brief Copies a dwt_deviceentcnts_t into an array indexed by evc_counter_e.
+ */
+static void counters_to_array(const dwt_deviceentcnts_t *cnt, uint16_t *raw)
+{
+    raw[EVC_PHE] = cnt->PHE;
+    raw[EVC_RSL] = cnt->RSL;
+    raw[EVC_CRCG] = cnt->CRCG;
+    raw[EVC_CRCB] = cnt->CRCB;
+    raw[EVC_ARFE] = cnt->ARFE;
+    raw[EVC_OVER] = cnt->OVER;
+    raw[EVC_SFDTO] = cnt->SFDTO;
+    raw[EVC_PTO] = cnt->PTO;
+    raw[EVC_RTO] = cnt->RTO;
+    raw[EVC_TXF] = cnt->TXF;
+    raw[EVC_HPW] = cnt->HPW;
+    raw[EVC_CRCE] = cnt->CRCE;
+    raw[EVC_PREJ] = cnt->PREJ;
+    raw[EVC_SFDD] = cnt->SFDD;
+    raw[EVC_STSE] = cnt->STSE;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn smooth_ratio()
+ *
+ * @brief Exponentially weighted moving average (weight 1/4) of a ratio in 1/1000. Periods with no events keep the
+ *        previous value, the first period with events seeds the average and sets *valid.
+ */
+static uint16_t smooth_ratio(uint16_t previous, uint32_t events, uint32_t total, uint8_t *valid)
+{
+    uint32_t ratio;
+
+    if (total == 0)
+    {
+        return previous;
+    }
+
+    ratio = (events * 1000) / total;
+    if (!*valid)
+    {
+        *valid = 1;
+        return (uint16_t)ratio;
+    }
+
+    return (uint16_t)((previous * 3 + ratio) / 4);
+}
+
+void evc_start(void)
+{
+    /* Enabling the counters also resets them to zero in the DW IC */
+    dwt_configeventcounters(1);
+    memset(last_raw, 0, sizeof(last_raw));
+    last_sample_ms = port_get_tick_ms();
+
+    /* evc_start() comes with every change of role: a responder's idle-listen timeouts say nothing about its peers
+     * answering once it is the initiator */
+    stats.miss_permille = 0;
+    miss_ratio_valid = 0;
+}
+
+int evc_poll(void)
+{
+    dwt_deviceentcnts_t cnt;
+    uint16_t raw[EVC_NUM_COUNTERS];
+    uint32_t now = port_get_tick_ms();
+    uint32_t elapsed = now - last_sample_ms;
+    uint32_t rx_good_bad, rx_outcomes;
+    int i;
+
+    if (elapsed < EVC_SAMPLE_PERIOD_MS)
+    {
+        return 0;
+    }
+
+    dwt_readeventcounters(&cnt);
+    counters_to_array(&cnt, raw);
+
+    for (i = 0; i < EVC_NUM_COUNTERS; i++)
+    {
+        /* Unsigned subtraction masked to the counter width handles the hardware wrap */
+        stats.delta[i] = (raw[i] - last_raw[i]) & counter_mask[i];
+        stats.total[i] += stats.delta[i];
+        stats.rate_per_s[i] = ((uint32_t)stats.delta[i] * 1000) / elapsed;
+        last_raw[i] = raw[i];
+    }
+
+    rx_good_bad = stats.delta[EVC_CRCG] + stats.delta[EVC_CRCB] + stats.delta[EVC_PHE];
+    rx_outcomes = rx_good_bad + stats.delta[EVC_PTO] + stats.delta[EVC_RTO] + stats.delta[EVC_SFDTO] + stats.delta[EVC_RSL];
+
+    stats.crc_err_permille = smooth_ratio(stats.crc_err_permille, stats.delta[EVC_CRCB] + stats.delta[EVC_PHE], rx_good_bad, &crc_ratio_valid);
+    stats.miss_permille
+        = smooth_ratio(stats.miss_permille, stats.delta[EVC_PTO] + stats.delta[EVC_RTO] + stats.delta[EVC_SFDTO], rx_outcomes, &miss_ratio_valid);
+
+    stats.period_ms = elapsed;
+    stats.samples++;
+    last_sample_ms = now;
+
+#if EVC_TELEMETRY_PERIOD > 0
+    if ((stats.samples % EVC_TELEMETRY_PERIOD) == 0)
+    {
+        evc_print();
+    }
+#endif
+
+    return 1;
+}
+
+const evc_stats_t *evc_get_stats(void)
+{
+    return &stats;
+}
+
+void evc_print(void)
+{
+    printf("EVC t=%lu crcg=%lu/s crcb=%lu/s phe=%lu/s pto=%lu/s rto=%lu/s sfdto=%lu/s txf=%lu/s hpw=%lu/s crc_err=%u miss=%u\n",
+        (unsigned long)last_sample_ms, (unsigned long)stats.rate_per_s[EVC_CRCG], (unsigned long)stats.rate_per_s[EVC_CRCB],
+        (unsigned long)stats.rate_per_s[EVC_PHE], (unsigned long)stats.rate_per_s[EVC_PTO], (unsigned long)stats.rate_per_s[EVC_RTO],
+        (unsigned long)stats.rate_per_s[EVC_SFDTO], (unsigned long)stats.rate_per_s[EVC_TXF], (unsigned long)stats.rate_per_s[EVC_HPW],
+        stats.crc_err_permille, stats.miss_permille);
+}
+
+uint32_t evc_ranging_delay_ms(uint32_t base_ms)
+{
+    uint32_t excess;
+
+    if (stats.crc_err_permille <= EVC_CRC_ERR_BACKOFF_PERMILLE)
+    {
+        return base_ms;
+    }
+
+    /* Grow linearly from 1x at the threshold to EVC_MAX_BACKOFF_FACTOR x at 100% errors */
+    excess = stats.crc_err_permille - EVC_CRC_ERR_BACKOFF_PERMILLE;
+    return base_ms + (base_ms * (EVC_MAX_BACKOFF_FACTOR - 1) * excess) / (1000 - EVC_CRC_ERR_BACKOFF_PERMILLE);
+}
+
+uint8_t evc_retry_limit(uint8_t base_retries)
+{
+    if ((stats.miss_permille > EVC_MISS_RETRY_CUT_PERMILLE) && (base_retries > 1))
+    {
+        return 1;
+    }
+
+    return base_retries ? base_retries : 1;
+}
@@ -0,0 +1,139 @@
+/*! ----------------------------------------------------------------------------
+ * @file    event_counters.h
+ * @brief   Periodic sampler for the DW3000 event counters
+ *
+ *          The DW3000 event counters (PHE, RSL, CRC good/bad, ARFE, SFD timeouts, PTO, RTO, TXF, HPW, ...) are
+ *          narrow (8 or 12 bits) and free-running. This module reads them at a fixed cadence, unwraps them into
+ *          32-bit totals, computes per-period deltas and per-second rates, and keeps smoothed error ratios that the
+ *          ranging scheduler uses to adapt its ranging rate and retry budget.
+ */
+
+#ifndef EVENT_COUNTERS_H_
+#define EVENT_COUNTERS_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <deca_device_api.h>
+#include <stdint.h>
+
+/* Interval between two reads of the event counters, in milliseconds. Must be shorter than the time it takes the
+ * 8-bit counters to wrap (256 events), which is many seconds at the ranging rates used here. */
+#define EVC_SAMPLE_PERIOD_MS 1000
+
+/* Number of sample periods between two telemetry lines printed over RTT. 0 disables the periodic print. */
+#define EVC_TELEMETRY_PERIOD 10
+
+/* Above this smoothed CRC/PHY header error ratio (in 1/1000) the ranging rate is backed off. */
+#define EVC_CRC_ERR_BACKOFF_PERMILLE 100
+
+/* Maximum factor applied to the inter-ranging delay when backing off. */
+#define EVC_MAX_BACKOFF_FACTOR 4
+
+/* Above this smoothed RX miss ratio (preamble/frame/SFD timeouts, in 1/1000) the retry budget is cut. */
+#define EVC_MISS_RETRY_CUT_PERMILLE 500
+
+    /* Index of each counter in the arrays of evc_stats_t, in dwt_deviceentcnts_t order */
+    typedef enum
+    {
+        EVC_PHE = 0, /* PHY header errors */
+        EVC_RSL,     /* Frame sync loss */
+        EVC_CRCG,    /* Good CRC frames */
+        EVC_CRCB,    /* Bad CRC frames */
+        EVC_ARFE,    /* Address filter errors */
+        EVC_OVER,    /* RX buffer overruns */
+        EVC_SFDTO,   /* SFD timeouts */
+        EVC_PTO,     /* Preamble detection timeouts */
+        EVC_RTO,     /* RX frame wait timeouts */
+        EVC_TXF,     /* Transmitted frames */
+        EVC_HPW,     /* Half period warnings (late delayed TX/RX) */
+        EVC_CRCE,    /* SPI CRC errors */
+        EVC_PREJ,    /* Preamble rejections */
+        EVC_SFDD,    /* SFD detections */
+        EVC_STSE,    /* STS errors/warnings */
+        EVC_NUM_COUNTERS
+    } evc_counter_e;
+
+    /* Statistics derived from the event counters */
+    typedef struct
+    {
+        uint32_t total[EVC_NUM_COUNTERS];      /* Unwrapped totals since the first evc_start() */
+        uint16_t delta[EVC_NUM_COUNTERS];      /* Events counted during the last sample period */
+        uint32_t rate_per_s[EVC_NUM_COUNTERS]; /* delta scaled to events per second */
+        uint32_t period_ms;                    /* Length of the last sample period */
+        uint32_t samples;                      /* Number of completed sample periods */
+        uint16_t crc_err_permille;             /* Smoothed (CRCB + PHE) / (CRCG + CRCB + PHE) */
+        uint16_t miss_permille;                /* Smoothed (PTO + RTO + SFDTO) / all RX outcomes since the last evc_start() */
+    } evc_stats_t;
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn evc_start()
+     *
+     * @brief Enables (and resets) the event counters in the DW IC. Must be called after every DW IC reset/initialisation
+     *        and change of role. The accumulated totals and the smoothed CRC error ratio are kept across calls, the miss
+     *        ratio starts again: a responder mostly listens for frames that are not sent, so its timeouts must not cut
+     *        the retry budget of its next turn as initiator.
+     *
+     * @return none
+     */
+    void evc_start(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn evc_poll()
+     *
+     * @brief Background service. Reads the counters when EVC_SAMPLE_PERIOD_MS has elapsed since the previous sample and
+     *        updates the statistics. Cheap to call as often as wanted from the main loop.
+     *
+     * @return 1 if a new sample was taken, 0 otherwise
+     */
+    int evc_poll(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn evc_get_stats()
+     *
+     * @brief Returns the latest statistics.
+     *
+     * @return pointer to the statistics, valid until the next evc_poll()
+     */
+    const evc_stats_t *evc_get_stats(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn evc_print()
+     *
+     * @brief Prints the latest rates and smoothed ratios as a single "EVC" telemetry line.
+     *
+     * @return none
+     */
+    void evc_print(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn evc_ranging_delay_ms()
+     *
+     * @brief Scales the inter-ranging delay with the smoothed CRC error ratio, so that a node backs off when the channel is
+     *        noisy or congested instead of adding more colliding frames.
+     *
+     * @param base_ms - nominal inter-ranging delay
+     *
+     * @return delay to use, between base_ms and EVC_MAX_BACKOFF_FACTOR * base_ms
+     */
+    uint32_t evc_ranging_delay_ms(uint32_t base_ms);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn evc_retry_limit()
+     *
+     * @brief Returns the number of attempts to spend on a peer before moving on. When most receptions end in a timeout the
+     *        peer is most likely absent, so retrying only burns airtime.
+     *
+     * @param base_retries - nominal number of attempts
+     *
+     * @return number of attempts to use, at least 1
+     */
+    uint8_t evc_retry_limit(uint8_t base_retries);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EVENT_COUNTERS_H_ */
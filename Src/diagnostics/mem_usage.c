@@ -0,0 +1,146 @@
+/*! ----------------------------------------------------------------------------
+ * @file    mem_usage.c
+ * @brief   Stack high-water marks per execution context and static RAM totals
+ *
+ *          See mem_usage.h for an overview.
+ */
+
+#include <mem_usage.h>
+#include <nrf.h>
+#include <port.h>
+#include <stdio.h>
+
+/* Linker symbols, see flash_placement.xml */
+extern uint32_t __StackLimit;
+extern uint32_t __StackTop;
+extern uint8_t __data_start__;
+extern uint8_t __data_end__;
+extern uint8_t __bss_start__;
+extern uint8_t __bss_end__;
+extern uint8_t __heap_start__;
+extern uint8_t __heap_end__;
+
+static const char *const context_names[MEM_NUM_CTX] = { "boot", "init", "resp" };
+
+static mem_report_t report;
+static mem_context_e current_ctx = MEM_CTX_BOOT;
+static uint32_t last_check_ms;
+static uint8_t warned = 0;
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn paint_below_sp()
+ *
+ * @brief Paints from the stack limit up to the stack pointer minus MEM_STACK_PAINT_MARGIN. Interrupts are disabled so
+ *        that no ISR frame is pushed into the region being painted.
+ */
+static void paint_below_sp(void)
+{
+    uint32_t *p = &__StackLimit;
+    uint32_t *end;
+
+    __disable_irq();
+    end = (uint32_t *)(__get_MSP() - MEM_STACK_PAINT_MARGIN);
+    while (p < end)
+    {
+        *p++ = MEM_STACK_PAINT_PATTERN;
+    }
+    __enable_irq();
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn stack_used()
+ *
+ * @brief Scans the painted area from the stack limit up.
+ *
+ * @return deepest stack use since the last painting, in bytes
+ */
+static uint32_t stack_used(void)
+{
+    const uint32_t *p = &__StackLimit;
+
+    while (p < &__StackTop && *p == MEM_STACK_PAINT_PATTERN)
+    {
+        p++;
+    }
+    return (uint32_t)((const uint8_t *)&__StackTop - (const uint8_t *)p);
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn check_stack()
+ *
+ * @brief Charges the current high-water mark to the current context.
+ */
+static void check_stack(void)
+{
+    uint32_t used = stack_used();
+
+    if (used > report.stack_peak[current_ctx])
+    {
+        report.stack_peak[current_ctx] = used;
+    }
+    if (used > report.stack_peak_all)
+    {
+        report.stack_peak_all = used;
+    }
+
+    if (!warned && (report.stack_size - report.stack_peak_all) < MEM_STACK_WARN_BYTES)
+    {
+        warned = 1;
+        printf("MEM WARNING stack headroom %lu bytes\n", (unsigned long)(report.stack_size - report.stack_peak_all));
+    }
+}
+
+void mem_stack_paint(void)
+{
+    report.stack_size = (uint32_t)((uint8_t *)&__StackTop - (uint8_t *)&__StackLimit);
+    report.data_bytes = (uint32_t)(&__data_end__ - &__data_start__);
+    report.bss_bytes = (uint32_t)(&__bss_end__ - &__bss_start__);
+    report.heap_bytes = (uint32_t)(&__heap_end__ - &__heap_start__);
+
+    paint_below_sp();
+    current_ctx = MEM_CTX_BOOT;
+    last_check_ms = port_get_tick_ms();
+}
+
+void mem_set_context(mem_context_e ctx)
+{
+    check_stack();
+    current_ctx = ctx;
+    paint_below_sp();
+}
+
+int mem_poll(void)
+{
+    uint32_t now = port_get_tick_ms();
+
+    if ((now - last_check_ms) < MEM_CHECK_PERIOD_MS)
+    {
+        return 0;
+    }
+
+    check_stack();
+    last_check_ms = now;
+    return 1;
+}
+
+const mem_report_t *mem_get_report(void)
+{
+    check_stack();
+    return &report;
+}
+
+void mem_print(void)
+{
+    int i;
+
+    check_stack();
+
+    printf("MEM stack=%lu peak=%lu free=%lu", (unsigned long)report.stack_size, (unsigned long)report.stack_peak_all,
+        (unsigned long)(report.stack_size - report.stack_peak_all));
+    for (i = 0; i < MEM_NUM_CTX; i++)
+    {
+        printf(" %s=%lu", context_names[i], (unsigned long)report.stack_peak[i]);
+    }
+    printf(" data=%lu bss=%lu heap=%lu\n", (unsigned long)report.data_bytes, (unsigned long)report.bss_bytes,
+        (unsigned long)report.heap_bytes);
+}
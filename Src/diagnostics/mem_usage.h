@@ -0,0 +1,108 @@
+/*! ----------------------------------------------------------------------------
+ * @file    mem_usage.h
+ * @brief   Stack high-water marks per execution context and static RAM totals
+ *
+ *          The unused part of the stack is painted with a known pattern at boot. The deepest point the pattern has
+ *          been overwritten to is the stack high-water mark. It is checked periodically and charged to the context
+ *          (role) that was running. On a context switch the region below the current stack pointer is painted again,
+ *          so every role gets its own high-water mark. Interrupts share the main stack, their usage is charged to the
+ *          role they interrupted.
+ *
+ *          Static RAM totals (.data, .bss, heap, stack) come from the linker symbols. A per-module breakdown is
+ *          produced at build time by `make ram-report` (Tools/ram_report.c).
+ */
+
+#ifndef MEM_USAGE_H_
+#define MEM_USAGE_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+
+/* Pattern written to the unused stack */
+#define MEM_STACK_PAINT_PATTERN 0xC5C5C5C5UL
+
+/* Bytes left unpainted below the stack pointer when painting, covers the painting function's own frame */
+#define MEM_STACK_PAINT_MARGIN 64
+
+/* Interval between two high-water mark checks, in milliseconds */
+#define MEM_CHECK_PERIOD_MS 1000
+
+/* A warning is printed once when the stack headroom drops below this many bytes */
+#define MEM_STACK_WARN_BYTES 1024
+
+    /* Execution contexts tracked separately */
+    typedef enum
+    {
+        MEM_CTX_BOOT = 0,
+        MEM_CTX_INITIATOR,
+        MEM_CTX_RESPONDER,
+        MEM_NUM_CTX
+    } mem_context_e;
+
+    typedef struct
+    {
+        uint32_t stack_size;                 /* Size of the main stack */
+        uint32_t stack_peak[MEM_NUM_CTX];    /* Deepest stack use seen in each context, in bytes */
+        uint32_t stack_peak_all;             /* Deepest stack use seen overall, in bytes */
+        uint32_t data_bytes;                 /* Initialised static data */
+        uint32_t bss_bytes;                  /* Zero-initialised static data */
+        uint32_t heap_bytes;                 /* Reserved heap */
+    } mem_report_t;
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn mem_stack_paint()
+     *
+     * @brief Paints the unused stack. Call once, as early as possible in main().
+     *
+     * @return none
+     */
+    void mem_stack_paint(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn mem_set_context()
+     *
+     * @brief Charges the stack used so far to the current context, then switches to ctx and paints the stack again
+     *        below the current stack pointer.
+     *
+     * @param ctx - context entered
+     *
+     * @return none
+     */
+    void mem_set_context(mem_context_e ctx);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn mem_poll()
+     *
+     * @brief Background service. Updates the high-water mark of the current context every MEM_CHECK_PERIOD_MS.
+     *
+     * @return 1 if a check was done, 0 otherwise
+     */
+    int mem_poll(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn mem_get_report()
+     *
+     * @brief Updates the high-water mark of the current context and returns the report.
+     *
+     * @return pointer to the report
+     */
+    const mem_report_t *mem_get_report(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn mem_print()
+     *
+     * @brief Prints the stack high-water marks and static RAM totals as a "MEM" line.
+     *
+     * @return none
+     */
+    void mem_print(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MEM_USAGE_H_ */
@@ -0,0 +1,131 @@
+/*! ----------------------------------------------------------------------------
+ * @file    trace.c
+ * @brief   Cycle-accurate trace points recorded into a lock-free RAM ring buffer
+ *
+ *          See trace.h for an overview.
+ */
+
+#include <string.h>
+#include <trace.h>
+
+#ifndef TRACE_VIRTUAL_TIME
+#include <SEGGER/SEGGER_RTT.h>
+#endif
+
+/* Records sent per RTT write. Writes are all-or-nothing, so records are never split across writes. */
+#define TRACE_CHUNK_RECORDS 32
+
+trace_record_t trace_buffer[TRACE_BUFFER_LEN];
+volatile uint32_t trace_head = 0;
+
+/* Number of records already sent (or skipped as lost) */
+static uint32_t trace_tail = 0;
+
+/* Records overwritten before they could be sent, reported in the next chunk */
+static uint32_t trace_lost = 0;
+
+/* Node id written at the start of every chunk */
+static uint8_t trace_node = 0;
+
+#ifdef TRACE_VIRTUAL_TIME
+uint32_t trace_virtual_cycles = 0;
+
+static FILE *trace_out = NULL;
+
+void trace_set_output(FILE *out)
+{
+    trace_out = out;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn trace_write()
+ *
+ * @brief Host sink: appends the records to the output file.
+ *
+ * @return number of bytes written
+ */
+static unsigned trace_write(const void *data, unsigned len)
+{
+    return trace_out ? (unsigned)fwrite(data, 1, len, trace_out) : len;
+}
+#else
+static uint8_t trace_rtt_buffer[TRACE_RTT_BUFFER_SIZE];
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn trace_write()
+ *
+ * @brief Target sink: writes the records to the trace RTT channel, or nothing if they do not all fit.
+ *
+ * @return number of bytes written
+ */
+static unsigned trace_write(const void *data, unsigned len)
+{
+    return SEGGER_RTT_Write(TRACE_RTT_CHANNEL, data, len);
+}
+#endif
+
+void trace_init(uint8_t node)
+{
+    trace_node = node;
+
+#ifndef TRACE_VIRTUAL_TIME
+    SEGGER_RTT_ConfigUpBuffer(TRACE_RTT_CHANNEL, "trace", trace_rtt_buffer, sizeof(trace_rtt_buffer), SEGGER_RTT_MODE_NO_BLOCK_SKIP);
+#endif
+}
+
+int trace_poll(void)
+{
+    /* Records are only read from the main loop. Writers in ISRs complete their record before returning, so every slot
+     * below the head is complete by the time this runs. */
+    uint32_t head = trace_head;
+    trace_record_t chunk[TRACE_CHUNK_RECORDS];
+    int sent = 0;
+
+    /* Records overwritten by the writers before they could be sent */
+    if (head - trace_tail > TRACE_BUFFER_LEN)
+    {
+        trace_lost += head - trace_tail - TRACE_BUFFER_LEN;
+        trace_tail = head - TRACE_BUFFER_LEN;
+    }
+
+    while (trace_tail != head)
+    {
+        uint32_t n = 0;
+        uint32_t i = 0;
+
+        /* Each chunk starts with the node id and clock so the host can resynchronise at any chunk */
+        chunk[n].cycles = TRACE_NOW();
+        chunk[n].event = TRACE_EV_META;
+        chunk[n].phase = TRACE_META_NODE;
+        chunk[n].arg = trace_node;
+        n++;
+        chunk[n] = chunk[0];
+        chunk[n].phase = TRACE_META_CLOCK_MHZ;
+        chunk[n].arg = TRACE_CLOCK_HZ / 1000000;
+        n++;
+        if (trace_lost)
+        {
+            chunk[n] = chunk[0];
+            chunk[n].phase = TRACE_META_LOST;
+            chunk[n].arg = (trace_lost > 0xFFFF) ? 0xFFFF : (uint16_t)trace_lost;
+            n++;
+        }
+
+        while (n < TRACE_CHUNK_RECORDS && (trace_tail + i) != head)
+        {
+            chunk[n++] = trace_buffer[(trace_tail + i++) & (TRACE_BUFFER_LEN - 1)];
+        }
+
+        if (trace_write(chunk, n * sizeof(trace_record_t)) == 0)
+        {
+            /* RTT buffer full, the host has not caught up yet. Try again on the next call. */
+            break;
+        }
+
+        trace_tail += i;
+        trace_lost = 0;
+        sent += (int)i;
+    }
+
+    return sent;
+}
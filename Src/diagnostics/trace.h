@@ -0,0 +1,173 @@
+/*! ----------------------------------------------------------------------------
+ * @file    trace.h
+ * @brief   Cycle-accurate trace points recorded into a lock-free RAM ring buffer
+ *
+ *          TRACE_BEGIN/TRACE_END/TRACE_INSTANT store an 8-byte record (32-bit cycle count, event id, phase and a
+ *          16-bit argument) into trace_buffer. Recording takes a handful of cycles: one atomic increment to reserve a
+ *          slot, then three stores, so it can be used in ISRs and around SPI transfers without disturbing timing.
+ *
+ *          trace_poll() forwards new records as raw binary on RTT up-channel TRACE_RTT_CHANNEL between ranging
+ *          exchanges. The buffer can also be read with a debugger (trace_buffer and trace_head). Tools/trace_to_perfetto.c
+ *          converts either into Chrome trace / Perfetto JSON.
+ *
+ *          When TRACE_VIRTUAL_TIME is defined (host builds), timestamps come from trace_virtual_cycles, which the
+ *          simulation advances explicitly, and trace_poll() writes to the FILE set with trace_set_output(). Simulated and
+ *          on-target timelines then use the same format and can be loaded side by side.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#ifdef TRACE_VIRTUAL_TIME
+#include <stdio.h>
+#endif
+
+/* Set to 0 to compile all trace points out */
+#define TRACE_ENABLED 1
+
+/* Number of records kept in RAM, must be a power of two. 8 bytes each. */
+#define TRACE_BUFFER_LEN 512
+
+/* RTT up-channel used to stream the records, channel 0 is the text terminal */
+#define TRACE_RTT_CHANNEL 1
+
+/* Size of the RTT up-buffer of TRACE_RTT_CHANNEL, a multiple of the record size */
+#define TRACE_RTT_BUFFER_SIZE 2048
+
+/* Nominal clock of the cycle counter, also used for virtual time so that both timelines share a scale */
+#define TRACE_CLOCK_HZ 64000000
+
+/* Trace events. X(name) expands to TRACE_EV_<name>, the host converter uses the same list for event names. */
+#define TRACE_EVENT_LIST(X)                                                                                                            \
+    X(META)       /* Stream metadata, see trace_meta_e */                                                                            \
+    X(ISR)        /* DW IC interrupt service, arg: none */                                                                           \
+    X(SPI_WRITE)  /* SPI write transaction, arg: bytes */                                                                            \
+    X(SPI_READ)   /* SPI read transaction, arg: bytes */                                                                             \
+    X(TX_ARM)     /* dwt_starttx() called, arg: frame length */                                                                       \
+    X(TX_DONE)    /* TX frame sent event seen, arg: frame length */                                                                   \
+    X(RX_WAIT)    /* Waiting for a frame, arg: expected sender or 0xFF */                                                             \
+    X(RX_DONE)    /* Good frame received, arg: frame length */                                                                        \
+    X(RX_FAIL)    /* RX timeout or error, arg: low 16 bits of the status register */                                                 \
+    X(EXCHANGE)   /* Ranging exchange, arg: peer */                                                                                  \
+    X(BACKGROUND) /* Background services between exchanges, arg: none */
+
+#define TRACE_EV_ENUM(name) TRACE_EV_##name,
+
+    typedef enum
+    {
+        TRACE_EVENT_LIST(TRACE_EV_ENUM) TRACE_EV_COUNT
+    } trace_event_e;
+
+    /* Record phases, mapped to the Chrome trace "ph" field */
+    typedef enum
+    {
+        TRACE_PH_INSTANT = 0,
+        TRACE_PH_BEGIN,
+        TRACE_PH_END
+    } trace_phase_e;
+
+    /* Kinds of TRACE_EV_META records, carried in the phase field */
+    typedef enum
+    {
+        TRACE_META_NODE = 0, /* arg: node id, starts every chunk of records sent by trace_poll() */
+        TRACE_META_CLOCK_MHZ, /* arg: cycle counter clock in MHz */
+        TRACE_META_LOST       /* arg: records overwritten before they could be sent (saturated) */
+    } trace_meta_e;
+
+    /* One trace record, little-endian on the wire */
+    typedef struct
+    {
+        uint32_t cycles;
+        uint8_t event;
+        uint8_t phase;
+        uint16_t arg;
+    } trace_record_t;
+
+    extern trace_record_t trace_buffer[TRACE_BUFFER_LEN];
+
+    /* Total number of records reserved since boot, the next slot is trace_head % TRACE_BUFFER_LEN */
+    extern volatile uint32_t trace_head;
+
+#ifdef TRACE_VIRTUAL_TIME
+    /* Virtual cycle counter of host builds, advanced by the simulation */
+    extern uint32_t trace_virtual_cycles;
+#define TRACE_NOW() (trace_virtual_cycles)
+#define TRACE_ADVANCE(cycles) (trace_virtual_cycles += (uint32_t)(cycles))
+#else
+    uint32_t port_get_cycles(void);
+#define TRACE_NOW() port_get_cycles()
+#define TRACE_ADVANCE(cycles)
+#endif
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn trace_record()
+     *
+     * @brief Stores one record. Reserving the slot is a single atomic increment, so concurrent writers (main loop and
+     *        ISRs) never lock each other out. Use the TRACE_* macros rather than calling this directly.
+     *
+     * @return none
+     */
+    static inline void trace_record(uint8_t event, uint8_t phase, uint16_t arg)
+    {
+        uint32_t slot = __atomic_fetch_add(&trace_head, 1, __ATOMIC_RELAXED) & (TRACE_BUFFER_LEN - 1);
+        trace_record_t *rec = &trace_buffer[slot];
+
+        rec->cycles = TRACE_NOW();
+        rec->event = event;
+        rec->phase = phase;
+        rec->arg = arg;
+    }
+
+#if TRACE_ENABLED
+#define TRACE_BEGIN(ev, arg) trace_record(TRACE_EV_##ev, TRACE_PH_BEGIN, (uint16_t)(arg))
+#define TRACE_END(ev, arg) trace_record(TRACE_EV_##ev, TRACE_PH_END, (uint16_t)(arg))
+#define TRACE_INSTANT(ev, arg) trace_record(TRACE_EV_##ev, TRACE_PH_INSTANT, (uint16_t)(arg))
+#else
+#define TRACE_BEGIN(ev, arg)
+#define TRACE_END(ev, arg)
+#define TRACE_INSTANT(ev, arg)
+#endif
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn trace_init()
+     *
+     * @brief Sets up the RTT channel (or nothing on host builds) and remembers the node id written in the stream.
+     *
+     * @param node - id of this node, used as the process id in the converted trace
+     *
+     * @return none
+     */
+    void trace_init(uint8_t node);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn trace_poll()
+     *
+     * @brief Background service. Sends the records recorded since the previous call, as many as fit in the RTT buffer,
+     *        the rest are sent on the next call. Must not be called while a timing-critical exchange is in progress.
+     *
+     * @return number of records sent
+     */
+    int trace_poll(void);
+
+#ifdef TRACE_VIRTUAL_TIME
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn trace_set_output()
+     *
+     * @brief Host builds only, selects the file trace_poll() writes to.
+     *
+     * @return none
+     */
+    void trace_set_output(FILE *out);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRACE_H_ */
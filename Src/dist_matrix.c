@@ -1,4 +1,3 @@
-
 /**
  * Firmware module for building a distributed distance matrix among N nodes
  * Nodes will be uniquely identified by an ID in {0,..., N-1}
@@ -9,14 +8,29 @@
  */
 
 #include "deca_probe_interface.h"
+#include <airtime.h>
+#include <cca.h>
+#include <chan_hop.h>
+#include <console.h>
 #include <config_options.h>
 #include <deca_device_api.h>
 #include <deca_spi.h>
+#include <event_counters.h>
 #include <example_selection.h>
+#include <link_phy.h>
+#include <link_pwr.h>
+#include <mac_mhr.h>
+#include <mem_usage.h>
+#include <pdoa_angle.h>
+#include <phy_profile.h>
 #include <port.h>
+#include <rf_cal.h>
 #include <shared_defines.h>
 #include <shared_functions.h>
 #include <stdio.h>
+#include <sts_link.h>
+#include <trace.h>
+#include <twr_timing.h>
 
 /* Example application name */
 #define APP_NAME "SS TWR DIST CONN MAT"
@@ -26,121 +40,133 @@
 #define NUM_DEVICES 2
 #define SET_INIT_DEV (DEVICE_ID + 1) % NUM_DEVICES
 
+/* Pull the rows of the matrix to a collector node with frame-pending acknowledgements instead of passing the whole
+ * matrix with the token, see dm_frames.h and row_pull_collect(). 0 passes the matrix with the token. */
+#define DM_ROW_PULL 1
+#define DM_COLLECTOR_ID 0
+
+/* Range with SP3 packets, which carry no payload, and pass the timestamps with the token, see dm_frames.h and
+ * sp3_round(). The per-link preamble and power adaptation ride on the poll's payload, they stay on the profile's. 0 ranges
+ * with data frames. */
+#define DM_SP3_RANGING 0
+
+/* Frame layouts, sized by NUM_DEVICES */
+#include <dm_frames.h>
+
+/* SP3 packets are recognised by their STS alone */
+FS_STATIC_ASSERT(!DM_SP3_RANGING || STS_LINK_MODE != DWT_STS_MODE_OFF, dm_sp3_needs_sts);
+
+/* Print an "RNG <src> <dst> <distance>" record for every completed exchange, decoded by Tools/rtt_decoder.c, followed by
+ * an "AOA <src> <dst> <degrees>" record when the response gave a valid angle of arrival. 0 disables. */
+#define PRINT_RANGING_RECORDS 1
+
 /* Connectivity components */
 static double connectivity_list[NUM_DEVICES];
 static double connectivity_matrix[NUM_DEVICES][NUM_DEVICES];
 
-/* Message definitions */
-
-#define TYPE_ITITIATOR 0  // Message type indicating it's the receving node's turn to be an initiator 
-#define TYPE_RANGING 1  // Message type indicating the sending node wants a response from the sender (for ranging) 
-#define TYPE_RESPONSE 2 // Message type indicating the sending node is a responder responding to a ranging request
+/* Angle of arrival of the last response from every peer, next to its distance (pdoa_angle.h) */
+static pdoa_bearing_t bearing_list[NUM_DEVICES];
 
-/**
- * Modified polling and response messages. See either ss_twr_initiator.c or ss_twr_responder.c for details
- */
-static uint8_t poll_msg[] = { 0x41, 0x88, 0, 0xCA, 0xDE, 0, 0, 0, 0, 0xE0, 0, 0 };
-static uint8_t resp_msg[] = { 0x41, 0x88, 0, 0xCA, 0xDE, 0, 0, 0, 0, 0xE1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+/* Last airtime report of every node, passed around with the connectivity matrix */
+static airtime_report_t network_airtime[NUM_DEVICES];
 
-/**
- * @struct message_header
- * @brief Contains metadata related to a transmitted message
- * 
- * Struct stores message metadata:
- *  Type of message
- *  Source device (ID of sender)
- *  Destination device (ID of intended recipient)
- */
-typedef struct message_header{
-    uint8_t type;
-    uint8_t src;
-    uint8_t dest;
-} message_header;
+/* Node currently holding the initiator token, as far as we know. Responders preload the STS IV of the pair they form
+ * with it. */
+static uint8_t cur_initiator = 0;
 
-/**
- * @struct message_payload
- * @brief Contains the payload (data) for a transmitted message
- * 
- * For ease of implementation, contains all possible data sent, even though at most one field
- * will be used for each transmission
- * In the future, it would be ideal if we weren't sending such large packets since so much information
- * is being unused.
- */
-typedef struct  message_payload{
-    uint8_t poll_msg[12];
-    uint8_t resp_msg[20];
-    double connectivity_matrix[NUM_DEVICES][NUM_DEVICES];
-    uint8_t crc[2]; // TODO: confirm this is necessary due to transmision cutting off last 2 bytes
-} message_payload;
+/* Frame lengths on air, MHR and FCS included */
+#define POLL_FRAME_LEN  (DM_MHR_LEN + dm_poll_SIZE + FCS_LEN)
+#define RESP_FRAME_LEN  (DM_MHR_LEN + dm_resp_SIZE + FCS_LEN)
+#define TOKEN_FRAME_LEN (DM_MHR_LEN + dm_token_SIZE + FCS_LEN)
+#define ROW_FRAME_LEN   (DM_MHR_LEN + dm_row_SIZE + FCS_LEN)
+#define PULL_FRAME_LEN  (RANGING_DATA_REQUEST_LEN(DM_RANGING_PROFILE) + FCS_LEN)
+#define MAX_FRAME_LEN   ((TOKEN_FRAME_LEN > ROW_FRAME_LEN) ? TOKEN_FRAME_LEN : ROW_FRAME_LEN)
 
-/**
- * @struct messsage
- * @brief A struct representing a message to be trasnmitted, containing header and payload
- * 
- */
-typedef struct message{
-    message_header header;
-    message_payload payload;
-} message;
+/* Frame buffers, see dm_frames.h for the layout of each frame */
+static uint8_t tx_buf[MAX_FRAME_LEN];
+static uint8_t rx_buf[MAX_FRAME_LEN];
 
 /* Configuration Steps - See either ss_twr_initiator.c or ss_twr_responder.c for more details */
 
-/* Default communication configuration. We use default non-STS DW mode. */
-static dwt_config_t config = {
-    5,                /* Channel number. */
-    DWT_PLEN_128,     /* Preamble length. Used in TX only. */
-    DWT_PAC8,         /* Preamble acquisition chunk size. Used in RX only. */
-    9,                /* TX preamble code. Used in TX only. */
-    9,                /* RX preamble code. Used in RX only. */
-    1,                /* 0 to use standard 8 symbol SFD, 1 to use non-standard 8 symbol, 2 for non-standard 16 symbol SFD and 3 for 4z 8 symbol SDF type */
-    DWT_BR_6M8,       /* Data rate. */
-    DWT_PHRMODE_STD,  /* PHY header mode. */
-    DWT_PHRRATE_STD,  /* PHY header rate. */
-    (129 + 8 - 8),    /* SFD timeout (preamble length + 1 + SFD length - PAC size). Used in RX only. */
-    DWT_STS_MODE_OFF, /* STS disabled */
-    DWT_STS_LEN_64,   /* STS length see allowed values in Enum dwt_sts_lengths_e */
-    DWT_PDOA_M0       /* PDOA mode off */
-};
-
-/* Inter-ranging delay period, in milliseconds. */
+/* Communication configuration. The PHY settings come from the network's radio profile (phy_profile_apply()), the
+ * channel from the hopping schedule (chan_hop_apply()), the STS mode and length are set by sts_link_apply() before
+ * every dwt_configure(). */
+static dwt_config_t config;
+
+/* Inter-ranging delay period, in milliseconds. Scaled up by evc_ranging_delay_ms() when the channel is noisy. */
 #define RNG_DELAY_MS 1000
 
+/* Number of ranging attempts per peer and round before moving on to the next peer. Cut by evc_retry_limit(). */
+#define RANGING_MAX_ATTEMPTS 5
+
 /* Default antenna delay values for 64 MHz PRF. */
 #define TX_ANT_DLY 16385
 #define RX_ANT_DLY 16385
 
 
-/* Length of the common part of the message (up to and including the function code). */
-#define ALL_MSG_COMMON_LEN 10
-/* Indexes to access some of the fields in the frames defined above. */
-#define ALL_MSG_SN_IDX          2
-#define RESP_MSG_POLL_RX_TS_IDX 10
-#define RESP_MSG_RESP_TX_TS_IDX 14
-#define RESP_MSG_TS_LEN         4
-
 /* Frame sequence number, incremented after each transmission. */
 static uint8_t frame_seq_nb = 0;
 
 /* Hold copy of status register state here for reference so that it can be examined at a debug breakpoint. */
 static uint32_t status_reg = 0;
 
-/* Delay between frames, in UWB microseconds. */
-#define POLL_TX_TO_RESP_RX_DLY_UUS 240
-/* Receive response timeout. */
-#define RESP_RX_TIMEOUT_UUS 400
+/* The delay between the poll and the response and the response timeout are worked out for every exchange, see twr_timing.h */
+
+/* Responder RX timeout, so that the listen loop wakes up periodically to run background services. */
+#define RESP_IDLE_RX_TIMEOUT_UUS 50000
+
+#if DM_ROW_PULL
+/* A node offers its row to the collector once one of its distances moved by more than this since it was last pulled, in metres */
+#define ROW_CHANGE_M 0.05
+
+/* Receive timeouts of a pull: the acknowledgement follows the data request at once, the row comes from the node's firmware */
+#define PULL_ACK_RX_TIMEOUT_UUS 400
+#define PULL_ROW_RX_TIMEOUT_UUS 1000
+
+/* Row last delivered to the collector, and whether the current row differs enough from it to be offered */
+static double pulled_row[NUM_DEVICES];
+static uint8_t row_pending = 0;
+
+/* Pulls done by the collector: data requests sent, rows received, requests answered with nothing pending, requests or
+ * rows that never arrived, and the airtime the unchanged rows did not use */
+typedef struct
+{
+    uint32_t requests;
+    uint32_t rows;
+    uint32_t unchanged;
+    uint32_t lost;
+    uint64_t saved_ns;
+} pull_stats_t;
+
+static pull_stats_t pull_stats;
+#endif
 
-/* Delay between frames, in UWB microseconds. */
-#define POLL_RX_TO_RESP_TX_DLY_UUS 650
+#if DM_SP3_RANGING
+/* How long a responder listens for its SP3 poll once a token has named the next initiator, which first resets and
+ * reconfigures its DW IC, in milliseconds */
+#define SP3_POLL_WAIT_MS 50
+
+/* Exchanges of our round, sent with the token */
+static dm_sp3_t sp3_report[NUM_DEVICES];
+
+/* Last SP3 exchange we answered, waiting for the initiator's half of the timestamps */
+typedef struct
+{
+    uint8_t initiator; /* 0xFF when none */
+    uint32_t sts_count;
+    uint64_t poll_rx_ts;
+    uint64_t resp_tx_ts;
+    pdoa_bearing_t bearing;
+} sp3_pending_t;
+
+static sp3_pending_t sp3_pending = { 0xFF };
+#endif
 
 
 /* Hold copies of computed time of flight and distance here for reference so that it can be examined at a debug breakpoint. */
 static double tof;
 static double distance;
 
-/* Values for the PG_DELAY and TX_POWER registers reflect the bandwidth and power of the spectrum at the current
- * temperature. These values can be calibrated prior to taking reference measurements. */
-extern dwt_txconfig_t txconfig_options;
-
 
 /**
  * @fn print_matrix
@@ -157,6 +183,101 @@ void print_matrix(){
 }
 
 
+/**
+ * @fn follow_phy_profile
+ * Moves the DW IC to the network's new radio profile once the switch time announced in the frames has come
+ */
+static void follow_phy_profile(){
+    if(phy_profile_poll()){
+        phy_profile_apply(&config);
+        chan_hop_apply(&config);
+        link_phy_apply(&config);
+        sts_link_apply(&config);
+        pdoa_angle_apply(&config);
+        if (dwt_configure(&config))
+        {
+            printf("CONFIG FAILED\n");
+        }
+        sts_link_start();
+        cca_set_config(&config);
+        rf_cal_start(chan_hop_txconfig(config.chan));
+        dwt_configuretxrf(chan_hop_txconfig(config.chan));
+        link_pwr_start(config.chan, chan_hop_txconfig(config.chan));
+        phy_profile_print();
+
+        /* Every link starts again from the new profile's preamble */
+        link_phy_init(airtime_preamble_symbols(config.txPreambLength));
+    }
+}
+
+
+/**
+ * @fn follow_channel
+ * Moves the DW IC to the channel of the current dwell. Waits out the guard time around a hop first, so that nothing is
+ * sent while the other nodes retune. Called between ranging exchanges, never during one.
+ */
+static void follow_channel(){
+    uint32_t wait_ms = chan_hop_guard_ms();
+    uint32_t start;
+    uint8_t chan;
+
+    if(wait_ms){
+        Sleep(wait_ms);
+    }
+    chan = chan_hop_poll();
+    if(chan == 0 || chan == config.chan){
+        return;
+    }
+
+    /* Only the channel changes: the frame filter and antenna delays survive dwt_configure() */
+    start = port_get_cycles();
+    config.chan = chan;
+    if (dwt_configure(&config))
+    {
+        printf("CONFIG FAILED\n");
+    }
+    sts_link_start();
+    rf_cal_start(chan_hop_txconfig(config.chan));
+    dwt_configuretxrf(chan_hop_txconfig(config.chan));
+    link_pwr_start(config.chan, chan_hop_txconfig(config.chan));
+    chan_hop_retuned(start);
+}
+
+
+/**
+ * @fn service_background
+ * Runs the periodic background services. Called between ranging exchanges, never during one.
+ */
+static void service_background(){
+    TRACE_BEGIN(BACKGROUND, 0);
+    follow_phy_profile();
+    follow_channel();
+    rf_cal_poll();
+    evc_poll();
+    airtime_poll();
+    mem_poll();
+    console_poll();
+    trace_poll();
+    TRACE_END(BACKGROUND, 0);
+}
+
+
+/**
+ * @fn follow_sts_length
+ * Adopts the network STS length carried in a received frame, reconfiguring the DW IC when it changed
+ */
+static void follow_sts_length(uint8_t sts_len){
+    if(sts_link_follow(sts_len)){
+        sts_link_apply(&config);
+        if (dwt_configure(&config))
+        {
+            printf("CONFIG FAILED\n");
+        }
+        sts_link_start();
+    }
+}
+
+
 /**
  * @fn update_matrix
  * Utility function that copies the connectivity list into the appropriate entry
@@ -164,15 +285,430 @@ void print_matrix(){
  */
 void update_matrix(){
     memcpy(&connectivity_matrix[DEVICE_ID], &connectivity_list[0], NUM_DEVICES * sizeof(double));
+
+#if DM_ROW_PULL
+    /* Offer the row to the collector once it has really changed */
+    for(int i=0; i<NUM_DEVICES; i++){
+        double moved = connectivity_list[i] - pulled_row[i];
+        if(moved > ROW_CHANGE_M || moved < -ROW_CHANGE_M){
+            row_pending = 1;
+        }
+    }
+#endif
+}
+
+
+#if DM_ROW_PULL
+/**
+ * @fn row_pull_arm
+ * Sets the frame filter of a responder: frames addressed to us are accepted, and the collector's data requests are
+ * acknowledged by the DW IC with the frame pending bit set when our row is pending (LE0_PEND holds the collector's address)
+ */
+static void row_pull_arm(){
+    dwt_configureframefilter(DWT_FF_ENABLE_802_15_4, DWT_FF_DATA_EN | (row_pending ? DWT_FF_MAC_LE0_EN : DWT_FF_MAC_EN));
+}
+
+
+/**
+ * @fn row_pull_ack_wait
+ * Waits for the acknowledgement the DW IC sends on its own for a received frame in rx_buf that requested one, it must be
+ * sent before we transmit anything
+ */
+static void row_pull_ack_wait(){
+    if(rx_buf[0] & MAC_MHR_FC_ACK_REQUEST){
+        waitforsysstatus(NULL, NULL, DWT_INT_TXFRS_BIT_MASK, 0);
+        dwt_writesysstatuslo(DWT_INT_TXFRS_BIT_MASK);
+        airtime_note_tx(RANGING_ACK_FRAME_LEN);
+    }
+}
+
+
+/**
+ * @fn row_pull_serve
+ * Responder side of a pull, for a data request in rx_buf. The DW IC has already acknowledged the frame; when the
+ * acknowledgement said our row was pending, the row follows it at once.
+ */
+static void row_pull_serve(const ranging_addr_t *rx_addr, uint16_t frame_len){
+    ranging_addr_t tx_addr = { 0 };
+    dm_row_t row = { { 0 } };
+
+    if(rx_addr->src != DM_COLLECTOR_ID || !row_pending){
+        return;
+    }
+    airtime_note_rx_useful(frame_len);
+
+    tx_addr.seq = frame_seq_nb++;
+    tx_addr.pan_id = DM_PAN_ID;
+    tx_addr.dest = DM_COLLECTOR_ID;
+    tx_addr.src = DEVICE_ID;
+    row.hdr.type = DM_TYPE_ROW;
+    row.hdr.sts_len = sts_link_length();
+    phy_profile_announce(&row.hdr.phy_next, &row.hdr.phy_in_ms);
+    chan_hop_announce(&row.hdr.hop_seq, &row.hdr.hop_in_ms, row.hdr.hop_bl);
+    memcpy(row.row, connectivity_list, sizeof(row.row));
+    ranging_mhr_write(tx_buf, DM_RANGING_PROFILE, &tx_addr);
+    dm_row_put(&tx_buf[DM_MHR_LEN], &row);
+    dwt_writetxdata(ROW_FRAME_LEN - FCS_LEN, tx_buf, 0);
+    dwt_writetxfctrl(ROW_FRAME_LEN, 0, 0);
+    TRACE_INSTANT(TX_ARM, ROW_FRAME_LEN);
+    dwt_starttx(DWT_START_TX_IMMEDIATE);
+    airtime_note_tx(ROW_FRAME_LEN);
+    waitforsysstatus(NULL, NULL, DWT_INT_TXFRS_BIT_MASK, 0);
+    TRACE_INSTANT(TX_DONE, ROW_FRAME_LEN);
+    dwt_writesysstatuslo(DWT_INT_TXFRS_BIT_MASK);
+
+    /* Rows are not acknowledged: a lost row is offered again once the row has changed again */
+    memcpy(pulled_row, connectivity_list, sizeof(pulled_row));
+    row_pending = 0;
+    row_pull_arm();
+}
+
+
+/**
+ * @fn pull_receive
+ * Waits for a frame of a pull, reception starting rx_offset_us from now. Returns 1 with the frame in rx_buf.
+ */
+static int pull_receive(uint32_t rx_offset_us, uint16_t *frame_len){
+    airtime_rx_begin(rx_offset_us);
+    waitforsysstatus(&status_reg, NULL, (DWT_INT_RXFCG_BIT_MASK | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR), 0);
+    airtime_rx_end();
+
+    if(!(status_reg & DWT_INT_RXFCG_BIT_MASK)){
+        TRACE_INSTANT(RX_FAIL, status_reg);
+        dwt_writesysstatuslo(SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR);
+        return 0;
+    }
+    dwt_writesysstatuslo(DWT_INT_RXFCG_BIT_MASK);
+    *frame_len = dwt_getframelength();
+    TRACE_INSTANT(RX_DONE, *frame_len);
+    if(*frame_len < FCS_LEN || *frame_len > sizeof(rx_buf)){
+        return 0;
+    }
+    dwt_readrxdata(rx_buf, *frame_len - FCS_LEN, 0);
+    airtime_note_rx_useful(*frame_len);
+    return 1;
+}
+
+
+/**
+ * @fn row_pull_collect
+ * Collector side: sends a data request to every node and receives the row of those whose acknowledgement has its frame
+ * pending bit set. A node whose row has not changed costs a data request and a 5-byte acknowledgement, no row frame.
+ */
+static void row_pull_collect(){
+    ranging_addr_t addr = { 0 }, rx_addr;
+    uint16_t frame_len;
+    uint8_t len;
+
+    addr.pan_id = DM_PAN_ID;
+    addr.src = DEVICE_ID;
+
+    /* The acknowledgement follows the request at once */
+    dwt_setrxaftertxdelay(0);
+
+    for(uint8_t node = 0; node < NUM_DEVICES; node++){
+        int pending = -1;
+
+        if(node == DEVICE_ID){
+            continue;
+        }
+
+        TRACE_BEGIN(EXCHANGE, node);
+        addr.dest = node;
+        addr.seq = frame_seq_nb++;
+        len = ranging_data_request_write(tx_buf, DM_RANGING_PROFILE, &addr);
+        dwt_writesysstatuslo(DWT_INT_TXFRS_BIT_MASK);
+        dwt_writetxdata(len, tx_buf, 0);
+        dwt_writetxfctrl(PULL_FRAME_LEN, 0, 0);
+        dwt_setrxtimeout(PULL_ACK_RX_TIMEOUT_UUS + sts_link_duration_uus());
+        TRACE_INSTANT(TX_ARM, PULL_FRAME_LEN);
+        dwt_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED);
+        airtime_note_tx(PULL_FRAME_LEN);
+        pull_stats.requests++;
+
+        if(pull_receive(airtime_frame_duration_ns(&config, PULL_FRAME_LEN) / 1000, &frame_len) && frame_len == RANGING_ACK_FRAME_LEN){
+            pending = ranging_ack_read(rx_buf, frame_len - FCS_LEN, addr.seq);
+        }
+
+        if(pending < 0){
+            pull_stats.lost++;
+        }
+        else if(!pending){
+            /* Nothing new, the acknowledgement replaced the row frame */
+            pull_stats.unchanged++;
+            pull_stats.saved_ns += airtime_frame_duration_ns(&config, ROW_FRAME_LEN);
+        }
+        else{
+            dwt_setrxtimeout(PULL_ROW_RX_TIMEOUT_UUS + sts_link_duration_uus());
+            dwt_rxenable(DWT_START_RX_IMMEDIATE);
+            if(pull_receive(0, &frame_len) && frame_len == ROW_FRAME_LEN
+               && ranging_mhr_read(DM_RANGING_PROFILE, rx_buf, frame_len - FCS_LEN, &rx_addr) && rx_addr.src == node && rx_addr.dest == DEVICE_ID
+               && dm_row_get_hdr(&rx_buf[DM_MHR_LEN]).type == DM_TYPE_ROW){
+                dm_row_get_row(&rx_buf[DM_MHR_LEN], connectivity_matrix[node]);
+                pull_stats.rows++;
+            }
+            else{
+                pull_stats.lost++;
+            }
+        }
+        TRACE_END(EXCHANGE, node);
+    }
+}
+
+
+/**
+ * @fn row_pull_print
+ * Prints the "PULL" line of the collector: requests, rows received, nodes with nothing new and the airtime they saved
+ */
+static void row_pull_print(){
+    printf("PULL requests=%lu rows=%lu unchanged=%lu lost=%lu saved=%luus\n", (unsigned long)pull_stats.requests, (unsigned long)pull_stats.rows,
+        (unsigned long)pull_stats.unchanged, (unsigned long)pull_stats.lost, (unsigned long)(pull_stats.saved_ns / 1000));
+}
+#endif
+
+
+/**
+ * @fn sp3_packet_ns
+ * Airtime of an SP3 packet in the active configuration: preamble, SFD and STS
+ */
+static uint32_t sp3_packet_ns(){
+    dwt_config_t nd = config;
+
+    nd.stsMode = DWT_STS_MODE_ND;
+    return airtime_frame_duration_ns(&nd, 0);
+}
+
+
+/**
+ * @fn sp3_print_airtime
+ * Prints the "RANGING" lines comparing a round of SP3 exchanges, whose timestamps make the token longer, with a round of
+ * data exchanges: airtime of one exchange and of the round with its token, and the exchanges per second of airtime
+ */
+static void sp3_print_airtime(){
+    uint16_t token_len = TOKEN_FRAME_LEN - DM_TOKEN_NEXT_SIZE - DM_TOKEN_SP3_SIZE;
+    uint32_t ex_ns[2], round_ns[2];
+    int m;
+
+    ex_ns[0] = 2 * sp3_packet_ns();
+    round_ns[0] = (NUM_DEVICES - 1) * ex_ns[0] + airtime_frame_duration_ns(&config, token_len + 1 + dm_sp3_SIZE * NUM_DEVICES);
+    ex_ns[1] = airtime_frame_duration_ns(&config, POLL_FRAME_LEN) + airtime_frame_duration_ns(&config, RESP_FRAME_LEN);
+    round_ns[1] = (NUM_DEVICES - 1) * ex_ns[1] + airtime_frame_duration_ns(&config, token_len + DM_ROW_PULL);
+
+    for(m = 0; m < 2; m++){
+        printf("RANGING %s exchange=%lu.%luus round=%luus rate=%lu/s%s\n", m ? "data" : "sp3", (unsigned long)(ex_ns[m] / 1000),
+            (unsigned long)((ex_ns[m] / 100) % 10), (unsigned long)(round_ns[m] / 1000),
+            (unsigned long)((uint64_t)(NUM_DEVICES - 1) * 1000000000 / round_ns[m]), (m == !DM_SP3_RANGING) ? " (in use)" : "");
+    }
+    printf("RANGING saved=%luus per round (%lu/1000 of its airtime)\n", (unsigned long)((round_ns[1] - round_ns[0]) / 1000),
+        (unsigned long)((uint64_t)(round_ns[1] - round_ns[0]) * 1000 / round_ns[1]));
 }
 
 
+/**
+ * @fn token_next
+ * Next initiator named by a received token: its destination, or when the token is broadcast, the field that names it
+ */
+static uint8_t token_next(const ranging_addr_t *rx_addr){
+#if DM_TOKEN_BROADCAST
+    (void)rx_addr;
+    return dm_token_get_next(&rx_buf[DM_MHR_LEN]);
+#else
+    return (uint8_t)rx_addr->dest;
+#endif
+}
+
+
+#if DM_SP3_RANGING
+/**
+ * @fn sp3_mode
+ * Switches the DW IC between SP3 packets and the protocol's STS mode, keeping config in step for the airtime accounting
+ */
+static void sp3_mode(int on){
+    sts_link_apply(&config);
+    if(on){
+        config.stsMode = DWT_STS_MODE_ND;
+    }
+    dwt_configurestsmode(config.stsMode);
+}
+
+
+/**
+ * @fn sp3_round
+ * Initiator side of SP3 ranging: one poll and response with every other node, back to back. Each poll is addressed by
+ * the STS of the pair alone, the other responders' STS does not correlate with it. Only our half of the timestamps is
+ * known here, it goes to the responders with the token.
+ */
+static void sp3_round(){
+    uint32_t packet_ns = sp3_packet_ns();
+    uint32_t rx_on_us;
+    twr_timing_t timing;
+
+    /* Both sides work the delay out from the configuration, there is no payload to agree on it. A missing response ends
+     * the exchange with its arrival window. */
+    sp3_mode(1);
+    timing = twr_timing_sp3();
+    dwt_setrxaftertxdelay(timing.rx_dly_uus);
+    dwt_setrxtimeout(timing.rx_timeout_uus);
+    dwt_setpreambledetecttimeout(twr_timing_pto_pacs());
+    dwt_writetxfctrl(0, 0, 1);
+
+    for(uint8_t peer = 0; peer < NUM_DEVICES; peer++){
+        if(peer == DEVICE_ID){
+            continue;
+        }
+
+        TRACE_BEGIN(EXCHANGE, peer);
+        sp3_report[peer].valid = 0;
+        sp3_report[peer].sts_count = sts_link_begin(peer);
+
+        dwt_writesysstatuslo(DWT_INT_TXFRS_BIT_MASK);
+        TRACE_INSTANT(TX_ARM, 0);
+        dwt_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED);
+        airtime_note_tx(0);
+        airtime_rx_begin(packet_ns / 1000 + timing.rx_dly_uus);
+        TRACE_BEGIN(RX_WAIT, peer);
+        waitforsysstatus(&status_reg, NULL, (DWT_INT_RXFR_BIT_MASK | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_ND_RX_ERR), 0);
+        TRACE_END(RX_WAIT, peer);
+        rx_on_us = airtime_rx_end();
+
+        /* Without a payload there is no frame check, only the STS tells the response is the pair's. A response at all
+         * means the responder found our poll's STS valid. */
+        if((status_reg & DWT_INT_RXFR_BIT_MASK) && sts_link_check(1)){
+            dwt_writesysstatuslo(SYS_STATUS_ALL_RX_GOOD);
+            airtime_note_rx_useful(0);
+            sp3_report[peer].poll_tx_ts = dwt_readtxtimestamplo32();
+            sp3_report[peer].resp_rx_ts = dwt_readrxtimestamplo32();
+            sp3_report[peer].valid = 1;
+        }
+        else{
+            TRACE_INSTANT(RX_FAIL, status_reg);
+            dwt_writesysstatuslo(SYS_STATUS_ALL_RX_GOOD | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR | SYS_STATUS_ALL_ND_RX_ERR);
+            twr_timing_note_miss(&timing, status_reg, rx_on_us);
+        }
+        chan_hop_note(config.chan, sp3_report[peer].valid);
+        TRACE_END(EXCHANGE, peer);
+    }
+    cca_restore_rx();
+    sp3_mode(0);
+}
+
+
+/**
+ * @fn sp3_respond
+ * Responder side of SP3 ranging: listens for the next initiator's poll, told apart from those to the other responders
+ * by the STS of our pair, and answers it. Gives up after SP3_POLL_WAIT_MS.
+ */
+static void sp3_respond(uint8_t initiator_id){
+    uint32_t start_ms = port_get_tick_ms();
+    uint32_t count, resp_tx_time;
+    uint64_t poll_rx_ts;
+    int16_t sts_qual;
+    uint16_t sts_status;
+
+    sp3_mode(1);
+    dwt_writetxfctrl(0, 0, 1);
+    while(port_get_tick_ms() - start_ms < SP3_POLL_WAIT_MS){
+        /* Every reception uses the IV up, it is loaded again for each one */
+        count = sts_link_load(initiator_id);
+        airtime_rx_begin(0);
+        dwt_rxenable(DWT_START_RX_IMMEDIATE);
+        TRACE_BEGIN(RX_WAIT, initiator_id);
+        waitforsysstatus(&status_reg, NULL, (DWT_INT_RXFR_BIT_MASK | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_ND_RX_ERR), 0);
+        TRACE_END(RX_WAIT, initiator_id);
+        airtime_rx_end();
+
+        if(!(status_reg & DWT_INT_RXFR_BIT_MASK)){
+            dwt_writesysstatuslo(SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR | SYS_STATUS_ALL_ND_RX_ERR);
+            continue;
+        }
+        dwt_writesysstatuslo(SYS_STATUS_ALL_RX_GOOD);
+
+        /* A packet whose STS does not correlate was for another responder */
+        if(dwt_readstsquality(&sts_qual) < 0 || dwt_readstsstatus(&sts_status, 0) != DWT_SUCCESS){
+            continue;
+        }
+        sts_link_accept(initiator_id, count);
+        airtime_note_rx_useful(0);
+
+        poll_rx_ts = get_rx_timestamp_u64();
+        resp_tx_time = (poll_rx_ts + TWR_TIMING_US_TO_DWT(twr_timing_sp3().reply_us)) >> 8;
+        dwt_setdelayedtrxtime(resp_tx_time);
+        TRACE_INSTANT(TX_ARM, 0);
+        twr_timing_measure(poll_rx_ts, 0);
+        if(dwt_starttx(DWT_START_TX_DELAYED) != DWT_SUCCESS){
+            twr_timing_note_late();
+        }
+        else{
+            airtime_note_tx(0);
+            waitforsysstatus(NULL, NULL, DWT_INT_TXFRS_BIT_MASK, 0);
+            TRACE_INSTANT(TX_DONE, 0);
+            dwt_writesysstatuslo(DWT_INT_TXFRS_BIT_MASK);
+
+            /* Our half of the timestamps, until the initiator's comes with its token */
+            sp3_pending.initiator = initiator_id;
+            sp3_pending.sts_count = count;
+            sp3_pending.poll_rx_ts = poll_rx_ts;
+            sp3_pending.resp_tx_ts = (((uint64_t)(resp_tx_time & 0xFFFFFFFEUL)) << 8) + TX_ANT_DLY;
+            sp3_pending.bearing = pdoa_angle_read(config.chan);
+        }
+        break;
+    }
+    sp3_mode(0);
+}
+
+
+/**
+ * @fn sp3_collect
+ * Responder side of SP3 ranging: completes the exchange we answered with the initiator's half of the timestamps,
+ * carried by its token, now in rx_buf, and records the distance
+ */
+static void sp3_collect(uint8_t src){
+    dm_sp3_t ours;
+    int32_t rtd_init, rtd_resp;
+    float clockOffsetRatio;
+
+    /* Carrier integrator of the token, sent on the initiator's clock */
+    clockOffsetRatio = ((float)dwt_readclockoffset()) / (uint32_t)(1 << 26);
+    dm_sp3_get(&rx_buf[DM_MHR_LEN + dm_token_OFF_sp3 + DEVICE_ID * dm_sp3_SIZE], &ours);
+
+    /* Whether or not we heard the poll, the pair's counter moves on with the initiator's. The token is not
+     * authenticated, so one whose counter is behind ours is ignored rather than allowed to move it back */
+    if(!sts_link_sync(src, ours.sts_count)){
+        sp3_pending.initiator = 0xFF;
+        return;
+    }
+
+    if(sp3_pending.initiator != src || sp3_pending.sts_count != ours.sts_count || !ours.valid){
+        sp3_pending.initiator = 0xFF;
+        return;
+    }
+    sp3_pending.initiator = 0xFF;
+
+    /* As in the initiator's computation, with the roles swapped: here the initiator's interval is on the other clock */
+    rtd_init = ours.resp_rx_ts - ours.poll_tx_ts;
+    rtd_resp = (uint32_t)sp3_pending.resp_tx_ts - (uint32_t)sp3_pending.poll_rx_ts;
+    tof = ((rtd_init * (1 - clockOffsetRatio) - rtd_resp) / 2.0) * DWT_TIME_UNITS;
+    distance = tof * SPEED_OF_LIGHT;
+    bearing_list[src] = sp3_pending.bearing;
+#if PRINT_RANGING_RECORDS
+    printf("RNG %d %d %3.3f\n", DEVICE_ID, src, distance);
+    if(bearing_list[src].valid){
+        printf("AOA %d %d %.1f\n", DEVICE_ID, src, bearing_list[src].angle_ddeg / 10.0);
+    }
+#endif
+    connectivity_list[src] = distance;
+}
+#endif
+
+
 /**
  * @fn initiator
  * Sets device to initiator, builds the connectivity list and updates the connectivity list
  * Finishes by sending connectivity matrix along with initiatior start message to next device
  */
 void initiator(){
+    mem_set_context(MEM_CTX_INITIATOR);
+
     /* Configure the TX spectrum parameters (power, PG delay and PG count) */
     /* Reset and initialize DW chip. */
     reset_DWIC(); /* Target specific drive of RSTn line into DW3000 low for a period. */
@@ -194,43 +730,79 @@ void initiator(){
 
     /* Configure DW IC. See NOTE 13 below. */
     /* if the dwt_configure returns DWT_ERROR either the PLL or RX calibration has failed the host should reset the device */
+    phy_profile_apply(&config);
+    chan_hop_apply(&config);
+    link_phy_apply(&config);
+    sts_link_apply(&config);
+    pdoa_angle_apply(&config);
     if (dwt_configure(&config))
     {
         printf("CONFIG FAILED\n");
         while (1) { };
     }
+    sts_link_start();
+    airtime_set_config(&config);
+    twr_timing_set_config(&config);
+    cca_set_config(&config);
 
-    /* Configure the TX spectrum parameters (power, PG delay and PG count) */
-    dwt_configuretxrf(&txconfig_options);
+    /* The chip reset undid any recalibration, start again from the current temperature */
+    rf_cal_start(chan_hop_txconfig(config.chan));
+
+    /* Configure the TX spectrum parameters (power, PG delay and PG count) of the current channel */
+    dwt_configuretxrf(chan_hop_txconfig(config.chan));
+    link_pwr_start(config.chan, chan_hop_txconfig(config.chan));
 
     /* Apply default antenna delay value. See NOTE 2 below. */
     dwt_setrxantennadelay(RX_ANT_DLY);
     dwt_settxantennadelay(TX_ANT_DLY);
 
-    /* Set expected response's delay and timeout. See NOTE 1 and 5 below.
-     * As this example only handles one incoming frame with always the same delay and timeout, those values can be set here once for all. */
-    dwt_setrxaftertxdelay(POLL_TX_TO_RESP_RX_DLY_UUS);
-    dwt_setrxtimeout(RESP_RX_TIMEOUT_UUS);
+    /* First-path power of the responses, measured by link_phy_read_fp_dbm() */
+    dwt_configciadiag(DW_CIA_DIAG_LOG_ALL);
+
+    /* (Re)start the event counters, the chip reset above cleared them. */
+    evc_start();
 
     /* Next can enable TX/RX states output on GPIOs 5 and 6 to help debug, and also TX/RX LEDs
      * Note, in real low power applications the LEDs should not be used. */
     dwt_setlnapamode(DWT_LNA_ENABLE | DWT_PA_ENABLE);
 
     // Start by printing out connectivity matrix (this will have been received unless this is first iter of device 0)
+    // With row pulls only the collector has the whole matrix
+#if DM_ROW_PULL
+    if(DEVICE_ID == DM_COLLECTOR_ID){
+        print_matrix();
+        row_pull_print();
+    }
+#else
     print_matrix();
-
-    // Initialize the message
-    message_header header;
-    header.type = TYPE_RANGING;
-    header.src = DEVICE_ID;
-
-    message_payload payload;
-    
-    message tx;
-    tx.header = header;
-    tx.payload = payload;
-
+#endif
+    airtime_print_network(network_airtime, NUM_DEVICES);
+    sts_link_print();
+    phy_profile_print();
+    chan_hop_print();
+    link_phy_print(DEVICE_ID, NUM_DEVICES);
+    link_pwr_print(DEVICE_ID, NUM_DEVICES);
+    cca_print();
+    twr_timing_print();
+    rf_cal_print();
+    pdoa_angle_print(bearing_list, DEVICE_ID, NUM_DEVICES);
+
+    // Initialize the poll header, the MHR carries our id as source address
+    dm_hdr_t hdr = { 0 };
+    ranging_addr_t addr = { 0 };
+    hdr.type = DM_TYPE_RANGING;
+    addr.pan_id = DM_PAN_ID;
+    addr.src = DEVICE_ID;
+
+#if DM_SP3_RANGING
+    /* One burst of SP3 exchanges, the responders work the distances out from the token */
+    follow_channel();
+    sp3_round();
+    service_background();
+    Sleep(evc_ranging_delay_ms(RNG_DELAY_MS));
+#else
     uint8_t cur_device = 0;
+    uint8_t attempts = 0;
     while(cur_device < NUM_DEVICES)
     {
         /* Skip ourselves */
@@ -239,21 +811,83 @@ void initiator(){
             continue;
         }
 
+        uint8_t ranged_device = cur_device;
+        twr_timing_t timing;
+        uint16_t plen;
+        int16_t fp_dbm = LINK_PHY_FP_NONE;
+        int sent = DWT_SUCCESS;
+        uint32_t rx_on_us;
+
+        /* The network may have switched radio profile or hopped during the delay between exchanges */
+        follow_phy_profile();
+        follow_channel();
+        plen = link_phy_plen(cur_device);
+
+        /* Set expected response's delay and timeout, from the frames, the link's preamble and the peer's processing
+         * budget. The poll asks the responder for the matching reply delay. */
+        timing = twr_timing_for_peer(cur_device, plen);
+        dwt_setrxaftertxdelay(timing.rx_dly_uus);
+        dwt_setrxtimeout(timing.rx_timeout_uus);
+
+        TRACE_BEGIN(EXCHANGE, cur_device);
+
         /* Update destination to cur_device. */
-        tx.header.dest = cur_device;
+        addr.dest = cur_device;
+        addr.seq = frame_seq_nb;
+
+        /* Load the STS IV of the pair, the responder resynchronises on the counter sent in clear. */
+        hdr.sts_len = sts_link_length();
+        hdr.sts_count = sts_link_begin(cur_device);
+        phy_profile_announce(&hdr.phy_next, &hdr.phy_in_ms);
+        chan_hop_announce(&hdr.hop_seq, &hdr.hop_in_ms, hdr.hop_bl);
 
         /* Write frame data to DW IC and prepare transmission  */
-        tx.payload.poll_msg[ALL_MSG_SN_IDX] = frame_seq_nb;
+        ranging_mhr_write(tx_buf, DM_RANGING_PROFILE, &addr);
+        dm_poll_set_hdr(&tx_buf[DM_MHR_LEN], hdr);
+        dm_poll_set_plen8(&tx_buf[DM_MHR_LEN], (uint8_t)(plen / 8));
+        dm_poll_set_pwr_fb(&tx_buf[DM_MHR_LEN], link_pwr_feedback(cur_device));
+        dm_poll_set_reply_us(&tx_buf[DM_MHR_LEN], timing.reply_us);
         dwt_writesysstatuslo(DWT_INT_TXFRS_BIT_MASK);
-        dwt_writetxdata(sizeof(tx), (uint8_t*) &tx, 0);
-        dwt_writetxfctrl(sizeof(tx), 0, 1);
+        dwt_writetxdata(POLL_FRAME_LEN - FCS_LEN, tx_buf, 0);
+        dwt_writetxfctrl(POLL_FRAME_LEN, 0, 1);
+        link_phy_set_tx(plen);
+        link_pwr_set_tx(cur_device);
 
         /* Start transmission, indicating that a response is expected so that reception is enabled automatically after the frame is sent and the delay
          * set by dwt_setrxaftertxdelay() has elapsed. */
-        dwt_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED);
+        TRACE_INSTANT(TX_ARM, POLL_FRAME_LEN);
+        if(attempts == 0){
+            /* A response that has not started by the end of the arrival window ends the exchange there */
+            dwt_setpreambledetecttimeout(twr_timing_pto_pacs());
+            dwt_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED);
+            airtime_note_tx(POLL_FRAME_LEN);
+            airtime_rx_begin(airtime_frame_duration_plen_ns(&config, plen, POLL_FRAME_LEN) / 1000 + timing.rx_dly_uus);
+        }
+        else{
+            /* A retry contends with whatever made the last attempt fail: the poll only goes once the channel is clear.
+             * The detection window also bounds the wait for the response's preamble. */
+            sent = cca_tx(DWT_RESPONSE_EXPECTED, twr_timing_pto_pacs());
+            if(sent == DWT_SUCCESS){
+                airtime_note_tx(POLL_FRAME_LEN);
+                airtime_rx_begin(timing.rx_dly_uus);
+            }
+        }
 
         /* We assume that the transmission is achieved correctly, poll for reception of a frame or error/timeout. */
-        waitforsysstatus(&status_reg, NULL, (DWT_INT_RXFCG_BIT_MASK | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR), 0);
+        if(sent == DWT_SUCCESS){
+            TRACE_BEGIN(RX_WAIT, cur_device);
+            waitforsysstatus(&status_reg, NULL, (DWT_INT_RXFCG_BIT_MASK | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR), 0);
+            TRACE_END(RX_WAIT, cur_device);
+            rx_on_us = airtime_rx_end();
+            if(!(status_reg & DWT_INT_RXFCG_BIT_MASK)){
+                twr_timing_note_miss(&timing, status_reg, rx_on_us);
+            }
+        }
+        else{
+            /* The channel stayed busy, the attempt counts as lost */
+            status_reg = 0;
+        }
+        cca_restore_rx();
 
         /* Increment frame sequence number after transmission of the poll message (modulo 256). */
         frame_seq_nb++;
@@ -264,16 +898,32 @@ void initiator(){
             /* Clear good RX frame event in the DW IC status register. */
             dwt_writesysstatuslo(DWT_INT_RXFCG_BIT_MASK);
 
-            /* A frame has been received, read it into a response message. */
+            /* A frame has been received, read it into the receive buffer. */
             frame_len = dwt_getframelength();
-            if (frame_len <= sizeof(message))
+            TRACE_INSTANT(RX_DONE, frame_len);
+            if (frame_len == RESP_FRAME_LEN)
             {
-                message response;
-                dwt_readrxdata((uint8_t*) &response, frame_len, 0);
-
-                /* Check that the response was a polling response and intended for us */
-                if (response.header.dest == DEVICE_ID && response.header.type == TYPE_RESPONSE)
+                dm_resp_t response;
+                ranging_addr_t rx_addr;
+                int is_response;
+                dwt_readrxdata(rx_buf, RESP_FRAME_LEN - FCS_LEN, 0);
+                dm_resp_get(&rx_buf[DM_MHR_LEN], &response);
+
+                /* Check that the response was a polling response and intended for us, and that both timestamps are secure */
+                is_response = ranging_mhr_read(DM_RANGING_PROFILE, rx_buf, RESP_FRAME_LEN - FCS_LEN, &rx_addr) && rx_addr.dest == DEVICE_ID
+                              && response.hdr.type == DM_TYPE_RESPONSE;
+
+                /* A responder that found our counter behind the pair's sends its own, catch up with it for the next poll */
+                if (is_response)
                 {
+                    sts_link_sync(cur_device, response.hdr.sts_count);
+                }
+                if (is_response && sts_link_check(response.hdr.sts_valid))
+                {
+                    airtime_note_rx_useful(frame_len);
+                    phy_profile_follow(response.hdr.phy_next, response.hdr.phy_in_ms);
+                    chan_hop_follow(response.hdr.hop_seq, response.hdr.hop_in_ms, response.hdr.hop_bl);
+
                     uint32_t poll_tx_ts, resp_rx_ts, poll_rx_ts, resp_tx_ts;
                     int32_t rtd_init, rtd_resp;
                     float clockOffsetRatio;
@@ -281,13 +931,22 @@ void initiator(){
                     /* Retrieve poll transmission and response reception timestamps */
                     poll_tx_ts = dwt_readtxtimestamplo32();
                     resp_rx_ts = dwt_readrxtimestamplo32();
+                    fp_dbm = link_phy_read_fp_dbm();
+                    bearing_list[cur_device] = pdoa_angle_read(config.chan);
+
+                    /* Close the power loop both ways: what we heard goes in the next poll, what the peer heard sets our power */
+                    link_pwr_heard(cur_device, fp_dbm);
+                    link_pwr_adjust(cur_device, response.pwr_fb);
+
+                    /* The next poll asks for a reply delay fitted to the responder's latest processing time */
+                    twr_timing_peer_heard(cur_device, response.proc_us);
 
                     /* Read carrier integrator value and calculate clock offset ratio. See NOTE 11 below. */
                     clockOffsetRatio = ((float)dwt_readclockoffset()) / (uint32_t)(1 << 26);
 
                     /* Get timestamps embedded in response message. */
-                    resp_msg_get_ts(&response.payload.resp_msg[RESP_MSG_POLL_RX_TS_IDX], &poll_rx_ts);
-                    resp_msg_get_ts(&response.payload.resp_msg[RESP_MSG_RESP_TX_TS_IDX], &resp_tx_ts);
+                    poll_rx_ts = response.poll_rx_ts;
+                    resp_tx_ts = response.resp_tx_ts;
 
                     /* Compute time of flight and distance, using clock offset ratio to correct for differing local and remote clock rates */
                     rtd_init = resp_rx_ts - poll_tx_ts;
@@ -297,6 +956,12 @@ void initiator(){
                     distance = tof * SPEED_OF_LIGHT;
                     /* Display computed distance on LCD. */
                     // printf("DIST: %3.2f m", distance);
+#if PRINT_RANGING_RECORDS
+                    printf("RNG %d %d %3.3f\n", DEVICE_ID, cur_device, distance);
+                    if(bearing_list[cur_device].valid){
+                        printf("AOA %d %d %.1f\n", DEVICE_ID, cur_device, bearing_list[cur_device].angle_ddeg / 10.0);
+                    }
+#endif
 
                     /* Update connectivity list */
                     connectivity_list[cur_device] = distance;
@@ -309,34 +974,96 @@ void initiator(){
         }
         else
         {
+            TRACE_INSTANT(RX_FAIL, status_reg);
+
             /* Clear RX error/timeout events in the DW IC status register. */
             dwt_writesysstatuslo(SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR);
         }
+        TRACE_END(EXCHANGE, ranged_device);
+
+        /* Adapt the link's preamble to how the exchange went, the other frames use the profile's */
+        link_phy_note(ranged_device, cur_device != ranged_device, fp_dbm);
+        link_phy_set_tx(0);
+        chan_hop_note(config.chan, cur_device != ranged_device);
+
+        /* A lost exchange may be an unheard poll: raise our power, and tell the peer its response was missed. It may
+         * also be a response the peer could not prepare in time, give it longer. */
+        if(cur_device == ranged_device){
+            link_pwr_heard(ranged_device, LINK_PHY_FP_NONE);
+            link_pwr_adjust(ranged_device, LINK_PWR_FB_NONE);
+            twr_timing_peer_lost(ranged_device);
+        }
+        link_pwr_set_tx(LINK_PWR_ALL);
+
+        /* Give up on an unresponsive peer once the retry budget is spent, its previous distance is kept. */
+        if(cur_device == ranged_device){
+            if(++attempts >= evc_retry_limit(RANGING_MAX_ATTEMPTS)){
+                cur_device++;
+                attempts = 0;
+            }
+        }
+        else{
+            attempts = 0;
+        }
+
+        service_background();
 
         /* Execute a delay between ranging exchanges. */
-        Sleep(RNG_DELAY_MS);
+        Sleep(evc_ranging_delay_ms(RNG_DELAY_MS));
     }
+#endif
 
     /* We now have a fresh connectivity list, so update the matrix */
     update_matrix();
 
-    /* Copy connectivity matrix to message and update dest to next initiator */
-    tx.header.dest = SET_INIT_DEV;
-    tx.header.type = TYPE_ITITIATOR;
-    for(int i=0; i<NUM_DEVICES; i++){
-        for(int j=0; j<NUM_DEVICES; j++){
-            memcpy(&tx.payload.connectivity_matrix[i][j], &connectivity_matrix[i][j], sizeof(double));
-        }
+#if DM_ROW_PULL
+    /* Gather the rows that changed while every other node is listening */
+    if(DEVICE_ID == DM_COLLECTOR_ID){
+        row_pull_collect();
     }
+#endif
+
+    /* Pick the STS length of the next round, announced with the token, which goes on the current dwell's channel */
+    follow_channel();
+    hdr.sts_len = sts_link_end_round();
+    cur_initiator = SET_INIT_DEV;
+    phy_profile_announce(&hdr.phy_next, &hdr.phy_in_ms);
+    chan_hop_announce(&hdr.hop_seq, &hdr.hop_in_ms, hdr.hop_bl);
+
+    /* Copy connectivity matrix to message and update dest to next initiator */
+    addr.dest = SET_INIT_DEV;
+    addr.seq = frame_seq_nb;
+    hdr.type = DM_TYPE_INITIATOR;
+#if DM_TOKEN_BROADCAST
+    /* Every responder hears the token through its frame filter, and follows the next initiator it names */
+    addr.dest = DM_BROADCAST_ID;
+    dm_token_set_next(&tx_buf[DM_MHR_LEN], SET_INIT_DEV);
+#endif
+#if DM_SP3_RANGING
+    /* Every responder takes its timestamps from the token */
+    dm_token_put_sp3(&tx_buf[DM_MHR_LEN], sp3_report);
+#endif
+    ranging_mhr_write(tx_buf, DM_RANGING_PROFILE, &addr);
+    dm_token_set_hdr(&tx_buf[DM_MHR_LEN], hdr);
+#if !DM_ROW_PULL
+    dm_token_put_matrix(&tx_buf[DM_MHR_LEN], &connectivity_matrix[0][0]);
+#endif
+
+    /* Share our latest airtime totals along with everyone else's */
+    network_airtime[DEVICE_ID] = *airtime_get_report();
+    dm_token_put_airtime(&tx_buf[DM_MHR_LEN], network_airtime);
     /* Write frame data to DW IC and prepare transmission  */
     dwt_writesysstatuslo(DWT_INT_TXFRS_BIT_MASK);
-    dwt_writetxdata(sizeof(tx), (uint8_t*) &tx, 0);
-    dwt_writetxfctrl(sizeof(tx), 0, 1);
+    dwt_writetxdata(TOKEN_FRAME_LEN - FCS_LEN, tx_buf, 0);
+    dwt_writetxfctrl(TOKEN_FRAME_LEN, 0, 1);
 
     /* Start transmission, indicating that a response is expected so that reception is enabled automatically after the frame is sent and the delay
         * set by dwt_setrxaftertxdelay() has elapsed. */
+    TRACE_INSTANT(TX_ARM, TOKEN_FRAME_LEN);
     dwt_starttx(DWT_START_TX_IMMEDIATE);
+    airtime_note_tx(TOKEN_FRAME_LEN);
     waitforsysstatus(NULL, NULL, DWT_INT_TXFRS_BIT_MASK, 0);
+    TRACE_INSTANT(TX_DONE, TOKEN_FRAME_LEN);
 
     /* Clear TX frame sent event. */
     dwt_writesysstatuslo(DWT_INT_TXFRS_BIT_MASK);
@@ -352,9 +1079,13 @@ void initiator(){
  * If an initiation message, moves into initiation 
  */
 void responder(){
-    message tx;
-    tx.header.type = TYPE_RESPONSE;
-    tx.header.src = DEVICE_ID;
+    mem_set_context(MEM_CTX_RESPONDER);
+
+    dm_resp_t tx = { { 0 } };
+    ranging_addr_t tx_addr = { 0 };
+    tx.hdr.type = DM_TYPE_RESPONSE;
+    tx_addr.pan_id = DM_PAN_ID;
+    tx_addr.src = DEVICE_ID;
 
     /* Reset and initialize DW chip. */
     reset_DWIC(); /* Target specific drive of RSTn line into DW3000 low for a period. */
@@ -376,14 +1107,27 @@ void responder(){
 
     /* Configure DW IC. See NOTE 13 below. */
     /* if the dwt_configure returns DWT_ERROR either the PLL or RX calibration has failed the host should reset the device */
+    phy_profile_apply(&config);
+    chan_hop_apply(&config);
+    link_phy_apply(&config);
+    sts_link_apply(&config);
+    pdoa_angle_apply(&config);
     if (dwt_configure(&config))
     {
         printf("CONFIG FAILED\n");
         while (1) { };
     }
+    sts_link_start();
+    airtime_set_config(&config);
+    twr_timing_set_config(&config);
+    cca_set_config(&config);
 
-    /* Configure the TX spectrum parameters (power, PG delay and PG count) */
-    dwt_configuretxrf(&txconfig_options);
+    /* The chip reset undid any recalibration, start again from the current temperature */
+    rf_cal_start(chan_hop_txconfig(config.chan));
+
+    /* Configure the TX spectrum parameters (power, PG delay and PG count) of the current channel */
+    dwt_configuretxrf(chan_hop_txconfig(config.chan));
+    link_pwr_start(config.chan, chan_hop_txconfig(config.chan));
 
     /* Apply default antenna delay value. See NOTE 2 below. */
     dwt_setrxantennadelay(RX_ANT_DLY);
@@ -393,30 +1137,89 @@ void responder(){
      * Note, in real low power applications the LEDs should not be used. */
     dwt_setlnapamode(DWT_LNA_ENABLE | DWT_PA_ENABLE);
 
+    /* First-path power of the polls, sent back to their initiator for power control */
+    dwt_configciadiag(DW_CIA_DIAG_LOG_ALL);
+
+#if DM_ROW_PULL
+    /* Let the DW IC acknowledge the collector's data requests on its own. Frame filtering drops the frames addressed to
+     * other nodes; the token is broadcast, so it still passes and the STS of the next initiator is loaded before its
+     * first poll. */
+    dwt_setpanid(DM_PAN_ID);
+    dwt_setaddress16(DEVICE_ID);
+    dwt_configure_le_address(DM_COLLECTOR_ID, LE0);
+    dwt_enableautoack(0, 1);
+    row_pull_arm();
+#endif
+
+    /* (Re)start the event counters, the chip reset above cleared them. */
+    evc_start();
+
     while (1)
     {
-        /* Activate reception immediately. */
+        service_background();
+
+        /* Expect the STS of the pair formed with the current initiator. */
+        sts_link_load(cur_initiator);
+
+        /* Activate reception immediately, waking up periodically and for the next hop so background services keep running */
+        dwt_setrxtimeout(chan_hop_rx_timeout_uus(RESP_IDLE_RX_TIMEOUT_UUS));
+        airtime_rx_begin(0);
         dwt_rxenable(DWT_START_RX_IMMEDIATE);
 
         /* Poll for reception of a frame or error/timeout. */
-        waitforsysstatus(&status_reg, NULL, (DWT_INT_RXFCG_BIT_MASK | SYS_STATUS_ALL_RX_ERR), 0);
+        TRACE_BEGIN(RX_WAIT, 0xFF);
+        waitforsysstatus(&status_reg, NULL, (DWT_INT_RXFCG_BIT_MASK | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR), 0);
+        TRACE_END(RX_WAIT, 0xFF);
+        airtime_rx_end();
 
         if (status_reg & DWT_INT_RXFCG_BIT_MASK)
         {
             uint16_t frame_len;
+#if DM_ROW_PULL
+            ranging_addr_t pull_addr;
+#endif
 
             /* Clear good RX frame event in the DW IC status register. */
             dwt_writesysstatuslo(DWT_INT_RXFCG_BIT_MASK);
 
-            /* A frame has been received, read it into the local message response */
+            /* A frame has been received, read it into the receive buffer and decode its header */
             frame_len = dwt_getframelength();
-            if (frame_len <= sizeof(message))
+            TRACE_INSTANT(RX_DONE, frame_len);
+            if (frame_len < FCS_LEN || frame_len > sizeof(rx_buf))
             {
-                message response;
-                dwt_readrxdata((uint8_t*) &response, frame_len, 0);
+                continue;
+            }
+            dwt_readrxdata(rx_buf, frame_len - FCS_LEN, 0);
+#if DM_ROW_PULL
+            row_pull_ack_wait();
 
-                if (response.header.dest == DEVICE_ID && response.header.type == TYPE_RANGING)
+            /* The collector's data requests are MAC command frames, told apart by their frame type and command id */
+            if (ranging_data_request_read(DM_RANGING_PROFILE, rx_buf, frame_len - FCS_LEN, &pull_addr))
+            {
+                row_pull_serve(&pull_addr, frame_len);
+                continue;
+            }
+#endif
+            if (frame_len >= POLL_FRAME_LEN)
+            {
+                dm_hdr_t response;
+                ranging_addr_t rx_addr;
+                dm_hdr_get(&rx_buf[DM_MHR_LEN], &response);
+
+                /* Frames of other protocols or MHR profiles are ignored */
+                if (!ranging_mhr_read(DM_RANGING_PROFILE, rx_buf, frame_len - FCS_LEN, &rx_addr))
+                {
+                    continue;
+                }
+
+                /* Any frame of the network passes on a pending radio profile switch and the hopping schedule */
+                phy_profile_follow(response.phy_next, response.phy_in_ms);
+                chan_hop_follow(response.hop_seq, response.hop_in_ms, response.hop_bl);
+
+                if (rx_addr.dest == DEVICE_ID && response.type == DM_TYPE_RANGING && frame_len == POLL_FRAME_LEN)
                 {
+                    airtime_note_rx_useful(frame_len);
+
                     uint32_t resp_tx_time;
                     uint64_t poll_rx_ts, resp_tx_ts;
                     int ret;
@@ -424,29 +1227,58 @@ void responder(){
                     /* Retrieve poll reception timestamp. */
                     poll_rx_ts = get_rx_timestamp_u64();
 
-                    /* Compute response message transmission time. See NOTE 7 below. */
-                    resp_tx_time = (poll_rx_ts + (POLL_RX_TO_RESP_TX_DLY_UUS * UUS_TO_DWT_TIME)) >> 8;
+                    /* Tell the initiator whether the poll's timestamp is secure, resynchronising the pair if needed */
+                    cur_initiator = (uint8_t)rx_addr.src;
+                    tx.hdr.sts_valid = sts_link_accept((uint8_t)rx_addr.src, response.sts_count);
+                    tx.hdr.sts_count = sts_link_last((uint8_t)rx_addr.src);
+                    tx.hdr.sts_len = sts_link_length();
+                    phy_profile_announce(&tx.hdr.phy_next, &tx.hdr.phy_in_ms);
+                    chan_hop_announce(&tx.hdr.hop_seq, &tx.hdr.hop_in_ms, tx.hdr.hop_bl);
+
+                    /* Answer at the power the initiator's feedback calls for, telling it how its previous poll was heard */
+                    link_pwr_adjust((uint8_t)rx_addr.src, dm_poll_get_pwr_fb(&rx_buf[DM_MHR_LEN]));
+                    tx.pwr_fb = link_pwr_feedback((uint8_t)rx_addr.src);
+
+                    /* Answer with the poll's preamble length, the initiator's reply delay allows for it */
+                    uint16_t plen = (uint16_t)dm_poll_get_plen8(&rx_buf[DM_MHR_LEN]) * 8;
+                    if (plen < LINK_PHY_PLEN_MIN || plen > LINK_PHY_PLEN_MAX)
+                    {
+                        plen = 0;
+                    }
+
+                    /* Answer at the delay the initiator is listening for, worked out from the budget we sent it last */
+                    resp_tx_time = (poll_rx_ts + TWR_TIMING_US_TO_DWT(dm_poll_get_reply_us(&rx_buf[DM_MHR_LEN]))) >> 8;
                     dwt_setdelayedtrxtime(resp_tx_time);
 
                     /* Response TX timestamp is the transmission time we programmed plus the antenna delay. */
                     resp_tx_ts = (((uint64_t)(resp_tx_time & 0xFFFFFFFEUL)) << 8) + TX_ANT_DLY;
 
                     /* Write all timestamps in the final message. See NOTE 8 below. */
-                    resp_msg_set_ts(&tx.payload.resp_msg[RESP_MSG_POLL_RX_TS_IDX], poll_rx_ts);
-                    resp_msg_set_ts(&tx.payload.resp_msg[RESP_MSG_RESP_TX_TS_IDX], resp_tx_ts);
+                    tx.poll_rx_ts = (uint32_t)poll_rx_ts;
+                    tx.resp_tx_ts = (uint32_t)resp_tx_ts;
+                    tx.proc_us = twr_timing_proc_us();
 
                     /* Write and send the response message. */
-                    tx.payload.resp_msg[ALL_MSG_SN_IDX] = frame_seq_nb;
-                    tx.header.dest = response.header.src;
-                    dwt_writetxdata(sizeof(tx), (uint8_t*) &tx, 0); /* Zero offset in TX buffer. */
-                    dwt_writetxfctrl(sizeof(tx), 0, 1);          /* Zero offset in TX buffer, ranging. */
+                    tx_addr.seq = frame_seq_nb;
+                    tx_addr.dest = rx_addr.src;
+                    ranging_mhr_write(tx_buf, DM_RANGING_PROFILE, &tx_addr);
+                    dm_resp_put(&tx_buf[DM_MHR_LEN], &tx);
+                    dwt_writetxdata(RESP_FRAME_LEN - FCS_LEN, tx_buf, 0); /* Zero offset in TX buffer. */
+                    dwt_writetxfctrl(RESP_FRAME_LEN, 0, 1);              /* Zero offset in TX buffer, ranging. */
+                    TRACE_INSTANT(TX_ARM, RESP_FRAME_LEN);
+                    link_phy_set_tx(plen);
+                    link_pwr_set_tx((uint8_t)rx_addr.src);
+                    twr_timing_measure(poll_rx_ts, POLL_FRAME_LEN);
                     ret = dwt_starttx(DWT_START_TX_DELAYED);
 
                     /* If dwt_starttx() returns an error, abandon this ranging exchange and proceed to the next one. See NOTE 10 below. */
                     if (ret == DWT_SUCCESS)
                     {
+                        airtime_note_tx(RESP_FRAME_LEN);
+
                         /* Poll DW IC until TX frame sent event set. See NOTE 6 below. */
                         waitforsysstatus(NULL, NULL, DWT_INT_TXFRS_BIT_MASK, 0);
+                        TRACE_INSTANT(TX_DONE, RESP_FRAME_LEN);
 
                         /* Clear TXFRS event. */
                         dwt_writesysstatuslo(DWT_INT_TXFRS_BIT_MASK);
@@ -454,24 +1286,66 @@ void responder(){
                         /* Increment frame sequence number after transmission of the poll message (modulo 256). */
                         frame_seq_nb++;
                     }
+                    else
+                    {
+                        /* Our processing outgrew the budget the initiator last heard, the next response tells it */
+                        twr_timing_note_late();
+                    }
+                    link_phy_set_tx(0);
+                    link_pwr_set_tx(LINK_PWR_ALL);
+
+                    /* The poll's level goes back in our next response, out of the response's critical path */
+                    link_pwr_heard((uint8_t)rx_addr.src, link_phy_read_fp_dbm());
+
+                    /* A missed token may have left us on an old STS length, the poll carries the current one */
+                    follow_sts_length(response.sts_len);
                 }
-                else if(response.header.dest == DEVICE_ID && response.header.type == TYPE_ITITIATOR){
+                else if(response.type == DM_TYPE_INITIATOR && frame_len == TOKEN_FRAME_LEN && token_next(&rx_addr) == DEVICE_ID){
+                    airtime_note_rx_useful(frame_len);
+#if DM_SP3_RANGING
+                    sp3_collect((uint8_t)rx_addr.src);
+#endif
+
                     /* Copy distance matrix then become initiator */
-                    for(int i=0; i<NUM_DEVICES; i++){
-                        for(int j=0; j<NUM_DEVICES; j++){
-                            memcpy(&connectivity_matrix[i][j], &response.payload.connectivity_matrix[i][j], sizeof(double));
-                        }
-                    }
+#if !DM_ROW_PULL
+                    dm_token_get_matrix(&rx_buf[DM_MHR_LEN], &connectivity_matrix[0][0]);
+#endif
+
+                    /* Keep the other nodes' airtime reports, ours is refreshed locally */
+                    dm_token_get_airtime(&rx_buf[DM_MHR_LEN], network_airtime);
+                    network_airtime[DEVICE_ID] = *airtime_get_report();
+
+                    /* initiator() configures the STS length announced with the token */
+                    sts_link_follow(response.sts_len);
 
                     initiator();
                     return;
                 }
+#if DM_SP3_RANGING
+                else if(response.type == DM_TYPE_INITIATOR && frame_len == TOKEN_FRAME_LEN){
+                    /* Token passed between two other nodes, only a whole one carries our half of the timestamps */
+                    cur_initiator = token_next(&rx_addr);
+                    follow_sts_length(response.sts_len);
+
+                    /* Finish our exchange with the sender, then answer the next initiator's poll */
+                    sp3_collect((uint8_t)rx_addr.src);
+                    sp3_respond(cur_initiator);
+                }
+#else
+                else if(response.type == DM_TYPE_INITIATOR && frame_len == TOKEN_FRAME_LEN){
+                    /* Token passed between two other nodes, follow it and its STS length */
+                    cur_initiator = token_next(&rx_addr);
+                    follow_sts_length(response.sts_len);
+                }
+#endif
             }
         }
         else
         {
-            /* Clear RX error events in the DW IC status register. */
-            dwt_writesysstatuslo(SYS_STATUS_ALL_RX_ERR);
+            TRACE_INSTANT(RX_FAIL, status_reg);
+
+            /* Clear RX error/timeout events in the DW IC status register. */
+            dwt_writesysstatuslo(SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR);
         }
     }
 }
@@ -488,6 +1362,37 @@ int dist_matrix(void){
     /* Configure SPI rate, DW3000 supports up to 36 MHz */
     port_set_dw_ic_spi_fastrate();
 
+    /* Trace records are streamed on their own RTT channel, tagged with our id */
+    trace_init(DEVICE_ID);
+
+    /* Secure timestamps, node 0 holds the initiator token first */
+    sts_link_init(DEVICE_ID);
+
+    /* Every link starts with the preamble and the TX power of the radio profile */
+    link_phy_init(airtime_preamble_symbols(phy_profile_active()->config.txPreambLength));
+    link_pwr_init();
+
+    /* Poll retries listen before they transmit, backing off differently on every node */
+    cca_init(DEVICE_ID);
+
+    /* Reply delays start from the processing time model, then follow the measurements */
+    twr_timing_init(POLL_FRAME_LEN, RESP_FRAME_LEN);
+
+    /* Every node starts hopping from dwell 0, then follows the schedule heard in the frames */
+    chan_hop_init();
+
+    /* What the MHR profile costs per exchange (poll and response) at the configured data rate */
+    {
+        static const uint16_t exchange_bodies[] = { dm_poll_SIZE, dm_resp_SIZE };
+
+        phy_profile_apply(&config);
+
+        link_phy_apply(&config);
+        sts_link_apply(&config);
+        ranging_profile_print_airtime(&config, DM_RANGING_PROFILE, exchange_bodies, 2);
+        sp3_print_airtime();
+    }
+
     // Need initial device to be set to initiator manually, otherwise rest are receiever and await being set to initiator
     if(DEVICE_ID == 0)
     {
@@ -153,6 +153,7 @@ int simple_rx_aes(void)
                     test_run_info((unsigned char *)"Error Frame");
                     break;
                 case AES_RES_ERROR_IGNORE_FRAME:
+                case AES_RES_ERROR_REPLAY:
                 case AES_RES_OK:
                     break;
                 }
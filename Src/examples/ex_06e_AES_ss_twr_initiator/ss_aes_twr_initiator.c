@@ -28,6 +28,7 @@
 #include <port.h>
 #include <shared_defines.h>
 #include <shared_functions.h>
+#include <stdio.h>
 
 #if defined(TEST_AES_SS_TWR_INITIATOR)
 
@@ -54,7 +55,7 @@ mac_frame_802_15_4_format_t mac_frame = {
 
     /* Set the Security Control field in the Auxiliary Security Header
      *  Security Control = 0xF:
-     *                         Security level: 0x7 = MIC 16 (data confidentiality OFF, data authenticity Yes),
+     *                         Security level: 0x7 = MIC 16 (data confidentiality ON, data authenticity Yes), replaced by AES_SECURITY_LEVEL below,
      *                         Key Identifier Mode: 0x1 = key determined from key index field,
      *                         Frame Counter Suppression: 0x0 = has the frame counter and the frame counter generates the nonce.
      *                         ASN in Nonce: 0x0 = frame counter is used to generate the nonce (CCM* nonce = SRC ADDR (8), Frame Counter (4) and Nonce Security
@@ -102,6 +103,16 @@ static dwt_aes_key_t keys_options[NUM_OF_KEY_OPTIONS] = { { 0x00010203, 0x040506
 /* Inter-ranging delay period, in milliseconds. */
 #define RNG_DELAY_MS 1000
 
+/* Number of ranging exchanges between two reports of the AES key/configuration writes saved. See NOTE 16 below. */
+#define AES_STATS_PERIOD 100
+
+/* Set to 1 to receive the response with a single SPI read and decrypt it in rx_buffer, 0 to decrypt it with the DW IC AES engine. See NOTE 18 below. */
+#define RX_AES_IN_PLACE 1
+
+/* Security level of the poll, and the lowest accepted for the response. Must match AES_SECURITY_LEVEL of ss_aes_twr_responder.c.
+ * AUX_SEC_LEVEL_DATA_CONF_OFF_MIC_4/8/16 only authenticate the frames, see NOTE 19 below. */
+#define AES_SECURITY_LEVEL AUX_SEC_LEVEL_DATA_CONF_ON_MIC_16
+
 /* Default antenna delay values for 64 MHz PRF. See NOTE 2 below. */
 #define TX_ANT_DLY 16385
 #define RX_ANT_DLY 16385
@@ -112,6 +123,9 @@ static uint8_t tx_poll_msg[] = { 'P', 'o', 'l', 'l', ' ', 'm', 'e', 's', 's', 'a
 /* Response message to the initiator. The first 8 bytes are used for Poll RX time and Response TX time.*/
 static uint8_t rx_resp_msg[] = { 0, 0, 0, 0, 0, 0, 0, 0, 'R', 'e', 's', 'p', 'o', 'n', 's', 'e' };
 
+/* MHR and poll payload in one block, the AES job's header when the payload is only authenticated */
+static uint8_t tx_auth_buf[sizeof(mhr_802_15_4_t) + sizeof(tx_poll_msg)];
+
 #define START_RECEIVE_DATA_LOCATION 8 // MAC payload user data starts at index 8 (e.g. 'R' - in above response message)
 
 /* Indexes to access some of the fields in the frames defined above. */
@@ -155,7 +169,10 @@ int ss_aes_twr_initiator(void)
 {
     static uint32_t frame_cnt = 0; /* See Note 13 */
     static uint8_t seq_cnt = 0x0A; /* Frame sequence number, incremented after each transmission. */
-    uint32_t status_reg;
+    static uint32_t exchanges = 0;
+    static uint32_t rx_frames = 0, rx_spi_transactions = 0, rx_cycles = 0;
+    uint32_t status_reg, spi_start, cycles_start;
+    uint16_t poll_frame_len;
     uint8_t nonce[13]; /* 13-byte nonce used in this example as per IEEE802.15.4 */
     dwt_aes_job_t aes_job_tx, aes_job_rx;
     int8_t status;
@@ -181,6 +198,9 @@ int ss_aes_twr_initiator(void)
         while (1) { };
     }
 
+    /* The reset cleared the AES block, make sure the key and configuration are written again */
+    mac_aes_invalidate();
+
     /* Enabling LEDs here for debug so that for each TX the D1 LED will flash on DW3000 red eval-shield boards.
      * Note, in real low power applications the LEDs should not be used. */
     dwt_setleds(DWT_LEDS_ENABLE | DWT_LEDS_INIT_BLINK);
@@ -215,23 +235,26 @@ int ss_aes_twr_initiator(void)
     aes_job_tx.src_port = AES_Src_Tx_buf;                        /* dwt_do_aes will take plain text to the TX buffer */
     aes_job_tx.dst_port = AES_Dst_Tx_buf;                        /* dwt_do_aes will replace the original plain text TX buffer with encrypted one */
     aes_job_tx.nonce = nonce;                                    /* pointer to the nonce structure*/
-    aes_job_tx.header = (uint8_t *)MHR_802_15_4_PTR(&mac_frame); /* plain-text header which will not be encrypted */
-    aes_job_tx.header_len = MAC_FRAME_HEADER_SIZE(&mac_frame);
-    aes_job_tx.payload = tx_poll_msg;             /* payload to be encrypted */
-    aes_job_tx.payload_len = sizeof(tx_poll_msg); /* size of payload to be encrypted */
+    /* header and payload are set by mac_frame_set_tx_aes_job() according to the security level, see NOTE 19 below */
 
     aes_job_rx.mode = AES_Decrypt;          /* this is decryption job */
     aes_job_rx.src_port = AES_Src_Rx_buf_0; /* The source of the data to be decrypted is the IC RX buffer */
     aes_job_rx.dst_port = AES_Dst_Rx_buf_0; /* Decrypt the encrypted data to the IC RX buffer : this will destroy original RX frame */
-    aes_job_rx.header_len = aes_job_tx.header_len;
-    aes_job_rx.header = aes_job_tx.header; /* plain-text header which will not be encrypted */
-    aes_job_rx.payload = rx_buffer;        /* pointer to where the decrypted data will be copied to when read from the IC*/
+    aes_job_rx.header_len = MAC_FRAME_HEADER_SIZE(&mac_frame);
+    aes_job_rx.header = (uint8_t *)MHR_802_15_4_PTR(&mac_frame); /* plain-text header which will not be encrypted */
+    aes_job_rx.payload = rx_buffer;                              /* pointer to where the decrypted data will be copied to when read from the IC*/
+
+    /* Responses below our security level are rejected, whatever level their MHR claims */
+    mac_set_rx_min_security_level(AES_SECURITY_LEVEL);
 
     /* Loop forever initiating ranging exchanges. */
     while (1)
     {
-        /* Program the correct key to be used */
-        dwt_set_keyreg_128(&keys_options[INITIATOR_KEY_INDEX - 1]);
+        /* Select the security level of the poll, the MHR of the last response was received into mac_frame */
+        mac_frame_set_aux_security_control(&mac_frame, AES_SECURITY_LEVEL);
+
+        /* Program the correct key to be used, skipped when it is already loaded. See NOTE 16 below. */
+        mac_aes_load_key(&keys_options[INITIATOR_KEY_INDEX - 1]);
         /* Set the key index for the frame */
         MAC_FRAME_AUX_KEY_IDENTIFY_802_15_4(&mac_frame) = INITIATOR_KEY_INDEX;
 
@@ -241,10 +264,10 @@ int ss_aes_twr_initiator(void)
         mac_frame_set_pan_ids_and_addresses_802_15_4(&mac_frame, DEST_PAN_ID, DEST_ADDR, SRC_ADDR);
         mac_frame_get_nonce(&mac_frame, nonce);
 
-        aes_job_tx.mic_size = mac_frame_get_aux_mic_size(&mac_frame);
+        poll_frame_len = mac_frame_set_tx_aes_job(&mac_frame, &aes_job_tx, tx_poll_msg, sizeof(tx_poll_msg), tx_auth_buf);
         aes_config.mode = AES_Encrypt;
         aes_config.mic = dwt_mic_size_from_bytes(aes_job_tx.mic_size);
-        dwt_configure_aes(&aes_config);
+        mac_aes_configure(&aes_config);
 
         /* The AES job will take the TX frame data and and copy it to DW IC TX buffer before transmission. See NOTE 7 below. */
         status = dwt_do_aes(&aes_job_tx, aes_config.aes_core_type);
@@ -261,7 +284,7 @@ int ss_aes_twr_initiator(void)
         }
 
         /* configure the frame control and start transmission */
-        dwt_writetxfctrl(aes_job_tx.header_len + aes_job_tx.payload_len + aes_job_tx.mic_size + FCS_LEN, 0, 1); /* Zero offset in TX buffer, ranging. */
+        dwt_writetxfctrl(poll_frame_len, 0, 1); /* Zero offset in TX buffer, ranging. */
 
         /* Start transmission, indicating that a response is expected so that reception is enabled automatically after the frame is sent and the delay
          * set by dwt_setrxaftertxdelay() has elapsed. */
@@ -290,11 +313,21 @@ int ss_aes_twr_initiator(void)
              * however that is not part of this example); then the header needs to have security enabled.
              * If any of these checks fail the rx_aes_802_15_4 will return an error
              * */
+            spi_start = spi_get_transaction_count();
+            cycles_start = port_get_cycles();
+#if RX_AES_IN_PLACE
+            /* The whole frame is read into rx_buffer and decrypted there, the MAC payload pointer is set to the plain text */
+            status = rx_aes_802_15_4_in_place(&mac_frame, rx_buffer, frame_len, sizeof(rx_buffer), keys_options, DEST_ADDR, SRC_ADDR, &aes_job_rx.payload_len);
+#else
             aes_config.mode = AES_Decrypt;
             PAYLOAD_PTR_802_15_4(&mac_frame) = rx_buffer; /* Set the MAC pyload ptr */
 
             /* This example assumes that initiator and responder are sending encrypted data */
             status = rx_aes_802_15_4(&mac_frame, frame_len, &aes_job_rx, sizeof(rx_buffer), keys_options, DEST_ADDR, SRC_ADDR, &aes_config);
+#endif
+            rx_cycles += port_get_cycles() - cycles_start;
+            rx_spi_transactions += spi_get_transaction_count() - spi_start;
+            rx_frames++;
             if (status != AES_RES_OK)
             {
                 switch (status)
@@ -310,13 +343,17 @@ int ss_aes_twr_initiator(void)
                     break;
                 case AES_RES_ERROR_IGNORE_FRAME:
                     continue; // Got frame not for us
+                case AES_RES_ERROR_REPLAY:
+                    test_run_info((unsigned char *)"Replayed frame dropped"); /* See NOTE 17 below. */
+                    continue;
                 }
                 while (1) { };
             }
 
             /* Check that the frame is the expected response from the companion "SS TWR AES responder" example.
              * ignore the 8 first bytes of the response message as they contain the poll and response timestamps */
-            if (memcmp(&rx_buffer[START_RECEIVE_DATA_LOCATION], &rx_resp_msg[START_RECEIVE_DATA_LOCATION], aes_job_rx.payload_len - START_RECEIVE_DATA_LOCATION)
+            if (memcmp(&PAYLOAD_PTR_802_15_4(&mac_frame)[START_RECEIVE_DATA_LOCATION], &rx_resp_msg[START_RECEIVE_DATA_LOCATION],
+                    aes_job_rx.payload_len - START_RECEIVE_DATA_LOCATION)
                 == 0)
             {
                 uint32_t poll_tx_ts, resp_rx_ts, poll_rx_ts, resp_tx_ts;
@@ -331,8 +368,8 @@ int ss_aes_twr_initiator(void)
                 clockOffsetRatio = ((float)dwt_readclockoffset()) / (uint32_t)(1 << 26);
 
                 /* Get timestamps embedded in response message. */
-                resp_msg_get_ts(&rx_buffer[RESP_MSG_POLL_RX_TS_IDX], &poll_rx_ts);
-                resp_msg_get_ts(&rx_buffer[RESP_MSG_RESP_TX_TS_IDX], &resp_tx_ts);
+                resp_msg_get_ts(&PAYLOAD_PTR_802_15_4(&mac_frame)[RESP_MSG_POLL_RX_TS_IDX], &poll_rx_ts);
+                resp_msg_get_ts(&PAYLOAD_PTR_802_15_4(&mac_frame)[RESP_MSG_RESP_TX_TS_IDX], &resp_tx_ts);
 
                 /* Compute time of flight and distance, using clock offset ratio to correct for differing local and remote clock rates */
                 rtd_init = resp_rx_ts - poll_tx_ts;
@@ -348,6 +385,32 @@ int ss_aes_twr_initiator(void)
             dwt_writesysstatuslo(SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR);
         }
 
+        /* Report the SPI traffic saved by not reloading the AES key and configuration */
+        if ((++exchanges % AES_STATS_PERIOD) == 0)
+        {
+            const mac_aes_stats_t *aes_stats = mac_aes_get_stats();
+            char str[96];
+
+            snprintf(str, sizeof(str), "AES key loads=%lu skipped=%lu cfg loads=%lu skipped=%lu saved=%luB (%luB/exchange)", (unsigned long)aes_stats->key_loads,
+                (unsigned long)aes_stats->key_skips, (unsigned long)aes_stats->config_loads, (unsigned long)aes_stats->config_skips,
+                (unsigned long)mac_aes_spi_bytes_saved(), (unsigned long)(mac_aes_spi_bytes_saved() / exchanges));
+            test_run_info((unsigned char *)str);
+
+            /* SPI transactions spent receiving and decrypting each secured frame, see NOTE 18 */
+            if (rx_frames)
+            {
+                snprintf(str, sizeof(str), "AES RX frames=%lu SPI transactions/frame=%lu.%02lu", (unsigned long)rx_frames,
+                    (unsigned long)(rx_spi_transactions / rx_frames), (unsigned long)((rx_spi_transactions % rx_frames) * 100 / rx_frames));
+                test_run_info((unsigned char *)str);
+
+                /* Frame size and RX verification time of the selected security level, see NOTE 19 */
+                snprintf(str, sizeof(str), "AES level=%u mic=%uB poll=%uB (%uB less than MIC-16) RX verify=%luus/frame", (unsigned)AES_SECURITY_LEVEL,
+                    (unsigned)aes_job_tx.mic_size, (unsigned)poll_frame_len, (unsigned)(16 - aes_job_tx.mic_size),
+                    (unsigned long)(rx_cycles / rx_frames / (SystemCoreClock / 1000000)));
+                test_run_info((unsigned char *)str);
+            }
+        }
+
         /* Execute a delay between ranging exchanges. */
         Sleep(RNG_DELAY_MS);
     }
@@ -424,4 +487,27 @@ int ss_aes_twr_initiator(void)
  * 14. Desired configuration by user may be different to the current programmed configuration. dwt_configure is called to set desired
  *     configuration.
  * 15. When CCM core type is used, AES_KEY_Load needs to be set prior to each encryption/decryption operation, even if the AES KEY used has not changed.
+ * 16. mac_aes_load_key() and mac_aes_configure() remember what was last written to the AES block and skip identical writes. The key register write
+ *     (16 bytes of key, ~24 bytes of SPI traffic) is skipped whenever the key does not change. The configuration write is tiny and, because of
+ *     NOTE 15, is still done before every CCM* operation. The responder encrypts with the same key index as the initiator, so after the first
+ *     exchange neither side reloads a key: the nonce contains the source address, so both directions can safely share a key.
+ * 17. rx_aes_802_15_4() keeps, per source address, the highest frame counter received and a bitmap of the MAC_REPLAY_WINDOW counters below it.
+ *     A frame whose counter is in the bitmap, or below the window, is a replay and is dropped before it is decrypted; the window only moves
+ *     once a frame's MIC has been verified. As the frame counter restarts from zero at reset (see NOTE 13), the responder must be restarted
+ *     (or mac_replay_reset() called) when the initiator is, otherwise its frames are dropped until the counter passes the old value.
+ * 18. rx_aes_802_15_4() reads the MHR, then lets the DW IC AES engine decrypt the payload in its RX buffer: besides the MHR read this costs the AES
+ *     configuration write and, inside dwt_do_aes(), the nonce and DMA set-up writes, the start command, the status polling and a second read for
+ *     the decrypted payload. rx_aes_802_15_4_in_place() reads MHR, payload and MIC in one burst and decrypts them in rx_buffer with the nRF52 ECB
+ *     peripheral, so a secured frame costs exactly one SPI transaction. The "AES RX" line reports the average measured with either setting of
+ *     RX_AES_IN_PLACE. Host decryption takes about one ECB operation per 16 bytes of MHR and two per 16 bytes of payload.
+ * 19. AES_SECURITY_LEVEL selects the security level of the frames. The levels with data confidentiality (AUX_SEC_LEVEL_DATA_CONF_ON_MIC_4/8/16)
+ *     encrypt the payload; the authentication-only levels (AUX_SEC_LEVEL_DATA_CONF_OFF_MIC_4/8/16) send it in clear and only protect it with the
+ *     MIC. Ranging timestamps are not secret, what matters is that they cannot be forged or replayed, which the MIC and the frame counter
+ *     ensure. mac_frame_set_tx_aes_job() then passes MHR and payload to the AES engine as one authenticated header with no payload to encrypt,
+ *     and the receivers only check the MIC: the host skips the counter-mode block of every 16 bytes of payload and the DW IC engine has no
+ *     payload to process. A 4-byte MIC (MIC-32) also makes each frame 12 bytes shorter than with MIC-16, about 12 us less on air per frame at
+ *     6.8 Mb/s. The "AES level" line reports the poll length, the bytes saved against MIC-16 and the time taken to receive and verify a
+ *     response; the responder reports its poll-to-response processing time. The responder has its own AES_SECURITY_LEVEL, which must be the
+ *     same. Each side only accepts frames at its level or above (mac_set_rx_min_security_level()): the level is carried in the MHR and chosen by
+ *     the sender, so taking it from the frame would let a frame at level 0, which has no MIC, pass as authenticated.
  ****************************************************************************************************************************************************/
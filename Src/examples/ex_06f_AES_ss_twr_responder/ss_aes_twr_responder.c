@@ -27,6 +27,7 @@
 #include <port.h>
 #include <shared_defines.h>
 #include <shared_functions.h>
+#include <stdio.h>
 
 #if defined(TEST_AES_SS_TWR_RESPONDER)
 
@@ -82,6 +83,9 @@ static uint8_t rx_poll_msg[] = { 'P', 'o', 'l', 'l', ' ', 'm', 'e', 's', 's', 'a
 /* Response message to the initiator. The first 8 bytes are used for Poll RX time and Response TX time.*/
 static uint8_t tx_resp_msg[] = { 0, 0, 0, 0, 0, 0, 0, 0, 'R', 'e', 's', 'p', 'o', 'n', 's', 'e' };
 
+/* MHR and response payload in one block, the AES job's header when the payload is only authenticated. See NOTE 16 below. */
+static uint8_t tx_auth_buf[sizeof(mhr_802_15_4_t) + sizeof(tx_resp_msg)];
+
 /* Index to access some of the fields in the frames involved in the process. */
 #define ALL_MSG_SN_IDX          2 // sequence number byte index in MHR
 #define RESP_MSG_POLL_RX_TS_IDX 0 // index in the MAC payload for Poll RX time
@@ -94,12 +98,24 @@ static uint8_t tx_resp_msg[] = { 0, 0, 0, 0, 0, 0, 0, 0, 'R', 'e', 's', 'p', 'o'
 static uint8_t rx_buffer[RX_BUF_LEN];
 
 /* Note, the key index of 0 is forbidden to send as key index. Thus index 1 is the first.
- * This example uses this index for the key table for the encryption of responder's data */
-#define RESPONDER_KEY_INDEX 2
+ * This example uses this index for the key table for the encryption of responder's data.
+ * It matches the initiator's key so that the AES key register never needs reloading (see NOTE 16 of ss_aes_twr_initiator.c). */
+#define RESPONDER_KEY_INDEX 1
+
+/* Set to 1 to receive the poll with a single SPI read and decrypt it in rx_buffer, 0 to decrypt it with the DW IC AES engine.
+ * See NOTE 18 of ss_aes_twr_initiator.c. */
+#define RX_AES_IN_PLACE 1
+
+/* Security level of the response, and the lowest accepted for the polls. Must match AES_SECURITY_LEVEL of ss_aes_twr_initiator.c,
+ * see NOTE 16 below. */
+#define AES_SECURITY_LEVEL AUX_SEC_LEVEL_DATA_CONF_ON_MIC_16
 
 /* Delay between frames, in UWB microseconds. See NOTE 1 below. */
 #define POLL_RX_TO_RESP_TX_DLY_UUS 2000
 
+/* Number of responses between two reports of the poll-to-response processing time. See NOTE 16 below. */
+#define TURNAROUND_STATS_PERIOD 100
+
 /* Timestamps of frames transmission/reception. */
 static uint64_t poll_rx_ts;
 static uint64_t resp_tx_ts;
@@ -121,7 +137,9 @@ int ss_aes_twr_responder(void)
 {
     dwt_aes_job_t aes_job_rx, aes_job_tx;
     int8_t status;
-    uint32_t status_reg;
+    uint32_t status_reg, poll_rx_cycles, turnaround_us;
+    uint32_t responses = 0, turnaround_sum = 0, turnaround_max = 0;
+    uint16_t resp_frame_len = 0;
 
     /* Display application name on LCD. */
     test_run_info((unsigned char *)APP_NAME);
@@ -144,6 +162,9 @@ int ss_aes_twr_responder(void)
         while (1) { };
     }
 
+    /* The reset cleared the AES block, make sure the key and configuration are written again */
+    mac_aes_invalidate();
+
     /* Enabling LEDs here for debug so that for each TX the D1 LED will flash on DW3000 red eval-shield boards.
      * Note, in real low power applications the LEDs should not be used. */
     dwt_setleds(DWT_LEDS_ENABLE | DWT_LEDS_INIT_BLINK);
@@ -179,10 +200,10 @@ int ss_aes_twr_responder(void)
     aes_job_tx.mode = AES_Encrypt;        /* this is encyption job */
     aes_job_tx.src_port = AES_Src_Tx_buf; /* dwt_do_aes will take plain text to the TX buffer */
     aes_job_tx.dst_port = AES_Dst_Tx_buf; /* dwt_do_aes will replace the original plain text TX buffer with encrypted one */
-    aes_job_tx.header_len = aes_job_rx.header_len;
-    aes_job_tx.header = aes_job_rx.header;        /* plain-text header which will not be encrypted */
-    aes_job_tx.payload = tx_resp_msg;             /* payload to be sent */
-    aes_job_tx.payload_len = sizeof(tx_resp_msg); /* payload length */
+    /* header and payload are set by mac_frame_set_tx_aes_job() according to AES_SECURITY_LEVEL, see NOTE 16 below */
+
+    /* Polls below our security level are rejected, whatever level their MHR claims */
+    mac_set_rx_min_security_level(AES_SECURITY_LEVEL);
 
     /* Loop forever responding to ranging requests. */
     while (1)
@@ -192,6 +213,7 @@ int ss_aes_twr_responder(void)
 
         /* Poll for reception of a frame or error/timeout. See NOTE 6 below. */
         waitforsysstatus(&status_reg, NULL, (DWT_INT_RXFCG_BIT_MASK | SYS_STATUS_ALL_RX_ERR), 0);
+        poll_rx_cycles = port_get_cycles();
 
         /* Once a frame has been received read the payload and decrypt*/
         if (status_reg & DWT_INT_RXFCG_BIT_MASK)
@@ -209,11 +231,16 @@ int ss_aes_twr_responder(void)
              * however that is not part of this example); then the header needs to have security enabled.
              * If any of these checks fail the rx_aes_802_15_4 will return an error
              * */
+#if RX_AES_IN_PLACE
+            /* The whole frame is read into rx_buffer and decrypted there, the MAC payload pointer is set to the plain text */
+            status = rx_aes_802_15_4_in_place(&mac_frame, rx_buffer, frame_len, sizeof(rx_buffer), keys_options, DEST_ADDR, SRC_ADDR, &aes_job_rx.payload_len);
+#else
             aes_config.mode = AES_Decrypt;                /* configure for decryption*/
             PAYLOAD_PTR_802_15_4(&mac_frame) = rx_buffer; /* Set the MAC frame structure payload pointer
                                                                (this will contain decrypted data if status below is AES_RES_OK) */
 
             status = rx_aes_802_15_4(&mac_frame, frame_len, &aes_job_rx, sizeof(rx_buffer), keys_options, DEST_ADDR, SRC_ADDR, &aes_config);
+#endif
             if (status != AES_RES_OK)
             {
                 /* report any errors */
@@ -230,13 +257,16 @@ int ss_aes_twr_responder(void)
                     break;
                 case AES_RES_ERROR_IGNORE_FRAME:
                     continue; // Got frame with wrong destination address
+                case AES_RES_ERROR_REPLAY:
+                    test_run_info((unsigned char *)"Replayed frame dropped"); /* See NOTE 15 below. */
+                    continue;
                 }
                 while (1) { };
             }
 
             /* Check that the payload of the MAC frame matches the expected poll message
              * as should be sent by "SS TWR AES initiator" example. */
-            if (memcmp(rx_buffer, rx_poll_msg, aes_job_rx.payload_len) == 0)
+            if (memcmp(PAYLOAD_PTR_802_15_4(&mac_frame), rx_poll_msg, aes_job_rx.payload_len) == 0)
             {
                 uint32_t resp_tx_time;
                 int ret;
@@ -258,8 +288,8 @@ int ss_aes_twr_responder(void)
 
                 /* Now need to encrypt the frame before transmitting*/
 
-                /* Program the correct key to be used */
-                dwt_set_keyreg_128(&keys_options[RESPONDER_KEY_INDEX - 1]);
+                /* Program the correct key to be used, skipped when it is already loaded */
+                mac_aes_load_key(&keys_options[RESPONDER_KEY_INDEX - 1]);
                 /* Set the key index for the frame */
                 MAC_FRAME_AUX_KEY_IDENTIFY_802_15_4(&mac_frame) = RESPONDER_KEY_INDEX;
 
@@ -269,15 +299,16 @@ int ss_aes_twr_responder(void)
                 /* Update the frame count */
                 mac_frame_update_aux_frame_cnt(&mac_frame, mac_frame_get_aux_frame_cnt(&mac_frame) + 1);
 
-                /* Configure the AES job */
-                aes_job_tx.mic_size = mac_frame_get_aux_mic_size(&mac_frame);
+                /* Update the MHR (reusing the received MHR, thus need to swap SRC/DEST addresses */
+                mac_frame_set_pan_ids_and_addresses_802_15_4(&mac_frame, DEST_PAN_ID, DEST_ADDR, SRC_ADDR);
+
+                /* Configure the AES job at our own security level, never at the one the poll claims */
+                mac_frame_set_aux_security_control(&mac_frame, AES_SECURITY_LEVEL);
+                resp_frame_len = mac_frame_set_tx_aes_job(&mac_frame, &aes_job_tx, tx_resp_msg, sizeof(tx_resp_msg), tx_auth_buf);
                 aes_job_tx.nonce = nonce; /* set below once MHR is set*/
                 aes_config.mode = AES_Encrypt;
                 aes_config.mic = dwt_mic_size_from_bytes(aes_job_tx.mic_size);
-                dwt_configure_aes(&aes_config);
-
-                /* Update the MHR (reusing the received MHR, thus need to swap SRC/DEST addresses */
-                mac_frame_set_pan_ids_and_addresses_802_15_4(&mac_frame, DEST_PAN_ID, DEST_ADDR, SRC_ADDR);
+                mac_aes_configure(&aes_config);
 
                 /* construct the nonce from the MHR */
                 mac_frame_get_nonce(&mac_frame, nonce);
@@ -296,9 +327,25 @@ int ss_aes_twr_responder(void)
                 }
 
                 /* configure the frame control and start transmission */
-                dwt_writetxfctrl(aes_job_tx.header_len + aes_job_tx.payload_len + aes_job_tx.mic_size + FCS_LEN, 0, 1); /* Zero offset in TX buffer, ranging. */
+                dwt_writetxfctrl(resp_frame_len, 0, 1); /* Zero offset in TX buffer, ranging. */
                 ret = dwt_starttx(DWT_START_TX_DELAYED);
 
+                /* Time from the poll's reception to the response being scheduled, what POLL_RX_TO_RESP_TX_DLY_UUS must cover */
+                turnaround_us = (port_get_cycles() - poll_rx_cycles) / (SystemCoreClock / 1000000);
+                turnaround_sum += turnaround_us;
+                turnaround_max = (turnaround_us > turnaround_max) ? turnaround_us : turnaround_max;
+                if (++responses == TURNAROUND_STATS_PERIOD)
+                {
+                    char str[96];
+
+                    snprintf(str, sizeof(str), "AES level=%u mic=%uB resp=%uB (%uB less than MIC-16) turnaround avg=%luus max=%luus",
+                        (unsigned)AUX_SECURITY_LEVEL(MAC_FRAME_AUX_SECURITY_CTRL_802_15_4(&mac_frame)), (unsigned)aes_job_tx.mic_size,
+                        (unsigned)resp_frame_len, (unsigned)(16 - aes_job_tx.mic_size), (unsigned long)(turnaround_sum / responses),
+                        (unsigned long)turnaround_max);
+                    test_run_info((unsigned char *)str);
+                    responses = turnaround_sum = turnaround_max = 0;
+                }
+
                 /* If dwt_starttx() returns an error, abandon this ranging exchange and proceed to the next one. See NOTE 10 below. */
                 if (ret == DWT_SUCCESS)
                 {
@@ -392,4 +439,13 @@ int ss_aes_twr_responder(void)
  * 13. Desired configuration by user may be different to the current programmed configuration. dwt_configure is called to set desired
  *     configuration.
  * 14. When CCM core type is used, AES_KEY_Load needs to be set prior to each encryption/decryption operation, even if the AES KEY used has not changed.
+ * 15. Polls are checked for replays by rx_aes_802_15_4(), see NOTE 17 of ss_aes_twr_initiator.c. The response reuses the poll's frame counter plus
+ *     one, so the initiator sees a counter that only moves forward as well.
+ * 16. The response is secured at AES_SECURITY_LEVEL, which must match the one of ss_aes_twr_initiator.c (see its NOTE 19). Polls below it are
+ *     rejected by rx_aes_802_15_4() (mac_set_rx_min_security_level()), so a poll at level 0, which has no MIC, cannot pass as authenticated
+ *     and the response is never weakened to the level a poll asks for.
+ *     With an authentication-only level the response payload is sent in clear and covered by the MIC, and the AES engine only computes the MIC.
+ *     The "AES level" line reports the response length, the bytes saved against MIC-16 and the time from the poll's reception to the
+ *     response being scheduled, average and worst case over the last TURNAROUND_STATS_PERIOD responses: the worst case is the lower bound for
+ *     POLL_RX_TO_RESP_TX_DLY_UUS, and with it the response delay that limits the ranging accuracy (NOTE 1).
  ****************************************************************************************************************************************************/
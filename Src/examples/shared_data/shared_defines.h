@@ -56,7 +56,8 @@ extern "C"
         AES_RES_ERROR_LENGTH = -1,
         AES_RES_ERROR = -2,
         AES_RES_ERROR_FRAME = -3,
-        AES_RES_ERROR_IGNORE_FRAME = -4
+        AES_RES_ERROR_IGNORE_FRAME = -4,
+        AES_RES_ERROR_REPLAY = -5
     } aes_results_e;
 
 #ifdef __cplusplus
@@ -49,6 +49,7 @@ Purpose : DWM3001C build main entry point for simple exmaples.
 
 #include <boards.h>
 #include <deca_spi.h>
+#include <mem_usage.h>
 #include <port.h>
 #include <sdk_config.h>
 #include <stdio.h>
@@ -68,6 +69,12 @@ int main(void)
     /* Initialise DWM3001C GPIOs */
     gpio_init();
 
+    /* Start the cycle counter used as the firmware time base */
+    port_cycle_counter_init();
+
+    /* Paint the unused stack for the high-water mark checks */
+    mem_stack_paint();
+
     /* Initialise the SPI for DWM3001C */
     dwm3001c_spi_init();
 
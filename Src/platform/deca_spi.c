@@ -14,6 +14,7 @@
 #include "deca_spi.h"
 #include "port.h"
 #include <deca_device_api.h>
+#include <trace.h>
 
 static spi_handle_t spi_handler;
 static spi_handle_t *pgSpiHandler = &spi_handler;
@@ -35,6 +36,7 @@ const dw_t *SPI = &s;
 
 static volatile bool spi_xfer_done;
 static uint8_t spi_init_stat = 0; // use 1 for slow, use 2 for fast;
+static uint32_t spi_transactions = 0;
 
 static uint8_t idatabuf[DATALEN1] = { 0 }; // Never define this inside the Spi read/write
 static uint8_t itempbuf[DATALEN1] = { 0 }; // As that will use the stack from the Task, which are not such long!!!!
@@ -46,6 +48,14 @@ static uint8_t itempbuf[DATALEN1] = { 0 }; // As that will use the stack from th
  *
  *******************************************************************************/
 
+/* @fn    spi_get_transaction_count
+ * @brief Returns the number of SPI transactions (reads and writes) done with the DW IC since boot
+ * */
+uint32_t spi_get_transaction_count(void)
+{
+    return spi_transactions;
+}
+
 /* @fn    dwm3001c_spi_init
  * Initialise DWM3001C SPI
  * */
@@ -203,7 +213,10 @@ int writetospiwithcrc(uint16_t headerLength, const uint8_t *headerBuffer, uint16
     nrfx_gpiote_out_toggle(current_cs_pin);
 
     spi_xfer_done = false;
+    TRACE_BEGIN(SPI_WRITE, idatalength);
     nrf_drv_spi_transfer(&pgSpiHandler->spi_inst, idatabuf, idatalength, itempbuf, idatalength);
+    TRACE_END(SPI_WRITE, idatalength);
+    spi_transactions++;
 
     closespi(&pgSpiHandler->spi_inst);
     nrfx_gpiote_out_toggle(current_cs_pin);
@@ -244,7 +257,10 @@ int writetospi(uint16_t headerLength, const uint8_t *headerBuffer, uint16_t body
     nrfx_gpiote_out_toggle(current_cs_pin);
 
     spi_xfer_done = false;
+    TRACE_BEGIN(SPI_WRITE, idatalength);
     nrf_drv_spi_transfer(&pgSpiHandler->spi_inst, idatabuf, idatalength, itempbuf, idatalength);
+    TRACE_END(SPI_WRITE, idatalength);
+    spi_transactions++;
 
     closespi(&pgSpiHandler->spi_inst);
     nrfx_gpiote_out_toggle(current_cs_pin);
@@ -288,7 +304,10 @@ int readfromspi(uint16_t headerLength, uint8_t *headerBuffer, uint16_t readLengt
     nrfx_gpiote_out_toggle(current_cs_pin);
 
     spi_xfer_done = false;
+    TRACE_BEGIN(SPI_READ, idatalength);
     nrf_drv_spi_transfer(&pgSpiHandler->spi_inst, idatabuf, idatalength, itempbuf, idatalength);
+    TRACE_END(SPI_READ, idatalength);
+    spi_transactions++;
 
     p1 = itempbuf + headerLength;
     memcpy(readBuffer, p1, readLength);
@@ -79,6 +79,11 @@ typedef struct
  * */
 void dwm3001c_spi_init(void);
 
+/* @fn    spi_get_transaction_count
+ * @brief Returns the number of SPI transactions (reads and writes) done with the DW IC since boot
+ * */
+uint32_t spi_get_transaction_count(void);
+
 /* @fn      port_set_dw_ic_spi_slowrate
  * @brief   set 2MHz
  * */
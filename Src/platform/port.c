@@ -12,6 +12,7 @@
  */
 
 #include "port.h"
+#include <trace.h>
 extern uint16_t  current_irq_pin;
 /****************************************************************************
  *
@@ -35,12 +36,103 @@ __INLINE void Sleep(uint32_t x)
     nrf_delay_ms(x);
 }
 
+/* Millisecond time base state, see port_get_tick_ms(). */
+static uint32_t tick_last_cycles = 0;
+static uint32_t tick_rem_cycles = 0;
+static uint32_t tick_ms = 0;
+
+/* @fn    port_cycle_counter_init
+ * @brief Enables the Cortex-M4 DWT cycle counter which is used as a free-running time base
+ * */
+void port_cycle_counter_init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    tick_last_cycles = 0;
+    tick_rem_cycles = 0;
+    tick_ms = 0;
+}
+
+/* @fn    port_get_cycles
+ * @brief Returns the raw CPU cycle count (SystemCoreClock, wraps every ~67 s at 64 MHz)
+ * */
+__INLINE uint32_t port_get_cycles(void)
+{
+    return DWT->CYCCNT;
+}
+
+/* @fn    port_get_tick_ms
+ * @brief Returns milliseconds elapsed since port_cycle_counter_init().
+ *        The cycle counter wraps, so this must be called at least once per wrap period (~67 s).
+ *        Not re-entrant, call it from the main loop only.
+ * */
+uint32_t port_get_tick_ms(void)
+{
+    uint32_t now = DWT->CYCCNT;
+    uint32_t cycles_per_ms = SystemCoreClock / 1000;
+
+    tick_rem_cycles += now - tick_last_cycles;
+    tick_last_cycles = now;
+
+    tick_ms += tick_rem_cycles / cycles_per_ms;
+    tick_rem_cycles %= cycles_per_ms;
+
+    return tick_ms;
+}
+
 /****************************************************************************
  *
  *                              END OF Time section
  *
  *******************************************************************************/
 
+/****************************************************************************
+ *
+ *                              AES section
+ *
+ *******************************************************************************/
+
+/* ECB data structure read and written by the peripheral through ECBDATAPTR */
+static struct
+{
+    uint8_t key[16];
+    uint8_t cleartext[16];
+    uint8_t ciphertext[16];
+} ecb_data;
+
+/* @fn    port_aes_ecb_set_key
+ * @brief Sets the 128-bit key used by port_aes_ecb_encrypt(), first key byte first.
+ * */
+void port_aes_ecb_set_key(const uint8_t *key)
+{
+    memcpy(ecb_data.key, key, sizeof(ecb_data.key));
+}
+
+/* @fn    port_aes_ecb_encrypt
+ * @brief Encrypts one 16-byte block with AES-128 using the nRF52 ECB peripheral. in and out may be the same buffer.
+ *        The radio's CCM/AAR blocks are not used by this port, so the operation is never aborted.
+ * */
+void port_aes_ecb_encrypt(const uint8_t *in, uint8_t *out)
+{
+    memcpy(ecb_data.cleartext, in, sizeof(ecb_data.cleartext));
+
+    NRF_ECB->ECBDATAPTR = (uint32_t)&ecb_data;
+    NRF_ECB->EVENTS_ENDECB = 0;
+    NRF_ECB->EVENTS_ERRORECB = 0;
+    NRF_ECB->TASKS_STARTECB = 1;
+    while (!NRF_ECB->EVENTS_ENDECB && !NRF_ECB->EVENTS_ERRORECB) { };
+
+    memcpy(out, ecb_data.ciphertext, sizeof(ecb_data.ciphertext));
+}
+
+/****************************************************************************
+ *
+ *                              END OF AES section
+ *
+ *******************************************************************************/
+
 /****************************************************************************
  *
  *                              Configuration section
@@ -174,6 +266,7 @@ void make_very_short_wakeup_io(void)
  * */
 __INLINE void process_deca_irq(void)
 {
+    TRACE_BEGIN(ISR, 0);
     while (port_CheckEXT_IRQ() != 0)
     {
         if (port_dwic_isr)
@@ -181,6 +274,7 @@ __INLINE void process_deca_irq(void)
             port_dwic_isr();
         }
     } // while DW3000 IRQ line active
+    TRACE_END(ISR, 0);
 }
 
 /* @fn      port_DisableEXT_IRQ
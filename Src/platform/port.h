@@ -57,6 +57,32 @@ typedef void (*port_dwic_isr_t)(void);
     * */
 void Sleep(uint32_t x);
 
+/* @fn    port_cycle_counter_init
+ * @brief Enables the Cortex-M4 DWT cycle counter which is used as a free-running time base
+ * */
+void port_cycle_counter_init(void);
+
+/* @fn    port_get_cycles
+ * @brief Returns the raw CPU cycle count (SystemCoreClock, wraps every ~67 s at 64 MHz)
+ * */
+uint32_t port_get_cycles(void);
+
+/* @fn    port_get_tick_ms
+ * @brief Returns milliseconds elapsed since port_cycle_counter_init().
+ *        Must be called at least once every ~67 s so the cycle counter wrap is not missed.
+ * */
+uint32_t port_get_tick_ms(void);
+
+/* @fn    port_aes_ecb_set_key
+ * @brief Sets the 128-bit key used by port_aes_ecb_encrypt(), first key byte first.
+ * */
+void port_aes_ecb_set_key(const uint8_t *key);
+
+/* @fn    port_aes_ecb_encrypt
+ * @brief Encrypts one 16-byte block with AES-128 using the nRF52 ECB peripheral. in and out may be the same buffer.
+ * */
+void port_aes_ecb_encrypt(const uint8_t *in, uint8_t *out);
+
 /* @fn    peripherals_init
     * No perifpherals used in this port.
     * */
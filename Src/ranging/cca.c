@@ -0,0 +1,118 @@
+/*! ----------------------------------------------------------------------------
+ * @file    cca.c
+ * @brief   Clear channel assessment with randomised backoff for the contention phases of the protocol
+ *
+ *          See cca.h for an overview.
+ */
+
+#include <airtime.h>
+#include <cca.h>
+#include <shared_functions.h>
+#include <stdio.h>
+#include <string.h>
+
+/* PAC duration of the active configuration, in nanoseconds */
+static uint32_t pac_ns = 8 * AIRTIME_PREAMBLE_SYMBOL_PS / 1000;
+
+static uint32_t rng_state = 1;
+static cca_stats_t stats;
+
+/* xorshift32, the backoffs need no more than different sequences on different nodes */
+static uint32_t rnd(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+void cca_init(uint8_t seed)
+{
+    rng_state = 0x2545F491UL ^ ((uint32_t)seed * 0x9E3779B9UL);
+    memset(&stats, 0, sizeof(stats));
+}
+
+void cca_set_config(const dwt_config_t *cfg)
+{
+    static const uint8_t pac_symbols[] = { [DWT_PAC8] = 8, [DWT_PAC16] = 16, [DWT_PAC32] = 32, [DWT_PAC4] = 4 };
+
+    pac_ns = (uint32_t)((uint64_t)pac_symbols[cfg->rxPAC & 3] * AIRTIME_PREAMBLE_SYMBOL_PS / 1000);
+}
+
+uint16_t cca_pacs_for_uus(uint32_t window_uus)
+{
+    /* 1 UWB microsecond is 512/499.2 us */
+    uint32_t window_ns = window_uus * 40000 / 39;
+
+    return (uint16_t)((window_ns + pac_ns - 1) / pac_ns);
+}
+
+int cca_tx(uint8_t mode, uint16_t pto_pacs)
+{
+    uint32_t status_lo, status_hi;
+    uint32_t backoff_us;
+    uint8_t be = CCA_MIN_BE;
+    uint8_t backoffs = 0;
+
+    if (pto_pacs == 0)
+    {
+        pto_pacs = CCA_PTO_PACS;
+    }
+    dwt_setpreambledetecttimeout(pto_pacs);
+
+    while (1)
+    {
+        stats.assessments++;
+        dwt_starttx(DWT_START_TX_CCA | mode);
+        waitforsysstatus(&status_lo, &status_hi, DWT_INT_TXFRS_BIT_MASK, DWT_INT_HI_CCA_FAIL_BIT_MASK);
+        if (status_lo & DWT_INT_TXFRS_BIT_MASK)
+        {
+            dwt_writesysstatuslo(DWT_INT_TXFRS_BIT_MASK);
+            break;
+        }
+
+        /* A preamble was heard, the DW IC is back in IDLE */
+        dwt_writesysstatushi(DWT_INT_HI_CCA_FAIL_BIT_MASK);
+        stats.busy++;
+        if (++backoffs > CCA_MAX_BACKOFFS)
+        {
+            stats.given_up++;
+            cca_restore_rx();
+            return DWT_ERROR;
+        }
+
+        /* Random number of detection windows, the counter adds one PAC to the timeout */
+        backoff_us = (rnd() & ((1UL << be) - 1)) * (pto_pacs + 1) * pac_ns / 1000;
+        if (backoff_us)
+        {
+            deca_usleep(backoff_us);
+        }
+        stats.backoff_us += backoff_us;
+        if (be < CCA_MAX_BE)
+        {
+            be++;
+        }
+    }
+
+    if (!(mode & DWT_RESPONSE_EXPECTED))
+    {
+        cca_restore_rx();
+    }
+    return DWT_SUCCESS;
+}
+
+void cca_restore_rx(void)
+{
+    dwt_setpreambledetecttimeout(0);
+}
+
+const cca_stats_t *cca_get_stats(void)
+{
+    return &stats;
+}
+
+void cca_print(void)
+{
+    printf("CCA assessments=%lu busy=%lu given_up=%lu backoff=%luus\n", (unsigned long)stats.assessments, (unsigned long)stats.busy,
+        (unsigned long)stats.given_up, (unsigned long)stats.backoff_us);
+}
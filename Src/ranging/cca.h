@@ -0,0 +1,130 @@
+/*! ----------------------------------------------------------------------------
+ * @file    cca.h
+ * @brief   Clear channel assessment with randomised backoff for the contention phases of the protocol
+ *
+ *          The token ring gives one node the channel at a time, so exchanges are sent blind. A retry is different:
+ *          the previous attempt was lost, possibly to a transmitter outside the ring, which may still be on air. A
+ *          retry is therefore sent with dwt_starttx(DWT_START_TX_CCA), as in ex_01e_tx_with_cca: the DW IC listens for
+ *          a preamble during the preamble detection timeout and only transmits if it heard none.
+ *
+ *          When the channel is busy the node backs off for a random number of units, each unit being that detection
+ *          window, drawn from a window that doubles with every busy assessment (CCA_MIN_BE to CCA_MAX_BE, as the
+ *          802.15.4 CSMA-CA exponents), and gives up after CCA_MAX_BACKOFFS. The statistics count the assessments,
+ *          the busy ones, the transmissions given up and the time spent backing off.
+ *
+ *          The preamble detection timeout also applies to the reception that follows a DWT_RESPONSE_EXPECTED
+ *          transmission, so it must then cover the wait for the response (cca_pacs_for_uus()), and be put back with
+ *          cca_restore_rx() once the response is in.
+ */
+
+#ifndef CCA_H_
+#define CCA_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <deca_device_api.h>
+#include <stdint.h>
+
+/* Default detection window, in PACs, as ex_01e_tx_with_cca */
+#define CCA_PTO_PACS 3
+
+/* Backoff exponents: the first backoff is drawn from 0 to 2^CCA_MIN_BE - 1 units, then doubled up to 2^CCA_MAX_BE - 1 */
+#define CCA_MIN_BE 3
+#define CCA_MAX_BE 5
+
+/* Busy assessments after which a transmission is given up */
+#define CCA_MAX_BACKOFFS 4
+
+    /* Channel access statistics, totals since boot */
+    typedef struct
+    {
+        uint32_t assessments; /* Clear channel assessments run */
+        uint32_t busy;        /* Of which heard a preamble and deferred the transmission */
+        uint32_t given_up;    /* Transmissions abandoned after CCA_MAX_BACKOFFS busy assessments */
+        uint32_t backoff_us;  /* Time spent backing off */
+    } cca_stats_t;
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn cca_init()
+     *
+     * @brief Seeds the backoff draws, different on every node so that two nodes deferring to the same frame do not retry
+     *        together, and clears the statistics. Call at boot.
+     *
+     * @param seed - node id
+     *
+     * @return none
+     */
+    void cca_init(uint8_t seed);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn cca_set_config()
+     *
+     * @brief Gives the PHY configuration in use, whose PAC size sets the detection window. Call after dwt_configure().
+     *
+     * @param cfg - active configuration
+     *
+     * @return none
+     */
+    void cca_set_config(const dwt_config_t *cfg);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn cca_pacs_for_uus()
+     *
+     * @brief Returns the preamble detection timeout that covers a wait.
+     *
+     * @param window_uus - wait, in UWB microseconds
+     *
+     * @return timeout for dwt_setpreambledetecttimeout(), in PACs
+     */
+    uint16_t cca_pacs_for_uus(uint32_t window_uus);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn cca_tx()
+     *
+     * @brief Sends the frame written to the DW IC once the channel is clear, backing off while it is busy, and waits for
+     *        the end of the transmission.
+     *
+     * @param mode     - 0, or DWT_RESPONSE_EXPECTED to turn the receiver on after the frame
+     * @param pto_pacs - detection window in PACs, 0 for CCA_PTO_PACS. With DWT_RESPONSE_EXPECTED it also bounds the
+     *                   wait for the response's preamble.
+     *
+     * @return DWT_SUCCESS once sent, DWT_ERROR when given up
+     */
+    int cca_tx(uint8_t mode, uint16_t pto_pacs);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn cca_restore_rx()
+     *
+     * @brief Puts back the preamble detection timeout of ordinary reception. Call after the response of a
+     *        DWT_RESPONSE_EXPECTED cca_tx(), received or not.
+     *
+     * @return none
+     */
+    void cca_restore_rx(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn cca_get_stats()
+     *
+     * @brief Returns the statistics since boot.
+     *
+     * @return pointer to the statistics
+     */
+    const cca_stats_t *cca_get_stats(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn cca_print()
+     *
+     * @brief Prints a "CCA" line with the statistics.
+     *
+     * @return none
+     */
+    void cca_print(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CCA_H_ */
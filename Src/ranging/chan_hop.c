@@ -0,0 +1,292 @@
+/*! ----------------------------------------------------------------------------
+ * @file    chan_hop.c
+ * @brief   Synchronised hopping between channels 5 and 9, with per-channel link quality and blacklisting
+ *
+ *          See chan_hop.h for an overview.
+ */
+
+#include <chan_hop.h>
+#include <port.h>
+#include <stdio.h>
+#include <string.h>
+
+/* TX power and pulse shape of each channel, see config_options.c */
+extern dwt_txconfig_t txconfig_options;
+extern dwt_txconfig_t txconfig_options_ch9;
+
+static const uint8_t channels[CHAN_HOP_COUNT] = { 5, 9 };
+
+/* Current dwell, when it ends and when it started, on the local clock, and its channel */
+static uint8_t seq = 0;
+static uint32_t hop_at_ms = 0;
+static uint32_t hopped_ms = 0;
+static uint8_t cur_chan = 5;
+
+/* Sequence number each channel is blacklisted until, equal to seq when it is not */
+static uint8_t bl_until[CHAN_HOP_COUNT];
+
+/* Current quality window of each channel: exchanges and those that gave a distance */
+static uint8_t win_count[CHAN_HOP_COUNT];
+static uint8_t win_ok[CHAN_HOP_COUNT];
+
+static chan_hop_stats_t stats;
+
+static int blacklisted(int i)
+{
+    return (int8_t)(bl_until[i] - seq) > 0;
+}
+
+/* Channel of the current dwell: a hash of its number picks one of the channels not blacklisted, any if all are */
+static uint8_t schedule(void)
+{
+    uint8_t allowed[CHAN_HOP_COUNT];
+    uint32_t h = ((uint32_t)seq + 1) * 2654435761UL;
+    int i, n = 0;
+
+    for (i = 0; i < CHAN_HOP_COUNT; i++)
+    {
+        if (!blacklisted(i))
+        {
+            allowed[n++] = (uint8_t)i;
+        }
+    }
+    if (n == 0)
+    {
+        for (i = 0; i < CHAN_HOP_COUNT; i++)
+        {
+            allowed[n++] = (uint8_t)i;
+        }
+    }
+    return channels[allowed[(h >> 16) % n]];
+}
+
+/* Starts the dwell seq: expired entries are moved to it so that they stay expired when the counter wraps */
+static void enter_dwell(void)
+{
+    int i;
+
+    for (i = 0; i < CHAN_HOP_COUNT; i++)
+    {
+        if (!blacklisted(i))
+        {
+            bl_until[i] = seq;
+        }
+    }
+    cur_chan = schedule();
+    for (i = 0; i < CHAN_HOP_COUNT; i++)
+    {
+        if (channels[i] == cur_chan)
+        {
+            stats.chan[i].dwells++;
+        }
+    }
+}
+
+void chan_hop_init(void)
+{
+    int i;
+
+    memset(&stats, 0, sizeof(stats));
+    memset(win_count, 0, sizeof(win_count));
+    memset(win_ok, 0, sizeof(win_ok));
+    seq = 0;
+    for (i = 0; i < CHAN_HOP_COUNT; i++)
+    {
+        bl_until[i] = seq;
+        stats.chan[i].chan = channels[i];
+    }
+    hopped_ms = port_get_tick_ms();
+    hop_at_ms = hopped_ms + CHAN_HOP_DWELL_MS;
+    enter_dwell();
+}
+
+void chan_hop_apply(dwt_config_t *cfg)
+{
+    if (CHAN_HOP_ENABLED)
+    {
+        cfg->chan = cur_chan;
+    }
+}
+
+dwt_txconfig_t *chan_hop_txconfig(uint8_t chan)
+{
+    return (chan == 9) ? &txconfig_options_ch9 : &txconfig_options;
+}
+
+uint8_t chan_hop_poll(void)
+{
+    if (!CHAN_HOP_ENABLED)
+    {
+        return 0;
+    }
+    while ((int32_t)(port_get_tick_ms() - hop_at_ms) >= 0)
+    {
+        seq++;
+        hopped_ms = hop_at_ms;
+        hop_at_ms += CHAN_HOP_DWELL_MS;
+        enter_dwell();
+    }
+    return cur_chan;
+}
+
+uint32_t chan_hop_guard_ms(void)
+{
+    uint32_t now = port_get_tick_ms();
+    int32_t to_hop = (int32_t)(hop_at_ms - now);
+    int32_t since_hop = (int32_t)(now - hopped_ms);
+
+    if (!CHAN_HOP_ENABLED)
+    {
+        return 0;
+    }
+    if (to_hop >= 0 && to_hop < CHAN_HOP_GUARD_MS)
+    {
+        return (uint32_t)to_hop + CHAN_HOP_GUARD_MS;
+    }
+    if (since_hop >= 0 && since_hop < CHAN_HOP_GUARD_MS)
+    {
+        return (uint32_t)(CHAN_HOP_GUARD_MS - since_hop);
+    }
+    return 0;
+}
+
+uint32_t chan_hop_rx_timeout_uus(uint32_t idle_uus)
+{
+    int32_t to_hop = (int32_t)(hop_at_ms - port_get_tick_ms());
+    uint32_t to_hop_uus;
+
+    if (!CHAN_HOP_ENABLED)
+    {
+        return idle_uus;
+    }
+
+    /* 1 UWB microsecond is 512/499.2 us, and a zero timeout would never end */
+    to_hop_uus = (to_hop > 1) ? (uint32_t)to_hop * 39000 / 40 : 975;
+    return (to_hop_uus < idle_uus) ? to_hop_uus : idle_uus;
+}
+
+void chan_hop_retuned(uint32_t start_cycles)
+{
+    stats.last_us = (port_get_cycles() - start_cycles) / (SystemCoreClock / 1000000);
+    if (stats.last_us > stats.max_us)
+    {
+        stats.max_us = stats.last_us;
+    }
+    stats.retunes++;
+}
+
+void chan_hop_announce(uint8_t *seq_out, uint16_t *in_ms, uint8_t *bl)
+{
+    int32_t left = (int32_t)(hop_at_ms - port_get_tick_ms());
+
+    *seq_out = seq;
+    *in_ms = (left < 0) ? 0 : (uint16_t)left;
+    memcpy(bl, bl_until, sizeof(bl_until));
+}
+
+void chan_hop_follow(uint8_t seq_in, uint16_t in_ms, const uint8_t *bl)
+{
+    uint32_t now = port_get_tick_ms();
+    int32_t diff;
+    int i;
+
+    if (!CHAN_HOP_ENABLED)
+    {
+        return;
+    }
+    if (in_ms > CHAN_HOP_DWELL_MS)
+    {
+        in_ms = CHAN_HOP_DWELL_MS;
+    }
+
+    /* The later expiry of every entry wins. Our expired entries move to the sender's dwell, which may be behind ours. */
+    for (i = 0; i < CHAN_HOP_COUNT; i++)
+    {
+        int ours = blacklisted(i);
+
+        if ((int8_t)(bl[i] - seq_in) > 0 && (!ours || (int8_t)(bl[i] - bl_until[i]) > 0))
+        {
+            bl_until[i] = bl[i];
+        }
+        else if (!ours)
+        {
+            bl_until[i] = seq_in;
+        }
+    }
+
+    diff = (int32_t)(now + in_ms - hop_at_ms);
+    if (seq_in != seq || diff > CHAN_HOP_SYNC_TOL_MS || diff < -CHAN_HOP_SYNC_TOL_MS)
+    {
+        stats.resyncs++;
+        hop_at_ms = now + in_ms;
+        hopped_ms = hop_at_ms - CHAN_HOP_DWELL_MS;
+        if (seq_in != seq)
+        {
+            seq = seq_in;
+            enter_dwell();
+        }
+    }
+}
+
+void chan_hop_note(uint8_t chan, int ok)
+{
+    int i;
+
+    for (i = 0; i < CHAN_HOP_COUNT && channels[i] != chan; i++)
+    {
+    }
+    if (i == CHAN_HOP_COUNT)
+    {
+        return;
+    }
+
+    stats.chan[i].exchanges++;
+    if (!ok)
+    {
+        stats.chan[i].lost++;
+    }
+    win_ok[i] += ok ? 1 : 0;
+    if (++win_count[i] < CHAN_HOP_WINDOW)
+    {
+        return;
+    }
+
+    /* Only with another channel left to hop to, and from the next dwell on, which every node works out the same */
+    if (CHAN_HOP_ENABLED && (uint32_t)win_ok[i] * 100 < (uint32_t)CHAN_HOP_BAD_PCT * win_count[i])
+    {
+        int others = 0, j;
+
+        for (j = 0; j < CHAN_HOP_COUNT; j++)
+        {
+            others += (j != i && !blacklisted(j));
+        }
+        if (others)
+        {
+            bl_until[i] = (uint8_t)(seq + 1 + CHAN_HOP_BLACKLIST_HOPS);
+            stats.chan[i].blacklisted++;
+        }
+    }
+    win_count[i] = 0;
+    win_ok[i] = 0;
+}
+
+const chan_hop_stats_t *chan_hop_get_stats(void)
+{
+    return &stats;
+}
+
+void chan_hop_print(void)
+{
+    int i;
+
+    printf("HOP seq=%u ch=%u", (unsigned)seq, (unsigned)cur_chan);
+    for (i = 0; i < CHAN_HOP_COUNT; i++)
+    {
+        const chan_hop_chan_stats_t *c = &stats.chan[i];
+
+        printf(" ch%u:dwells=%lu,ex=%lu,lost=%lu,bl=%u%s", (unsigned)c->chan, (unsigned long)c->dwells, (unsigned long)c->exchanges,
+            (unsigned long)c->lost, (unsigned)c->blacklisted, blacklisted(i) ? "*" : "");
+    }
+    printf(" retunes=%lu resyncs=%lu last=%luus max=%luus\n", (unsigned long)stats.retunes, (unsigned long)stats.resyncs,
+        (unsigned long)stats.last_us, (unsigned long)stats.max_us);
+}
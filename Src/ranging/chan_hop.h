@@ -0,0 +1,210 @@
+/*! ----------------------------------------------------------------------------
+ * @file    chan_hop.h
+ * @brief   Synchronised hopping between channels 5 and 9, with per-channel link quality and blacklisting
+ *
+ *          The radio profiles of config_options.c exist on both channels, with preamble codes 9 and 10 valid on
+ *          either, and the DWM3001CDK transmits on both (txconfig_options, txconfig_options_ch9). A network fixed to one
+ *          channel loses all its exchanges while that band is jammed or saturated. Here time is cut into dwells of
+ *          CHAN_HOP_DWELL_MS, numbered by an 8-bit sequence number, and the channel of each dwell is a hash of its number
+ *          over the channels not blacklisted. The schedule is deterministic: nodes that agree on the sequence number,
+ *          the time left in the dwell and the blacklist are on the same channel.
+ *
+ *          Every frame header carries those three (chan_hop_announce()), and a node takes them from every frame it
+ *          hears whose timing is off from its own by more than CHAN_HOP_SYNC_TOL_MS (chan_hop_follow()). A node that
+ *          lost step keeps hopping on its own schedule and meets the network again on the next dwell they share.
+ *
+ *          The initiator counts the exchanges completed on each channel. After CHAN_HOP_WINDOW exchanges on a channel,
+ *          it blacklists that channel when fewer than CHAN_HOP_BAD_PCT went through. The entry holds the sequence number
+ *          it expires at, CHAN_HOP_BLACKLIST_HOPS dwells later. It spreads with the headers, where each node keeps the
+ *          later expiry, and expires on every node at the same dwell. The last channel left is never blacklisted.
+ *
+ *          A retune is a dwt_configure() and dwt_configuretxrf() for the new channel. It is only done between exchanges.
+ *          No frame is sent within CHAN_HOP_GUARD_MS of a hop (chan_hop_guard_ms()), and listening responders wake up
+ *          at the hop (chan_hop_rx_timeout_uus()). The time each retune takes is measured.
+ */
+
+#ifndef CHAN_HOP_H_
+#define CHAN_HOP_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <deca_device_api.h>
+#include <stdint.h>
+
+/* 1 to hop, 0 to stay on the radio profile's channel */
+#define CHAN_HOP_ENABLED 1
+
+/* Channels hopped over, see chan_hop.c */
+#define CHAN_HOP_COUNT 2
+
+/* Length of a dwell, in milliseconds. A few exchanges at RNG_DELAY_MS. */
+#define CHAN_HOP_DWELL_MS 4000
+
+/* No frame is sent this long before and after a hop, in milliseconds */
+#define CHAN_HOP_GUARD_MS 10
+
+/* Timing difference below which a received schedule is not taken over, in milliseconds */
+#define CHAN_HOP_SYNC_TOL_MS 2
+
+/* Exchanges per channel quality window, share that must get through, and dwells a bad channel is left out for */
+#define CHAN_HOP_WINDOW         16
+#define CHAN_HOP_BAD_PCT        50
+#define CHAN_HOP_BLACKLIST_HOPS 16
+
+    /* Statistics of one channel, totals since boot */
+    typedef struct
+    {
+        uint8_t chan;         /* Channel number */
+        uint32_t dwells;      /* Dwells spent on it */
+        uint32_t exchanges;   /* Exchanges initiated on it */
+        uint32_t lost;        /* Of which got no distance */
+        uint16_t blacklisted; /* Times we blacklisted it */
+    } chan_hop_chan_stats_t;
+
+    /* Hopping statistics, totals since boot */
+    typedef struct
+    {
+        chan_hop_chan_stats_t chan[CHAN_HOP_COUNT];
+        uint32_t retunes; /* Changes of channel */
+        uint32_t resyncs; /* Schedules taken over from a received frame */
+        uint32_t last_us; /* Duration of the last retune, in microseconds */
+        uint32_t max_us;  /* Longest one */
+    } chan_hop_stats_t;
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn chan_hop_init()
+     *
+     * @brief Starts the schedule at dwell 0 with no channel blacklisted, and clears the statistics. Call at boot.
+     *
+     * @return none
+     */
+    void chan_hop_init(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn chan_hop_apply()
+     *
+     * @brief Sets the channel of the current dwell in a configuration. Call after phy_profile_apply() and before
+     *        dwt_configure(), then set the TX power from chan_hop_txconfig().
+     *
+     * @param cfg - configuration to update
+     *
+     * @return none
+     */
+    void chan_hop_apply(dwt_config_t *cfg);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn chan_hop_txconfig()
+     *
+     * @brief Returns the TX power and pulse shape of a channel, see config_options.c.
+     *
+     * @param chan - channel, 5 or 9
+     *
+     * @return the TX configuration
+     */
+    dwt_txconfig_t *chan_hop_txconfig(uint8_t chan);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn chan_hop_poll()
+     *
+     * @brief Moves the schedule on past the dwells that have ended. Call between exchanges, after chan_hop_guard_ms().
+     *
+     * @return channel the DW IC must be on, 0 when hopping is disabled
+     */
+    uint8_t chan_hop_poll(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn chan_hop_guard_ms()
+     *
+     * @brief Returns how long to wait before sending, so that no frame is on air around a hop.
+     *
+     * @return wait in milliseconds, 0 outside the guard time
+     */
+    uint32_t chan_hop_guard_ms(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn chan_hop_rx_timeout_uus()
+     *
+     * @brief Bounds a listening timeout so that the receiver wakes up for the next hop.
+     *
+     * @param idle_uus - timeout wanted, in UWB microseconds
+     *
+     * @return timeout for dwt_setrxtimeout(), in UWB microseconds
+     */
+    uint32_t chan_hop_rx_timeout_uus(uint32_t idle_uus);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn chan_hop_retuned()
+     *
+     * @brief Accounts a change of channel.
+     *
+     * @param start_cycles - CPU cycle count (port_get_cycles()) before the DW IC was reconfigured
+     *
+     * @return none
+     */
+    void chan_hop_retuned(uint32_t start_cycles);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn chan_hop_announce()
+     *
+     * @brief Gives the schedule to write in an outgoing frame.
+     *
+     * @param seq   - set to the sequence number of the current dwell
+     * @param in_ms - set to the time left in it, in milliseconds
+     * @param bl    - set to the blacklist, CHAN_HOP_COUNT sequence numbers the channels are left out until
+     *
+     * @return none
+     */
+    void chan_hop_announce(uint8_t *seq, uint16_t *in_ms, uint8_t *bl);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn chan_hop_follow()
+     *
+     * @brief Takes the schedule announced in a received frame when it differs from ours, and merges its blacklist.
+     *
+     * @param seq   - sequence number announced
+     * @param in_ms - time left in the dwell
+     * @param bl    - blacklist announced
+     *
+     * @return none
+     */
+    void chan_hop_follow(uint8_t seq, uint16_t in_ms, const uint8_t *bl);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn chan_hop_note()
+     *
+     * @brief Accounts an exchange we initiated, blacklisting its channel at the end of a bad window.
+     *
+     * @param chan - channel it was on
+     * @param ok   - 1 if it gave a distance
+     *
+     * @return none
+     */
+    void chan_hop_note(uint8_t chan, int ok);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn chan_hop_get_stats()
+     *
+     * @brief Returns the statistics since boot.
+     *
+     * @return pointer to the statistics
+     */
+    const chan_hop_stats_t *chan_hop_get_stats(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn chan_hop_print()
+     *
+     * @brief Prints a "HOP" line with the current dwell and channel, the exchanges and blacklist of each channel, and
+     *        the retunes.
+     *
+     * @return none
+     */
+    void chan_hop_print(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CHAN_HOP_H_ */
@@ -0,0 +1,190 @@
+/*! ----------------------------------------------------------------------------
+ * @file    dm_frames.h
+ * @brief   Frames of the connectivity matrix protocol (dist_matrix.c)
+ *
+ *          Frames are 802.15.4 data frames whose MHR follows DM_RANGING_PROFILE (see ranging_profile.h): it carries the
+ *          sequence number, the PAN ID and the node ids as addresses. After the MHR every frame starts with the same
+ *          header, which also carries the STS state, any pending radio profile switch and the channel hopping
+ *          schedule. A poll adds the link's preamble length and the reply delay it asks for, a response the responder's
+ *          two timestamps and processing budget, and both add the level the receiver was last heard at, for power
+ *          control. The token, passed to the next initiator, adds the connectivity matrix and the airtime report of
+ *          every node. The layouts are declared with frame_schema.h, so they are packed and little-endian on air and
+ *          each frame is only as long as its content.
+ *
+ *          With DM_ROW_PULL the matrix no longer travels with the token: a collector pulls the row of each node with a
+ *          MAC data request (see ranging_profile.h) and the node answers with a row frame, the header and its
+ *          distances, only when its row has changed. The token then only carries the airtime reports. The nodes
+ *          filter frames by address to get the acknowledgements, so the token is broadcast and names the next
+ *          initiator, which keeps every node following the ring.
+ *
+ *          With DM_SP3_RANGING polls and responses are STS mode 3 packets, which have no PHR and no payload, and are
+ *          told apart by the STS of the pair alone. The timestamps they would have carried travel once per round in the
+ *          token instead: the initiator adds its transmission and reception times of every exchange, and the token is
+ *          broadcast, naming the next initiator, so that every responder gets its own and works out the distance.
+ *
+ *          NUM_DEVICES, and DM_ROW_PULL and DM_SP3_RANGING if used, must be defined before this header is included.
+ */
+
+#ifndef DM_FRAMES_H_
+#define DM_FRAMES_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <airtime.h>
+#include <chan_hop.h>
+#include <frame_schema.h>
+#include <ranging_profile.h>
+
+#ifndef NUM_DEVICES
+#error "NUM_DEVICES must be defined before including dm_frames.h"
+#endif
+
+#ifndef DM_ROW_PULL
+#define DM_ROW_PULL 0
+#endif
+
+#ifndef DM_SP3_RANGING
+#define DM_SP3_RANGING 0
+#endif
+
+/* Whether the token is broadcast and names the next initiator in its payload: frame filtering (row pulls) would drop a
+ * token addressed to another node, and every responder needs the SP3 timestamps */
+#define DM_TOKEN_BROADCAST (DM_ROW_PULL || DM_SP3_RANGING)
+
+/* Frame types */
+#define DM_TYPE_INITIATOR 0 /* The receiving node's turn to be the initiator, carries the token */
+#define DM_TYPE_RANGING   1 /* The sending node wants a response from the receiver, for ranging */
+#define DM_TYPE_RESPONSE  2 /* The sending node responds to a ranging request */
+#define DM_TYPE_ROW       3 /* The sending node's row of the matrix, pulled by the collector */
+
+/* Longest frame with the standard PHR (DWT_PHRMODE_STD), including the FCS */
+#define DM_MAX_FRAME_LEN 127
+
+/* MHR profile of the protocol's frames and PAN ID of the network. The node ids are the MAC addresses. */
+#define DM_RANGING_PROFILE RANGING_PROFILE_SHORT
+#define DM_MHR_LEN         RANGING_MHR_LEN(DM_RANGING_PROFILE)
+#define DM_PAN_ID          0xDECA
+
+/* Destination of the frames every node must hear */
+#define DM_BROADCAST_ID 0xFFFF
+
+/* Header: type, then the STS state of sts_link.h (network STS length, STS counter of the exchange and responder's
+ * verdict on the poll's STS), then the pending radio profile switch of phy_profile.h (next profile, PHY_PROFILE_NONE
+ * if none, and milliseconds left before it), then the hopping schedule of chan_hop.h (current dwell, milliseconds left
+ * in it, and the dwell each channel is blacklisted until) */
+#define DM_HDR_FIELDS(FIELD, ARRAY, s)                                                                                                                        \
+    FIELD(s, type, fs_u8)                                                                                                                                     \
+    FIELD(s, sts_len, fs_u8)                                                                                                                                  \
+    FIELD(s, sts_count, fs_u32)                                                                                                                               \
+    FIELD(s, sts_valid, fs_u8)                                                                                                                                \
+    FIELD(s, phy_next, fs_u8)                                                                                                                                 \
+    FIELD(s, phy_in_ms, fs_u16)                                                                                                                               \
+    FIELD(s, hop_seq, fs_u8)                                                                                                                                  \
+    FIELD(s, hop_in_ms, fs_u16)                                                                                                                               \
+    ARRAY(s, hop_bl, fs_u8, CHAN_HOP_COUNT)
+    FRAME_SCHEMA(dm_hdr, DM_HDR_FIELDS)
+
+/* Poll: header, then the preamble length the initiator used for the link and wants the response sent with, in
+ * 8-symbol units (link_phy.h), the power control feedback: the level the responder was last heard at (link_pwr.h), and
+ * the delay from the poll's timestamp to the response's the initiator is listening for, in microseconds (twr_timing.h) */
+#define DM_POLL_FIELDS(FIELD, ARRAY, s)                                                                                                                       \
+    FIELD(s, hdr, dm_hdr)                                                                                                                                     \
+    FIELD(s, plen8, fs_u8)                                                                                                                                    \
+    FIELD(s, pwr_fb, fs_u8)                                                                                                                                   \
+    FIELD(s, reply_us, fs_u16)
+    FRAME_SCHEMA(dm_poll, DM_POLL_FIELDS)
+
+/* Response: poll reception and response transmission times of the responder, low 32 bits of the DW IC timestamps, the
+ * level the initiator's previous poll was heard at, and the responder's processing budget for the next poll, in
+ * microseconds (twr_timing.h) */
+#define DM_RESP_FIELDS(FIELD, ARRAY, s)                                                                                                                       \
+    FIELD(s, hdr, dm_hdr)                                                                                                                                     \
+    FIELD(s, poll_rx_ts, fs_u32)                                                                                                                              \
+    FIELD(s, resp_tx_ts, fs_u32)                                                                                                                              \
+    FIELD(s, pwr_fb, fs_u8)                                                                                                                                   \
+    FIELD(s, proc_us, fs_u16)
+    FRAME_SCHEMA(dm_resp, DM_RESP_FIELDS)
+
+/* Airtime report of one node, see airtime.h */
+#define DM_AIRTIME_FIELDS(FIELD, ARRAY, s)                                                                                                                    \
+    FIELD(s, tx_us, fs_u32)                                                                                                                                   \
+    FIELD(s, rx_listen_us, fs_u32)                                                                                                                            \
+    FIELD(s, rx_useful_us, fs_u32)
+    FRAME_SCHEMA_FOR(dm_airtime, DM_AIRTIME_FIELDS, airtime_report_t)
+
+/* SP3 exchange of the round with one responder, as the initiator saw it: poll transmission and response reception
+ * times, low 32 bits of the DW IC timestamps, the pair's STS counter the poll used, and 1 if the response came with a
+ * valid STS (0 when lost, the times are then meaningless) */
+#define DM_SP3_FIELDS(FIELD, ARRAY, s)                                                                                                                        \
+    FIELD(s, poll_tx_ts, fs_u32)                                                                                                                              \
+    FIELD(s, resp_rx_ts, fs_u32)                                                                                                                              \
+    FIELD(s, sts_count, fs_u32)                                                                                                                               \
+    FIELD(s, valid, fs_u8)
+    FRAME_SCHEMA(dm_sp3, DM_SP3_FIELDS)
+
+#if DM_TOKEN_BROADCAST
+/* What a broadcast token adds: the next initiator */
+#define DM_TOKEN_NEXT_FIELDS(FIELD, ARRAY, s) FIELD(s, next, fs_u8)
+#define DM_TOKEN_NEXT_SIZE                    1
+#else
+#define DM_TOKEN_NEXT_FIELDS(FIELD, ARRAY, s)
+#define DM_TOKEN_NEXT_SIZE 0
+#endif
+
+#if DM_SP3_RANGING
+/* What the token adds with SP3 ranging: the round's exchanges indexed by responder */
+#define DM_TOKEN_SP3_FIELDS(FIELD, ARRAY, s) ARRAY(s, sp3, dm_sp3, NUM_DEVICES)
+#define DM_TOKEN_SP3_SIZE                    (dm_sp3_SIZE * NUM_DEVICES)
+#else
+#define DM_TOKEN_SP3_FIELDS(FIELD, ARRAY, s)
+#define DM_TOKEN_SP3_SIZE 0
+#endif
+
+#if DM_ROW_PULL
+/* Token: the airtime report of every node, the rows are pulled by the collector */
+#define DM_TOKEN_FIELDS(FIELD, ARRAY, s)                                                                                                                      \
+    FIELD(s, hdr, dm_hdr)                                                                                                                                     \
+    ARRAY(s, airtime, dm_airtime, NUM_DEVICES)                                                                                                                \
+    DM_TOKEN_NEXT_FIELDS(FIELD, ARRAY, s)                                                                                                                     \
+    DM_TOKEN_SP3_FIELDS(FIELD, ARRAY, s)
+#else
+/* Token: connectivity matrix in row-major order, in metres, then the airtime report of every node */
+#define DM_TOKEN_FIELDS(FIELD, ARRAY, s)                                                                                                                      \
+    FIELD(s, hdr, dm_hdr)                                                                                                                                     \
+    ARRAY(s, matrix, fs_f64, NUM_DEVICES * NUM_DEVICES)                                                                                                       \
+    ARRAY(s, airtime, dm_airtime, NUM_DEVICES)                                                                                                                \
+    DM_TOKEN_NEXT_FIELDS(FIELD, ARRAY, s)                                                                                                                     \
+    DM_TOKEN_SP3_FIELDS(FIELD, ARRAY, s)
+#endif
+    FRAME_SCHEMA(dm_token, DM_TOKEN_FIELDS)
+
+/* Row: the sending node's distance to every node, in metres */
+#define DM_ROW_FIELDS(FIELD, ARRAY, s)                                                                                                                        \
+    FIELD(s, hdr, dm_hdr)                                                                                                                                     \
+    ARRAY(s, row, fs_f64, NUM_DEVICES)
+    FRAME_SCHEMA(dm_row, DM_ROW_FIELDS)
+
+/* Sizes are those of the frame after the MHR */
+    FS_STATIC_ASSERT(dm_hdr_SIZE == 13 + CHAN_HOP_COUNT, dm_hdr_size);
+    FS_STATIC_ASSERT(dm_poll_SIZE == dm_hdr_SIZE + 4, dm_poll_size);
+    FS_STATIC_ASSERT(dm_resp_SIZE == dm_hdr_SIZE + 11, dm_resp_size);
+    FS_STATIC_ASSERT(dm_airtime_SIZE == 12, dm_airtime_size);
+    FS_STATIC_ASSERT(dm_sp3_SIZE == 13, dm_sp3_size);
+    FS_STATIC_ASSERT(dm_token_SIZE == dm_hdr_SIZE + (DM_ROW_PULL ? 0 : 8 * NUM_DEVICES * NUM_DEVICES) + dm_airtime_SIZE * NUM_DEVICES + DM_TOKEN_NEXT_SIZE
+                         + DM_TOKEN_SP3_SIZE,
+        dm_token_size);
+    FS_STATIC_ASSERT(dm_row_SIZE == dm_hdr_SIZE + 8 * NUM_DEVICES, dm_row_size);
+    /* Fail when NUM_DEVICES is too large for the token or a row to fit in one frame */
+    FS_STATIC_ASSERT(DM_MHR_LEN + dm_token_SIZE + FCS_LEN <= DM_MAX_FRAME_LEN, dm_token_fits_in_frame);
+    FS_STATIC_ASSERT(DM_MHR_LEN + dm_row_SIZE + FCS_LEN <= DM_MAX_FRAME_LEN, dm_row_fits_in_frame);
+    /* The DW IC only sets the frame pending bit of its acknowledgements for 2003/2006 frames */
+    FS_STATIC_ASSERT(!DM_ROW_PULL || DM_RANGING_PROFILE == RANGING_PROFILE_SHORT, dm_row_pull_needs_short_profile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DM_FRAMES_H_ */
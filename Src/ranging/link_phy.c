@@ -0,0 +1,193 @@
+/*! ----------------------------------------------------------------------------
+ * @file    link_phy.c
+ * @brief   Per-link preamble length adaptation for the connectivity matrix protocol
+ *
+ *          See link_phy.h for an overview.
+ */
+
+#include <airtime.h>
+#include <link_phy.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/* dwt_setplenfine() counts 8-symbol steps, 1 for 16 symbols up to 255 for 2048, 0 leaves the configured length */
+#define FINE_PLEN(symbols) ((uint8_t)((symbols) / 8 - 1))
+
+/* First-path power constants for the 64 MHz PRF (DW3000 User Manual 4.7.1): A, plus 6 dB per DGC decision step */
+#define FP_ALPHA_PRF64_DB (-121.7f)
+#define FP_DGC_STEP_DB 6
+
+/* State of the link with one peer */
+typedef struct
+{
+    uint16_t plen;         /* Preamble length in use, in symbols */
+    uint8_t window;        /* Exchanges of the current window */
+    uint8_t window_losses; /* Of which lost */
+    int16_t window_min_fp; /* Weakest first path of the window, in dBm */
+    int16_t last_fp;       /* First path of the last good exchange, in dBm */
+    uint8_t clean_windows; /* Windows in a row that allow a shorter preamble */
+} link_t;
+
+static link_t links[LINK_PHY_MAX_NODES];
+static uint16_t base = 128;
+static link_phy_stats_t stats;
+
+static void window_reset(link_t *l)
+{
+    l->window = 0;
+    l->window_losses = 0;
+    l->window_min_fp = INT16_MAX;
+}
+
+void link_phy_init(uint16_t base_plen)
+{
+    int i;
+
+    base = base_plen;
+    memset(&stats, 0, sizeof(stats));
+    for (i = 0; i < LINK_PHY_MAX_NODES; i++)
+    {
+        links[i].plen = base_plen;
+        links[i].last_fp = LINK_PHY_FP_NONE;
+        links[i].clean_windows = 0;
+        window_reset(&links[i]);
+    }
+}
+
+void link_phy_apply(dwt_config_t *cfg)
+{
+    /* Preamble length + 1 + SFD length - PAC size, as in config_options.c, for the longest preamble */
+    uint16_t sfd_to = LINK_PHY_PLEN_MAX + 1 + 8 - 8;
+
+    if (cfg->sfdTO < sfd_to)
+    {
+        cfg->sfdTO = sfd_to;
+    }
+}
+
+uint16_t link_phy_plen(uint8_t peer)
+{
+    return (peer < LINK_PHY_MAX_NODES) ? links[peer].plen : base;
+}
+
+void link_phy_set_tx(uint16_t plen)
+{
+    if (plen == 0 || plen == base)
+    {
+        dwt_setplenfine(0);
+        airtime_set_preamble(0);
+    }
+    else
+    {
+        dwt_setplenfine(FINE_PLEN(plen));
+        airtime_set_preamble(plen);
+    }
+}
+
+int16_t link_phy_read_fp_dbm(void)
+{
+    dwt_nlos_alldiag_t diag;
+    float f1, f2, f3, n;
+
+    diag.diag_type = IPATOV;
+    dwt_nlos_alldiag(&diag);
+    if (diag.accumCount == 0)
+    {
+        return LINK_PHY_FP_NONE;
+    }
+
+    /* The amplitudes have 2 fractional bits */
+    f1 = diag.F1 / 4.0f;
+    f2 = diag.F2 / 4.0f;
+    f3 = diag.F3 / 4.0f;
+    n = (float)diag.accumCount;
+    return (int16_t)lrintf(10.0f * log10f((f1 * f1 + f2 * f2 + f3 * f3) / (n * n)) + FP_ALPHA_PRF64_DB + FP_DGC_STEP_DB * diag.D);
+}
+
+void link_phy_note(uint8_t peer, int ok, int16_t fp_dbm)
+{
+    link_t *l;
+
+    if (peer >= LINK_PHY_MAX_NODES)
+    {
+        return;
+    }
+    l = &links[peer];
+
+    stats.exchanges++;
+    l->window++;
+    if (!ok)
+    {
+        stats.losses++;
+        l->window_losses++;
+    }
+    else if (fp_dbm != LINK_PHY_FP_NONE)
+    {
+        l->last_fp = fp_dbm;
+        if (fp_dbm < l->window_min_fp)
+        {
+            l->window_min_fp = fp_dbm;
+        }
+    }
+
+    if (l->window < LINK_PHY_WINDOW)
+    {
+        return;
+    }
+
+    if ((uint32_t)l->window_losses * 100 > (uint32_t)LINK_PHY_LOSS_TARGET_PCT * l->window)
+    {
+        /* Too many losses: longer preamble */
+        l->clean_windows = 0;
+        if (l->plen < LINK_PHY_PLEN_MAX)
+        {
+            l->plen *= 2;
+            stats.grows++;
+        }
+    }
+    else if (l->window_losses == 0 && l->window_min_fp != INT16_MAX && l->window_min_fp >= LINK_PHY_SHRINK_FP_DBM)
+    {
+        /* Clean and strong: try a shorter preamble once it has lasted */
+        if (++l->clean_windows >= LINK_PHY_SHRINK_WINDOWS && l->plen > LINK_PHY_PLEN_MIN)
+        {
+            l->plen /= 2;
+            l->clean_windows = 0;
+            stats.shrinks++;
+        }
+    }
+    else
+    {
+        l->clean_windows = 0;
+    }
+    window_reset(l);
+}
+
+const link_phy_stats_t *link_phy_get_stats(void)
+{
+    return &stats;
+}
+
+void link_phy_print(uint8_t self, uint8_t num_nodes)
+{
+    uint8_t peer;
+
+    printf("LINK");
+    for (peer = 0; peer < num_nodes && peer < LINK_PHY_MAX_NODES; peer++)
+    {
+        if (peer == self)
+        {
+            continue;
+        }
+        if (links[peer].last_fp == LINK_PHY_FP_NONE)
+        {
+            printf(" %u:plen=%u", (unsigned)peer, (unsigned)links[peer].plen);
+        }
+        else
+        {
+            printf(" %u:plen=%u,fp=%ddBm", (unsigned)peer, (unsigned)links[peer].plen, (int)links[peer].last_fp);
+        }
+    }
+    printf(" exchanges=%lu lost=%lu grows=%u shrinks=%u\n", (unsigned long)stats.exchanges, (unsigned long)stats.losses, (unsigned)stats.grows,
+        (unsigned)stats.shrinks);
+}
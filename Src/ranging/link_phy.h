@@ -0,0 +1,152 @@
+/*! ----------------------------------------------------------------------------
+ * @file    link_phy.h
+ * @brief   Per-link preamble length adaptation for the connectivity matrix protocol
+ *
+ *          Every link starts with the preamble length of the radio profile (phy_profile.h). The initiator measures
+ *          each exchange with a peer: whether it succeeded with valid STS, and the first-path power of the response.
+ *          After LINK_PHY_WINDOW exchanges it doubles the link's preamble when more than LINK_PHY_LOSS_TARGET_PCT of
+ *          them were lost, and halves it after LINK_PHY_SHRINK_WINDOWS windows in a row without loss and with every
+ *          first path above LINK_PHY_SHRINK_FP_DBM. Short links thus settle on a short preamble and far ones on a
+ *          long one.
+ *
+ *          The preamble length is a transmitter setting (dwt_setplenfine()): the initiator sends it in the poll and
+ *          the responder answers with the same length; the reply delay covers the link's preamble (twr_timing.h). The
+ *          receivers only need an SFD timeout that covers the longest preamble (link_phy_apply()). The data rate
+ *          stays the profile's, as the receiver has to be configured for it.
+ */
+
+#ifndef LINK_PHY_H_
+#define LINK_PHY_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <deca_device_api.h>
+#include <stdint.h>
+
+/* Largest number of nodes with their own link state */
+#define LINK_PHY_MAX_NODES 16
+
+/* Range of preamble lengths a link may use, in symbols, each step doubling or halving the length */
+#define LINK_PHY_PLEN_MIN 64
+#define LINK_PHY_PLEN_MAX 1024
+
+/* Exchanges per adaptation decision, and loss rate above which the preamble is made twice as long */
+#define LINK_PHY_WINDOW 8
+#define LINK_PHY_LOSS_TARGET_PCT 10
+
+/* The preamble is halved when, for LINK_PHY_SHRINK_WINDOWS windows in a row, no exchange was lost and every first
+ * path was received at least this strong, in dBm */
+#define LINK_PHY_SHRINK_FP_DBM (-90)
+#define LINK_PHY_SHRINK_WINDOWS 2
+
+/* First-path power of an exchange that got no response */
+#define LINK_PHY_FP_NONE INT16_MIN
+
+    /* Link statistics, totals since boot */
+    typedef struct
+    {
+        uint32_t exchanges; /* Exchanges measured */
+        uint32_t losses;    /* Of which got no response with valid STS */
+        uint16_t grows;     /* Preamble doublings */
+        uint16_t shrinks;   /* Preamble halvings */
+    } link_phy_stats_t;
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn link_phy_init()
+     *
+     * @brief Puts every link back on the radio profile's preamble length and clears the statistics. Call at boot and
+     *        when the network switches radio profile.
+     *
+     * @param base_plen - preamble length of the profile, in symbols
+     *
+     * @return none
+     */
+    void link_phy_init(uint16_t base_plen);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn link_phy_apply()
+     *
+     * @brief Raises the SFD timeout of a configuration so that frames with the longest link preamble are received.
+     *        Call before dwt_configure().
+     *
+     * @param cfg - configuration to update
+     *
+     * @return none
+     */
+    void link_phy_apply(dwt_config_t *cfg);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn link_phy_plen()
+     *
+     * @brief Returns the preamble length to poll a peer with.
+     *
+     * @param peer - id of the peer
+     *
+     * @return preamble length, in symbols
+     */
+    uint16_t link_phy_plen(uint8_t peer);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn link_phy_set_tx()
+     *
+     * @brief Makes the next transmissions use a preamble length (dwt_setplenfine()), and accounts their airtime with it.
+     *
+     * @param plen - preamble length in symbols, 0 for the profile's
+     *
+     * @return none
+     */
+    void link_phy_set_tx(uint16_t plen);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn link_phy_read_fp_dbm()
+     *
+     * @brief Reads the first-path power of the frame just received from the Ipatov diagnostics (DW3000 User Manual
+     *        4.7.1). The CIA diagnostics must be enabled (dwt_configciadiag(DW_CIA_DIAG_LOG_ALL)).
+     *
+     * @return first-path power, in dBm
+     */
+    int16_t link_phy_read_fp_dbm(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn link_phy_note()
+     *
+     * @brief Accounts one exchange with a peer and adapts the link's preamble at the end of a window.
+     *
+     * @param peer   - id of the peer
+     * @param ok     - 1 if the exchange gave a distance, 0 if it was lost
+     * @param fp_dbm - first-path power of the response, LINK_PHY_FP_NONE when lost
+     *
+     * @return none
+     */
+    void link_phy_note(uint8_t peer, int ok, int16_t fp_dbm);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn link_phy_get_stats()
+     *
+     * @brief Returns the statistics since boot.
+     *
+     * @return pointer to the statistics
+     */
+    const link_phy_stats_t *link_phy_get_stats(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn link_phy_print()
+     *
+     * @brief Prints a "LINK" line with the preamble length and last first-path power of every link, and the
+     *        statistics.
+     *
+     * @param self      - id of this node, skipped
+     * @param num_nodes - number of nodes of the network
+     *
+     * @return none
+     */
+    void link_phy_print(uint8_t self, uint8_t num_nodes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LINK_PHY_H_ */
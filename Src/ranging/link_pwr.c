@@ -0,0 +1,192 @@
+/*! ----------------------------------------------------------------------------
+ * @file    link_pwr.c
+ * @brief   Per-link transmit power control for the connectivity matrix protocol
+ *
+ *          See link_pwr.h for an overview.
+ */
+
+#include <link_phy.h>
+#include <link_pwr.h>
+#include <rf_cal.h>
+#include <stdio.h>
+#include <string.h>
+
+/* State of the link with one peer */
+typedef struct
+{
+    uint8_t atten_db; /* Attenuation of our frames to the peer */
+    uint8_t heard_fb; /* Level the peer's last frame was heard at, as feedback */
+} link_t;
+
+static link_t links[LINK_PWR_MAX_NODES];
+static link_pwr_stats_t stats;
+
+/* TX power setting of every attenuation, [0] is the profile's, and the setting in the DW IC */
+static uint32_t settings[LINK_PWR_RANGE_DB + 1];
+static uint32_t tx_power = 0;
+
+/* Boost over LINK_PWR_FLOOR of the profile's setting on channels 5 and 9, found once per setting */
+static uint32_t anchor_power[2];
+static uint16_t anchor_boost[2];
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn find_boost()
+ *
+ * @brief Finds the boost over LINK_PWR_FLOOR that dwt_adjust_tx_power() turns into the given setting, so that the
+ *        attenuations are counted from it. A setting the driver never produces from the floor is taken to be at the top
+ *        of its range.
+ *
+ * @return boost in 0.1 dB units
+ */
+static uint16_t find_boost(uint8_t chan, uint32_t power)
+{
+    uint32_t setting;
+    uint16_t boost, applied, top = 0;
+
+    for (boost = 0; boost <= LINK_PWR_BOOST_MAX; boost++)
+    {
+        if (dwt_adjust_tx_power(boost, LINK_PWR_FLOOR, chan, &setting, &applied) != DWT_SUCCESS)
+        {
+            continue;
+        }
+        if (setting == power)
+        {
+            return applied;
+        }
+        if (applied > top)
+        {
+            top = applied;
+        }
+    }
+    return top;
+}
+
+void link_pwr_init(void)
+{
+    int i;
+
+    memset(&stats, 0, sizeof(stats));
+    for (i = 0; i < LINK_PWR_MAX_NODES; i++)
+    {
+        links[i].atten_db = 0;
+        links[i].heard_fb = LINK_PWR_FB_NONE;
+    }
+}
+
+void link_pwr_start(uint8_t chan, const dwt_txconfig_t *txconfig)
+{
+    int ch9 = (chan == 9);
+    uint16_t applied;
+    int a;
+
+    if (anchor_power[ch9] != txconfig->power)
+    {
+        anchor_boost[ch9] = find_boost(chan, txconfig->power);
+        anchor_power[ch9] = txconfig->power;
+    }
+
+    settings[0] = txconfig->power;
+    for (a = 1; a <= LINK_PWR_RANGE_DB; a++)
+    {
+        /* a dB less boost than the profile's setting, down to the floor; a setting the driver cannot work out falls back
+         * to the one above */
+        if (anchor_boost[ch9] <= a * 10)
+        {
+            settings[a] = LINK_PWR_FLOOR;
+        }
+        else if (dwt_adjust_tx_power((uint16_t)(anchor_boost[ch9] - a * 10), LINK_PWR_FLOOR, chan, &settings[a], &applied) != DWT_SUCCESS)
+        {
+            settings[a] = settings[a - 1];
+        }
+    }
+    tx_power = txconfig->power;
+}
+
+void link_pwr_set_tx(uint8_t peer)
+{
+    dwt_txconfig_t txconfig;
+    uint32_t power = (peer < LINK_PWR_MAX_NODES) ? settings[links[peer].atten_db] : settings[0];
+
+    if (power == tx_power)
+    {
+        return;
+    }
+
+    /* Without a PG count dwt_configuretxrf() only writes the PG delay and the power, no bandwidth calibration */
+    txconfig.PGdly = rf_cal_get_stats()->pg_delay;
+    txconfig.power = power;
+    txconfig.PGcount = 0;
+    dwt_configuretxrf(&txconfig);
+    tx_power = power;
+    stats.writes++;
+}
+
+uint8_t link_pwr_feedback(uint8_t peer)
+{
+    return (peer < LINK_PWR_MAX_NODES) ? links[peer].heard_fb : LINK_PWR_FB_NONE;
+}
+
+void link_pwr_heard(uint8_t peer, int16_t fp_dbm)
+{
+    if (peer >= LINK_PWR_MAX_NODES)
+    {
+        return;
+    }
+    if (fp_dbm == LINK_PHY_FP_NONE)
+    {
+        links[peer].heard_fb = LINK_PWR_FB_NONE;
+    }
+    else
+    {
+        links[peer].heard_fb = (fp_dbm >= -1) ? 1 : (fp_dbm <= -255) ? 255 : (uint8_t)-fp_dbm;
+    }
+}
+
+void link_pwr_adjust(uint8_t peer, uint8_t fb)
+{
+    uint8_t atten;
+
+    if (peer >= LINK_PWR_MAX_NODES)
+    {
+        return;
+    }
+
+    atten = link_pwr_step(links[peer].atten_db, (fb == LINK_PWR_FB_NONE) ? 0 : -(int16_t)fb);
+    if (atten > links[peer].atten_db)
+    {
+        stats.lowered++;
+    }
+    else if (atten < links[peer].atten_db)
+    {
+        stats.raised++;
+    }
+    links[peer].atten_db = atten;
+}
+
+const link_pwr_stats_t *link_pwr_get_stats(void)
+{
+    return &stats;
+}
+
+void link_pwr_print(uint8_t self, uint8_t num_nodes)
+{
+    uint8_t peer;
+
+    printf("PWR");
+    for (peer = 0; peer < num_nodes && peer < LINK_PWR_MAX_NODES; peer++)
+    {
+        if (peer == self)
+        {
+            continue;
+        }
+        if (links[peer].heard_fb == LINK_PWR_FB_NONE)
+        {
+            printf(" %u:-%udB", (unsigned)peer, (unsigned)links[peer].atten_db);
+        }
+        else
+        {
+            printf(" %u:-%udB,heard=-%udBm", (unsigned)peer, (unsigned)links[peer].atten_db, (unsigned)links[peer].heard_fb);
+        }
+    }
+    printf(" lowered=%lu raised=%lu writes=%lu\n", (unsigned long)stats.lowered, (unsigned long)stats.raised, (unsigned long)stats.writes);
+}
@@ -0,0 +1,195 @@
+/*! ----------------------------------------------------------------------------
+ * @file    link_pwr.h
+ * @brief   Per-link transmit power control for the connectivity matrix protocol
+ *
+ *          Every frame used to go out at the TX power of the radio profile's txconfig, so a pair of nodes a metre
+ *          apart filled the same area with signal as a pair at the edge of range. Here each node keeps, for every
+ *          peer, an attenuation below that power. It is set before every poll or response to that peer, the other
+ *          frames (token, rows) keep the full power as every node has to hear them.
+ *
+ *          The loop is closed over the air: each poll and response carries the first-path power at which the sender
+ *          last heard the receiver (link_phy_read_fp_dbm()). The receiver lowers its power towards the peer by at most
+ *          LINK_PWR_STEP_DOWN_DB per exchange while that level is more than LINK_PWR_HYST_DB above
+ *          LINK_PWR_TARGET_DBM, raises it at once when it is below, and by LINK_PWR_LOSS_STEP_DB when the peer heard
+ *          nothing. The received level thus settles just above the target, which is kept above the level link_phy.h
+ *          needs to shorten the preamble.
+ *
+ *          The settings below full power come from dwt_adjust_tx_power() over LINK_PWR_FLOOR: the boost that gives
+ *          the profile's setting is found first, and attenuation a uses a dB less, down to the floor. They are only as
+ *          exact as the driver's gain tables; the loop only needs them to grow with the boost.
+ *          Tools/link_pwr_sim.c runs the same controller (link_pwr_step()) on random layouts and reports how many
+ *          more exchanges fit concurrently in the same channel.
+ */
+
+#ifndef LINK_PWR_H_
+#define LINK_PWR_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <deca_device_api.h>
+#include <stdint.h>
+
+/* Largest number of nodes with their own power setting */
+#define LINK_PWR_MAX_NODES 16
+
+/* Attenuations a link may use, 0 to LINK_PWR_RANGE_DB below the profile's TX power, in 1 dB steps */
+#define LINK_PWR_RANGE_DB 30
+
+/* First-path power the loop keeps each link at, and the band above it in which the power is left alone, in dBm and dB */
+#define LINK_PWR_TARGET_DBM (-85)
+#define LINK_PWR_HYST_DB    3
+
+/* Largest decrease per exchange, and increase after the peer heard nothing, in dB */
+#define LINK_PWR_STEP_DOWN_DB 2
+#define LINK_PWR_LOSS_STEP_DB 6
+
+/* Lowest TX power setting, fine gain 1 and coarse gain 0 on all four parts of the frame (see dwt_txconfig_t) */
+#define LINK_PWR_FLOOR 0x04040404UL
+
+/* Largest boost dwt_adjust_tx_power() applies over a setting, on channel 5 (305 on channel 9), in 0.1 dB units */
+#define LINK_PWR_BOOST_MAX 354
+
+/* Feedback of a frame: the first-path power the sender last heard the receiver at, as -dBm, or nothing heard */
+#define LINK_PWR_FB_NONE 0
+
+/* Peer value for the frames every node has to hear, sent at full power */
+#define LINK_PWR_ALL 0xFF
+
+    /* Power control statistics, totals since boot */
+    typedef struct
+    {
+        uint32_t lowered; /* Decreases of a link's power */
+        uint32_t raised;  /* Increases, after a weak or missed frame */
+        uint32_t writes;  /* TX power changes written to the DW IC */
+    } link_pwr_stats_t;
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn link_pwr_step()
+     *
+     * @brief The controller: gives the attenuation of a link after one exchange.
+     *
+     * @param atten_db - attenuation in use, 0 to LINK_PWR_RANGE_DB
+     * @param fb_dbm   - first-path power the peer heard us at, in dBm, or 0 when it heard nothing
+     *
+     * @return the new attenuation, in dB
+     */
+    static inline uint8_t link_pwr_step(uint8_t atten_db, int16_t fb_dbm)
+    {
+        int16_t a = atten_db;
+        int16_t excess = fb_dbm - (LINK_PWR_TARGET_DBM + LINK_PWR_HYST_DB);
+
+        if (fb_dbm == 0)
+        {
+            a -= LINK_PWR_LOSS_STEP_DB;
+        }
+        else if (fb_dbm < LINK_PWR_TARGET_DBM)
+        {
+            a -= LINK_PWR_TARGET_DBM - fb_dbm;
+        }
+        else if (excess > 0)
+        {
+            a += (excess < LINK_PWR_STEP_DOWN_DB) ? excess : LINK_PWR_STEP_DOWN_DB;
+        }
+        return (uint8_t)((a < 0) ? 0 : (a > LINK_PWR_RANGE_DB) ? LINK_PWR_RANGE_DB : a);
+    }
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn link_pwr_init()
+     *
+     * @brief Puts every link back on full power and clears the statistics. Call at boot.
+     *
+     * @return none
+     */
+    void link_pwr_init(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn link_pwr_start()
+     *
+     * @brief Works out the TX power setting of every attenuation for a channel, counted from the boost over
+     *        LINK_PWR_FLOOR that gives the profile's setting (looked up once per channel and setting). Call after
+     *        dwt_configuretxrf(), at every chip reset, hop and profile switch; the DW IC is then at full power.
+     *
+     * @param chan     - channel in use, 5 or 9
+     * @param txconfig - TX configuration of the channel, its power is the full power
+     *
+     * @return none
+     */
+    void link_pwr_start(uint8_t chan, const dwt_txconfig_t *txconfig);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn link_pwr_set_tx()
+     *
+     * @brief Makes the next transmissions use the power of a link, writing the DW IC only when it changes. Keeps the
+     *        pulse bandwidth of the last calibration (rf_cal.h).
+     *
+     * @param peer - id of the peer, LINK_PWR_ALL for full power
+     *
+     * @return none
+     */
+    void link_pwr_set_tx(uint8_t peer);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn link_pwr_feedback()
+     *
+     * @brief Returns the feedback to send to a peer: the first-path power its last frame was heard at.
+     *
+     * @param peer - id of the peer
+     *
+     * @return -dBm, or LINK_PWR_FB_NONE
+     */
+    uint8_t link_pwr_feedback(uint8_t peer);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn link_pwr_heard()
+     *
+     * @brief Records the first-path power a peer's frame was received at, sent back as feedback in the next frame to it.
+     *
+     * @param peer   - id of the peer
+     * @param fp_dbm - first-path power, LINK_PHY_FP_NONE when its frame was missed
+     *
+     * @return none
+     */
+    void link_pwr_heard(uint8_t peer, int16_t fp_dbm);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn link_pwr_adjust()
+     *
+     * @brief Adapts the power towards a peer to the feedback it sent.
+     *
+     * @param peer - id of the peer
+     * @param fb   - feedback of its frame, -dBm or LINK_PWR_FB_NONE
+     *
+     * @return none
+     */
+    void link_pwr_adjust(uint8_t peer, uint8_t fb);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn link_pwr_get_stats()
+     *
+     * @brief Returns the statistics since boot.
+     *
+     * @return pointer to the statistics
+     */
+    const link_pwr_stats_t *link_pwr_get_stats(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn link_pwr_print()
+     *
+     * @brief Prints a "PWR" line with the attenuation of every link and the level it was last heard at, and the
+     *        statistics.
+     *
+     * @param self      - id of this node, skipped
+     * @param num_nodes - number of nodes of the network
+     *
+     * @return none
+     */
+    void link_pwr_print(uint8_t self, uint8_t num_nodes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LINK_PWR_H_ */
@@ -0,0 +1,134 @@
+/*! ----------------------------------------------------------------------------
+ * @file    pdoa_angle.c
+ * @brief   Angle of arrival of the ranging frames from the phase difference between two receive antennas
+ *
+ *          See pdoa_angle.h for an overview.
+ */
+
+#include <pdoa_angle.h>
+#include <stdio.h>
+
+/* Carrier wavelengths, in micrometres */
+#define WAVELENGTH_CH5_UM 46196
+#define WAVELENGTH_CH9_UM 37534
+
+/* sin(theta) in Q15 per dwt_readpdoa() unit, in Q16: wavelength / (2 * pi * spacing), scaled from radians << 11 */
+#define SIN_GAIN_Q16(wavelength_um) ((int32_t)((16LL * 65536 * 1000000 * (wavelength_um)) / (6283185LL * PDOA_ANGLE_SPACING_UM)))
+
+/* pi in dwt_readpdoa() units */
+#define PI_Q11 6434
+
+#define SIN_ONE_Q15 32768
+#define SIN_MAX_Q15 (SIN_ONE_Q15 * PDOA_ANGLE_SIN_MAX_PCT / 100)
+
+/* asin(i / 64) in tenths of a degree, i = 0 to 64 */
+static const int16_t asin_ddeg[65] = {
+    0, 9, 18, 27, 36, 45, 54, 63, 72, 81, 90, 99, 108, 117, 126, 136, 145, 154, 163, 173, 182, 192,
+    201, 211, 220, 230, 240, 250, 259, 269, 280, 290, 300, 310, 321, 332, 342, 353, 364, 375, 387, 398,
+    410, 422, 434, 447, 460, 473, 486, 500, 514, 528, 543, 559, 575, 592, 610, 630, 650, 672, 696, 724,
+    756, 799, 900
+};
+
+static pdoa_angle_stats_t stats;
+
+void pdoa_angle_apply(dwt_config_t *cfg)
+{
+    if (PDOA_ANGLE_ENABLED)
+    {
+        cfg->pdoaMode = DWT_PDOA_M3;
+    }
+}
+
+int16_t pdoa_angle_from_pdoa(int16_t pdoa, uint8_t chan)
+{
+    int32_t gain = (chan == 9) ? SIN_GAIN_Q16(WAVELENGTH_CH9_UM) : SIN_GAIN_Q16(WAVELENGTH_CH5_UM);
+    int32_t sin_q15 = (int32_t)(((int64_t)pdoa * gain) >> 16);
+    int32_t mag = (sin_q15 < 0) ? -sin_q15 : sin_q15;
+    int32_t angle;
+    uint32_t idx, frac;
+
+    if (mag > SIN_MAX_Q15)
+    {
+        return PDOA_ANGLE_NONE;
+    }
+    if (mag >= SIN_ONE_Q15)
+    {
+        angle = asin_ddeg[64];
+    }
+    else
+    {
+        /* 64 table steps of 512 in Q15 */
+        idx = (uint32_t)mag >> 9;
+        frac = (uint32_t)mag & 511;
+        angle = asin_ddeg[idx] + (((asin_ddeg[idx + 1] - asin_ddeg[idx]) * (int32_t)frac + 256) >> 9);
+    }
+    return (int16_t)((sin_q15 < 0) ? -angle : angle);
+}
+
+pdoa_bearing_t pdoa_angle_read(uint8_t chan)
+{
+    pdoa_bearing_t bearing = { PDOA_ANGLE_NONE, 0 };
+    int16_t sts_qual;
+    int32_t pdoa;
+
+    if (!PDOA_ANGLE_ENABLED)
+    {
+        return bearing;
+    }
+
+    stats.reads++;
+    if (dwt_readstsquality(&sts_qual) < 0)
+    {
+        stats.bad_sts++;
+        return bearing;
+    }
+
+    /* Removing the offset may take the phase past +/-pi, wrap it back */
+    pdoa = (int32_t)dwt_readpdoa() - PDOA_ANGLE_OFFSET;
+    if (pdoa > PI_Q11)
+    {
+        pdoa -= 2 * PI_Q11;
+    }
+    else if (pdoa < -PI_Q11)
+    {
+        pdoa += 2 * PI_Q11;
+    }
+
+    bearing.angle_ddeg = pdoa_angle_from_pdoa((int16_t)pdoa, chan);
+    if (bearing.angle_ddeg == PDOA_ANGLE_NONE)
+    {
+        stats.out_of_range++;
+        return bearing;
+    }
+    bearing.valid = 1;
+    return bearing;
+}
+
+const pdoa_angle_stats_t *pdoa_angle_get_stats(void)
+{
+    return &stats;
+}
+
+void pdoa_angle_print(const pdoa_bearing_t *bearings, uint8_t self, uint8_t num_nodes)
+{
+    uint8_t peer;
+
+    printf("AOA");
+    for (peer = 0; peer < num_nodes; peer++)
+    {
+        if (peer == self)
+        {
+            continue;
+        }
+        if (bearings[peer].valid)
+        {
+            printf(" %u:%.1fdeg", (unsigned)peer, bearings[peer].angle_ddeg / 10.0);
+        }
+        else
+        {
+            printf(" %u:-", (unsigned)peer);
+        }
+    }
+    printf(" reads=%lu bad_sts=%lu out_of_range=%lu\n", (unsigned long)stats.reads, (unsigned long)stats.bad_sts,
+        (unsigned long)stats.out_of_range);
+}
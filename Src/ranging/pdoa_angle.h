@@ -0,0 +1,126 @@
+/*! ----------------------------------------------------------------------------
+ * @file    pdoa_angle.h
+ * @brief   Angle of arrival of the ranging frames from the phase difference between two receive antennas
+ *
+ *          A DW3000 with two receive antennas (the PDoA variants of the module, not the single-antenna DWM3001CDK)
+ *          measures the carrier phase difference of a frame between them. With PDoA mode 3 the STS is received on one
+ *          antenna for its first half and on the other for its second, so the measurement comes with every secure
+ *          frame at no extra airtime (ex_02h_simple_rx_pdoa). For antennas PDOA_ANGLE_SPACING_UM apart, a frame
+ *          arriving at an angle theta from broadside shows a difference of
+ *
+ *              pdoa = 2 * pi * spacing * sin(theta) / wavelength
+ *
+ *          so sin(theta) follows from the reading with one multiply by a per-channel constant, and theta from a small
+ *          arcsine table with linear interpolation, all in integers: an angle per frame costs a register read and a
+ *          few instructions, next to the timestamps.
+ *
+ *          An angle is only reported valid when the frame's STS was good (the phase is measured on it) and the sine
+ *          stays within PDOA_ANGLE_SIN_MAX_PCT of full scale. Readings further out come from a wrong calibration or
+ *          from multipath, and are dropped rather than clamped to the end of the range. The board's own phase offset,
+ *          measured with a source at broadside, goes in PDOA_ANGLE_OFFSET.
+ */
+
+#ifndef PDOA_ANGLE_H_
+#define PDOA_ANGLE_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <deca_device_api.h>
+#include <stdint.h>
+
+/* 1 on nodes with two receive antennas. The DWM3001CDK has one, and a PDoA reading there means nothing. */
+#define PDOA_ANGLE_ENABLED 0
+
+/* Distance between the antenna phase centres, in micrometres. Half the channel 5 wavelength by default. */
+#define PDOA_ANGLE_SPACING_UM 23100
+
+/* Phase offset of the board at broadside, in dwt_readpdoa() units (radians << 11), subtracted from every reading */
+#define PDOA_ANGLE_OFFSET 0
+
+/* Largest |sin(theta)| accepted, in percent. Readings up to it are taken as +/-90 degrees, beyond it as invalid. */
+#define PDOA_ANGLE_SIN_MAX_PCT 110
+
+/* Angle of a frame without a valid measurement */
+#define PDOA_ANGLE_NONE INT16_MIN
+
+    /* Angle of arrival of the last frame from one peer */
+    typedef struct
+    {
+        int16_t angle_ddeg; /* In tenths of a degree from broadside, -900 to 900, PDOA_ANGLE_NONE when not valid */
+        uint8_t valid;      /* 1 when angle_ddeg was measured on a frame with good STS and is in range */
+    } pdoa_bearing_t;
+
+    /* Measurement statistics, totals since boot */
+    typedef struct
+    {
+        uint32_t reads;        /* Frames whose phase difference was read */
+        uint32_t bad_sts;      /* Of which the STS quality was too low to trust the phase */
+        uint32_t out_of_range; /* Of which the sine came out beyond PDOA_ANGLE_SIN_MAX_PCT */
+    } pdoa_angle_stats_t;
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn pdoa_angle_apply()
+     *
+     * @brief Selects PDoA mode 3 in a configuration when PDOA_ANGLE_ENABLED. Call after sts_link_apply() and before
+     *        dwt_configure().
+     *
+     * @param cfg - configuration to update
+     *
+     * @return none
+     */
+    void pdoa_angle_apply(dwt_config_t *cfg);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn pdoa_angle_from_pdoa()
+     *
+     * @brief Converts a phase difference to an angle of arrival.
+     *
+     * @param pdoa - phase difference as dwt_readpdoa() returns it, offset already removed
+     * @param chan - channel it was measured on, 5 or 9
+     *
+     * @return angle in tenths of a degree, PDOA_ANGLE_NONE when the sine is out of range
+     */
+    int16_t pdoa_angle_from_pdoa(int16_t pdoa, uint8_t chan);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn pdoa_angle_read()
+     *
+     * @brief Measures the angle of arrival of the frame just received. Call after the timestamps are read and before
+     *        the receiver is enabled again.
+     *
+     * @param chan - channel in use
+     *
+     * @return the angle, with valid cleared when PDoA is disabled, the STS was bad or the reading is out of range
+     */
+    pdoa_bearing_t pdoa_angle_read(uint8_t chan);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn pdoa_angle_get_stats()
+     *
+     * @brief Returns the statistics since boot.
+     *
+     * @return pointer to the statistics
+     */
+    const pdoa_angle_stats_t *pdoa_angle_get_stats(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn pdoa_angle_print()
+     *
+     * @brief Prints an "AOA" line with the last angle to every peer and the statistics.
+     *
+     * @param bearings  - last angle to every node, indexed by node id
+     * @param self      - our node id, skipped
+     * @param num_nodes - number of nodes
+     *
+     * @return none
+     */
+    void pdoa_angle_print(const pdoa_bearing_t *bearings, uint8_t self, uint8_t num_nodes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PDOA_ANGLE_H_ */
@@ -0,0 +1,137 @@
+/*! ----------------------------------------------------------------------------
+ * @file    phy_profile.c
+ * @brief   Radio profiles of the connectivity matrix protocol, switched by the whole network at runtime
+ *
+ *          See phy_profile.h for an overview.
+ */
+
+#include <phy_profile.h>
+#include <port.h>
+#include <stdio.h>
+
+/* TX power and pulse shape of each channel, see config_options.c */
+extern dwt_txconfig_t txconfig_options;
+extern dwt_txconfig_t txconfig_options_ch9;
+#define TXCONFIG_5 &txconfig_options
+#define TXCONFIG_9 &txconfig_options_ch9
+
+/* One profile: channel, preamble length in symbols, preamble code, data rate (850K or 6M8) and STS length, the other
+ * settings are those shared by all the options of config_options.c */
+#define PHY_PROFILE(ch, plen, code, rate, sts)                                                                                                                \
+    {                                                                                                                                                         \
+        { ch, DWT_PLEN_##plen, DWT_PAC8, code, code, DWT_SFD_IEEE_4Z, DWT_BR_##rate, DWT_PHRMODE_STD, DWT_PHRRATE_STD, (plen + 1 + 8 - 8), DWT_STS_MODE_1, \
+            DWT_STS_LEN_##sts, DWT_PDOA_M0 },                                                                                                                 \
+            TXCONFIG_##ch                                                                                                                                     \
+    }
+
+/* Same order as CONFIG_OPTION_01..33 */
+static const phy_profile_t profiles[PHY_PROFILE_COUNT] = {
+    PHY_PROFILE(5, 64, 9, 850K, 64),   PHY_PROFILE(9, 64, 9, 850K, 64),   PHY_PROFILE(5, 128, 9, 850K, 64),  PHY_PROFILE(9, 128, 9, 850K, 64),
+    PHY_PROFILE(5, 512, 9, 850K, 64),  PHY_PROFILE(9, 512, 9, 850K, 64),  PHY_PROFILE(5, 1024, 9, 850K, 64), PHY_PROFILE(9, 1024, 9, 850K, 64),
+    PHY_PROFILE(5, 64, 10, 850K, 64),  PHY_PROFILE(9, 64, 10, 850K, 64),  PHY_PROFILE(5, 128, 10, 850K, 64), PHY_PROFILE(9, 128, 10, 850K, 64),
+    PHY_PROFILE(5, 512, 10, 850K, 64), PHY_PROFILE(9, 512, 10, 850K, 64), PHY_PROFILE(5, 1024, 10, 850K, 64), PHY_PROFILE(9, 1024, 10, 850K, 64),
+    PHY_PROFILE(5, 64, 9, 6M8, 64),    PHY_PROFILE(9, 64, 9, 6M8, 64),    PHY_PROFILE(5, 128, 9, 6M8, 64),   PHY_PROFILE(9, 128, 9, 6M8, 64),
+    PHY_PROFILE(5, 512, 9, 6M8, 64),   PHY_PROFILE(9, 512, 9, 6M8, 64),   PHY_PROFILE(5, 1024, 9, 6M8, 64),  PHY_PROFILE(9, 1024, 9, 6M8, 64),
+    PHY_PROFILE(5, 64, 10, 6M8, 64),   PHY_PROFILE(9, 64, 10, 6M8, 64),   PHY_PROFILE(5, 128, 10, 6M8, 64),  PHY_PROFILE(9, 128, 10, 6M8, 64),
+    PHY_PROFILE(5, 512, 10, 6M8, 64),  PHY_PROFILE(9, 512, 10, 6M8, 64),  PHY_PROFILE(5, 1024, 10, 6M8, 64), PHY_PROFILE(9, 1024, 10, 6M8, 64),
+    PHY_PROFILE(5, 128, 9, 6M8, 128),
+};
+
+/* Active profile, pending switch and its time on the local clock */
+static uint8_t active = PHY_PROFILE_DEFAULT;
+static uint8_t next = PHY_PROFILE_NONE;
+static uint32_t switch_at_ms = 0;
+
+const phy_profile_t *phy_profile_get(uint8_t option)
+{
+    return (option >= 1 && option <= PHY_PROFILE_COUNT) ? &profiles[option - 1] : NULL;
+}
+
+const phy_profile_t *phy_profile_active(void)
+{
+    return &profiles[active - 1];
+}
+
+void phy_profile_apply(dwt_config_t *cfg)
+{
+    *cfg = phy_profile_active()->config;
+}
+
+int phy_profile_request(uint8_t option)
+{
+    if (!phy_profile_get(option))
+    {
+        return -1;
+    }
+    next = option;
+    switch_at_ms = port_get_tick_ms() + PHY_SWITCH_LEAD_MS;
+    return 0;
+}
+
+void phy_profile_announce(uint8_t *next_out, uint16_t *in_ms)
+{
+    int32_t left = (int32_t)(switch_at_ms - port_get_tick_ms());
+
+    *next_out = next;
+    *in_ms = (next == PHY_PROFILE_NONE || left < 0) ? 0 : (uint16_t)left;
+}
+
+void phy_profile_follow(uint8_t option, uint16_t in_ms)
+{
+    /* Announcements are repeated by every node until the switch, the first one heard sets the time */
+    if (!phy_profile_get(option) || option == next || (option == active && next == PHY_PROFILE_NONE))
+    {
+        return;
+    }
+    next = option;
+    switch_at_ms = port_get_tick_ms() + in_ms;
+}
+
+int phy_profile_poll(void)
+{
+    if (next == PHY_PROFILE_NONE || (int32_t)(port_get_tick_ms() - switch_at_ms) < 0)
+    {
+        return 0;
+    }
+    active = next;
+    next = PHY_PROFILE_NONE;
+    return 1;
+}
+
+/* Preamble length in symbols, data rate and channel of a profile, as "ch5 plen128 6M8" */
+static void print_profile(const phy_profile_t *p)
+{
+    static const uint16_t plen[] = { [DWT_PLEN_64] = 64, [DWT_PLEN_128] = 128, [DWT_PLEN_512] = 512, [DWT_PLEN_1024] = 1024 };
+
+    printf("ch%u plen%u code%u %s", (unsigned)p->config.chan, (unsigned)plen[p->config.txPreambLength], (unsigned)p->config.txCode,
+        (p->config.dataRate == DWT_BR_6M8) ? "6M8" : "850K");
+}
+
+void phy_profile_print(void)
+{
+    uint8_t pending;
+    uint16_t in_ms;
+
+    printf("PHY profile=%u ", (unsigned)active);
+    print_profile(phy_profile_active());
+    phy_profile_announce(&pending, &in_ms);
+    if (pending != PHY_PROFILE_NONE)
+    {
+        printf(" switch=%u in=%ums", (unsigned)pending, (unsigned)in_ms);
+    }
+    printf("\n");
+}
+
+void phy_profile_print_table(void)
+{
+    uint8_t option;
+
+    for (option = 1; option <= PHY_PROFILE_COUNT; option++)
+    {
+        const phy_profile_t *p = phy_profile_get(option);
+
+        printf("%2u ", (unsigned)option);
+        print_profile(p);
+        printf("%s\n", (option == active) ? " *" : "");
+    }
+}
@@ -0,0 +1,142 @@
+/*! ----------------------------------------------------------------------------
+ * @file    phy_profile.h
+ * @brief   Radio profiles of the connectivity matrix protocol, switched by the whole network at runtime
+ *
+ *          The 33 configurations of config_options.c (CONFIG_OPTION_01..33) are all compiled into one const table,
+ *          numbered as there. The ranging delays and timeouts follow from the profile at runtime, see twr_timing.h.
+ *
+ *          A switch is requested on one node with the "phy N" console command. It is announced in the header of
+ *          every frame the node sends as the next profile and the time left before the switch, and every node that
+ *          hears it adopts it and announces it in turn, so the countdown reaches the whole network. When it expires
+ *          each node moves to the new profile between two exchanges. The lead time must let every node hear at least
+ *          one frame: a node that missed the announcement stays on the old profile.
+ *
+ *          The profile's channel is only used with hopping disabled, chan_hop_apply() overrides it (see chan_hop.h).
+ */
+
+#ifndef PHY_PROFILE_H_
+#define PHY_PROFILE_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <deca_device_api.h>
+#include <stdint.h>
+
+/* Number of profiles, profile used after boot (channel 5, 128-symbol preamble, 6.8 Mb/s) and "no switch pending" */
+#define PHY_PROFILE_COUNT 33
+#define PHY_PROFILE_DEFAULT 19
+#define PHY_PROFILE_NONE 0
+
+/* Time between a switch request and the switch, in milliseconds. Must cover a few token rounds. */
+#define PHY_SWITCH_LEAD_MS 10000
+
+    /* A radio profile */
+    typedef struct
+    {
+        dwt_config_t config;      /* As in config_options.c, the STS fields are overwritten by sts_link_apply() */
+        dwt_txconfig_t *txconfig; /* TX power and pulse shape of the channel, see config_options.c */
+    } phy_profile_t;
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn phy_profile_get()
+     *
+     * @brief Returns a profile of the table.
+     *
+     * @param option - profile number, 1 to PHY_PROFILE_COUNT as CONFIG_OPTION_xx
+     *
+     * @return the profile, NULL for an unknown number
+     */
+    const phy_profile_t *phy_profile_get(uint8_t option);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn phy_profile_active()
+     *
+     * @brief Returns the profile in use.
+     *
+     * @return the active profile
+     */
+    const phy_profile_t *phy_profile_active(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn phy_profile_apply()
+     *
+     * @brief Copies the PHY settings of the active profile into a configuration. Call before sts_link_apply() and
+     *        dwt_configure(), then set the TX power from the profile's txconfig.
+     *
+     * @param cfg - configuration to update
+     *
+     * @return none
+     */
+    void phy_profile_apply(dwt_config_t *cfg);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn phy_profile_request()
+     *
+     * @brief Schedules a switch of the whole network to another profile, PHY_SWITCH_LEAD_MS from now.
+     *
+     * @param option - profile number
+     *
+     * @return 0 on success, -1 for an unknown number
+     */
+    int phy_profile_request(uint8_t option);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn phy_profile_announce()
+     *
+     * @brief Gives the pending switch to write in an outgoing frame.
+     *
+     * @param next  - set to the profile switched to, PHY_PROFILE_NONE when no switch is pending
+     * @param in_ms - set to the time left before the switch, in milliseconds
+     *
+     * @return none
+     */
+    void phy_profile_announce(uint8_t *next, uint16_t *in_ms);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn phy_profile_follow()
+     *
+     * @brief Adopts the switch announced in a received frame, unless it is already pending or done.
+     *
+     * @param next  - profile announced
+     * @param in_ms - time left before the switch
+     *
+     * @return none
+     */
+    void phy_profile_follow(uint8_t next, uint16_t in_ms);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn phy_profile_poll()
+     *
+     * @brief Makes the pending profile active once its switch time has come. Call between exchanges.
+     *
+     * @return 1 if the profile changed and the DW IC has to be reconfigured (phy_profile_apply(), sts_link_apply(),
+     *         dwt_configure(), sts_link_start(), dwt_configuretxrf()), 0 otherwise
+     */
+    int phy_profile_poll(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn phy_profile_print()
+     *
+     * @brief Prints a "PHY" line with the active profile and the pending switch.
+     *
+     * @return none
+     */
+    void phy_profile_print(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn phy_profile_print_table()
+     *
+     * @brief Prints every profile, the active one marked.
+     *
+     * @return none
+     */
+    void phy_profile_print_table(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PHY_PROFILE_H_ */
@@ -0,0 +1,139 @@
+/*! ----------------------------------------------------------------------------
+ * @file    ranging_profile.c
+ * @brief   MAC header profiles of ranging frames
+ *
+ *          See ranging_profile.h for an overview.
+ */
+
+#include <airtime.h>
+#include <mac_mhr.h>
+#include <ranging_profile.h>
+#include <stdio.h>
+
+/* Frame control fields of each profile: 2015 frame for the extended profile, as the AES examples, 2006 for the short
+ * one, whose PAN ID compression leaves only the destination PAN ID */
+typedef struct
+{
+    const char *name;
+    uint8_t version;
+    uint8_t addr_mode;
+    uint8_t addr_len;
+} profile_def_t;
+
+static const profile_def_t profiles[RANGING_PROFILE_COUNT] = {
+    [RANGING_PROFILE_EXT] = { "ext", MAC_MHR_VERSION_2015, MAC_MHR_ADDR_EXT, 8 },
+    [RANGING_PROFILE_SHORT] = { "short", MAC_MHR_VERSION_2006, MAC_MHR_ADDR_SHORT, 2 },
+};
+
+/* MHR of a frame of the given type of a profile, requesting an acknowledgement or not */
+static uint8_t mhr_write(uint8_t *buf, ranging_profile_e profile, const ranging_addr_t *addr, uint8_t frame_type, uint8_t ack_request)
+{
+    const profile_def_t *p = &profiles[profile];
+    mac_mhr_fields_t fields = { 0 };
+    uint64_t mask = (p->addr_len == 8) ? UINT64_MAX : 0xFFFF;
+
+    fields.frame_type = frame_type;
+    fields.ack_request = ack_request;
+    fields.version = p->version;
+    fields.dest_mode = p->addr_mode;
+    fields.src_mode = p->addr_mode;
+    fields.seq = addr->seq;
+    fields.dest_pan = addr->pan_id;
+    fields.src_pan = addr->pan_id;
+    fields.dest_addr = addr->dest & mask;
+    fields.src_addr = addr->src & mask;
+    return mac_mhr_build(buf, &fields);
+}
+
+/* Parses the MHR of a received frame of the given type of a profile, 0 if it is not one */
+static uint8_t mhr_read(ranging_profile_e profile, uint8_t frame_type, const uint8_t *frame, uint16_t frame_len, ranging_addr_t *addr)
+{
+    const profile_def_t *p = &profiles[profile];
+    mac_mhr_t mhr;
+    uint16_t len = mac_mhr_parse(&mhr, frame, frame_len);
+
+    /* Same frame control as mhr_write() writes, so the fields are where RANGING_MHR_LEN() expects them */
+    if (!len || len != RANGING_MHR_LEN(profile) || MAC_MHR_FRAME_TYPE(&mhr) != frame_type || MAC_MHR_SECURED(&mhr)
+        || ((mhr.fc >> MAC_MHR_FC_VERSION_SHIFT) & 3) != p->version || ((mhr.fc >> MAC_MHR_FC_DEST_MODE_SHIFT) & 3) != p->addr_mode
+        || ((mhr.fc >> MAC_MHR_FC_SRC_MODE_SHIFT) & 3) != p->addr_mode)
+    {
+        return 0;
+    }
+
+    addr->seq = MAC_MHR_SEQ(&mhr);
+    addr->pan_id = MAC_MHR_DEST_PAN(&mhr);
+    addr->dest = MAC_MHR_DEST_ADDR(&mhr);
+    addr->src = MAC_MHR_SRC_ADDR(&mhr);
+    return (uint8_t)len;
+}
+
+uint8_t ranging_mhr_write(uint8_t *buf, ranging_profile_e profile, const ranging_addr_t *addr)
+{
+    return mhr_write(buf, profile, addr, MAC_MHR_TYPE_DATA, 0);
+}
+
+uint8_t ranging_mhr_read(ranging_profile_e profile, const uint8_t *frame, uint16_t frame_len, ranging_addr_t *addr)
+{
+    return mhr_read(profile, MAC_MHR_TYPE_DATA, frame, frame_len, addr);
+}
+
+uint8_t ranging_data_request_write(uint8_t *buf, ranging_profile_e profile, const ranging_addr_t *addr)
+{
+    uint8_t len = mhr_write(buf, profile, addr, MAC_MHR_TYPE_COMMAND, 1);
+
+    buf[len] = RANGING_CMD_DATA_REQUEST;
+    return len + 1;
+}
+
+uint8_t ranging_data_request_read(ranging_profile_e profile, const uint8_t *frame, uint16_t frame_len, ranging_addr_t *addr)
+{
+    uint8_t len = mhr_read(profile, MAC_MHR_TYPE_COMMAND, frame, frame_len, addr);
+
+    return len && (frame_len == len + 1) && (frame[len] == RANGING_CMD_DATA_REQUEST);
+}
+
+int ranging_ack_read(const uint8_t *frame, uint16_t frame_len, uint8_t seq)
+{
+    mac_mhr_t mhr;
+
+    if (!mac_mhr_parse(&mhr, frame, frame_len) || MAC_MHR_FRAME_TYPE(&mhr) != MAC_MHR_TYPE_ACK || !MAC_MHR_HAS_SEQ(&mhr) || MAC_MHR_SEQ(&mhr) != seq)
+    {
+        return -1;
+    }
+    return (mhr.fc & MAC_MHR_FC_FRAME_PENDING) != 0;
+}
+
+const char *ranging_profile_name(ranging_profile_e profile)
+{
+    return profiles[profile].name;
+}
+
+/* On-air time of one exchange with the MHR of a profile, in nanoseconds */
+static uint32_t exchange_ns(const dwt_config_t *cfg, ranging_profile_e profile, const uint16_t *body_lens, int num_frames)
+{
+    uint32_t ns = 0;
+    int i;
+
+    for (i = 0; i < num_frames; i++)
+    {
+        ns += airtime_frame_duration_ns(cfg, RANGING_MHR_LEN(profile) + body_lens[i] + FCS_LEN);
+    }
+    return ns;
+}
+
+void ranging_profile_print_airtime(const dwt_config_t *cfg, ranging_profile_e profile, const uint16_t *body_lens, int num_frames)
+{
+    uint32_t ext_ns = exchange_ns(cfg, RANGING_PROFILE_EXT, body_lens, num_frames);
+    uint32_t used_ns = exchange_ns(cfg, profile, body_lens, num_frames);
+    int p;
+
+    for (p = 0; p < RANGING_PROFILE_COUNT; p++)
+    {
+        uint32_t ns = exchange_ns(cfg, (ranging_profile_e)p, body_lens, num_frames);
+
+        printf("FRAME %s mhr=%uB exchange=%lu.%luus%s\n", profiles[p].name, (unsigned)RANGING_MHR_LEN(p), (unsigned long)(ns / 1000),
+            (unsigned long)((ns / 100) % 10), (p == profile) ? " (in use)" : "");
+    }
+    printf("FRAME saved=%luus per exchange (%lu/1000 of its airtime)\n", (unsigned long)((ext_ns - used_ns) / 1000),
+        (unsigned long)(ext_ns ? (uint64_t)(ext_ns - used_ns) * 1000 / ext_ns : 0));
+}
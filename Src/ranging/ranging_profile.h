@@ -0,0 +1,157 @@
+/*! ----------------------------------------------------------------------------
+ * @file    ranging_profile.h
+ * @brief   MAC header profiles of ranging frames
+ *
+ *          A ranging protocol sends standard 802.15.4 data frames and picks, once, the MHR profile of its frames. The
+ *          extended profile is the layout of the AES examples: 64-bit destination and source addresses and the
+ *          destination PAN ID, 21 bytes. The short profile uses 16-bit addresses and PAN ID compression: frame
+ *          control, sequence number, one PAN ID and the two addresses, 9 bytes, the smallest MHR that still carries
+ *          both addresses and a sequence number. Both are built and parsed with mac_mhr.h.
+ *
+ *          Every byte of MHR is sent twice per single-sided exchange, so the 12 bytes saved by the short profile are a
+ *          sizeable part of the short poll and response frames. ranging_profile_print_airtime() prints what each
+ *          profile costs for the frames of a protocol with the configured data rate, preamble and STS.
+ *
+ *          A protocol can also ask a node whether it has data with a MAC data request command. With the short profile
+ *          (2006 frames) the DW IC of the node answers it with a hardware acknowledgement whose frame pending bit is
+ *          set when the requester's address is in one of its LE_PEND registers (see ex_15_le_pend): the requester
+ *          learns from a 5-byte frame, sent without any help from the node's firmware, whether a data frame follows.
+ *          The DW IC only sets the bit for frame versions 2003 and 2006, so this does not work with the extended
+ *          profile.
+ */
+
+#ifndef RANGING_PROFILE_H_
+#define RANGING_PROFILE_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <deca_device_api.h>
+#include <stdint.h>
+
+    typedef enum
+    {
+        RANGING_PROFILE_EXT = 0, /* 64-bit addresses and destination PAN ID */
+        RANGING_PROFILE_SHORT,   /* 16-bit addresses, PAN ID compression */
+        RANGING_PROFILE_COUNT
+    } ranging_profile_e;
+
+/* MHR length of each profile, a compile-time constant so that frame buffers and layouts can be sized with it */
+#define RANGING_MHR_LEN_EXT       (2 + 1 + 2 + 8 + 8)
+#define RANGING_MHR_LEN_SHORT     (2 + 1 + 2 + 2 + 2)
+#define RANGING_MHR_LEN(profile)  (((profile) == RANGING_PROFILE_EXT) ? RANGING_MHR_LEN_EXT : RANGING_MHR_LEN_SHORT)
+#define RANGING_MHR_MAX_LEN       RANGING_MHR_LEN_EXT
+
+/* MAC command identifier of a data request (IEEE 802.15.4), the length of a data request of a profile without its FCS,
+ * and the length of an immediate acknowledgement with its FCS */
+#define RANGING_CMD_DATA_REQUEST          0x04
+#define RANGING_DATA_REQUEST_LEN(profile) (RANGING_MHR_LEN(profile) + 1)
+#define RANGING_ACK_FRAME_LEN             5
+
+    /* Addressing of a ranging frame. With the short profile only the low 16 bits of the addresses are sent. */
+    typedef struct
+    {
+        uint8_t seq;
+        uint16_t pan_id;
+        uint64_t dest;
+        uint64_t src;
+    } ranging_addr_t;
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn ranging_mhr_write()
+     *
+     * @brief Writes the MHR of a data frame of the given profile.
+     *
+     * @param buf     - destination, at least RANGING_MHR_LEN(profile) bytes
+     * @param profile - MHR profile
+     * @param addr    - sequence number, PAN ID and addresses
+     *
+     * @return the MHR length, RANGING_MHR_LEN(profile)
+     */
+    uint8_t ranging_mhr_write(uint8_t *buf, ranging_profile_e profile, const ranging_addr_t *addr);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn ranging_mhr_read()
+     *
+     * @brief Parses the MHR of a received frame, which must be an unsecured data frame of the given profile.
+     *
+     * @param profile   - MHR profile the protocol uses
+     * @param frame     - received frame
+     * @param frame_len - length of the frame, without the FCS
+     * @param addr      - receives the sequence number, PAN ID and addresses
+     *
+     * @return the MHR length, where the payload starts, or 0 if the frame is not a data frame of that profile
+     */
+    uint8_t ranging_mhr_read(ranging_profile_e profile, const uint8_t *frame, uint16_t frame_len, ranging_addr_t *addr);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn ranging_data_request_write()
+     *
+     * @brief Writes a MAC data request command of the given profile, requesting an acknowledgement.
+     *
+     * @param buf     - destination, at least RANGING_DATA_REQUEST_LEN(profile) bytes
+     * @param profile - MHR profile
+     * @param addr    - sequence number, PAN ID and addresses
+     *
+     * @return the frame length without the FCS, RANGING_DATA_REQUEST_LEN(profile)
+     */
+    uint8_t ranging_data_request_write(uint8_t *buf, ranging_profile_e profile, const ranging_addr_t *addr);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn ranging_data_request_read()
+     *
+     * @brief Checks whether a received frame is a data request of the given profile, written by
+     *        ranging_data_request_write().
+     *
+     * @param profile   - MHR profile the protocol uses
+     * @param frame     - received frame
+     * @param frame_len - length of the frame, without the FCS
+     * @param addr      - receives the sequence number, PAN ID and addresses
+     *
+     * @return 1 for a data request, 0 otherwise
+     */
+    uint8_t ranging_data_request_read(ranging_profile_e profile, const uint8_t *frame, uint16_t frame_len, ranging_addr_t *addr);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn ranging_ack_read()
+     *
+     * @brief Parses a received acknowledgement.
+     *
+     * @param frame     - received frame
+     * @param frame_len - length of the frame, without the FCS
+     * @param seq       - sequence number of the acknowledged frame
+     *
+     * @return its frame pending bit, or -1 if the frame is not an acknowledgement of seq
+     */
+    int ranging_ack_read(const uint8_t *frame, uint16_t frame_len, uint8_t seq);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn ranging_profile_name()
+     *
+     * @return the name of a profile, as printed in the FRAME lines
+     */
+    const char *ranging_profile_name(ranging_profile_e profile);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn ranging_profile_print_airtime()
+     *
+     * @brief Prints one "FRAME" line per profile with its MHR length and the on-air time of one exchange made of the
+     *        given frames, computed with airtime_frame_duration_ns() for the PHY configuration, then how much the
+     *        profile in use saves per exchange over the extended one.
+     *
+     * @param cfg        - PHY configuration of the protocol
+     * @param profile    - profile in use
+     * @param body_lens  - length of each frame of one exchange after the MHR, without the FCS
+     * @param num_frames - number of entries in body_lens
+     *
+     * @return none
+     */
+    void ranging_profile_print_airtime(const dwt_config_t *cfg, ranging_profile_e profile, const uint16_t *body_lens, int num_frames);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RANGING_PROFILE_H_ */
@@ -0,0 +1,102 @@
+/*! ----------------------------------------------------------------------------
+ * @file    rf_cal.c
+ * @brief   Background PLL and pulse bandwidth recalibration following the DW IC temperature
+ *
+ *          See rf_cal.h for an overview.
+ */
+
+#include <math.h>
+#include <port.h>
+#include <rf_cal.h>
+#include <stdio.h>
+
+/* TX configuration of the channel in use, and temperatures of the last calibrations */
+static dwt_txconfig_t *txcfg = NULL;
+static float pll_ref_c;
+static float bw_ref_c;
+
+static uint32_t next_sample_ms = 0;
+static rf_cal_stats_t stats;
+
+static float read_temp_c(void)
+{
+    return dwt_convertrawtemperature((uint8_t)(dwt_readtempvbat() >> 8));
+}
+
+/* Microseconds since a CPU cycle count, accounted into a calibration's timing */
+static void note_duration(rf_cal_timing_t *t, uint32_t start_cycles)
+{
+    t->last_us = (port_get_cycles() - start_cycles) / (SystemCoreClock / 1000000);
+    if (t->last_us > t->max_us)
+    {
+        t->max_us = t->last_us;
+    }
+    t->runs++;
+}
+
+void rf_cal_start(dwt_txconfig_t *txconfig)
+{
+    txcfg = txconfig;
+
+    /* Reference measurement, with the PLL idle after dwt_configure(), or the PG delay that meets it at this temperature */
+    if (txcfg->PGcount == 0)
+    {
+        txcfg->PGcount = dwt_calcpgcount(txcfg->PGdly);
+        stats.pg_delay = txcfg->PGdly;
+    }
+    else
+    {
+        stats.pg_delay = dwt_calcbandwidthadj(txcfg->PGcount);
+    }
+    stats.pg_count = txcfg->PGcount;
+
+    stats.temp_c = read_temp_c();
+    pll_ref_c = stats.temp_c;
+    bw_ref_c = stats.temp_c;
+    next_sample_ms = port_get_tick_ms() + RF_CAL_SAMPLE_MS;
+}
+
+void rf_cal_poll(void)
+{
+    uint32_t start;
+
+    if (!txcfg || (int32_t)(port_get_tick_ms() - next_sample_ms) < 0)
+    {
+        return;
+    }
+    next_sample_ms = port_get_tick_ms() + RF_CAL_SAMPLE_MS;
+    stats.temp_c = read_temp_c();
+
+    if (fabsf(stats.temp_c - pll_ref_c) >= RF_CAL_PLL_DELTA_C)
+    {
+        start = port_get_cycles();
+        if (dwt_pll_cal() != DWT_SUCCESS)
+        {
+            stats.pll.fails++;
+        }
+        note_duration(&stats.pll, start);
+        pll_ref_c = stats.temp_c;
+    }
+
+    if (fabsf(stats.temp_c - bw_ref_c) >= RF_CAL_BW_DELTA_C)
+    {
+        /* What dwt_configuretxrf() does with a PG count set, without rewriting the TX power */
+        start = port_get_cycles();
+        stats.pg_delay = dwt_calcbandwidthadj(txcfg->PGcount);
+        note_duration(&stats.bw, start);
+        bw_ref_c = stats.temp_c;
+    }
+}
+
+const rf_cal_stats_t *rf_cal_get_stats(void)
+{
+    return &stats;
+}
+
+void rf_cal_print(void)
+{
+    printf("RFCAL temp=%.1fC pg_count=%u pg_delay=0x%02x", stats.temp_c, (unsigned)stats.pg_count, (unsigned)stats.pg_delay);
+    printf(" pll=%u fails=%u last=%luus max=%luus bw=%u last=%luus max=%luus\n", (unsigned)stats.pll.runs, (unsigned)stats.pll.fails,
+        (unsigned long)stats.pll.last_us, (unsigned long)stats.pll.max_us, (unsigned)stats.bw.runs, (unsigned long)stats.bw.last_us,
+        (unsigned long)stats.bw.max_us);
+}
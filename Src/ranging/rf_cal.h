@@ -0,0 +1,102 @@
+/*! ----------------------------------------------------------------------------
+ * @file    rf_cal.h
+ * @brief   Background PLL and pulse bandwidth recalibration following the DW IC temperature
+ *
+ *          dwt_configure() calibrates the PLL and dwt_configuretxrf() sets the pulse bandwidth at the temperature of the
+ *          chip reset. Outdoor units then drift with the weather: the PLL may lose lock and the spectrum widens or
+ *          narrows, and frames start to get lost. This module samples the DW IC temperature every RF_CAL_SAMPLE_MS
+ *          and, once it has moved far enough from the temperature of the last calibration, re-runs it:
+ *
+ *          - dwt_pll_cal() after RF_CAL_PLL_DELTA_C degrees, as in ex_16_pll_cal;
+ *          - dwt_calcbandwidthadj() after RF_CAL_BW_DELTA_C degrees, towards the pulse generator count measured with
+ *            the channel's PG delay at the first configuration (dwt_calcpgcount(), as in ex_17_bw_cal). The count is
+ *            kept in the channel's dwt_txconfig_t, so every later dwt_configuretxrf() also corrects the bandwidth.
+ *
+ *          rf_cal_poll() is called with the other background services, between exchanges and with the receiver off,
+ *          so a calibration never falls inside an exchange. The time each one took is recorded.
+ */
+
+#ifndef RF_CAL_H_
+#define RF_CAL_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <deca_device_api.h>
+#include <stdint.h>
+
+/* Time between two temperature samples, in milliseconds */
+#define RF_CAL_SAMPLE_MS 5000
+
+/* Temperature change since the last calibration that triggers a new one, in degrees Celsius */
+#define RF_CAL_PLL_DELTA_C 10
+#define RF_CAL_BW_DELTA_C  5
+
+    /* Duration of one kind of calibration, totals since boot */
+    typedef struct
+    {
+        uint16_t runs;    /* Calibrations done */
+        uint16_t fails;   /* Of which failed (PLL did not lock) */
+        uint32_t last_us; /* Duration of the last one, in microseconds */
+        uint32_t max_us;  /* Longest one */
+    } rf_cal_timing_t;
+
+    /* Calibration statistics */
+    typedef struct
+    {
+        float temp_c;        /* Last temperature sample, in degrees Celsius */
+        uint8_t pg_delay;    /* PG delay in use, set by the last bandwidth calibration */
+        uint16_t pg_count;   /* Pulse generator count it aims at */
+        rf_cal_timing_t pll; /* dwt_pll_cal() */
+        rf_cal_timing_t bw;  /* dwt_calcbandwidthadj() */
+    } rf_cal_stats_t;
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn rf_cal_start()
+     *
+     * @brief Takes the temperature of a fresh configuration as the reference of both calibrations. The first time a
+     *        channel's TX configuration is seen, also measures its reference pulse generator count. Call after
+     *        dwt_configure() and before dwt_configuretxrf(), at every chip reset and profile switch.
+     *
+     * @param txconfig - TX configuration of the channel in use, its PGcount is set
+     *
+     * @return none
+     */
+    void rf_cal_start(dwt_txconfig_t *txconfig);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn rf_cal_poll()
+     *
+     * @brief Samples the temperature when due and runs the calibrations it calls for. Call between exchanges, with the
+     *        receiver off.
+     *
+     * @return none
+     */
+    void rf_cal_poll(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn rf_cal_get_stats()
+     *
+     * @brief Returns the statistics since boot.
+     *
+     * @return pointer to the statistics
+     */
+    const rf_cal_stats_t *rf_cal_get_stats(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn rf_cal_print()
+     *
+     * @brief Prints an "RFCAL" line with the temperature, the bandwidth setting and the count and durations of each
+     *        calibration.
+     *
+     * @return none
+     */
+    void rf_cal_print(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RF_CAL_H_ */
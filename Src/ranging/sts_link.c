@@ -0,0 +1,314 @@
+/*! ----------------------------------------------------------------------------
+ * @file    sts_link.c
+ * @brief   802.15.4z STS (secure timestamp) management for the connectivity matrix protocol
+ *
+ *          See sts_link.h for an overview.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sts_link.h>
+
+/* Duration of an STS symbol (512 chips at 499.2 MHz) and of a UWB microsecond (512/499.2 us), in picoseconds */
+#define STS_SYMBOL_PS 1017630
+#define UUS_PS 1025641
+
+/* The STS counter advances by one per 1024 chips, so one STS of the longest length moves it by STS_LEN_MAX symbols / 2.
+ * Each exchange gets its own block of STS_IV_STRIDE counter values, enough for a poll and a response. */
+#define STS_IV_STRIDE_SHIFT 12
+
+/*
+ * 128-bit STS key shared by the network, and the IV from which the pair IVs are derived.
+ *
+ * Here we use the default key and IV of the IEEE 802.15.4z annex, as the examples do (see ss_twr_initiator_sts.c). In a
+ * deployment they must be provisioned per network and kept secret.
+ */
+static dwt_sts_cp_key_t network_key = { 0x14EB220F, 0xF86050A8, 0xD1D336AA, 0x14148674 };
+static const dwt_sts_cp_iv_t network_iv = { 0x1F9A3DE4, 0xD37EC3CA, 0xC44FA8FB, 0x362EEB34 };
+
+/* Exchange counter of the pair formed with each node */
+static uint32_t pair_count[STS_MAX_NODES];
+
+static uint8_t self_id = 0;
+static uint8_t sts_length = STS_LEN_DEFAULT;
+static uint8_t shrink_rounds = 0;
+
+/* Pair and counter of the IV loaded for the next reception */
+static uint8_t loaded_peer = 0xFF;
+static uint32_t loaded_count = 0;
+
+static sts_link_stats_t stats;
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn load_iv()
+ *
+ * @brief Loads the IV of the pair formed with peer for the given exchange counter. The pair ids go into the second
+ *        word so that every pair has its own sequence, and the bits of the counter shifted out of the low word go into
+ *        the top word so that a wrap never repeats an IV.
+ */
+static void load_iv(uint8_t peer, uint32_t count)
+{
+    dwt_sts_cp_iv_t iv = network_iv;
+    uint8_t lo = (peer < self_id) ? peer : self_id;
+    uint8_t hi = (peer < self_id) ? self_id : peer;
+
+    iv.iv0 = count << STS_IV_STRIDE_SHIFT;
+    iv.iv1 ^= ((uint32_t)hi << 8) | lo;
+    iv.iv3 ^= count >> (32 - STS_IV_STRIDE_SHIFT);
+
+    dwt_configurestsiv(&iv);
+    dwt_configurestsloadiv();
+
+    loaded_peer = peer;
+    loaded_count = count;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn read_quality()
+ *
+ * @brief Checks the STS of the last received frame and accounts it.
+ *
+ * @return 1 if the STS is valid
+ */
+static int read_quality(void)
+{
+    int16_t quality;
+    uint16_t status;
+    int valid = (dwt_readstsquality(&quality) >= 0) && (dwt_readstsstatus(&status, 0) == DWT_SUCCESS);
+
+    stats.checked++;
+    stats.round_checked++;
+    if (valid)
+    {
+        /* The quality index counts the STS symbols that correlated */
+        uint32_t pct = (quality > 0) ? ((uint32_t)quality * 100) / (32u << sts_length) : 0;
+
+        stats.valid++;
+        stats.round_valid++;
+        if (pct < stats.round_min_qual_pct)
+        {
+            stats.round_min_qual_pct = (uint8_t)pct;
+        }
+    }
+
+    return valid;
+}
+
+static void reset_round(void)
+{
+    stats.round_checked = 0;
+    stats.round_valid = 0;
+    stats.round_min_qual_pct = 100;
+}
+
+void sts_link_init(uint8_t self)
+{
+    self_id = self;
+    sts_length = STS_LEN_DEFAULT;
+    shrink_rounds = 0;
+    loaded_peer = 0xFF;
+    memset(pair_count, 0, sizeof(pair_count));
+    memset(&stats, 0, sizeof(stats));
+    reset_round();
+}
+
+void sts_link_apply(dwt_config_t *cfg)
+{
+    cfg->stsMode = STS_LINK_MODE;
+    cfg->stsLength = (dwt_sts_lengths_e)sts_length;
+}
+
+void sts_link_start(void)
+{
+    if (STS_LINK_MODE != DWT_STS_MODE_OFF)
+    {
+        dwt_configurestskey(&network_key);
+        loaded_peer = 0xFF;
+    }
+}
+
+uint8_t sts_link_length(void)
+{
+    return sts_length;
+}
+
+uint32_t sts_link_duration_uus(void)
+{
+    if (STS_LINK_MODE == DWT_STS_MODE_OFF)
+    {
+        return 0;
+    }
+    return (uint32_t)(((uint64_t)(32u << sts_length) * STS_SYMBOL_PS + UUS_PS - 1) / UUS_PS);
+}
+
+int sts_link_follow(uint8_t length)
+{
+    if (length == sts_length || length > STS_LEN_MAX)
+    {
+        return 0;
+    }
+    sts_length = length;
+    stats.length_moves++;
+    return 1;
+}
+
+uint32_t sts_link_load(uint8_t peer)
+{
+    if (STS_LINK_MODE != DWT_STS_MODE_OFF && peer < STS_MAX_NODES)
+    {
+        load_iv(peer, pair_count[peer]);
+    }
+    return (peer < STS_MAX_NODES) ? pair_count[peer] : 0;
+}
+
+uint32_t sts_link_begin(uint8_t peer)
+{
+    uint32_t count = sts_link_load(peer);
+
+    if (peer < STS_MAX_NODES)
+    {
+        pair_count[peer]++;
+    }
+    return count;
+}
+
+int sts_link_accept(uint8_t peer, uint32_t count)
+{
+    int in_step = (peer == loaded_peer) && (count == loaded_count);
+
+    if (STS_LINK_MODE == DWT_STS_MODE_OFF || peer >= STS_MAX_NODES)
+    {
+        return STS_LINK_MODE == DWT_STS_MODE_OFF;
+    }
+
+    /* The counter travels in clear: moving it back would let a replayed poll make both ends use an IV again */
+    if ((int32_t)(count - pair_count[peer]) < 0)
+    {
+        stats.stale++;
+        stats.checked++;
+        stats.round_checked++;
+        return 0;
+    }
+
+    /* Nor may it push the pair arbitrarily far ahead: a peer further ahead is reached over several exchanges */
+    if (count - pair_count[peer] >= STS_RESYNC_MAX_STEP)
+    {
+        pair_count[peer] += STS_RESYNC_MAX_STEP;
+        stats.resyncs++;
+        stats.checked++;
+        stats.round_checked++;
+        return 0;
+    }
+
+    pair_count[peer] = count + 1;
+    if (!in_step)
+    {
+        /* The STS was generated from another IV, it cannot correlate */
+        stats.resyncs++;
+        stats.checked++;
+        stats.round_checked++;
+        return 0;
+    }
+    return read_quality();
+}
+
+int sts_link_check(int poll_valid)
+{
+    int valid;
+
+    if (STS_LINK_MODE == DWT_STS_MODE_OFF)
+    {
+        return 1;
+    }
+
+    valid = read_quality();
+
+    /* The poll's verdict counts as a check of its own, so that the adaptation sees both directions */
+    stats.checked++;
+    stats.round_checked++;
+    if (poll_valid)
+    {
+        stats.valid++;
+        stats.round_valid++;
+    }
+
+    return valid && poll_valid;
+}
+
+uint32_t sts_link_last(uint8_t peer)
+{
+    return (peer < STS_MAX_NODES) ? pair_count[peer] - 1 : 0;
+}
+
+int sts_link_sync(uint8_t peer, uint32_t count)
+{
+    uint32_t ahead;
+
+    if (STS_LINK_MODE == DWT_STS_MODE_OFF || peer >= STS_MAX_NODES || pair_count[peer] == count + 1)
+    {
+        return 1;
+    }
+
+    /* As in sts_link_accept(), only forwards and by a bounded step: the counter comes in clear in an unauthenticated
+     * response or token */
+    ahead = count + 1 - pair_count[peer];
+    if ((int32_t)ahead < 0)
+    {
+        stats.stale++;
+        return 0;
+    }
+    pair_count[peer] += (ahead > STS_RESYNC_MAX_STEP) ? STS_RESYNC_MAX_STEP : ahead;
+    stats.resyncs++;
+    return 1;
+}
+
+uint8_t sts_link_end_round(void)
+{
+    if (STS_LINK_MODE != DWT_STS_MODE_OFF && stats.round_checked >= STS_ADAPT_MIN_FRAMES)
+    {
+        uint32_t valid_pct = ((uint32_t)stats.round_valid * 100) / stats.round_checked;
+
+        if (valid_pct < STS_VALID_TARGET_PCT)
+        {
+            shrink_rounds = 0;
+            if (sts_length < STS_LEN_MAX)
+            {
+                sts_length++;
+                stats.length_moves++;
+            }
+        }
+        else if (stats.round_valid == stats.round_checked && stats.round_min_qual_pct >= STS_SHRINK_QUAL_PCT)
+        {
+            if (++shrink_rounds >= STS_SHRINK_ROUNDS && sts_length > STS_LEN_MIN)
+            {
+                sts_length--;
+                stats.length_moves++;
+                shrink_rounds = 0;
+            }
+        }
+        else
+        {
+            shrink_rounds = 0;
+        }
+    }
+    reset_round();
+
+    return sts_length;
+}
+
+const sts_link_stats_t *sts_link_get_stats(void)
+{
+    return &stats;
+}
+
+void sts_link_print(void)
+{
+    if (STS_LINK_MODE == DWT_STS_MODE_OFF)
+    {
+        printf("STS off\n");
+        return;
+    }
+    printf("STS len=%u extra=%luus checked=%lu valid=%lu resync=%lu stale=%lu moves=%lu\n", 32u << sts_length,
+        (unsigned long)sts_link_duration_uus(), (unsigned long)stats.checked, (unsigned long)stats.valid,
+        (unsigned long)stats.resyncs, (unsigned long)stats.stale, (unsigned long)stats.length_moves);
+}
@@ -0,0 +1,247 @@
+/*! ----------------------------------------------------------------------------
+ * @file    sts_link.h
+ * @brief   802.15.4z STS (secure timestamp) management for the connectivity matrix protocol
+ *
+ *          Every pair of nodes has its own STS IV: the upper 96 bits are derived from the network IV and the two node
+ *          ids, the low 32 bits from an exchange counter kept per pair. The initiator loads the pair IV before each
+ *          poll and sends the counter in plain text; the responder, which has preloaded the IV of the pair it expects,
+ *          checks it against the counter received and resynchronises when it is ahead. A counter behind the pair's is
+ *          rejected, since it travels unauthenticated and a replayed poll must not rewind the pair, and the response
+ *          carries the responder's counter so that the initiator catches up with it (after a reboot, for example). No
+ *          counter received in clear moves a pair by more than STS_RESYNC_MAX_STEP at once. Both then advance the
+ *          counter, so no IV value is ever used twice with the same key. SP3 polls (DM_SP3_RANGING) carry no counter: the
+ *          responder listens with the pair's current one, and catches up from the counter reported in the token.
+ *
+ *          A timestamp is only trusted when the STS of the frame was received with good quality
+ *          (dwt_readstsquality() and dwt_readstsstatus()). The STS length is shared by the whole network and carried
+ *          in every frame: at the end of its round the initiator picks the shortest length for which the proportion of
+ *          valid STS met STS_VALID_TARGET_PCT, so the airtime added to each frame stays as small as the channel allows.
+ */
+
+#ifndef STS_LINK_H_
+#define STS_LINK_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <deca_device_api.h>
+#include <stdint.h>
+
+/* STS mode used by the protocol. DWT_STS_MODE_2 puts the STS after the payload, so a node whose STS length or IV is
+ * out of step still decodes the frame and can resynchronise from it. DWT_STS_MODE_OFF disables secure timestamps. */
+#define STS_LINK_MODE DWT_STS_MODE_2
+
+/* Largest number of nodes with their own pair state */
+#define STS_MAX_NODES 16
+
+/* Range of STS lengths the adaptation may choose from, and the length used after boot */
+#define STS_LEN_MIN DWT_STS_LEN_32
+#define STS_LEN_MAX DWT_STS_LEN_256
+#define STS_LEN_DEFAULT DWT_STS_LEN_64
+
+/* Proportion of checked frames whose STS must be valid, below it the STS is made twice as long */
+#define STS_VALID_TARGET_PCT 95
+
+/* The STS is halved when, for STS_SHRINK_ROUNDS rounds in a row, every STS was valid and none had a quality index
+ * under this percentage of the STS length */
+#define STS_SHRINK_QUAL_PCT 98
+#define STS_SHRINK_ROUNDS 3
+
+/* Fewest checked frames in a round for the round to be used by the adaptation */
+#define STS_ADAPT_MIN_FRAMES 4
+
+/* Furthest a counter received in clear (poll, response or SP3 token) moves the pair's counter at once. A peer further
+ * ahead, for example because this node rebooted, is caught up in steps of this size, one per exchange: a day of 10
+ * exchanges per second takes 14. A forged counter then needs 65536 frames to run through the counter space. */
+#define STS_RESYNC_MAX_STEP 65536
+
+    /* STS statistics, totals since boot except for the round fields */
+    typedef struct
+    {
+        uint32_t checked;      /* Frames whose STS was checked */
+        uint32_t valid;        /* Of which had a valid STS */
+        uint32_t resyncs;      /* Counters received ahead of the pair's, or polls received with an unexpected pair */
+        uint32_t stale;        /* Polls and SP3 token reports rejected because their counter was behind the pair's */
+        uint32_t length_moves; /* Changes of the network STS length */
+        uint16_t round_checked;
+        uint16_t round_valid;
+        uint8_t round_min_qual_pct; /* Lowest quality index of the round's valid frames, in % of the STS length */
+    } sts_link_stats_t;
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn sts_link_init()
+     *
+     * @brief Resets the pair counters and statistics.
+     *
+     * @param self - id of this node
+     *
+     * @return none
+     */
+    void sts_link_init(uint8_t self);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn sts_link_apply()
+     *
+     * @brief Writes the STS mode and the current network STS length into a configuration. Call before dwt_configure().
+     *
+     * @param cfg - configuration to update
+     *
+     * @return none
+     */
+    void sts_link_apply(dwt_config_t *cfg);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn sts_link_start()
+     *
+     * @brief Loads the STS key into the DW IC. Must be called after every dwt_configure(), the IV is loaded per exchange.
+     *
+     * @return none
+     */
+    void sts_link_start(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn sts_link_length()
+     *
+     * @brief Returns the current network STS length, carried in every frame.
+     *
+     * @return a dwt_sts_lengths_e value
+     */
+    uint8_t sts_link_length(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn sts_link_duration_uus()
+     *
+     * @brief Returns how much longer than a frame without STS a frame is, in UWB microseconds, so that RX delays and
+     *        timeouts can account for it.
+     *
+     * @return STS duration, 0 when STS is off
+     */
+    uint32_t sts_link_duration_uus(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn sts_link_follow()
+     *
+     * @brief Adopts the STS length announced in a received frame.
+     *
+     * @param length - STS length carried in the frame
+     *
+     * @return 1 if the length changed and the DW IC has to be reconfigured (sts_link_apply(), dwt_configure(),
+     *         sts_link_start()), 0 otherwise
+     */
+    int sts_link_follow(uint8_t length);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn sts_link_load()
+     *
+     * @brief Loads the IV of the pair formed with a peer, at the pair's current counter. The responder calls it before
+     *        listening for the initiator it expects.
+     *
+     * @param peer - id of the other node
+     *
+     * @return the counter loaded
+     */
+    uint32_t sts_link_load(uint8_t peer);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn sts_link_begin()
+     *
+     * @brief Initiator side. Loads the IV of the pair for a new exchange and consumes its counter.
+     *
+     * @param peer - id of the responder
+     *
+     * @return the counter to send in plain text in the poll
+     */
+    uint32_t sts_link_begin(uint8_t peer);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn sts_link_accept()
+     *
+     * @brief Responder side, called for every poll addressed to this node. Checks that the preloaded IV was the one the
+     *        initiator used and that the STS was received with good quality. A counter ahead of the pair's moves the
+     *        pair past it, by at most STS_RESYNC_MAX_STEP, so an out of step pair is back in step for the next
+     *        exchange. A counter behind it is rejected and leaves the pair as it was: the response then carries the
+     *        pair's counter (sts_link_last()) and the initiator catches up with sts_link_sync().
+     *
+     * @param peer  - id of the initiator
+     * @param count - counter received in the poll
+     *
+     * @return 1 if the poll's timestamp is secure, 0 otherwise
+     */
+    int sts_link_accept(uint8_t peer, uint32_t count);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn sts_link_check()
+     *
+     * @brief Initiator side, called for the response. Checks the quality of its STS and accounts the result together
+     *        with the responder's verdict on the poll.
+     *
+     * @param poll_valid - whether the responder found the poll's STS valid
+     *
+     * @return 1 if both timestamps of the exchange are secure, 0 otherwise
+     */
+    int sts_link_check(int poll_valid);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn sts_link_last()
+     *
+     * @brief Responder side, after sts_link_accept(). Returns the counter of the pair's last exchange, sent back in the
+     *        response: the poll's own, unless the poll was behind the pair.
+     *
+     * @param peer - id of the initiator
+     *
+     * @return the counter to send in the response
+     */
+    uint32_t sts_link_last(uint8_t peer);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn sts_link_sync()
+     *
+     * @brief Moves the pair counter past the one a peer reports having used: the responder's counter in a response, so
+     *        that an initiator that fell behind catches up, and for SP3 polls, which cannot carry it, the initiator's
+     *        counter in the token, so that a missed poll does not leave the pair out of step. The counter only moves
+     *        forwards, by at most STS_RESYNC_MAX_STEP: a report behind the pair's counter is counted as stale and
+     *        ignored.
+     *
+     * @param peer  - id of the other node
+     * @param count - counter of the pair's last exchange
+     *
+     * @return 1 if the report is not behind the pair's counter, 0 if it is stale
+     */
+    int sts_link_sync(uint8_t peer, uint32_t count);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn sts_link_end_round()
+     *
+     * @brief Initiator side, called once the round is over. Picks the network STS length for the next round from the
+     *        proportion of valid STS and their quality. The new length takes effect on the next sts_link_apply(), and
+     *        is announced with the token so that the other nodes follow.
+     *
+     * @return the STS length for the next round
+     */
+    uint8_t sts_link_end_round(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn sts_link_get_stats()
+     *
+     * @brief Returns the STS statistics.
+     *
+     * @return pointer to the statistics, valid until the next call to a sts_link function
+     */
+    const sts_link_stats_t *sts_link_get_stats(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn sts_link_print()
+     *
+     * @brief Prints an "STS" line with the current length and the statistics.
+     *
+     * @return none
+     */
+    void sts_link_print(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STS_LINK_H_ */
@@ -0,0 +1,229 @@
+/*! ----------------------------------------------------------------------------
+ * @file    twr_timing.c
+ * @brief   Reply delay and receive window of the ranging exchanges, from the frames and the measured processing time
+ *
+ *          See twr_timing.h for an overview.
+ */
+
+#include <airtime.h>
+#include <cca.h>
+#include <shared_defines.h>
+#include <stdio.h>
+#include <string.h>
+#include <twr_timing.h>
+
+/* 1 UWB microsecond is 512/499.2 us. Delays are rounded down, timeouts up. */
+#define NS_TO_UUS_FLOOR(ns) ((uint32_t)((uint64_t)(ns) * 39 / 40000))
+#define NS_TO_UUS_CEIL(ns)  ((uint32_t)(((uint64_t)(ns) * 39 + 39999) / 40000))
+
+/* DW IC timestamps and system time are 40-bit counters */
+#define DWT_TIME_MASK 0xFFFFFFFFFFULL
+
+static const dwt_config_t *active_config = NULL;
+static uint16_t poll_frame_len = 0;
+static uint16_t resp_frame_len = 0;
+
+/* Longest processing time of the current window and of the last one, 0 before any, and measurements in the current one */
+static uint32_t window_peak_ns = 0;
+static uint32_t last_peak_ns = 0;
+static uint16_t window_count = 0;
+
+/* Budget of every peer, 0 until it sent one */
+static uint32_t peer_proc_ns[TWR_TIMING_MAX_NODES];
+
+static twr_timing_stats_t stats;
+
+/* Preamble and SFD, with the link's preamble length or the configuration's */
+static uint32_t shr_ns(uint16_t plen)
+{
+    uint32_t symbols = plen ? plen : airtime_preamble_symbols(active_config->txPreambLength);
+
+    symbols += (active_config->sfdType == DWT_SFD_DW_16) ? DWT_SFD_LEN16 : DWT_SFD_LEN8;
+    return (uint32_t)((uint64_t)symbols * AIRTIME_PREAMBLE_SYMBOL_PS / 1000);
+}
+
+/* Part of a frame after its timestamp: PHR, payload and STS, or the STS alone for an SP3 packet */
+static uint32_t tail_ns(uint16_t frame_len)
+{
+    return airtime_frame_duration_ns(active_config, frame_len) - shr_ns(0);
+}
+
+static uint32_t with_margin(uint32_t ns)
+{
+    return (uint32_t)((uint64_t)ns * (100 + TWR_TIMING_MARGIN_PCT) / 100);
+}
+
+/* Processing time expected before any measurement, for an exchange reading rx_len bytes and writing tx_len */
+static uint32_t model_ns(uint16_t rx_len, uint16_t tx_len)
+{
+    uint32_t spi_ns = TWR_TIMING_SPI_ACCESSES * TWR_TIMING_SPI_ACCESS_NS
+                      + (uint32_t)((uint64_t)(rx_len + tx_len) * 8 * 1000000000 / TWR_TIMING_SPI_HZ);
+
+    return TWR_TIMING_CIA_NS + TWR_TIMING_CPU_NS + spi_ns;
+}
+
+static uint32_t own_budget_ns(void)
+{
+    uint32_t peak = (window_peak_ns > last_peak_ns) ? window_peak_ns : last_peak_ns;
+
+    return with_margin(peak ? peak : model_ns(poll_frame_len, resp_frame_len));
+}
+
+static twr_timing_t exchange(uint16_t poll_len, uint16_t resp_len, uint16_t plen, uint32_t proc_ns)
+{
+    twr_timing_t t;
+
+    /* End of the poll to start of the response's preamble */
+    uint32_t gap_ns = proc_ns + TWR_TIMING_TX_GUARD_NS;
+    uint32_t reply_ns = tail_ns(poll_len) + gap_ns + shr_ns(plen);
+
+    /* Rounding the reply up only makes the response later within the receive window */
+    t.reply_us = (uint16_t)((reply_ns + 999) / 1000);
+    t.rx_dly_uus = (uint16_t)((gap_ns > TWR_TIMING_RX_EARLY_NS) ? NS_TO_UUS_FLOOR(gap_ns - TWR_TIMING_RX_EARLY_NS) : 0);
+    t.rx_timeout_uus = (uint16_t)NS_TO_UUS_CEIL(TWR_TIMING_RX_EARLY_NS + shr_ns(plen) + tail_ns(resp_len) + TWR_TIMING_RX_MARGIN_NS);
+    return t;
+}
+
+void twr_timing_init(uint16_t poll_len, uint16_t resp_len)
+{
+    poll_frame_len = poll_len;
+    resp_frame_len = resp_len;
+    window_peak_ns = 0;
+    last_peak_ns = 0;
+    window_count = 0;
+    memset(peer_proc_ns, 0, sizeof(peer_proc_ns));
+    memset(&stats, 0, sizeof(stats));
+}
+
+void twr_timing_set_config(const dwt_config_t *cfg)
+{
+    active_config = cfg;
+}
+
+twr_timing_t twr_timing_for_peer(uint8_t peer, uint16_t plen)
+{
+    uint32_t proc_ns = (peer < TWR_TIMING_MAX_NODES) ? peer_proc_ns[peer] : 0;
+
+    if (proc_ns == 0)
+    {
+        proc_ns = with_margin(model_ns(poll_frame_len, resp_frame_len));
+    }
+    return exchange(poll_frame_len, resp_frame_len, plen, proc_ns);
+}
+
+twr_timing_t twr_timing_sp3(void)
+{
+    return exchange(0, 0, 0, with_margin(model_ns(0, 0)));
+}
+
+uint16_t twr_timing_pto_pacs(void)
+{
+    return (uint16_t)(cca_pacs_for_uus(NS_TO_UUS_CEIL(TWR_TIMING_RX_EARLY_NS + TWR_TIMING_RX_MARGIN_NS)) + TWR_TIMING_DETECT_PACS);
+}
+
+uint16_t twr_timing_proc_us(void)
+{
+    return (uint16_t)((own_budget_ns() + 999) / 1000);
+}
+
+void twr_timing_measure(uint64_t poll_rx_ts, uint16_t poll_len)
+{
+    /* The system time register holds the high 32 bits of the 40-bit counter */
+    uint64_t now = (uint64_t)dwt_readsystimestamphi32() << 8;
+    uint32_t elapsed_ns = (uint32_t)TWR_TIMING_DWT_TO_NS((now - poll_rx_ts) & DWT_TIME_MASK);
+    uint32_t tail = tail_ns(poll_len);
+    uint32_t proc_ns = (elapsed_ns > tail) ? elapsed_ns - tail : 0;
+
+    if (proc_ns > TWR_TIMING_PROC_MAX_NS)
+    {
+        proc_ns = TWR_TIMING_PROC_MAX_NS;
+    }
+
+    stats.measured++;
+    stats.last_ns = proc_ns;
+    if (proc_ns > stats.max_ns)
+    {
+        stats.max_ns = proc_ns;
+    }
+
+    if (proc_ns > window_peak_ns)
+    {
+        window_peak_ns = proc_ns;
+    }
+    if (++window_count >= TWR_TIMING_WINDOW)
+    {
+        last_peak_ns = window_peak_ns;
+        window_peak_ns = 0;
+        window_count = 0;
+    }
+}
+
+void twr_timing_note_late(void)
+{
+    stats.late++;
+}
+
+void twr_timing_peer_heard(uint8_t peer, uint16_t proc_us)
+{
+    uint32_t proc_ns = (uint32_t)proc_us * 1000;
+
+    if (peer >= TWR_TIMING_MAX_NODES || proc_us == 0)
+    {
+        return;
+    }
+    peer_proc_ns[peer] = (proc_ns > TWR_TIMING_PROC_MAX_NS) ? TWR_TIMING_PROC_MAX_NS : proc_ns;
+}
+
+void twr_timing_peer_lost(uint8_t peer)
+{
+    uint32_t proc_ns;
+
+    if (peer >= TWR_TIMING_MAX_NODES)
+    {
+        return;
+    }
+    proc_ns = peer_proc_ns[peer] ? peer_proc_ns[peer] : with_margin(model_ns(poll_frame_len, resp_frame_len));
+    proc_ns += proc_ns / 2;
+    peer_proc_ns[peer] = (proc_ns > TWR_TIMING_PROC_MAX_NS) ? TWR_TIMING_PROC_MAX_NS : proc_ns;
+    stats.widened++;
+}
+
+void twr_timing_note_miss(const twr_timing_t *t, uint32_t status, uint32_t rx_on_us)
+{
+    /* Without the preamble detection timeout the receiver stays on until the frame timeout */
+    uint32_t window_us = (uint32_t)t->rx_timeout_uus * 40 / 39;
+
+    stats.misses++;
+    if (status & DWT_INT_RXPTO_BIT_MASK)
+    {
+        stats.pto++;
+    }
+    stats.miss_us += rx_on_us;
+    if (window_us > rx_on_us)
+    {
+        stats.saved_us += window_us - rx_on_us;
+    }
+}
+
+const twr_timing_stats_t *twr_timing_get_stats(void)
+{
+    return &stats;
+}
+
+void twr_timing_print(void)
+{
+    twr_timing_t t;
+    uint32_t misses = stats.misses ? stats.misses : 1;
+
+    if (!active_config)
+    {
+        return;
+    }
+    t = exchange(poll_frame_len, resp_frame_len, 0, own_budget_ns());
+    printf("TIMING proc=%uus model=%luus reply=%uus rx_dly=%u rx_to=%u pto=%u measured=%lu last=%luus max=%luus late=%lu widened=%lu"
+           " misses=%lu pto_ends=%lu miss_rx=%luus saved=%luus\n",
+        (unsigned)twr_timing_proc_us(), (unsigned long)(model_ns(poll_frame_len, resp_frame_len) / 1000), (unsigned)t.reply_us,
+        (unsigned)t.rx_dly_uus, (unsigned)t.rx_timeout_uus, (unsigned)twr_timing_pto_pacs(), (unsigned long)stats.measured,
+        (unsigned long)(stats.last_ns / 1000), (unsigned long)(stats.max_ns / 1000), (unsigned long)stats.late, (unsigned long)stats.widened,
+        (unsigned long)stats.misses, (unsigned long)stats.pto, (unsigned long)(stats.miss_us / misses), (unsigned long)(stats.saved_us / misses));
+}
@@ -0,0 +1,254 @@
+/*! ----------------------------------------------------------------------------
+ * @file    twr_timing.h
+ * @brief   Reply delay and receive window of the ranging exchanges, from the frames and the measured processing time
+ *
+ *          A responder answers a poll a fixed delay after the poll's timestamp, and the initiator turns its receiver
+ *          on for the response accordingly. These used to be compile-time constants of each radio profile: a 40-byte
+ *          frame and a 470 us turnaround, with wide margins on both sides. Every microsecond of the reply delay holds
+ *          the channel, and in single-sided TWR the uncorrected clock drift error grows with it.
+ *
+ *          The delay is now the sum of what has to happen between the two timestamps:
+ *
+ *              reply = tail(poll) + processing + TWR_TIMING_TX_GUARD_NS + SHR(response)
+ *
+ *          tail(poll) is the part of the poll after its timestamp (PHR, payload and STS of the actual frame, see
+ *          airtime.h). Processing runs from the end of the poll until the responder has issued its delayed
+ *          dwt_starttx(): the DW IC finishing the timestamp, the firmware and its SPI transfers. The guard is how early
+ *          the DW IC needs the command, and SHR(response) is the response's preamble and SFD at the link's preamble
+ *          length, since its timestamp is at the end of the SFD.
+ *
+ *          The processing time is measured by the responder on every exchange on the DW IC's clock: just before
+ *          dwt_starttx() it reads the system time and takes off the poll's timestamp and tail (twr_timing_measure()).
+ *          Its budget is the longest time seen over the last two windows of TWR_TIMING_WINDOW exchanges, plus
+ *          TWR_TIMING_MARGIN_PCT. Before the first measurement it is a model: the timestamp computation, the firmware
+ *          path, and the SPI traffic of the exchange at the bus rate.
+ *
+ *          Each response carries the responder's budget, and the initiator asks each peer, in the poll, for the delay
+ *          worked out from the peer's last budget. A lost exchange widens the peer's budget by half for the next
+ *          attempt, and the next response resets it. The initiator turns its receiver on TWR_TIMING_RX_EARLY_NS before the
+ *          response's preamble is due and gives up TWR_TIMING_RX_MARGIN_NS after the response should have ended. SP3
+ *          packets have no payload to agree on a delay, so both sides use the model.
+ *
+ *          The receive timeout covers the whole response, so a missing one used to hold the receiver on for all of it.
+ *          The initiator also sets a preamble detection timeout (twr_timing_pto_pacs()): the early and late margins
+ *          plus TWR_TIMING_DETECT_PACS for the DW IC to lock on. A response that does not start in that window ends the
+ *          exchange there, and only one that does runs on to the frame timeout. Each miss is accounted with the time
+ *          the receiver was actually on, and the time saved against the full window (twr_timing_note_miss()).
+ *
+ *          The reply delay is in microseconds: the DW IC counts 63897.6 time units in one (TWR_TIMING_US_TO_DWT()).
+ *          The receive delay and timeout are in UWB microseconds (512/499.2 us), as the driver takes them.
+ */
+
+#ifndef TWR_TIMING_H_
+#define TWR_TIMING_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <deca_device_api.h>
+#include <stdint.h>
+
+/* Largest number of nodes with their own budget */
+#define TWR_TIMING_MAX_NODES 16
+
+/* DW IC time units (1/(128 * 499.2 MHz)) to nanoseconds and from microseconds, exactly: 63.8976 units per nanosecond,
+ * which UUS_TO_DWT_TIME rounds to 63898 per microsecond */
+#define TWR_TIMING_DWT_TO_NS(t)  ((uint64_t)(t) * 10000 / 638976)
+#define TWR_TIMING_US_TO_DWT(us) ((uint64_t)(us) * 638976 / 10)
+
+/* The delayed dwt_starttx() must be issued this long before the response's preamble starts, in nanoseconds */
+#define TWR_TIMING_TX_GUARD_NS 20000
+
+/* The initiator's receiver is on this long before the response's preamble is due, and this long after its end */
+#define TWR_TIMING_RX_EARLY_NS  16000
+#define TWR_TIMING_RX_MARGIN_NS 16000
+
+/* PACs the DW IC needs from the start of a preamble to detect it */
+#define TWR_TIMING_DETECT_PACS 2
+
+/* Processing time model: the DW IC's timestamp computation after the end of a frame (longer with STS), the firmware
+ * path from poll to response, and the SPI transfers: TWR_TIMING_SPI_ACCESSES register accesses of
+ * TWR_TIMING_SPI_ACCESS_NS each (command bytes, driver call, chip select), plus both frames at TWR_TIMING_SPI_HZ */
+#define TWR_TIMING_CIA_NS        60000
+#define TWR_TIMING_CPU_NS        60000
+#define TWR_TIMING_SPI_HZ        32000000
+#define TWR_TIMING_SPI_ACCESSES  20
+#define TWR_TIMING_SPI_ACCESS_NS 2000
+
+/* Exchanges per measurement window, margin added to the longest processing time, and largest budget, in nanoseconds */
+#define TWR_TIMING_WINDOW       32
+#define TWR_TIMING_MARGIN_PCT   20
+#define TWR_TIMING_PROC_MAX_NS  1000000
+
+    /* Timing of one exchange */
+    typedef struct
+    {
+        uint16_t reply_us;       /* Poll RX timestamp to response TX timestamp at the responder, in microseconds */
+        uint16_t rx_dly_uus;     /* End of the poll to receiver on at the initiator, dwt_setrxaftertxdelay() */
+        uint16_t rx_timeout_uus; /* Receiver on time for the response, dwt_setrxtimeout() */
+    } twr_timing_t;
+
+    /* Processing time statistics, totals since boot */
+    typedef struct
+    {
+        uint32_t measured; /* Responses whose processing time was measured */
+        uint32_t late;     /* Of which dwt_starttx() came too late for the reply delay asked for */
+        uint32_t widened;  /* Exchanges lost as initiator, which widened the peer's budget */
+        uint32_t last_ns;  /* Last processing time measured */
+        uint32_t max_ns;   /* Longest processing time measured */
+        uint32_t misses;   /* Responses we waited for in vain */
+        uint32_t pto;      /* Of which ended by the preamble detection timeout */
+        uint32_t miss_us;  /* Receiver on time of the misses */
+        uint32_t saved_us; /* Receiver on time the preamble detection timeout saved on them */
+    } twr_timing_stats_t;
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn twr_timing_init()
+     *
+     * @brief Sets the lengths of the poll and the response, drops the measurements and the peers' budgets. Call at
+     *        boot.
+     *
+     * @param poll_len - poll length, including the FCS
+     * @param resp_len - response length, including the FCS
+     *
+     * @return none
+     */
+    void twr_timing_init(uint16_t poll_len, uint16_t resp_len);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn twr_timing_set_config()
+     *
+     * @brief Gives the PHY configuration in use. The pointer is kept: STS changes made to it later are followed.
+     *
+     * @param cfg - active configuration
+     *
+     * @return none
+     */
+    void twr_timing_set_config(const dwt_config_t *cfg);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn twr_timing_for_peer()
+     *
+     * @brief Works out the timing of an exchange with a peer, from the peer's last budget.
+     *
+     * @param peer - responder's node id
+     * @param plen - preamble length of the link in symbols, 0 for the configuration's
+     *
+     * @return the reply delay to ask for, and the initiator's receive delay and timeout
+     */
+    twr_timing_t twr_timing_for_peer(uint8_t peer, uint16_t plen);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn twr_timing_sp3()
+     *
+     * @brief Works out the timing of an SP3 exchange, from the model on both sides. Call with the configuration in
+     *        STS mode 3.
+     *
+     * @return the reply delay, and the initiator's receive delay and timeout
+     */
+    twr_timing_t twr_timing_sp3(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn twr_timing_pto_pacs()
+     *
+     * @brief Returns the preamble detection timeout of the initiator's receiver: how long after it is on the response's
+     *        preamble may still start, and be detected. Call after cca_set_config(), and cca_restore_rx() once the
+     *        exchange is over.
+     *
+     * @return timeout for dwt_setpreambledetecttimeout() and cca_tx(), in PACs
+     */
+    uint16_t twr_timing_pto_pacs(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn twr_timing_proc_us()
+     *
+     * @brief Returns our processing budget, to send back in a response.
+     *
+     * @return budget in microseconds
+     */
+    uint16_t twr_timing_proc_us(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn twr_timing_measure()
+     *
+     * @brief Measures the processing time of the exchange being answered. Call right before the delayed
+     *        dwt_starttx() of the response, after every other access to the DW IC.
+     *
+     * @param poll_rx_ts - poll RX timestamp, 40 bits
+     * @param poll_len   - poll length including the FCS, 0 for an SP3 packet
+     *
+     * @return none
+     */
+    void twr_timing_measure(uint64_t poll_rx_ts, uint16_t poll_len);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn twr_timing_note_late()
+     *
+     * @brief Counts a response that could not be sent because dwt_starttx() came too late.
+     *
+     * @return none
+     */
+    void twr_timing_note_late(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn twr_timing_peer_heard()
+     *
+     * @brief Takes the budget a peer sent back in its response.
+     *
+     * @param peer    - responder's node id
+     * @param proc_us - its budget, in microseconds
+     *
+     * @return none
+     */
+    void twr_timing_peer_heard(uint8_t peer, uint16_t proc_us);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn twr_timing_peer_lost()
+     *
+     * @brief Widens a peer's budget by half, up to TWR_TIMING_PROC_MAX_NS, after an exchange that gave no response.
+     *
+     * @param peer - responder's node id
+     *
+     * @return none
+     */
+    void twr_timing_peer_lost(uint8_t peer);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn twr_timing_note_miss()
+     *
+     * @brief Accounts a response that did not come, with the time the receiver was on for it.
+     *
+     * @param t        - timing of the exchange
+     * @param status   - DW IC status that ended the wait
+     * @param rx_on_us - receiver on time, from airtime_rx_end()
+     *
+     * @return none
+     */
+    void twr_timing_note_miss(const twr_timing_t *t, uint32_t status, uint32_t rx_on_us);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn twr_timing_get_stats()
+     *
+     * @brief Returns the statistics since boot.
+     *
+     * @return pointer to the statistics
+     */
+    const twr_timing_stats_t *twr_timing_get_stats(void);
+
+    /*! ------------------------------------------------------------------------------------------------------------------
+     * @fn twr_timing_print()
+     *
+     * @brief Prints a "TIMING" line with our budget and the reply delay it gives, the model, and the statistics,
+     *        with the receiver on time of a miss and the time saved on it, on average.
+     *
+     * @return none
+     */
+    void twr_timing_print(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TWR_TIMING_H_ */
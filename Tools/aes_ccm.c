@@ -0,0 +1,512 @@
+/**
+ * Host implementation of the DW3000 AES-128 CCM* engine
+ *
+ * See aes_ccm.h. CCM* with a 13-byte nonce (so a 2-byte length/counter field, L = 2) as in IEEE 802.15.4 annex B:
+ * the MIC is the CBC-MAC of B0, the length-prefixed header and the payload, encrypted with counter block A0; the
+ * payload is encrypted with counter blocks A1, A2, ...
+ */
+
+#include "aes_ccm.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AES_CCM_HAVE_AESNI 1
+#include <wmmintrin.h>
+#else
+#define AES_CCM_HAVE_AESNI 0
+#endif
+
+/* Largest number of blocks of a CBC-MAC input: B0, 2-byte length and a header of up to 255 bytes, the payload */
+#define MAX_MAC_BLOCKS (1 + (2 + 255 + 15) / 16 + (AES_CCM_MAX_FRAME + 15) / 16)
+
+/* Largest number of counter blocks per frame: A0 and the payload */
+#define MAX_CTR_BLOCKS (1 + (AES_CCM_MAX_FRAME + 15) / 16)
+
+static const uint8_t sbox[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76, 0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59,
+    0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0, 0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1,
+    0x71, 0xd8, 0x31, 0x15, 0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75, 0x09, 0x83,
+    0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84, 0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b,
+    0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf, 0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c,
+    0x9f, 0xa8, 0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2, 0xcd, 0x0c, 0x13, 0xec,
+    0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73, 0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee,
+    0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb, 0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08, 0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6,
+    0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a, 0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9,
+    0x86, 0xc1, 0x1d, 0x9e, 0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf, 0x8c, 0xa1,
+    0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+/* Encryption T-tables, te[0][x] = MixColumns of column (S[x], 0, 0, 0), the others are byte rotations of it */
+static uint32_t te[4][256];
+static int tables_ready = 0;
+
+static int aesni_enabled = -1;
+
+static uint8_t xtime(uint8_t x)
+{
+    return (uint8_t)((x << 1) ^ ((x & 0x80) ? 0x1b : 0));
+}
+
+static void build_tables(void)
+{
+    int i;
+
+    for (i = 0; i < 256; i++)
+    {
+        uint8_t s = sbox[i];
+        uint32_t t = ((uint32_t)xtime(s) << 24) | ((uint32_t)s << 16) | ((uint32_t)s << 8) | (uint32_t)(xtime(s) ^ s);
+
+        te[0][i] = t;
+        te[1][i] = (t >> 8) | (t << 24);
+        te[2][i] = (t >> 16) | (t << 16);
+        te[3][i] = (t >> 24) | (t << 8);
+    }
+    tables_ready = 1;
+}
+
+static uint32_t load_be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void store_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+/* Table-based encryption of n independent blocks */
+static void encrypt_blocks_table(const aes_ccm_key_t *ctx, uint8_t (*blocks)[16], int n)
+{
+    int b, r;
+
+    for (b = 0; b < n; b++)
+    {
+        const uint8_t *rk = ctx->round_keys[0];
+        uint32_t s0 = load_be32(&blocks[b][0]) ^ load_be32(&rk[0]);
+        uint32_t s1 = load_be32(&blocks[b][4]) ^ load_be32(&rk[4]);
+        uint32_t s2 = load_be32(&blocks[b][8]) ^ load_be32(&rk[8]);
+        uint32_t s3 = load_be32(&blocks[b][12]) ^ load_be32(&rk[12]);
+        uint32_t t0, t1, t2, t3;
+
+        for (r = 1; r < 10; r++)
+        {
+            rk = ctx->round_keys[r];
+            t0 = te[0][s0 >> 24] ^ te[1][(s1 >> 16) & 0xff] ^ te[2][(s2 >> 8) & 0xff] ^ te[3][s3 & 0xff] ^ load_be32(&rk[0]);
+            t1 = te[0][s1 >> 24] ^ te[1][(s2 >> 16) & 0xff] ^ te[2][(s3 >> 8) & 0xff] ^ te[3][s0 & 0xff] ^ load_be32(&rk[4]);
+            t2 = te[0][s2 >> 24] ^ te[1][(s3 >> 16) & 0xff] ^ te[2][(s0 >> 8) & 0xff] ^ te[3][s1 & 0xff] ^ load_be32(&rk[8]);
+            t3 = te[0][s3 >> 24] ^ te[1][(s0 >> 16) & 0xff] ^ te[2][(s1 >> 8) & 0xff] ^ te[3][s2 & 0xff] ^ load_be32(&rk[12]);
+            s0 = t0;
+            s1 = t1;
+            s2 = t2;
+            s3 = t3;
+        }
+
+        /* Last round: SubBytes and ShiftRows only */
+        rk = ctx->round_keys[10];
+        t0 = ((uint32_t)sbox[s0 >> 24] << 24) | ((uint32_t)sbox[(s1 >> 16) & 0xff] << 16) | ((uint32_t)sbox[(s2 >> 8) & 0xff] << 8) | sbox[s3 & 0xff];
+        t1 = ((uint32_t)sbox[s1 >> 24] << 24) | ((uint32_t)sbox[(s2 >> 16) & 0xff] << 16) | ((uint32_t)sbox[(s3 >> 8) & 0xff] << 8) | sbox[s0 & 0xff];
+        t2 = ((uint32_t)sbox[s2 >> 24] << 24) | ((uint32_t)sbox[(s3 >> 16) & 0xff] << 16) | ((uint32_t)sbox[(s0 >> 8) & 0xff] << 8) | sbox[s1 & 0xff];
+        t3 = ((uint32_t)sbox[s3 >> 24] << 24) | ((uint32_t)sbox[(s0 >> 16) & 0xff] << 16) | ((uint32_t)sbox[(s1 >> 8) & 0xff] << 8) | sbox[s2 & 0xff];
+        store_be32(&blocks[b][0], t0 ^ load_be32(&rk[0]));
+        store_be32(&blocks[b][4], t1 ^ load_be32(&rk[4]));
+        store_be32(&blocks[b][8], t2 ^ load_be32(&rk[8]));
+        store_be32(&blocks[b][12], t3 ^ load_be32(&rk[12]));
+    }
+}
+
+#if AES_CCM_HAVE_AESNI
+/* AES-NI encryption of n independent blocks, eight at a time so that the rounds of different blocks overlap */
+__attribute__((target("aes,sse2"))) static void encrypt_blocks_aesni(const aes_ccm_key_t *ctx, uint8_t (*blocks)[16], int n)
+{
+    __m128i rk[11];
+    int b, i, r;
+
+    for (r = 0; r < 11; r++)
+    {
+        rk[r] = _mm_loadu_si128((const __m128i *)ctx->round_keys[r]);
+    }
+
+    for (b = 0; b + 8 <= n; b += 8)
+    {
+        __m128i s[8];
+
+        for (i = 0; i < 8; i++)
+        {
+            s[i] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)blocks[b + i]), rk[0]);
+        }
+        for (r = 1; r < 10; r++)
+        {
+            for (i = 0; i < 8; i++)
+            {
+                s[i] = _mm_aesenc_si128(s[i], rk[r]);
+            }
+        }
+        for (i = 0; i < 8; i++)
+        {
+            _mm_storeu_si128((__m128i *)blocks[b + i], _mm_aesenclast_si128(s[i], rk[10]));
+        }
+    }
+    for (; b < n; b++)
+    {
+        __m128i s = _mm_xor_si128(_mm_loadu_si128((const __m128i *)blocks[b]), rk[0]);
+
+        for (r = 1; r < 10; r++)
+        {
+            s = _mm_aesenc_si128(s, rk[r]);
+        }
+        _mm_storeu_si128((__m128i *)blocks[b], _mm_aesenclast_si128(s, rk[10]));
+    }
+}
+
+/* CBC-MAC of up to AES_CCM_LANES independent inputs, interleaved so that their serial chains overlap */
+__attribute__((target("aes,sse2"))) static void cbc_mac_aesni(
+    const aes_ccm_key_t *ctx, uint8_t (*in)[MAX_MAC_BLOCKS][16], const int *blocks, int lanes, uint8_t (*mac)[16])
+{
+    __m128i rk[11], s[AES_CCM_LANES];
+    int max_blocks = 0, b, l, r;
+
+    for (r = 0; r < 11; r++)
+    {
+        rk[r] = _mm_loadu_si128((const __m128i *)ctx->round_keys[r]);
+    }
+    for (l = 0; l < lanes; l++)
+    {
+        s[l] = _mm_setzero_si128();
+        max_blocks = (blocks[l] > max_blocks) ? blocks[l] : max_blocks;
+    }
+
+    for (b = 0; b < max_blocks; b++)
+    {
+        /* Lanes whose input is over keep running on their last block, their result is discarded below */
+        __m128i t[AES_CCM_LANES];
+
+        for (l = 0; l < lanes; l++)
+        {
+            t[l] = _mm_xor_si128(_mm_xor_si128(s[l], _mm_loadu_si128((const __m128i *)in[l][b < blocks[l] ? b : 0])), rk[0]);
+        }
+        for (r = 1; r < 10; r++)
+        {
+            for (l = 0; l < lanes; l++)
+            {
+                t[l] = _mm_aesenc_si128(t[l], rk[r]);
+            }
+        }
+        for (l = 0; l < lanes; l++)
+        {
+            if (b < blocks[l])
+            {
+                s[l] = _mm_aesenclast_si128(t[l], rk[10]);
+            }
+        }
+    }
+
+    for (l = 0; l < lanes; l++)
+    {
+        _mm_storeu_si128((__m128i *)mac[l], s[l]);
+    }
+}
+#endif
+
+static void encrypt_blocks(const aes_ccm_key_t *ctx, uint8_t (*blocks)[16], int n)
+{
+#if AES_CCM_HAVE_AESNI
+    if (aesni_enabled)
+    {
+        encrypt_blocks_aesni(ctx, blocks, n);
+        return;
+    }
+#endif
+    encrypt_blocks_table(ctx, blocks, n);
+}
+
+static void cbc_mac(const aes_ccm_key_t *ctx, uint8_t (*in)[MAX_MAC_BLOCKS][16], const int *blocks, int lanes, uint8_t (*mac)[16])
+{
+    int b, l, i;
+
+#if AES_CCM_HAVE_AESNI
+    if (aesni_enabled)
+    {
+        cbc_mac_aesni(ctx, in, blocks, lanes, mac);
+        return;
+    }
+#endif
+    for (l = 0; l < lanes; l++)
+    {
+        memset(mac[l], 0, 16);
+        for (b = 0; b < blocks[l]; b++)
+        {
+            for (i = 0; i < 16; i++)
+            {
+                mac[l][i] ^= in[l][b][i];
+            }
+            encrypt_blocks_table(ctx, &mac[l], 1);
+        }
+    }
+}
+
+int aes_ccm_use_aesni(int enable)
+{
+#if AES_CCM_HAVE_AESNI
+    __builtin_cpu_init();
+    aesni_enabled = enable && __builtin_cpu_supports("aes");
+#else
+    aesni_enabled = 0;
+#endif
+    return aesni_enabled;
+}
+
+void aes_ccm_set_key(aes_ccm_key_t *ctx, const dwt_aes_key_t *key)
+{
+    const uint32_t words[4] = { key->key3, key->key2, key->key1, key->key0 };
+    uint8_t bytes[16];
+    int i;
+
+    /* The key register holds the key as one 128-bit number, key3 being its most significant word */
+    for (i = 0; i < 4; i++)
+    {
+        store_be32(&bytes[4 * i], words[i]);
+    }
+    aes_ccm_set_key_bytes(ctx, bytes);
+}
+
+void aes_ccm_set_key_bytes(aes_ccm_key_t *ctx, const uint8_t key[16])
+{
+    static const uint8_t rcon[10] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36 };
+    uint8_t *w = ctx->round_keys[0];
+    int i;
+
+    if (!tables_ready)
+    {
+        build_tables();
+    }
+    if (aesni_enabled < 0)
+    {
+        aes_ccm_use_aesni(1);
+    }
+
+    memcpy(w, key, 16);
+    for (i = 4; i < 44; i++)
+    {
+        uint8_t t[4];
+
+        memcpy(t, &w[4 * (i - 1)], 4);
+        if (i % 4 == 0)
+        {
+            uint8_t t0 = t[0];
+
+            t[0] = sbox[t[1]] ^ rcon[i / 4 - 1];
+            t[1] = sbox[t[2]];
+            t[2] = sbox[t[3]];
+            t[3] = sbox[t0];
+        }
+        w[4 * i + 0] = w[4 * (i - 4) + 0] ^ t[0];
+        w[4 * i + 1] = w[4 * (i - 4) + 1] ^ t[1];
+        w[4 * i + 2] = w[4 * (i - 4) + 2] ^ t[2];
+        w[4 * i + 3] = w[4 * (i - 4) + 3] ^ t[3];
+    }
+}
+
+void aes_ccm_encrypt_block(const aes_ccm_key_t *ctx, const uint8_t in[16], uint8_t out[16])
+{
+    uint8_t block[1][16];
+
+    memcpy(block[0], in, 16);
+    encrypt_blocks(ctx, block, 1);
+    memcpy(out, block[0], 16);
+}
+
+void aes_ccm_frame_nonce(const mhr_802_15_4_t *mhr, uint8_t nonce[13])
+{
+    memcpy(&nonce[0], mhr->src_addr, 8);
+    memcpy(&nonce[8], mhr->aux_security.frame_counter, 4);
+    nonce[12] = mhr->aux_security.security_ctrl & 0x7;
+}
+
+/* Checks a job against what the DW3000 engine accepts */
+static int8_t check_job(const dwt_aes_job_t *job, const dwt_aes_config_t *cfg)
+{
+    if (cfg->aes_core_type != AES_core_type_CCM || cfg->key_size != AES_KEY_128bit || job->mode > AES_Decrypt)
+    {
+        return ERROR_WRONG_MODE;
+    }
+    if (job->mic_size > 16 || (job->mic_size & 1) || job->mic_size == 2 || (job->mic_size ? (job->mic_size - 2) / 2 : 0) != cfg->mic)
+    {
+        return ERROR_WRONG_MIC_SIZE;
+    }
+    if ((uint32_t)job->header_len + job->payload_len + job->mic_size > AES_CCM_MAX_FRAME)
+    {
+        return ERROR_PAYLOAD_SIZE;
+    }
+    if (job->header_len && !job->header)
+    {
+        return ERROR_DATA_SIZE;
+    }
+    return 0;
+}
+
+/* Counter block Ai */
+static void counter_block(uint8_t *block, const uint8_t *nonce, uint16_t i)
+{
+    block[0] = 1; /* L - 1 */
+    memcpy(&block[1], nonce, 13);
+    block[14] = (uint8_t)(i >> 8);
+    block[15] = (uint8_t)i;
+}
+
+/* XORs the payload with its keystream, blocks A1... of ks */
+static void apply_keystream(dwt_aes_job_t *job, uint8_t (*ks)[16])
+{
+    uint16_t done, i;
+
+    for (done = 0; done + 16 <= job->payload_len; done += 16)
+    {
+        uint64_t p[2], k[2];
+
+        memcpy(p, &job->payload[done], 16);
+        memcpy(k, ks[1 + done / 16], 16);
+        p[0] ^= k[0];
+        p[1] ^= k[1];
+        memcpy(&job->payload[done], p, 16);
+    }
+    for (i = done; i < job->payload_len; i++)
+    {
+        job->payload[i] ^= ks[1 + i / 16][i % 16];
+    }
+}
+
+/* Formats the CBC-MAC input of a job (B0, header, payload) into blocks, returns the number of blocks */
+static int mac_input(const dwt_aes_job_t *job, uint8_t (*in)[16])
+{
+    uint8_t *p = in[0];
+    int len;
+
+    p[0] = (uint8_t)((job->header_len ? 0x40 : 0) | (((job->mic_size - 2) / 2) << 3) | 1);
+    memcpy(&p[1], job->nonce, 13);
+    p[14] = (uint8_t)(job->payload_len >> 8);
+    p[15] = (uint8_t)job->payload_len;
+    len = 16;
+
+    /* Both the header and the payload are zero-padded to a whole block */
+    if (job->header_len)
+    {
+        int padded = (2 + job->header_len + 15) & ~15;
+
+        p[16] = 0;
+        p[17] = job->header_len;
+        memcpy(&p[18], job->header, job->header_len);
+        memset(&p[18 + job->header_len], 0, padded - 2 - job->header_len);
+        len += padded;
+    }
+
+    memcpy(&p[len], job->payload, job->payload_len);
+    memset(&p[len + job->payload_len], 0, ((job->payload_len + 15) & ~15) - job->payload_len);
+    len += (job->payload_len + 15) & ~15;
+
+    return len / 16;
+}
+
+void aes_ccm_do_batch(const aes_ccm_key_t *ctx, dwt_aes_job_t *jobs, int8_t *status, int n, const dwt_aes_config_t *cfg)
+{
+    static uint8_t ks[AES_CCM_LANES * MAX_CTR_BLOCKS][16];
+    static uint8_t in[AES_CCM_LANES][MAX_MAC_BLOCKS][16];
+    int base;
+
+    for (base = 0; base < n; base += AES_CCM_LANES)
+    {
+        int lanes = (n - base < AES_CCM_LANES) ? n - base : AES_CCM_LANES;
+        int ks_first[AES_CCM_LANES], mac_blocks[AES_CCM_LANES];
+        uint8_t mac[AES_CCM_LANES][16];
+        int num_ks = 0, l, b;
+
+        /* Keystream of every frame, A0 (for the MIC) then one block per 16 bytes of payload */
+        for (l = 0; l < lanes; l++)
+        {
+            dwt_aes_job_t *job = &jobs[base + l];
+            int blocks;
+
+            status[base + l] = check_job(job, cfg);
+            ks_first[l] = num_ks;
+            if (status[base + l] < 0)
+            {
+                continue;
+            }
+            blocks = 1 + (job->payload_len + 15) / 16;
+            for (b = 0; b < blocks; b++)
+            {
+                counter_block(ks[num_ks + b], job->nonce, (uint16_t)b);
+            }
+            num_ks += blocks;
+        }
+        encrypt_blocks(ctx, ks, num_ks);
+
+        /* The MIC is computed over the plaintext, so decrypt first */
+        for (l = 0; l < lanes; l++)
+        {
+            dwt_aes_job_t *job = &jobs[base + l];
+
+            mac_blocks[l] = 0;
+            if (status[base + l] < 0)
+            {
+                continue;
+            }
+            if (job->mode == AES_Decrypt)
+            {
+                apply_keystream(job, &ks[ks_first[l]]);
+            }
+            if (job->mic_size)
+            {
+                mac_blocks[l] = mac_input(job, in[l]);
+            }
+        }
+
+        /* CBC-MAC of all frames in lockstep */
+        cbc_mac(ctx, in, mac_blocks, lanes, mac);
+
+        for (l = 0; l < lanes; l++)
+        {
+            dwt_aes_job_t *job = &jobs[base + l];
+            uint8_t *tag;
+            uint8_t diff = 0;
+            int i;
+
+            if (status[base + l] < 0)
+            {
+                continue;
+            }
+            if (job->mode == AES_Encrypt)
+            {
+                apply_keystream(job, &ks[ks_first[l]]);
+            }
+
+            /* The MIC follows the payload, encrypted with A0 */
+            tag = &job->payload[job->payload_len];
+            for (i = 0; i < job->mic_size; i++)
+            {
+                uint8_t u = mac[l][i] ^ ks[ks_first[l]][i];
+
+                if (job->mode == AES_Encrypt)
+                {
+                    tag[i] = u;
+                }
+                else
+                {
+                    diff |= tag[i] ^ u;
+                }
+            }
+            status[base + l] = diff ? DWT_INT_AES_STS_AUTH_ERR_BIT_MASK : 0;
+        }
+    }
+}
+
+int8_t aes_ccm_do_aes(const aes_ccm_key_t *ctx, dwt_aes_job_t *job, const dwt_aes_config_t *cfg)
+{
+    int8_t status;
+
+    aes_ccm_do_batch(ctx, job, &status, 1, cfg);
+    return status;
+}
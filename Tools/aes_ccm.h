@@ -0,0 +1,76 @@
+/**
+ * Host implementation of the DW3000 AES-128 CCM* engine
+ *
+ * Mirrors dwt_do_aes() for AES_core_type_CCM with a 128-bit key from the key register, so that the simulator can
+ * produce and consume the same secured frames as the firmware and captured traffic can be decrypted offline. The job
+ * and configuration structures are the driver's own (dwt_aes_job_t, dwt_aes_config_t), and dwt_aes_key_t words are
+ * interpreted the way the key register does (key3 holds the first key bytes, see ex_20_simple_aes). The nonce of a
+ * secured 802.15.4 frame is built exactly as mac_frame_get_nonce() does.
+ *
+ * AES-NI is used when the CPU has it, otherwise a table-based implementation. aes_ccm_do_batch() processes several
+ * frames at once, interleaving their blocks so that the serial CBC-MAC chains of the frames overlap.
+ */
+
+#ifndef AES_CCM_H_
+#define AES_CCM_H_
+
+#include <deca_device_api.h>
+#include <mac_802_15_4.h>
+#include <stdint.h>
+
+/* Number of frames aes_ccm_do_batch() interleaves */
+#define AES_CCM_LANES 8
+
+/* Largest frame the DW3000 AES engine accepts: header, payload and MIC */
+#define AES_CCM_MAX_FRAME 127
+
+/* Expanded AES-128 key */
+typedef struct
+{
+    uint8_t round_keys[11][16];
+} aes_ccm_key_t;
+
+/**
+ * Expands the key held in a dwt_aes_key_t, as passed to dwt_set_keyreg_128()
+ */
+void aes_ccm_set_key(aes_ccm_key_t *ctx, const dwt_aes_key_t *key);
+
+/**
+ * Expands a key given as its 16 bytes, first byte first, as passed to port_aes_ecb_set_key()
+ */
+void aes_ccm_set_key_bytes(aes_ccm_key_t *ctx, const uint8_t key[16]);
+
+/**
+ * Encrypts one block with AES-128 (ECB), like the nRF52833 ECB peripheral behind port_aes_ecb_encrypt(). in and out
+ * may be the same buffer.
+ */
+void aes_ccm_encrypt_block(const aes_ccm_key_t *ctx, const uint8_t in[16], uint8_t out[16]);
+
+/**
+ * Runs one job like dwt_do_aes(). The payload is processed in place. On encryption the MIC is written after the
+ * payload; on decryption it is read from there. Unlike the hardware, which reads the header from the RX buffer, the
+ * header must always be in job->header. The configuration is only checked, the job's mode and MIC size are used.
+ *
+ * Returns a negative ERROR_* code of deca_device_api.h for an unsupported job, otherwise AES status bits (0, or
+ * DWT_INT_AES_STS_AUTH_ERR_BIT_MASK when the MIC does not match)
+ */
+int8_t aes_ccm_do_aes(const aes_ccm_key_t *ctx, dwt_aes_job_t *job, const dwt_aes_config_t *cfg);
+
+/**
+ * Runs n jobs with the same key and configuration, status[i] receives what aes_ccm_do_aes() would return for job i
+ */
+void aes_ccm_do_batch(const aes_ccm_key_t *ctx, dwt_aes_job_t *jobs, int8_t *status, int n, const dwt_aes_config_t *cfg);
+
+/**
+ * Builds the 13-byte nonce of a secured frame: source address (8), frame counter (4) and security level (1), copied as
+ * they are in the MHR, like mac_frame_get_nonce()
+ */
+void aes_ccm_frame_nonce(const mhr_802_15_4_t *mhr, uint8_t nonce[13]);
+
+/**
+ * Selects the AES implementation. Returns 1 if AES-NI is used, which is only possible when enable is set and the CPU
+ * supports it.
+ */
+int aes_ccm_use_aesni(int enable);
+
+#endif /* AES_CCM_H_ */
@@ -0,0 +1,580 @@
+/**
+ * Offline decryption of secured 802.15.4 frames captured from the AES examples
+ *
+ * Reads frames as hex bytes, one frame per line (spaces, ':' and a leading "0x" are ignored), as dumped from the RX
+ * buffer by ex_02i_simple_rx_aes or ss_aes_twr_*. Every frame must use the MHR of mac_802_15_4.h (mhr_802_15_4_t) and
+ * end with its 2-byte FCS, unless --no-fcs is given. Each frame is checked and decrypted the way rx_aes_802_15_4()
+ * does it, with the key selected by its key index, then printed as one line:
+ *     OK src=<addr> dst=<addr> cnt=<frame counter> key=<index> mic=<bytes> payload=<hex>
+ *     AUTH src=... (MIC mismatch) or ERR <reason>
+ * Frames of an authentication-only security level (1-3) have a clear payload, only their MIC is checked.
+ *
+ * The keys default to the keys_options table of the examples; --key INDEX:K0,K1,K2,K3 replaces one, with the words of
+ * the dwt_aes_key_t passed to dwt_set_keyreg_128().
+ *
+ * Build with `make tools`, then for example:
+ *     Output/tools/aes_decrypt Output/aes-capture.txt
+ *     Output/tools/aes_decrypt --selftest
+ *     Output/tools/aes_decrypt --bench 256
+ *     Output/tools/aes_decrypt --levels
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "aes_ccm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Longest input line */
+#define MAX_LINE_LEN 1024
+
+/* Keys of ss_aes_twr_initiator.c / ss_aes_twr_responder.c, index 1 first */
+static dwt_aes_key_t keys[NUM_OF_KEY_OPTIONS] = { { 0x00010203, 0x04050607, 0x08090A0B, 0x0C0D0E0F, 0, 0, 0, 0 },
+    { 0x11223344, 0x55667788, 0x99AABBCC, 0xDDEEFF00, 0, 0, 0, 0 }, { 0xFFEEDDCC, 0xBBAA9988, 0x77665544, 0x33221100, 0, 0, 0, 0 } };
+
+static aes_ccm_key_t expanded[NUM_OF_KEY_OPTIONS];
+
+/* CCM* with the key register, as configured by the examples */
+static dwt_aes_config_t aes_config = { .key_load = AES_KEY_Load,
+    .key_size = AES_KEY_128bit,
+    .key_src = AES_KEY_Src_Register,
+    .mode = AES_Decrypt,
+    .aes_core_type = AES_core_type_CCM,
+    .aes_key_otp_type = AES_key_RAM,
+    .key_addr = 0 };
+
+static double monotonic_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int hex_digit(int c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+/* Parses a line of hex bytes, returns the number of bytes or -1 */
+static int parse_hex(const char *line, uint8_t *out, int max)
+{
+    int len = 0;
+
+    while (*line)
+    {
+        int hi, lo;
+
+        if (*line == ' ' || *line == '\t' || *line == ':' || *line == ',' || *line == '\r' || *line == '\n')
+        {
+            line++;
+            continue;
+        }
+        if (line[0] == '0' && (line[1] == 'x' || line[1] == 'X'))
+        {
+            line += 2;
+            continue;
+        }
+        hi = hex_digit(line[0]);
+        lo = hex_digit(line[1]);
+        if (hi < 0 || lo < 0 || len >= max)
+        {
+            return -1;
+        }
+        out[len++] = (uint8_t)((hi << 4) | lo);
+        line += 2;
+    }
+    return len;
+}
+
+static uint64_t addr_of(const uint8_t *p)
+{
+    uint64_t addr = 0;
+    int i;
+
+    for (i = 7; i >= 0; i--)
+    {
+        addr = (addr << 8) | p[i];
+    }
+    return addr;
+}
+
+/* MIC length of a security level, like mac_frame_get_aux_mic_size() */
+static int mic_size_of(uint8_t security_ctrl)
+{
+    static const int8_t sizes[8] = { 0, 4, 8, 16, -1, 4, 8, 16 };
+
+    return sizes[security_ctrl & 0x7];
+}
+
+/* A captured frame and the job decrypting it */
+typedef struct
+{
+    uint8_t data[MAX_LINE_LEN / 2];
+    uint8_t nonce[13];
+    int key_index;
+    int payload_len;
+    const char *error;
+} frame_t;
+
+/* Checks the MHR and prepares the job, as rx_aes_802_15_4() does. Returns 0 if the frame can be decrypted. */
+static int prepare_frame(frame_t *frame, int len, int has_fcs, dwt_aes_job_t *job)
+{
+    const mhr_802_15_4_t *mhr = (const mhr_802_15_4_t *)frame->data;
+    int mic, payload_len;
+
+    len -= has_fcs ? FCS_LEN : 0;
+    frame->error = NULL;
+    if (len < (int)sizeof(mhr_802_15_4_t))
+    {
+        frame->error = "shorter than the MHR";
+        return -1;
+    }
+    if (!(mhr->frame_ctrl[0] & SECURITY_ENABLE_BIT_MASK))
+    {
+        frame->error = "not secured";
+        return -1;
+    }
+    mic = mic_size_of(mhr->aux_security.security_ctrl);
+    payload_len = len - (int)sizeof(mhr_802_15_4_t) - mic;
+    if (mic < 0 || payload_len < 0)
+    {
+        frame->error = (mic < 0) ? "reserved security level" : "shorter than its MIC";
+        return -1;
+    }
+    frame->key_index = mhr->aux_security.key_indentifier;
+    if (frame->key_index < 1 || frame->key_index > NUM_OF_KEY_OPTIONS)
+    {
+        frame->error = "unknown key index";
+        return -1;
+    }
+
+    /* Without data confidentiality the payload is authenticated with the MHR, as mac_frame_set_tx_aes_job() sends it */
+    aes_ccm_frame_nonce(mhr, frame->nonce);
+    frame->payload_len = payload_len;
+    if (!AUX_SEC_LEVEL_HAS_CONFIDENTIALITY(AUX_SECURITY_LEVEL(mhr->aux_security.security_ctrl)))
+    {
+        job->header_len = (uint8_t)(sizeof(mhr_802_15_4_t) + payload_len);
+        payload_len = 0;
+    }
+    else
+    {
+        job->header_len = sizeof(mhr_802_15_4_t);
+    }
+    job->nonce = frame->nonce;
+    job->header = frame->data;
+    job->payload = frame->data + job->header_len;
+    job->payload_len = (uint16_t)payload_len;
+    job->src_port = AES_Src_Rx_buf_0;
+    job->dst_port = AES_Dst_Rx_buf_0;
+    job->mode = AES_Decrypt;
+    job->mic_size = (uint8_t)mic;
+    return 0;
+}
+
+static void print_frame(const frame_t *frame, const dwt_aes_job_t *job, int8_t status)
+{
+    const mhr_802_15_4_t *mhr = (const mhr_802_15_4_t *)frame->data;
+    const uint8_t *cnt = mhr->aux_security.frame_counter;
+    int i;
+
+    if (frame->error || status < 0)
+    {
+        printf("ERR %s\n", frame->error ? frame->error : "length rejected by the AES engine");
+        return;
+    }
+    printf("%s src=%016llx dst=%016llx cnt=%lu key=%d mic=%d payload=", (status & DWT_AES_ERRORS) ? "AUTH" : "OK",
+        (unsigned long long)addr_of(mhr->src_addr), (unsigned long long)addr_of(mhr->dest_addr),
+        (unsigned long)(cnt[0] | (cnt[1] << 8) | (cnt[2] << 16) | ((uint32_t)cnt[3] << 24)), frame->key_index, job->mic_size);
+    for (i = 0; i < frame->payload_len; i++)
+    {
+        printf("%02x", frame->data[sizeof(mhr_802_15_4_t) + i]);
+    }
+    printf("\n");
+}
+
+/* Decrypts a batch of frames, runs of frames with the same key and MIC size together */
+static int flush_batch(frame_t *frames, dwt_aes_job_t *jobs, int n)
+{
+    int8_t status[AES_CCM_LANES];
+    int failures = 0, i, start = 0;
+
+    while (start < n)
+    {
+        int end = start;
+
+        while (end < n && frames[end].key_index == frames[start].key_index && jobs[end].mic_size == jobs[start].mic_size)
+        {
+            end++;
+        }
+        aes_config.mic = jobs[start].mic_size ? (dwt_mic_size_e)((jobs[start].mic_size - 2) / 2) : MIC_0;
+        aes_ccm_do_batch(&expanded[frames[start].key_index - 1], &jobs[start], &status[start], end - start, &aes_config);
+        start = end;
+    }
+    for (i = 0; i < n; i++)
+    {
+        print_frame(&frames[i], &jobs[i], status[i]);
+        failures += (status[i] != 0);
+    }
+    return failures;
+}
+
+static int decrypt_file(FILE *in, int has_fcs)
+{
+    static frame_t frames[AES_CCM_LANES];
+    static dwt_aes_job_t jobs[AES_CCM_LANES];
+    char line[MAX_LINE_LEN];
+    int n = 0, failures = 0;
+
+    while (fgets(line, sizeof(line), in))
+    {
+        int len = parse_hex(line, frames[n].data, sizeof(frames[n].data));
+
+        if (len == 0)
+        {
+            continue;
+        }
+        if (len < 0)
+        {
+            failures += flush_batch(frames, jobs, n) + 1;
+            printf("ERR not a hex frame\n");
+            n = 0;
+            continue;
+        }
+        if (prepare_frame(&frames[n], len, has_fcs, &jobs[n]) != 0)
+        {
+            /* Keep the output in input order */
+            failures += flush_batch(frames, jobs, n);
+            print_frame(&frames[n], &jobs[n], 0);
+            failures++;
+            n = 0;
+            continue;
+        }
+        if (++n == AES_CCM_LANES)
+        {
+            failures += flush_batch(frames, jobs, n);
+            n = 0;
+        }
+    }
+    failures += flush_batch(frames, jobs, n);
+
+    return failures ? 1 : 0;
+}
+
+/* IEEE 802.15.4-2020 C.3.4 MAC command frame, the vector used by ex_20_simple_aes */
+static int selftest_vector(void)
+{
+    static const dwt_aes_key_t key = { 0xcccdcecf, 0xc8c9cacb, 0xc4c5c6c7, 0xc0c1c2c3, 0, 0, 0, 0 };
+    static const uint8_t expected[] = { 0x3e, 0xd2, 0xad, 0xf2, 0x5f, 0x3a, 0x12, 0x2c, 0x81, 0x4a, 0xdc, 0x9a, 0xeb, 0xbe, 0x26, 0x38, 0x41,
+        0xb8, 0x46, 0x33, 0x5f, 0xb0, 0x76, 0x18 };
+    uint8_t nonce[13] = { 0xac, 0xde, 0x48, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x07, 0x07 };
+    uint8_t header[]
+        = { 0x4b, 0xea, 0x86, 0x21, 0x43, 0xff, 0xff, 0x01, 0x00, 0x00, 0x00, 0x00, 0x48, 0xde, 0xac, 0x07, 0x07, 0x00, 0x00, 0x00, 0x00, 0x3f };
+    uint8_t payload[8 + 16] = { 0x03, 0x88, 0x01, 0x1e, 0x01, 0x00, 0xf8, 0x07 };
+    dwt_aes_config_t cfg = aes_config;
+    dwt_aes_job_t job = { nonce, header, payload, sizeof(header), 8, AES_Src_Scratch, AES_Dst_Scratch, AES_Encrypt, 16 };
+    aes_ccm_key_t ctx;
+    int8_t status;
+
+    cfg.mic = MIC_16;
+    aes_ccm_set_key(&ctx, &key);
+    status = aes_ccm_do_aes(&ctx, &job, &cfg);
+    if (status != 0 || memcmp(payload, expected, sizeof(expected)) != 0)
+    {
+        return 1;
+    }
+
+    job.mode = AES_Decrypt;
+    if (aes_ccm_do_aes(&ctx, &job, &cfg) != 0 || payload[0] != 0x03 || payload[7] != 0x07)
+    {
+        return 1;
+    }
+
+    /* A modified header must be rejected */
+    job.mode = AES_Encrypt;
+    aes_ccm_do_aes(&ctx, &job, &cfg);
+    header[2] ^= 1;
+    job.mode = AES_Decrypt;
+    return (aes_ccm_do_aes(&ctx, &job, &cfg) == DWT_INT_AES_STS_AUTH_ERR_BIT_MASK) ? 0 : 1;
+}
+
+static int run_selftest(void)
+{
+    int have_aesni = aes_ccm_use_aesni(1);
+    int failures = 0;
+
+    failures += selftest_vector();
+    aes_ccm_use_aesni(0);
+    failures += selftest_vector();
+    aes_ccm_use_aesni(1);
+
+    printf("IEEE 802.15.4 C.3.4 vector: %s (table%s)\n", failures ? "FAILED" : "ok", have_aesni ? " and AES-NI" : " only, no AES-NI");
+    return failures ? 1 : 0;
+}
+
+/* Encrypts a synthetic capture of 127-byte secured frames, then times their decryption */
+static int run_benchmark(size_t megabytes)
+{
+    const int frame_len = AES_CCM_MAX_FRAME;
+    const int mic = 16;
+    const int payload_len = frame_len - (int)sizeof(mhr_802_15_4_t) - mic;
+    size_t num_frames = megabytes * 1024 * 1024 / frame_len;
+    uint8_t *data = malloc(num_frames * frame_len);
+    uint8_t(*nonces)[13] = malloc(num_frames * 13);
+    dwt_aes_job_t *jobs = malloc(num_frames * sizeof(dwt_aes_job_t));
+    int8_t *status = malloc(num_frames);
+    dwt_aes_config_t cfg = aes_config;
+    aes_ccm_key_t ctx;
+    int pass, bad = 0;
+    size_t i;
+
+    if (!data || !nonces || !jobs || !status)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    cfg.mic = MIC_16;
+    aes_ccm_set_key(&ctx, &keys[0]);
+    for (i = 0; i < num_frames; i++)
+    {
+        mhr_802_15_4_t *mhr = (mhr_802_15_4_t *)&data[i * frame_len];
+        int b;
+
+        for (b = 0; b < frame_len; b++)
+        {
+            data[i * frame_len + b] = (uint8_t)(i * 31 + b);
+        }
+        mhr->frame_ctrl[0] |= SECURITY_ENABLE_BIT_MASK;
+        mhr->aux_security.security_ctrl = AUX_SEC_LEVEL_DATA_CONF_ON_MIC_16;
+        memcpy(mhr->aux_security.frame_counter, &i, 4);
+        aes_ccm_frame_nonce(mhr, nonces[i]);
+        jobs[i] = (dwt_aes_job_t) { nonces[i], &data[i * frame_len], &data[i * frame_len + sizeof(mhr_802_15_4_t)], sizeof(mhr_802_15_4_t),
+            (uint16_t)payload_len, AES_Src_Tx_buf, AES_Dst_Tx_buf, AES_Encrypt, (uint8_t)mic };
+    }
+    aes_ccm_do_batch(&ctx, jobs, status, (int)num_frames, &cfg);
+
+    /* Table fallback and AES-NI, one frame at a time and in batches */
+    for (pass = 0; pass < 4; pass++)
+    {
+        int aesni = aes_ccm_use_aesni(pass >= 2);
+        int batched = pass & 1;
+        double start, elapsed;
+
+        if (pass >= 2 && !aesni)
+        {
+            printf("AES-NI not available\n");
+            break;
+        }
+        for (i = 0; i < num_frames; i++)
+        {
+            jobs[i].mode = AES_Decrypt;
+        }
+
+        start = monotonic_s();
+        if (batched)
+        {
+            aes_ccm_do_batch(&ctx, jobs, status, (int)num_frames, &cfg);
+        }
+        else
+        {
+            for (i = 0; i < num_frames; i++)
+            {
+                status[i] = aes_ccm_do_aes(&ctx, &jobs[i], &cfg);
+            }
+        }
+        elapsed = monotonic_s() - start;
+
+        for (i = 0; i < num_frames; i++)
+        {
+            bad += (status[i] != 0);
+            jobs[i].mode = AES_Encrypt;
+        }
+        /* Back to ciphertext for the next pass */
+        aes_ccm_do_batch(&ctx, jobs, status, (int)num_frames, &cfg);
+
+        printf("%-6s %-8s %8.1f MB/s  %6.2f Mframes/s\n", aesni ? "AES-NI" : "table", batched ? "batch" : "single",
+            (double)num_frames * frame_len / elapsed / 1e6, (double)num_frames / elapsed / 1e6);
+    }
+    aes_ccm_use_aesni(1);
+
+    printf("%zu frames of %d bytes (%d payload, %d MIC), %d MIC failures\n", num_frames, frame_len, payload_len, mic, bad);
+    free(data);
+    free(nonces);
+    free(jobs);
+    free(status);
+    return bad ? 1 : 0;
+}
+
+/* AES block operations of one CCM* frame: B0, the length-prefixed header and the payload for the CBC-MAC, then A0 and one
+ * counter block per 16 bytes of payload */
+static int ccm_blocks(int header_len, int payload_len)
+{
+    return 1 + (2 + header_len + 15) / 16 + (payload_len + 15) / 16 + 1 + (payload_len + 15) / 16;
+}
+
+/* Compares the security levels for the frames of ss_aes_twr_*: frame lengths, AES block operations to receive a frame
+ * (what the nRF52 ECB does in rx_aes_802_15_4_in_place()) and the host time to secure and verify one exchange */
+static int run_levels(void)
+{
+    static const aux_security_level_e levels[] = { AUX_SEC_LEVEL_DATA_CONF_ON_MIC_16, AUX_SEC_LEVEL_DATA_CONF_ON_MIC_8,
+        AUX_SEC_LEVEL_DATA_CONF_ON_MIC_4, AUX_SEC_LEVEL_DATA_CONF_OFF_MIC_16, AUX_SEC_LEVEL_DATA_CONF_OFF_MIC_8, AUX_SEC_LEVEL_DATA_CONF_OFF_MIC_4 };
+    static const int body_lens[2] = { 12, 16 }; /* poll and response payloads */
+    const int rounds = 200000;
+    const int hdr = (int)sizeof(mhr_802_15_4_t);
+    dwt_aes_config_t cfg = aes_config;
+    aes_ccm_key_t ctx;
+    int l, f, bad = 0, base_bytes = 0;
+
+    aes_ccm_use_aesni(0); /* the table implementation, closer to one block operation at a time */
+    aes_ccm_set_key(&ctx, &keys[0]);
+    printf("level conf mic  poll  resp  saved  blocks(poll+resp)  host ns/exchange\n");
+    for (l = 0; l < (int)(sizeof(levels) / sizeof(levels[0])); l++)
+    {
+        int conf = AUX_SEC_LEVEL_HAS_CONFIDENTIALITY(levels[l]);
+        int mic = mic_size_of(levels[l]);
+        int bytes = 0, blocks = 0, r;
+        uint8_t frames[2][AES_CCM_MAX_FRAME];
+        uint8_t nonces[2][13];
+        dwt_aes_job_t jobs[2];
+        double start, elapsed;
+
+        for (f = 0; f < 2; f++)
+        {
+            mhr_802_15_4_t *mhr = (mhr_802_15_4_t *)frames[f];
+
+            memset(frames[f], f + 1, sizeof(frames[f]));
+            mhr->frame_ctrl[0] |= SECURITY_ENABLE_BIT_MASK;
+            mhr->aux_security.security_ctrl = (uint8_t)levels[l];
+            aes_ccm_frame_nonce(mhr, nonces[f]);
+            jobs[f] = (dwt_aes_job_t) { nonces[f], frames[f], frames[f] + (conf ? hdr : hdr + body_lens[f]), (uint8_t)(conf ? hdr : hdr + body_lens[f]),
+                (uint16_t)(conf ? body_lens[f] : 0), AES_Src_Tx_buf, AES_Dst_Tx_buf, AES_Encrypt, (uint8_t)mic };
+            bytes += hdr + body_lens[f] + mic + FCS_LEN;
+            blocks += ccm_blocks(jobs[f].header_len, jobs[f].payload_len);
+        }
+        cfg.mic = (dwt_mic_size_e)((mic - 2) / 2);
+        if (l == 0)
+        {
+            base_bytes = bytes;
+        }
+
+        /* Each exchange secures and verifies both frames, as initiator and responder do between them */
+        start = monotonic_s();
+        for (r = 0; r < rounds; r++)
+        {
+            for (f = 0; f < 2; f++)
+            {
+                jobs[f].mode = AES_Encrypt;
+                aes_ccm_do_aes(&ctx, &jobs[f], &cfg);
+                jobs[f].mode = AES_Decrypt;
+                bad += (aes_ccm_do_aes(&ctx, &jobs[f], &cfg) != 0);
+            }
+        }
+        elapsed = monotonic_s() - start;
+
+        printf("%5d %4s %3d %5d %5d %6d %18d %17.0f\n", levels[l], conf ? "on" : "off", mic, hdr + body_lens[0] + mic + FCS_LEN,
+            hdr + body_lens[1] + mic + FCS_LEN, base_bytes - bytes, blocks, elapsed / rounds * 1e9);
+    }
+    aes_ccm_use_aesni(1);
+    printf("%d MIC failures\n", bad);
+    return bad ? 1 : 0;
+}
+
+static int parse_key(const char *arg)
+{
+    unsigned long index, k[4];
+
+    if (sscanf(arg, "%lu:%lx,%lx,%lx,%lx", &index, &k[0], &k[1], &k[2], &k[3]) != 5 || index < 1 || index > NUM_OF_KEY_OPTIONS)
+    {
+        return -1;
+    }
+    keys[index - 1] = (dwt_aes_key_t) { (uint32_t)k[0], (uint32_t)k[1], (uint32_t)k[2], (uint32_t)k[3], 0, 0, 0, 0 };
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+        "usage: %s [--no-fcs] [--key INDEX:K0,K1,K2,K3]... [FILE|-]\n"
+        "       %s --selftest\n"
+        "       %s --bench [MEGABYTES]\n"
+        "       %s --levels\n"
+        "  --no-fcs    the frames do not end with their FCS\n"
+        "  --key       replace key INDEX (1-%d), words as in dwt_aes_key_t\n"
+        "  --selftest  check both implementations against the IEEE 802.15.4 test vector\n"
+        "  --bench     decryption throughput of the table and AES-NI implementations\n"
+        "  --levels    frame lengths and CCM* cost of each security level for the SS-TWR frames\n",
+        name, name, name, name, NUM_OF_KEY_OPTIONS);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = "-";
+    int has_fcs = 1;
+    FILE *in;
+    int i, ret;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--selftest") == 0)
+        {
+            return run_selftest();
+        }
+        else if (strcmp(argv[i], "--bench") == 0)
+        {
+            return run_benchmark((i + 1 < argc) ? (size_t)atoi(argv[i + 1]) : 64);
+        }
+        else if (strcmp(argv[i], "--levels") == 0)
+        {
+            return run_levels();
+        }
+        else if (strcmp(argv[i], "--no-fcs") == 0)
+        {
+            has_fcs = 0;
+        }
+        else if (strcmp(argv[i], "--key") == 0 && i + 1 < argc)
+        {
+            if (parse_key(argv[++i]) != 0)
+            {
+                usage(argv[0]);
+                return 2;
+            }
+        }
+        else if (argv[i][0] == '-' && argv[i][1] != '\0')
+        {
+            usage(argv[0]);
+            return 2;
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+
+    for (i = 0; i < NUM_OF_KEY_OPTIONS; i++)
+    {
+        aes_ccm_set_key(&expanded[i], &keys[i]);
+    }
+
+    in = (strcmp(path, "-") == 0) ? stdin : fopen(path, "r");
+    if (!in)
+    {
+        perror(path);
+        return 1;
+    }
+    ret = decrypt_file(in, has_fcs);
+    if (in != stdin)
+    {
+        fclose(in);
+    }
+    return ret;
+}
@@ -0,0 +1,256 @@
+/**
+ * Host round-trip check of the connectivity matrix frames of Src/ranging/dm_frames.h
+ *
+ * Prints the layout of every frame, generated from the same field lists as the encoders, then checks that:
+ * - a known header and a known double encode to the expected bytes (little-endian, no padding),
+ * - random headers, responses, tokens and rows decode to the values they were encoded from,
+ * - the single-field accessors agree with the whole-frame encoder.
+ * NUM_DEVICES, DM_ROW_PULL and DM_SP3_RANGING default to the values of dist_matrix.c and can be overridden to check other
+ * network sizes, the token carrying the matrix or the SP3 timestamps, the static assertions of dm_frames.h then reject
+ * sizes whose frames do not fit.
+ *
+ * Build with `make tools`, then for example:
+ *     Output/tools/dm_frames_check
+ *     cc -DNUM_DEVICES=3 ... (see the Makefile) to check another network size
+ *     cc -DDM_ROW_PULL=0 ... to check the token carrying the matrix
+ *     cc -DDM_SP3_RANGING=1 ... to check the token carrying the SP3 timestamps
+ */
+
+#ifndef NUM_DEVICES
+#define NUM_DEVICES 2
+#endif
+#ifndef DM_ROW_PULL
+#define DM_ROW_PULL 1
+#endif
+#ifndef DM_SP3_RANGING
+#define DM_SP3_RANGING 0
+#endif
+
+#include <dm_frames.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Number of random frames of each kind */
+#define ROUNDS 10000
+
+static int failures;
+
+#define CHECK(cond)                                                                                                                                           \
+    do                                                                                                                                                        \
+    {                                                                                                                                                         \
+        if (!(cond))                                                                                                                                          \
+        {                                                                                                                                                     \
+            printf("FAIL line %d: %s\n", __LINE__, #cond);                                                                                                    \
+            failures++;                                                                                                                                       \
+        }                                                                                                                                                     \
+    } while (0)
+
+/* Layout printers, applied to the field lists of dm_frames.h */
+#define PRINT_FIELD(s, f, t)    printf("  %-12s %4d %4d\n", #f, s##_OFF_##f, t##_SIZE);
+#define PRINT_ARRAY(s, f, t, n) printf("  %-12s %4d %4d  (%d x %s)\n", #f, s##_OFF_##f, (n) * t##_SIZE, (n), #t);
+
+static uint32_t rng_state = 0x2545F491;
+
+static uint32_t rnd(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void random_hdr(dm_hdr_t *h)
+{
+    int i;
+
+    h->type = (uint8_t)rnd();
+    h->sts_len = (uint8_t)rnd();
+    h->sts_count = rnd();
+    h->sts_valid = (uint8_t)rnd();
+    h->phy_next = (uint8_t)rnd();
+    h->phy_in_ms = (uint16_t)rnd();
+    h->hop_seq = (uint8_t)rnd();
+    h->hop_in_ms = (uint16_t)rnd();
+    for (i = 0; i < CHAN_HOP_COUNT; i++)
+    {
+        h->hop_bl[i] = (uint8_t)rnd();
+    }
+}
+
+static int hdr_equal(const dm_hdr_t *a, const dm_hdr_t *b)
+{
+    return a->type == b->type && a->sts_len == b->sts_len && a->sts_count == b->sts_count && a->sts_valid == b->sts_valid && a->phy_next == b->phy_next
+           && a->phy_in_ms == b->phy_in_ms && a->hop_seq == b->hop_seq && a->hop_in_ms == b->hop_in_ms
+           && memcmp(a->hop_bl, b->hop_bl, sizeof(a->hop_bl)) == 0;
+}
+
+static void print_layouts(void)
+{
+    printf("NUM_DEVICES %d, DM_ROW_PULL %d, DM_SP3_RANGING %d, MHR of %d bytes, then field offset and size in bytes\n", NUM_DEVICES, DM_ROW_PULL,
+        DM_SP3_RANGING, DM_MHR_LEN);
+    printf("dm_hdr, %d bytes\n", dm_hdr_SIZE);
+    DM_HDR_FIELDS(PRINT_FIELD, PRINT_ARRAY, dm_hdr)
+    printf("dm_poll, %d bytes\n", dm_poll_SIZE);
+    DM_POLL_FIELDS(PRINT_FIELD, PRINT_ARRAY, dm_poll)
+    printf("dm_resp, %d bytes\n", dm_resp_SIZE);
+    DM_RESP_FIELDS(PRINT_FIELD, PRINT_ARRAY, dm_resp)
+    printf("dm_sp3, %d bytes\n", dm_sp3_SIZE);
+    DM_SP3_FIELDS(PRINT_FIELD, PRINT_ARRAY, dm_sp3)
+    printf("dm_token, %d bytes\n", dm_token_SIZE);
+    DM_TOKEN_FIELDS(PRINT_FIELD, PRINT_ARRAY, dm_token)
+    printf("dm_row, %d bytes\n", dm_row_SIZE);
+    DM_ROW_FIELDS(PRINT_FIELD, PRINT_ARRAY, dm_row)
+}
+
+static void check_known_bytes(void)
+{
+    static const uint8_t expected_hdr[dm_hdr_SIZE] = { 1, 2, 0x44, 0x33, 0x22, 0x11, 3, 4, 0x88, 0x13, 6, 0xA0, 0x0F, 7, 8 };
+    static const uint8_t expected_one[8] = { 0, 0, 0, 0, 0, 0, 0xF0, 0x3F };
+    dm_hdr_t h = { 1, 2, 0x11223344, 3, 4, 5000, 6, 4000, { 7, 8 } };
+    uint8_t buf[dm_token_SIZE];
+    double one = 1.0;
+
+    dm_hdr_put(buf, &h);
+    CHECK(memcmp(buf, expected_hdr, sizeof(expected_hdr)) == 0);
+    fs_f64_put(buf, &one);
+    CHECK(memcmp(buf, expected_one, sizeof(expected_one)) == 0);
+}
+
+static void check_round_trips(void)
+{
+    static dm_token_t token, token_out;
+    static dm_row_t row, row_out;
+    uint8_t buf[dm_token_SIZE], buf2[dm_token_SIZE];
+    int round, i;
+
+    for (round = 0; round < ROUNDS; round++)
+    {
+        dm_hdr_t h, h_out;
+        dm_poll_t poll, poll_out;
+        dm_resp_t resp, resp_out;
+
+        random_hdr(&h);
+        dm_hdr_put(buf, &h);
+        dm_hdr_get(buf, &h_out);
+        CHECK(hdr_equal(&h, &h_out));
+        CHECK(dm_hdr_get_sts_count(buf) == h.sts_count && dm_hdr_get_type(buf) == h.type);
+
+        /* The poll is written field by field by the initiator */
+        random_hdr(&poll.hdr);
+        poll.plen8 = (uint8_t)rnd();
+        poll.pwr_fb = (uint8_t)rnd();
+        poll.reply_us = (uint16_t)rnd();
+        dm_poll_put(buf, &poll);
+        dm_poll_get(buf, &poll_out);
+        CHECK(hdr_equal(&poll.hdr, &poll_out.hdr) && poll.plen8 == poll_out.plen8 && poll.pwr_fb == poll_out.pwr_fb
+              && poll.reply_us == poll_out.reply_us);
+        dm_poll_set_hdr(buf2, poll.hdr);
+        dm_poll_set_plen8(buf2, poll.plen8);
+        dm_poll_set_pwr_fb(buf2, poll.pwr_fb);
+        dm_poll_set_reply_us(buf2, poll.reply_us);
+        CHECK(memcmp(buf, buf2, dm_poll_SIZE) == 0);
+
+        random_hdr(&resp.hdr);
+        resp.poll_rx_ts = rnd();
+        resp.resp_tx_ts = rnd();
+        resp.pwr_fb = (uint8_t)rnd();
+        resp.proc_us = (uint16_t)rnd();
+        dm_resp_put(buf, &resp);
+        dm_resp_get(buf, &resp_out);
+        CHECK(hdr_equal(&resp.hdr, &resp_out.hdr) && resp.poll_rx_ts == resp_out.poll_rx_ts && resp.resp_tx_ts == resp_out.resp_tx_ts
+              && resp.pwr_fb == resp_out.pwr_fb && resp.proc_us == resp_out.proc_us);
+
+        /* Field by field, as the responder writes it, must give the same bytes */
+        dm_resp_set_hdr(buf2, resp.hdr);
+        dm_resp_set_poll_rx_ts(buf2, resp.poll_rx_ts);
+        dm_resp_set_resp_tx_ts(buf2, resp.resp_tx_ts);
+        dm_resp_set_pwr_fb(buf2, resp.pwr_fb);
+        dm_resp_set_proc_us(buf2, resp.proc_us);
+        CHECK(memcmp(buf, buf2, dm_resp_SIZE) == 0);
+
+        random_hdr(&token.hdr);
+#if !DM_ROW_PULL
+        for (i = 0; i < NUM_DEVICES * NUM_DEVICES; i++)
+        {
+            token.matrix[i] = (double)(int32_t)rnd() / 1000.0;
+        }
+#endif
+        for (i = 0; i < NUM_DEVICES; i++)
+        {
+            token.airtime[i].tx_us = rnd();
+            token.airtime[i].rx_listen_us = rnd();
+            token.airtime[i].rx_useful_us = rnd();
+        }
+#if DM_TOKEN_BROADCAST
+        token.next = (uint8_t)rnd();
+#endif
+#if DM_SP3_RANGING
+        for (i = 0; i < NUM_DEVICES; i++)
+        {
+            token.sp3[i].poll_tx_ts = rnd();
+            token.sp3[i].resp_rx_ts = rnd();
+            token.sp3[i].sts_count = rnd();
+            token.sp3[i].valid = (uint8_t)(rnd() & 1);
+        }
+#endif
+        dm_token_put(buf, &token);
+        dm_token_get(buf, &token_out);
+        CHECK(hdr_equal(&token.hdr, &token_out.hdr));
+#if !DM_ROW_PULL
+        CHECK(memcmp(token.matrix, token_out.matrix, sizeof(token.matrix)) == 0);
+#endif
+        for (i = 0; i < NUM_DEVICES; i++)
+        {
+            CHECK(token.airtime[i].tx_us == token_out.airtime[i].tx_us && token.airtime[i].rx_listen_us == token_out.airtime[i].rx_listen_us
+                  && token.airtime[i].rx_useful_us == token_out.airtime[i].rx_useful_us);
+        }
+#if DM_TOKEN_BROADCAST
+        CHECK(token.next == token_out.next);
+#endif
+#if DM_SP3_RANGING
+        for (i = 0; i < NUM_DEVICES; i++)
+        {
+            CHECK(token.sp3[i].poll_tx_ts == token_out.sp3[i].poll_tx_ts && token.sp3[i].resp_rx_ts == token_out.sp3[i].resp_rx_ts
+                  && token.sp3[i].sts_count == token_out.sp3[i].sts_count && token.sp3[i].valid == token_out.sp3[i].valid);
+        }
+#endif
+
+        dm_token_set_hdr(buf2, token.hdr);
+#if !DM_ROW_PULL
+        dm_token_put_matrix(buf2, token.matrix);
+#endif
+        dm_token_put_airtime(buf2, token.airtime);
+#if DM_TOKEN_BROADCAST
+        dm_token_set_next(buf2, token.next);
+#endif
+#if DM_SP3_RANGING
+        dm_token_put_sp3(buf2, token.sp3);
+#endif
+        CHECK(memcmp(buf, buf2, dm_token_SIZE) == 0);
+
+        random_hdr(&row.hdr);
+        for (i = 0; i < NUM_DEVICES; i++)
+        {
+            row.row[i] = (double)(int32_t)rnd() / 1000.0;
+        }
+        dm_row_put(buf, &row);
+        dm_row_get(buf, &row_out);
+        CHECK(hdr_equal(&row.hdr, &row_out.hdr) && memcmp(row.row, row_out.row, sizeof(row.row)) == 0);
+        CHECK(dm_row_get_hdr(buf).type == row.hdr.type);
+
+        if (failures)
+        {
+            return;
+        }
+    }
+}
+
+int main(void)
+{
+    print_layouts();
+    check_known_bytes();
+    check_round_trips();
+    printf("%s: %d rounds of poll, response, token and row frames\n", failures ? "FAILED" : "OK", ROUNDS);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,296 @@
+/**
+ * Host simulation of the per-link transmit power control of Src/ranging/link_pwr.h
+ *
+ * Drops NODES nodes at random in a square of AREA_M metres, or in groups of CLUSTER_SIZE nodes within CLUSTER_M metres
+ * of a random point of it, and takes every pair within range as a link of the connectivity matrix. Each direction of
+ * each link runs the firmware's controller (link_pwr_step()) over CONVERGE_EXCHANGES exchanges, with the first-path
+ * level given by a log-distance path loss, a fixed shadowing per pair and a measurement jitter per frame. The links are
+ * then packed greedily into concurrent slots, once with every node at full power and once at the converged powers: a
+ * link joins a slot when it shares no node with the links already there and every receiver of the slot keeps a signal
+ * to interference and noise ratio of SINR_MIN_DB, counting both nodes of every other link as transmitting. The ratio
+ * of links to slots is the number of exchanges that can run at the same time.
+ *
+ * The radio figures below are round numbers for channel 5 line of sight, not measurements. The long links of the
+ * matrix stay near full power and are the ones that limit reuse, which bounds the gain.
+ *
+ * Build with `make tools`, then:
+ *     Output/tools/link_pwr_sim [NODES [AREA_M [TRIALS [CLUSTER_M]]]]
+ */
+
+#include <link_pwr.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* First-path level at 1 m from a node at full power, path loss exponent and shadowing, in dBm and dB */
+#define FULL_AT_1M_DBM (-62.0)
+#define PATH_LOSS_EXP  2.0
+#define SHADOWING_DB   3.0
+#define JITTER_DB      1.0
+
+/* Weakest first path received, noise floor, and the SINR a reception needs */
+#define SENSITIVITY_DBM (-100.0)
+#define NOISE_DBM       (-110.0)
+#define SINR_MIN_DB     10.0
+
+#define CONVERGE_EXCHANGES 50
+
+/* Nodes per group when they are placed in groups */
+#define CLUSTER_SIZE 4
+
+#define MAX_NODES LINK_PWR_MAX_NODES
+#define MAX_LINKS (MAX_NODES * (MAX_NODES - 1) / 2)
+
+typedef struct
+{
+    uint8_t a, b;         /* Nodes, a polls b */
+    double loss_db;       /* Path loss between them, the same both ways */
+    uint8_t atten_ab;     /* Converged attenuation of a's frames to b */
+    uint8_t atten_ba;     /* And of b's frames to a */
+} link_t;
+
+static double pos[MAX_NODES][2];
+static double shadow[MAX_NODES][MAX_NODES];
+static link_t links[MAX_LINKS];
+static int num_links;
+
+static uint32_t rng_state = 0x2545F491;
+
+static uint32_t rnd(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static double uniform(void)
+{
+    return (rnd() + 0.5) / 4294967296.0;
+}
+
+/* Standard normal, Box-Muller */
+static double gauss(void)
+{
+    return sqrt(-2.0 * log(uniform())) * cos(2.0 * M_PI * uniform());
+}
+
+static double loss_db(int i, int j)
+{
+    double d = hypot(pos[i][0] - pos[j][0], pos[i][1] - pos[j][1]);
+
+    return 10.0 * PATH_LOSS_EXP * log10(d < 1.0 ? 1.0 : d) + shadow[i < j ? i : j][i < j ? j : i];
+}
+
+/* First-path level of node i's frames at node j when i sends with an attenuation. link_pwr_start() counts the
+ * attenuations from the boost that gives the profile's setting, so attenuation a is a dB below full power; the steps of
+ * the driver's gain tables, a fraction of a dB, are not modelled. */
+static double level_dbm(int i, int j, uint8_t atten_db)
+{
+    return FULL_AT_1M_DBM - atten_db - loss_db(i, j);
+}
+
+static void place_nodes(int nodes, double area_m, double cluster_m)
+{
+    double cx = 0, cy = 0;
+    int i, j;
+
+    for (i = 0; i < nodes; i++)
+    {
+        if (cluster_m <= 0)
+        {
+            pos[i][0] = uniform() * area_m;
+            pos[i][1] = uniform() * area_m;
+        }
+        else
+        {
+            if (i % CLUSTER_SIZE == 0)
+            {
+                cx = uniform() * area_m;
+                cy = uniform() * area_m;
+            }
+            pos[i][0] = cx + (2.0 * uniform() - 1.0) * cluster_m;
+            pos[i][1] = cy + (2.0 * uniform() - 1.0) * cluster_m;
+        }
+        for (j = i + 1; j < nodes; j++)
+        {
+            shadow[i][j] = SHADOWING_DB * gauss();
+        }
+    }
+
+    num_links = 0;
+    for (i = 0; i < nodes; i++)
+    {
+        for (j = i + 1; j < nodes; j++)
+        {
+            /* Links need margin over the sensitivity at full power to range at all */
+            if (level_dbm(i, j, 0) >= SENSITIVITY_DBM + 6.0)
+            {
+                links[num_links].a = (uint8_t)i;
+                links[num_links].b = (uint8_t)j;
+                links[num_links].loss_db = loss_db(i, j);
+                num_links++;
+            }
+        }
+    }
+}
+
+/* Feedback the receiver sends back for one frame, as link_pwr_heard() encodes it */
+static int16_t feedback_dbm(const link_t *l, uint8_t atten_db)
+{
+    double rx = FULL_AT_1M_DBM - atten_db - l->loss_db + JITTER_DB * gauss();
+
+    return (rx < SENSITIVITY_DBM) ? 0 : (int16_t)lrint(rx);
+}
+
+static void converge(void)
+{
+    int i, n;
+
+    for (i = 0; i < num_links; i++)
+    {
+        link_t *l = &links[i];
+
+        l->atten_ab = 0;
+        l->atten_ba = 0;
+        for (n = 0; n < CONVERGE_EXCHANGES; n++)
+        {
+            l->atten_ab = link_pwr_step(l->atten_ab, feedback_dbm(l, l->atten_ab));
+            l->atten_ba = link_pwr_step(l->atten_ba, feedback_dbm(l, l->atten_ba));
+        }
+    }
+}
+
+/* SINR of node rx receiving from tx, with the links of a slot transmitting */
+static double sinr_db(int rx, int tx, uint8_t atten_db, const int *slot, int count, int controlled)
+{
+    double interference_mw = pow(10.0, NOISE_DBM / 10.0);
+    int k;
+
+    for (k = 0; k < count; k++)
+    {
+        const link_t *o = &links[slot[k]];
+
+        if (o->a == rx || o->b == rx || o->a == tx || o->b == tx)
+        {
+            continue;
+        }
+        interference_mw += pow(10.0, level_dbm(o->a, rx, controlled ? o->atten_ab : 0) / 10.0);
+        interference_mw += pow(10.0, level_dbm(o->b, rx, controlled ? o->atten_ba : 0) / 10.0);
+    }
+    return level_dbm(tx, rx, atten_db) - 10.0 * log10(interference_mw);
+}
+
+/* Whether every link of a slot still gets through, both the poll and the response */
+static int slot_ok(const int *slot, int count, int controlled)
+{
+    int k;
+
+    for (k = 0; k < count; k++)
+    {
+        const link_t *l = &links[slot[k]];
+
+        if (sinr_db(l->b, l->a, controlled ? l->atten_ab : 0, slot, count, controlled) < SINR_MIN_DB
+            || sinr_db(l->a, l->b, controlled ? l->atten_ba : 0, slot, count, controlled) < SINR_MIN_DB)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Number of slots the links are packed into, first fit */
+static int pack(int controlled)
+{
+    static int slots[MAX_LINKS][MAX_LINKS];
+    static int counts[MAX_LINKS];
+    int num_slots = 0;
+    int i, s, k;
+
+    for (i = 0; i < num_links; i++)
+    {
+        for (s = 0; s < num_slots; s++)
+        {
+            int shared = 0;
+
+            for (k = 0; k < counts[s]; k++)
+            {
+                const link_t *o = &links[slots[s][k]];
+
+                shared |= o->a == links[i].a || o->a == links[i].b || o->b == links[i].a || o->b == links[i].b;
+            }
+            if (shared)
+            {
+                continue;
+            }
+            slots[s][counts[s]++] = i;
+            if (slot_ok(slots[s], counts[s], controlled))
+            {
+                break;
+            }
+            counts[s]--;
+        }
+        if (s == num_slots)
+        {
+            slots[num_slots][0] = i;
+            counts[num_slots++] = 1;
+        }
+    }
+    return num_slots;
+}
+
+int main(int argc, char **argv)
+{
+    int nodes = (argc > 1) ? atoi(argv[1]) : MAX_NODES;
+    double area_m = (argc > 2) ? atof(argv[2]) : 100.0;
+    int trials = (argc > 3) ? atoi(argv[3]) : 200;
+    double cluster_m = (argc > 4) ? atof(argv[4]) : 0.0;
+    double sum_links = 0, sum_full = 0, sum_ctrl = 0, sum_atten = 0, sum_area = 0;
+    int t, i;
+
+    if (nodes < 2 || nodes > MAX_NODES || area_m <= 0 || trials < 1)
+    {
+        fprintf(stderr, "usage: %s [NODES (2..%d) [AREA_M [TRIALS [CLUSTER_M]]]]\n", argv[0], MAX_NODES);
+        return 1;
+    }
+
+    for (t = 0; t < trials; t++)
+    {
+        place_nodes(nodes, area_m, cluster_m);
+        if (num_links == 0)
+        {
+            continue;
+        }
+        converge();
+        for (i = 0; i < num_links; i++)
+        {
+            sum_atten += links[i].atten_ab + links[i].atten_ba;
+
+            /* The area a frame covers above any level goes with the range squared */
+            sum_area += pow(10.0, -2.0 * links[i].atten_ab / (10.0 * PATH_LOSS_EXP)) + pow(10.0, -2.0 * links[i].atten_ba / (10.0 * PATH_LOSS_EXP));
+        }
+        sum_links += num_links;
+        sum_full += pack(0);
+        sum_ctrl += pack(1);
+    }
+
+    if (sum_links == 0)
+    {
+        printf("no links in range\n");
+        return 1;
+    }
+    printf("%d nodes in %.0f x %.0f m", nodes, area_m, area_m);
+    if (cluster_m > 0)
+    {
+        printf(", groups of %d within %.0f m", CLUSTER_SIZE, cluster_m);
+    }
+    printf(", %d trials, %.1f links per layout\n", trials, sum_links / trials);
+    printf("target %d dBm: mean attenuation %.1f dB, interference footprint %.0f%% of full power\n", LINK_PWR_TARGET_DBM,
+        sum_atten / (2 * sum_links), 100.0 * sum_area / (2 * sum_links));
+    printf("full power:    %.1f slots, %.2f concurrent exchanges\n", sum_full / trials, sum_links / sum_full);
+    printf("power control: %.1f slots, %.2f concurrent exchanges\n", sum_ctrl / trials, sum_links / sum_ctrl);
+    printf("capacity gain: %+.0f%%\n", 100.0 * (sum_full / sum_ctrl - 1.0));
+    return 0;
+}
@@ -0,0 +1,348 @@
+/**
+ * Host check of the secured frame reception of Src/MAC_802_15_4/mac_802_15_4.c
+ *
+ * Builds mac_802_15_4.c against stubs of the DW IC driver and of the nRF52833 AES ECB peripheral. The stub RX buffer
+ * holds the frame under test. The AES engine and the ECB peripheral are both the host model of Tools/aes_ccm.c, so the
+ * frames are built and checked with a real AES-128. Then checks that:
+ * - rx_aes_802_15_4_in_place() decrypts frames built by the model at every allowed level, with payloads of 0 bytes up
+ *   to several blocks and with the second key, to the plain text they were built from, and rejects them once a
+ *   payload or MIC byte is modified. This also checks the key register byte order used for the ECB key,
+ * - a genuine frame at the configured minimum level is accepted, and is rejected as a replay the second time,
+ * - a frame with a forged MHR at security level 0 (no MIC) is rejected by rx_aes_802_15_4() and
+ *   rx_aes_802_15_4_in_place() without reaching the AES engine or the ECB peripheral, and without moving the replay
+ *   window on,
+ * - the same for the reserved level 4 and for levels below the configured minimum,
+ * - a frame at an allowed level with a wrong MIC reaches the MIC check and is rejected there.
+ *
+ * Build with `make tools`, then run Output/tools/mac_sec_check
+ */
+
+#include <stdint.h>
+
+/* port.h pulls in the nRF SDK, only its AES ECB functions are used: its guard is defined so that it is skipped */
+#define PORT_H_
+void port_aes_ecb_set_key(const uint8_t *key);
+void port_aes_ecb_encrypt(const uint8_t *in, uint8_t *out);
+
+#include "../Src/MAC_802_15_4/mac_802_15_4.c"
+
+#include "aes_ccm.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define INITIATOR_ADDR 0x1122334455667788
+#define RESPONDER_ADDR 0x8877665544332211
+#define PAN_ID         0xDECA
+#define PAYLOAD_LEN    12
+#define MAX_PAYLOAD    64
+
+static int failures;
+
+#define CHECK(cond)                                                                                                                                           \
+    do                                                                                                                                                        \
+    {                                                                                                                                                         \
+        if (!(cond))                                                                                                                                          \
+        {                                                                                                                                                     \
+            printf("FAIL line %d: %s\n", __LINE__, #cond);                                                                                                    \
+            failures++;                                                                                                                                       \
+        }                                                                                                                                                     \
+    } while (0)
+
+/* Keys of ss_aes_twr_initiator.c / ss_aes_twr_responder.c, index 1 first */
+static dwt_aes_key_t keys[NUM_OF_KEY_OPTIONS] = { { 0x00010203, 0x04050607, 0x08090A0B, 0x0C0D0E0F, 0, 0, 0, 0 },
+    { 0x11223344, 0x55667788, 0x99AABBCC, 0xDDEEFF00, 0, 0, 0, 0 }, { 0xFFEEDDCC, 0xBBAA9988, 0x77665544, 0x33221100, 0, 0, 0, 0 } };
+
+static dwt_aes_config_t aes_config = { .key_load = AES_KEY_Load,
+    .key_size = AES_KEY_128bit,
+    .key_src = AES_KEY_Src_Register,
+    .mode = AES_Decrypt,
+    .aes_core_type = AES_core_type_CCM,
+    .aes_key_otp_type = AES_key_RAM,
+    .key_addr = 0 };
+
+/* Stub DW IC: the RX buffer holds the frame under test, without its FCS */
+static uint8_t rx_buffer[AES_CCM_MAX_FRAME];
+static dwt_aes_key_t keyreg;
+static int aes_engine_runs;
+static int ecb_blocks;
+
+void dwt_readrxdata(uint8_t *buffer, uint16_t length, uint16_t rxBufferOffset)
+{
+    memcpy(buffer, &rx_buffer[rxBufferOffset], length);
+}
+
+void dwt_set_keyreg_128(const dwt_aes_key_t *key)
+{
+    keyreg = *key;
+}
+
+void dwt_configure_aes(const dwt_aes_config_t *pCfg)
+{
+    (void)pCfg;
+}
+
+void dwt_writetxfctrl(uint16_t txFrameLength, uint16_t txBufferOffset, uint8_t ranging)
+{
+    (void)txFrameLength;
+    (void)txBufferOffset;
+    (void)ranging;
+}
+
+dwt_mic_size_e dwt_mic_size_from_bytes(uint8_t mic_size_in_bytes)
+{
+    return (mic_size_in_bytes == 0) ? MIC_0 : (dwt_mic_size_e)((mic_size_in_bytes >> 1) - 1);
+}
+
+/* The engine reads the header and the payload with its MIC from the RX buffer, the model needs them in the job */
+int8_t dwt_do_aes(dwt_aes_job_t *job, dwt_aes_core_type_e core_type)
+{
+    aes_ccm_key_t ctx;
+    dwt_aes_config_t cfg = aes_config;
+    uint8_t out[AES_CCM_MAX_FRAME];
+
+    (void)core_type;
+    aes_engine_runs++;
+    cfg.mic = dwt_mic_size_from_bytes(job->mic_size);
+    memcpy(out, &rx_buffer[job->header_len], job->payload_len + job->mic_size);
+    job->header = rx_buffer;
+    job->payload = job->payload_len ? job->payload : out;
+    if (job->payload_len)
+    {
+        memcpy(job->payload, out, job->payload_len + job->mic_size);
+    }
+    aes_ccm_set_key(&ctx, &keyreg);
+    return aes_ccm_do_aes(&ctx, job, &cfg);
+}
+
+/* Stub ECB peripheral: AES-128 of the model, counting the blocks so that the checks can tell whether a frame got that far */
+static aes_ccm_key_t ecb_key;
+
+void port_aes_ecb_set_key(const uint8_t *key)
+{
+    aes_ccm_set_key_bytes(&ecb_key, key);
+}
+
+void port_aes_ecb_encrypt(const uint8_t *in, uint8_t *out)
+{
+    ecb_blocks++;
+    aes_ccm_encrypt_block(&ecb_key, in, out);
+}
+
+/* Plain text byte i of the frame with the given counter */
+static uint8_t plain_byte(uint32_t frame_cnt, uint16_t i)
+{
+    return (uint8_t)(0xA0 + i + 7 * frame_cnt);
+}
+
+/* Writes into the RX buffer a frame from the initiator to the responder, secured at the given level with the given key,
+ * and returns its length with the FCS. With sign unset the MIC is left as zeros, as a forger would have to. */
+static uint16_t make_frame_key(aux_security_level_e level, uint8_t key_index, uint32_t frame_cnt, uint16_t payload_len, int sign)
+{
+    mac_frame_802_15_4_format_t mac_frame;
+    uint8_t nonce[13], header_len, mic_size, auth_only;
+    uint16_t i;
+    dwt_aes_job_t job;
+    dwt_aes_config_t cfg = aes_config;
+    aes_ccm_key_t ctx;
+
+    memset(&mac_frame, 0, sizeof(mac_frame));
+    mac_frame_init_mac_frame_ctrl(&mac_frame);
+    mac_frame_set_pan_ids_and_addresses_802_15_4(&mac_frame, PAN_ID, RESPONDER_ADDR, INITIATOR_ADDR);
+    mac_frame_set_aux_security_control(&mac_frame, level);
+    mac_frame_set_AUX_key_identifier(&mac_frame, key_index);
+    mac_frame_update_aux_frame_cnt(&mac_frame, frame_cnt);
+    header_len = MAC_FRAME_HEADER_SIZE(&mac_frame);
+    mic_size = mac_frame_get_aux_mic_size(&mac_frame);
+    mic_size = (mic_size == MIC_ERROR) ? 0 : mic_size;
+
+    memset(rx_buffer, 0, sizeof(rx_buffer));
+    memcpy(rx_buffer, MHR_802_15_4_PTR(&mac_frame), header_len);
+    for (i = 0; i < payload_len; i++)
+    {
+        rx_buffer[header_len + i] = plain_byte(frame_cnt, i);
+    }
+    if (sign && mic_size)
+    {
+        /* Without data confidentiality the MHR and payload are all authenticated as the header */
+        auth_only = !AUX_SEC_LEVEL_HAS_CONFIDENTIALITY(level);
+        mac_frame_get_nonce(&mac_frame, nonce);
+        job.nonce = nonce;
+        job.header = rx_buffer;
+        job.header_len = auth_only ? (uint8_t)(header_len + payload_len) : header_len;
+        job.payload = auth_only ? &rx_buffer[header_len + payload_len] : &rx_buffer[header_len];
+        job.payload_len = auth_only ? 0 : payload_len;
+        job.src_port = AES_Src_Scratch;
+        job.dst_port = AES_Dst_Scratch;
+        job.mode = AES_Encrypt;
+        job.mic_size = mic_size;
+        cfg.mic = dwt_mic_size_from_bytes(mic_size);
+        cfg.mode = AES_Encrypt;
+        aes_ccm_set_key(&ctx, &keys[key_index - 1]);
+        aes_ccm_do_aes(&ctx, &job, &cfg);
+    }
+    return (uint16_t)(header_len + payload_len + mic_size + FCS_LEN);
+}
+
+/* The same with key 1 and the payload length of the examples */
+static uint16_t make_frame(aux_security_level_e level, uint32_t frame_cnt, int sign)
+{
+    return make_frame_key(level, 1, frame_cnt, PAYLOAD_LEN, sign);
+}
+
+/* Receives the RX buffer through the AES engine path */
+static aes_results_e rx_engine(uint16_t frame_length)
+{
+    mac_frame_802_15_4_format_t mac_frame;
+    uint8_t payload[MAX_PAYLOAD + 16];
+    dwt_aes_job_t job;
+
+    memset(&mac_frame, 0, sizeof(mac_frame));
+    mac_frame_init_mac_frame_ctrl(&mac_frame);
+    mac_frame_set_aux_security_control(&mac_frame, MAC_RX_MIN_SECURITY_LEVEL_DEFAULT);
+    mac_frame_set_AUX_key_identifier(&mac_frame, 1);
+    memset(&job, 0, sizeof(job));
+    job.header_len = MAC_FRAME_HEADER_SIZE(&mac_frame);
+    job.payload = payload;
+    job.src_port = AES_Src_Rx_buf_0;
+    job.dst_port = AES_Dst_Rx_buf_0;
+    job.mode = AES_Decrypt;
+    return rx_aes_802_15_4(&mac_frame, frame_length, &job, MAX_PAYLOAD, keys, INITIATOR_ADDR, RESPONDER_ADDR, &aes_config);
+}
+
+/* Receives the RX buffer through the in-place path, copying the plain text to payload on success */
+static aes_results_e rx_in_place_payload(uint16_t frame_length, uint8_t *payload, uint16_t *payload_len)
+{
+    mac_frame_802_15_4_format_t mac_frame;
+    uint8_t frame_buf[AES_CCM_MAX_FRAME];
+    aes_results_e result;
+
+    memset(&mac_frame, 0, sizeof(mac_frame));
+    mac_frame_init_mac_frame_ctrl(&mac_frame);
+    mac_frame_set_AUX_key_identifier(&mac_frame, 1);
+    result = rx_aes_802_15_4_in_place(&mac_frame, frame_buf, frame_length, sizeof(frame_buf), keys, INITIATOR_ADDR, RESPONDER_ADDR, payload_len);
+    if (result == AES_RES_OK)
+    {
+        memcpy(payload, PAYLOAD_PTR_802_15_4(&mac_frame), *payload_len);
+    }
+    return result;
+}
+
+static aes_results_e rx_in_place(uint16_t frame_length)
+{
+    uint8_t payload[AES_CCM_MAX_FRAME];
+    uint16_t payload_len;
+
+    return rx_in_place_payload(frame_length, payload, &payload_len);
+}
+
+/* Every level the minimum allows, every payload length, through the in-place path and the ECB peripheral */
+static void check_in_place_round_trips(uint32_t *frame_cnt)
+{
+    static const aux_security_level_e levels[] = { AUX_SEC_LEVEL_DATA_CONF_OFF_MIC_4, AUX_SEC_LEVEL_DATA_CONF_OFF_MIC_8,
+        AUX_SEC_LEVEL_DATA_CONF_OFF_MIC_16, AUX_SEC_LEVEL_DATA_CONF_ON_MIC_4, AUX_SEC_LEVEL_DATA_CONF_ON_MIC_8, AUX_SEC_LEVEL_DATA_CONF_ON_MIC_16 };
+    static const uint16_t lengths[] = { 0, 1, 15, 16, 17, 40 };
+    uint8_t payload[AES_CCM_MAX_FRAME];
+    uint16_t len, payload_len, i;
+    unsigned l, n;
+
+    for (l = 0; l < sizeof(levels) / sizeof(levels[0]); l++)
+    {
+        for (n = 0; n < sizeof(lengths) / sizeof(lengths[0]); n++)
+        {
+            uint32_t accepted = mac_replay_get_stats()->accepted;
+            uint8_t mic_size = (uint8_t)(2u << (levels[l] & 0x3));
+            int same = 1;
+
+            /* A modified payload byte, or MIC byte when there is no payload, fails the MIC and is not accepted */
+            len = make_frame_key(levels[l], 2, ++*frame_cnt, lengths[n], 1);
+            rx_buffer[len - FCS_LEN - 1 - (lengths[n] ? mic_size : 0)] ^= 0x01;
+            CHECK(rx_in_place(len) == AES_RES_ERROR);
+
+            len = make_frame_key(levels[l], 2, *frame_cnt, lengths[n], 1);
+            CHECK(rx_in_place_payload(len, payload, &payload_len) == AES_RES_OK);
+            CHECK(payload_len == lengths[n]);
+            for (i = 0; i < lengths[n] && i < payload_len; i++)
+            {
+                same &= (payload[i] == plain_byte(*frame_cnt, i));
+            }
+            CHECK(same);
+            CHECK(mac_replay_get_stats()->accepted == accepted + 1);
+            if (failures)
+            {
+                printf("  at level %d, payload of %u bytes\n", levels[l], lengths[n]);
+                return;
+            }
+        }
+    }
+}
+
+/* A frame at the given level must be rejected by both paths before any AES work, and leave the replay window alone */
+static void check_rejected(aux_security_level_e level, uint32_t frame_cnt)
+{
+    uint32_t accepted = mac_replay_get_stats()->accepted;
+    uint16_t len;
+
+    aes_engine_runs = 0;
+    ecb_blocks = 0;
+    len = make_frame(level, frame_cnt, 1);
+    CHECK(rx_engine(len) == AES_RES_ERROR_FRAME);
+    len = make_frame(level, frame_cnt, 0);
+    CHECK(rx_engine(len) == AES_RES_ERROR_FRAME);
+    CHECK(rx_in_place(len) == AES_RES_ERROR_FRAME);
+    CHECK(aes_engine_runs == 0);
+    CHECK(ecb_blocks == 0);
+    CHECK(mac_replay_get_stats()->accepted == accepted);
+}
+
+int main(void)
+{
+    uint16_t len;
+    uint32_t frame_cnt;
+
+    mac_replay_reset();
+
+    /* Default minimum: a genuine frame at that level goes through, once */
+    len = make_frame(MAC_RX_MIN_SECURITY_LEVEL_DEFAULT, 100, 1);
+    CHECK(rx_engine(len) == AES_RES_OK);
+    CHECK(rx_engine(len) == AES_RES_ERROR_REPLAY);
+    CHECK(mac_replay_get_stats()->accepted == 1);
+
+    /* Level 0 with a forged, well-formed MHR and a counter far ahead, then the reserved level 4 */
+    check_rejected(AUX_SEC_LEVEL_DATA_CONF_OFF_MIC_0, 1000);
+    check_rejected(AUX_SEC_LEVEL_RESERVED, 1001);
+
+    /* Weaker than the default minimum: shorter MICs, and a MIC without confidentiality */
+    check_rejected(AUX_SEC_LEVEL_DATA_CONF_OFF_MIC_4, 1002);
+    check_rejected(AUX_SEC_LEVEL_DATA_CONF_ON_MIC_4, 1003);
+    check_rejected(AUX_SEC_LEVEL_DATA_CONF_OFF_MIC_16, 1004);
+
+    /* The forged counters did not move the window: the next genuine frame is still in it */
+    len = make_frame(MAC_RX_MIN_SECURITY_LEVEL_DEFAULT, 101, 1);
+    CHECK(rx_engine(len) == AES_RES_OK);
+
+    /* A lower configured minimum lets those levels through, but never level 0 */
+    mac_set_rx_min_security_level(AUX_SEC_LEVEL_DATA_CONF_OFF_MIC_4);
+    len = make_frame(AUX_SEC_LEVEL_DATA_CONF_OFF_MIC_4, 102, 1);
+    CHECK(rx_engine(len) == AES_RES_OK);
+    len = make_frame(AUX_SEC_LEVEL_DATA_CONF_ON_MIC_8, 103, 1);
+    CHECK(rx_engine(len) == AES_RES_OK);
+    check_rejected(AUX_SEC_LEVEL_DATA_CONF_OFF_MIC_0, 1005);
+
+    /* An allowed level with a forged MIC reaches the MIC check on both paths, and is rejected there */
+    aes_engine_runs = 0;
+    ecb_blocks = 0;
+    len = make_frame(AUX_SEC_LEVEL_DATA_CONF_ON_MIC_16, 104, 0);
+    CHECK(rx_engine(len) == AES_RES_ERROR);
+    CHECK(rx_in_place(len) == AES_RES_ERROR);
+    CHECK(aes_engine_runs == 1);
+    CHECK(ecb_blocks > 0);
+    CHECK(mac_replay_get_stats()->accepted == 4);
+
+    /* Round trips through the in-place path at every level allowed by the lowest minimum */
+    frame_cnt = 200;
+    check_in_place_round_trips(&frame_cnt);
+
+    printf("%s: in-place decryption at every level, security levels 0 and 4 and levels below the minimum rejected\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,381 @@
+/**
+ * Checks and benchmarks the IEEE 802.15.4 MAC header parser of Src/MAC_802_15_4/mac_mhr.c
+ *
+ * Generates a corpus of frames mixing the headers found on a UWB network: the short-address data frames of the
+ * ranging examples (2006, PAN ID compressed), the secured 64-bit frames of the AES examples, 2015 frames with a
+ * suppressed sequence number or header IEs, acks and beacons without addresses, and random combinations. Every frame is
+ * built with mac_mhr_build(), parsed back with mac_mhr_parse() and checked against its fields and against a direct
+ * field-by-field parser written from the standard. Both parsers are then timed over the corpus.
+ *
+ * Build with `make tools`, then for example:
+ *     Output/tools/mhr_bench
+ *     Output/tools/mhr_bench 1000000
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <mac_mhr.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Longest frame of the corpus: header, header IEs and payload */
+#define MAX_FRAME 127
+
+/* Number of passes over the corpus for each timing */
+#define PASSES 20
+
+typedef struct
+{
+    uint8_t data[MAX_FRAME];
+    uint16_t len;
+    uint16_t header_len;
+    mac_mhr_fields_t fields;
+} corpus_frame_t;
+
+/* Reference result of a parse */
+typedef struct
+{
+    uint16_t header_len;
+    uint64_t dest_addr, src_addr;
+    uint16_t dest_pan, src_pan;
+    int seq;
+} ref_mhr_t;
+
+static uint32_t rng_state = 0x12345678;
+
+static uint32_t rnd(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t read_le(const uint8_t *p, int len)
+{
+    uint64_t v = 0;
+    int i;
+
+    for (i = len - 1; i >= 0; i--)
+    {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+/* Parses a header the way the standard describes it, one field after the other. Returns 0 on a malformed header. */
+static int reference_parse(const uint8_t *f, uint16_t len, ref_mhr_t *out)
+{
+    uint16_t fc, pos = 2;
+    int dm, sm, ver, pc, dest_pan = 0, src_pan = 0, seq = 1;
+    int alen[4] = { 0, -1, 2, 8 };
+
+    if (len < 2)
+    {
+        return 0;
+    }
+    fc = (uint16_t)(f[0] | (f[1] << 8));
+    dm = (fc >> 10) & 3;
+    sm = (fc >> 14) & 3;
+    ver = (fc >> 12) & 3;
+    pc = (fc >> 6) & 1;
+    if (dm == 1 || sm == 1 || ver == 3)
+    {
+        return 0;
+    }
+
+    if (ver < 2)
+    {
+        if (pc && !(dm && sm))
+        {
+            return 0;
+        }
+        dest_pan = (dm != 0);
+        src_pan = (sm != 0) && !pc;
+    }
+    else
+    {
+        seq = !(fc & 0x100);
+        if (!dm && !sm)
+        {
+            dest_pan = pc;
+        }
+        else if (dm && !sm)
+        {
+            dest_pan = !pc;
+        }
+        else if (!dm && sm)
+        {
+            src_pan = !pc;
+        }
+        else if (dm == 3 && sm == 3)
+        {
+            dest_pan = !pc;
+        }
+        else
+        {
+            dest_pan = 1;
+            src_pan = !pc;
+        }
+    }
+
+    out->seq = -1;
+    if (seq)
+    {
+        out->seq = f[pos++];
+    }
+    out->dest_pan = 0xFFFF;
+    if (dest_pan)
+    {
+        out->dest_pan = (uint16_t)read_le(&f[pos], 2);
+        pos += 2;
+    }
+    out->dest_addr = read_le(&f[pos], alen[dm]);
+    pos += alen[dm];
+    out->src_pan = out->dest_pan;
+    if (src_pan)
+    {
+        out->src_pan = (uint16_t)read_le(&f[pos], 2);
+        pos += 2;
+    }
+    out->src_addr = read_le(&f[pos], alen[sm]);
+    pos += alen[sm];
+    if (pos > len)
+    {
+        return 0;
+    }
+
+    if (fc & 0x08)
+    {
+        int key_len[4] = { 0, 1, 5, 9 };
+
+        if (ver == 0 || pos >= len)
+        {
+            return 0;
+        }
+        pos += 1 + ((f[pos] & 0x20) ? 0 : 4) + key_len[(f[pos] >> 3) & 3];
+    }
+    if ((fc & 0x200) && ver == 2)
+    {
+        while (pos + 2 <= len)
+        {
+            uint16_t d = (uint16_t)(f[pos] | (f[pos + 1] << 8));
+            int id = (d >> 7) & 0xFF;
+
+            pos += 2 + (d & 0x7F);
+            if (id == 0x7E || id == 0x7F)
+            {
+                break;
+            }
+        }
+    }
+    if (pos > len)
+    {
+        return 0;
+    }
+    out->header_len = pos;
+    return 1;
+}
+
+/* Picks the header of the next corpus frame */
+static void random_fields(mac_mhr_fields_t *f)
+{
+    uint32_t kind = rnd() % 100;
+
+    memset(f, 0, sizeof(*f));
+    f->frame_type = 1;
+    f->seq = (uint8_t)rnd();
+    f->dest_pan = f->src_pan = 0xDECA;
+    f->dest_addr = rnd();
+    f->src_addr = rnd();
+
+    if (kind < 40)
+    {
+        /* Ranging examples: 2006 data frame, short addresses, one PAN */
+        f->version = MAC_MHR_VERSION_2006;
+        f->dest_mode = f->src_mode = MAC_MHR_ADDR_SHORT;
+        f->dest_addr &= 0xFFFF;
+        f->src_addr &= 0xFFFF;
+    }
+    else if (kind < 65)
+    {
+        /* AES examples: 64-bit addresses, security with a key index */
+        f->version = MAC_MHR_VERSION_2015;
+        f->dest_mode = f->src_mode = MAC_MHR_ADDR_EXT;
+        f->dest_addr = ((uint64_t)rnd() << 32) | rnd();
+        f->src_addr = ((uint64_t)rnd() << 32) | rnd();
+        f->security = 1;
+        f->sec_level = 5 + rnd() % 3;
+        f->key_id_mode = 1;
+        f->key_index = 1 + rnd() % 3;
+        f->frame_counter = rnd();
+    }
+    else if (kind < 75)
+    {
+        /* 2015 short frames without sequence number */
+        f->version = MAC_MHR_VERSION_2015;
+        f->dest_mode = f->src_mode = MAC_MHR_ADDR_SHORT;
+        f->dest_addr &= 0xFFFF;
+        f->src_addr &= 0xFFFF;
+        f->seq_suppress = 1;
+    }
+    else if (kind < 80)
+    {
+        /* Acks and beacons */
+        f->frame_type = (kind & 1) ? 2 : 0;
+        f->version = MAC_MHR_VERSION_2006;
+        f->src_mode = (kind & 1) ? MAC_MHR_ADDR_NONE : MAC_MHR_ADDR_SHORT;
+        f->src_addr &= 0xFFFF;
+        f->dest_addr = 0;
+        if (!f->src_mode)
+        {
+            f->src_addr = 0;
+        }
+    }
+    else
+    {
+        /* Anything valid */
+        static const uint8_t modes[3] = { MAC_MHR_ADDR_NONE, MAC_MHR_ADDR_SHORT, MAC_MHR_ADDR_EXT };
+
+        f->version = (uint8_t)(rnd() % 3);
+        f->dest_mode = modes[rnd() % 3];
+        f->src_mode = modes[rnd() % 3];
+        f->dest_addr = (f->dest_mode == MAC_MHR_ADDR_SHORT) ? (f->dest_addr & 0xFFFF) : (f->dest_mode ? ((uint64_t)rnd() << 32) | rnd() : 0);
+        f->src_addr = (f->src_mode == MAC_MHR_ADDR_SHORT) ? (f->src_addr & 0xFFFF) : (f->src_mode ? ((uint64_t)rnd() << 32) | rnd() : 0);
+        if (rnd() & 1)
+        {
+            f->src_pan = (uint16_t)rnd();
+        }
+        f->seq_suppress = (f->version == MAC_MHR_VERSION_2015) && (rnd() & 1);
+        f->security = (f->version != MAC_MHR_VERSION_2003) && (rnd() & 1);
+        f->sec_level = rnd() % 8;
+        f->key_id_mode = rnd() % 2;
+        f->key_index = (uint8_t)rnd();
+        f->frame_counter = rnd();
+    }
+}
+
+/* Builds a corpus frame, adding header IEs to some 2015 frames. Returns 0 for an invalid combination. */
+static int build_frame(corpus_frame_t *c)
+{
+    uint16_t len = mac_mhr_build(c->data, &c->fields);
+    uint16_t payload;
+
+    if (!len)
+    {
+        return 0;
+    }
+    if (c->fields.version == MAC_MHR_VERSION_2015 && (rnd() % 4) == 0)
+    {
+        uint8_t ie_len = rnd() % 8;
+
+        /* One header IE (element ID 0x1A) and a HT1 termination IE */
+        c->data[1] |= MAC_MHR_FC_IE_PRESENT >> 8;
+        c->data[len++] = (uint8_t)(ie_len | (0x1A << 7));
+        c->data[len++] = (uint8_t)(0x1A >> 1);
+        memset(&c->data[len], 0xA5, ie_len);
+        len += ie_len;
+        c->data[len++] = (uint8_t)(0x7E << 7);
+        c->data[len++] = (uint8_t)(0x7E >> 1);
+    }
+    c->header_len = len;
+
+    payload = rnd() % (MAX_FRAME - len + 1);
+    memset(&c->data[len], 0x5A, payload);
+    c->len = len + payload;
+    return 1;
+}
+
+/* Checks one frame against its fields and the reference parser, returns the number of mismatches */
+static int check_frame(const corpus_frame_t *c)
+{
+    const mac_mhr_fields_t *f = &c->fields;
+    mac_mhr_t mhr;
+    ref_mhr_t ref;
+    int errors = 0;
+
+    if (mac_mhr_parse(&mhr, c->data, c->len) != c->header_len || !reference_parse(c->data, c->len, &ref) || ref.header_len != c->header_len)
+    {
+        return 1;
+    }
+    errors += MAC_MHR_FRAME_TYPE(&mhr) != f->frame_type;
+    errors += MAC_MHR_DEST_ADDR(&mhr) != f->dest_addr || ref.dest_addr != f->dest_addr;
+    errors += MAC_MHR_SRC_ADDR(&mhr) != f->src_addr || ref.src_addr != f->src_addr;
+    errors += MAC_MHR_HAS_SEQ(&mhr) == (f->seq_suppress != 0);
+    errors += MAC_MHR_HAS_SEQ(&mhr) && (MAC_MHR_SEQ(&mhr) != f->seq || ref.seq != f->seq);
+    errors += f->dest_mode && (MAC_MHR_DEST_PAN(&mhr) != f->dest_pan || ref.dest_pan != f->dest_pan);
+    errors += f->src_mode && (MAC_MHR_SRC_PAN(&mhr) != f->src_pan || ref.src_pan != f->src_pan);
+    errors += MAC_MHR_SECURED(&mhr) != (f->security != 0);
+    errors += f->security && mac_mhr_read_addr(MAC_MHR_AUX_PTR(&mhr) + 1, 4) != f->frame_counter;
+    return errors != 0;
+}
+
+int main(int argc, char **argv)
+{
+    size_t num_frames = (argc > 1) ? (size_t)atol(argv[1]) : 100000;
+    corpus_frame_t *corpus = malloc(num_frames * sizeof(*corpus));
+    size_t i, bad = 0, header_bytes = 0;
+    volatile uint64_t sink = 0;
+    double t0, table_s, ref_s;
+    int pass;
+
+    if (!corpus || !num_frames)
+    {
+        fprintf(stderr, "usage: %s [FRAMES]\n", argv[0]);
+        return 1;
+    }
+
+    for (i = 0; i < num_frames; i++)
+    {
+        do
+        {
+            random_fields(&corpus[i].fields);
+        } while (!build_frame(&corpus[i]));
+        bad += check_frame(&corpus[i]);
+        header_bytes += corpus[i].header_len;
+    }
+    printf("%zu frames, average MHR %.1f bytes, %zu mismatches\n", num_frames, (double)header_bytes / num_frames, bad);
+
+    t0 = now_s();
+    for (pass = 0; pass < PASSES; pass++)
+    {
+        for (i = 0; i < num_frames; i++)
+        {
+            mac_mhr_t mhr;
+
+            sink += mac_mhr_parse(&mhr, corpus[i].data, corpus[i].len);
+            sink += MAC_MHR_SRC_ADDR(&mhr);
+        }
+    }
+    table_s = now_s() - t0;
+
+    t0 = now_s();
+    for (pass = 0; pass < PASSES; pass++)
+    {
+        for (i = 0; i < num_frames; i++)
+        {
+            ref_mhr_t ref;
+
+            sink += reference_parse(corpus[i].data, corpus[i].len, &ref);
+            sink += ref.header_len + ref.src_addr;
+        }
+    }
+    ref_s = now_s() - t0;
+
+    printf("%-10s %7.1f ns/frame  %7.2f Mframes/s\n", "table", table_s * 1e9 / (num_frames * PASSES), num_frames * PASSES / table_s / 1e6);
+    printf("%-10s %7.1f ns/frame  %7.2f Mframes/s\n", "reference", ref_s * 1e9 / (num_frames * PASSES), num_frames * PASSES / ref_s / 1e6);
+
+    free(corpus);
+    return bad ? 1 : 0;
+}
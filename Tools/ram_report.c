@@ -0,0 +1,196 @@
+/**
+ * Build-time report of the static RAM used by every module of the firmware
+ *
+ * Reads the ELF object files produced by the build and sums, per object file, the writable sections that end up in
+ * RAM: initialised data (.data*), zero-initialised data (.bss*) and common symbols. The linker may still discard
+ * unused sections, so the figures are an upper bound per module. The stack and heap are reserved by the linker and
+ * are not part of any module (see arm_linker_stack_size / arm_linker_heap_size in dw3000_api.emProject).
+ *
+ * Build with `make tools`, run with `make ram-report` after `make build`, or directly:
+ *     Output/tools/ram_report Output/Common/Obj/dw3000_api/main.o ...
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ELF32 constants used below */
+#define ELFCLASS32 1
+#define ELFDATA2LSB 1
+#define SHT_PROGBITS 1
+#define SHT_SYMTAB 2
+#define SHT_NOBITS 8
+#define SHF_WRITE 0x1
+#define SHF_ALLOC 0x2
+#define SHN_COMMON 0xFFF2
+
+/* Largest number of modules reported */
+#define MAX_MODULES 512
+
+typedef struct
+{
+    const char *name;
+    uint32_t data;
+    uint32_t bss;
+} module_t;
+
+static uint16_t rd16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t rd32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint8_t *read_file(const char *path, long *size)
+{
+    FILE *f = fopen(path, "rb");
+    uint8_t *data;
+
+    if (!f)
+    {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = malloc(*size > 0 ? (size_t)*size : 1);
+    if (data && fread(data, 1, (size_t)*size, f) != (size_t)*size)
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    return data;
+}
+
+/* Sums the RAM sections of one little-endian ELF32 object, returns -1 if the file is not one */
+static int measure_object(const char *path, module_t *mod)
+{
+    long size;
+    uint8_t *elf = read_file(path, &size);
+    uint32_t shoff;
+    uint16_t shentsize, shnum;
+    int i;
+
+    if (!elf)
+    {
+        perror(path);
+        return -1;
+    }
+    if (size < 52 || memcmp(elf, "\177ELF", 4) != 0 || elf[4] != ELFCLASS32 || elf[5] != ELFDATA2LSB)
+    {
+        fprintf(stderr, "%s: not a little-endian ELF32 file\n", path);
+        free(elf);
+        return -1;
+    }
+
+    shoff = rd32(elf + 32);
+    shentsize = rd16(elf + 46);
+    shnum = rd16(elf + 48);
+    if (shentsize < 40 || (long)shoff + (long)shnum * shentsize > size)
+    {
+        fprintf(stderr, "%s: truncated section table\n", path);
+        free(elf);
+        return -1;
+    }
+
+    mod->name = path;
+    mod->data = 0;
+    mod->bss = 0;
+
+    for (i = 0; i < shnum; i++)
+    {
+        const uint8_t *sh = elf + shoff + (uint32_t)i * shentsize;
+        uint32_t type = rd32(sh + 4);
+        uint32_t flags = rd32(sh + 8);
+        uint32_t sec_off = rd32(sh + 16);
+        uint32_t sec_size = rd32(sh + 20);
+        uint32_t entsize = rd32(sh + 36);
+
+        if ((flags & (SHF_ALLOC | SHF_WRITE)) == (SHF_ALLOC | SHF_WRITE))
+        {
+            if (type == SHT_NOBITS)
+            {
+                mod->bss += sec_size;
+            }
+            else if (type == SHT_PROGBITS)
+            {
+                mod->data += sec_size;
+            }
+        }
+        else if (type == SHT_SYMTAB && entsize >= 16 && (long)sec_off + sec_size <= size)
+        {
+            /* Tentative definitions (-fcommon) live in no section until link time */
+            uint32_t n;
+
+            for (n = 0; n < sec_size / entsize; n++)
+            {
+                const uint8_t *sym = elf + sec_off + n * entsize;
+
+                if (rd16(sym + 14) == SHN_COMMON)
+                {
+                    mod->bss += rd32(sym + 8);
+                }
+            }
+        }
+    }
+
+    free(elf);
+    return 0;
+}
+
+static int by_total_desc(const void *a, const void *b)
+{
+    const module_t *ma = (const module_t *)a;
+    const module_t *mb = (const module_t *)b;
+    uint32_t ta = ma->data + ma->bss;
+    uint32_t tb = mb->data + mb->bss;
+
+    return (ta < tb) ? 1 : (ta > tb) ? -1 : strcmp(ma->name, mb->name);
+}
+
+int main(int argc, char **argv)
+{
+    static module_t modules[MAX_MODULES];
+    int num_modules = 0;
+    uint32_t total_data = 0, total_bss = 0;
+    int i, ret = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s OBJECT.o...\n", argv[0]);
+        return 2;
+    }
+
+    for (i = 1; i < argc && num_modules < MAX_MODULES; i++)
+    {
+        if (measure_object(argv[i], &modules[num_modules]) == 0)
+        {
+            total_data += modules[num_modules].data;
+            total_bss += modules[num_modules].bss;
+            num_modules++;
+        }
+        else
+        {
+            ret = 1;
+        }
+    }
+
+    qsort(modules, (size_t)num_modules, sizeof(modules[0]), by_total_desc);
+
+    printf("%8s %8s %8s  %s\n", "data", "bss", "total", "module");
+    for (i = 0; i < num_modules; i++)
+    {
+        if (modules[i].data + modules[i].bss)
+        {
+            printf("%8u %8u %8u  %s\n", modules[i].data, modules[i].bss, modules[i].data + modules[i].bss, modules[i].name);
+        }
+    }
+    printf("%8u %8u %8u  total (%d modules)\n", total_data, total_bss, total_data + total_bss, num_modules);
+
+    return ret;
+}
@@ -0,0 +1,713 @@
+/**
+ * Host-side streaming decoder for the connectivity matrix firmware's RTT output
+ *
+ * Consumes the text produced by `make stream-rtt` / `make stream-debug-logs` incrementally (stdin, a recorded log,
+ * or a log that is still being written with --follow) without buffering the whole stream. It decodes:
+ *  - matrix snapshots printed by print_matrix() ("Connectivity matrix for device D:" followed by N rows)
+ *  - ranging records ("RNG <src> <dst> <distance>")
+ * and maintains a live in-memory matrix where every cell keeps the time it last changed. Changes are published to
+ * the registered consumers; the default consumer prints them as JSON lines on stdout.
+ *
+ * Build with `make tools`, then for example:
+ *     Output/tools/rtt_decoder --follow Output/debug-log.txt
+ *     Output/tools/rtt_decoder --bench 64
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Largest network the live matrix can hold */
+#define MAX_NODES 64
+
+/* Longest line kept, longer lines are truncated (the firmware prints at most one matrix row per line) */
+#define MAX_LINE_LEN 2048
+
+/* Read size when streaming from a file descriptor */
+#define READ_CHUNK 65536
+
+/* Maximum number of consumers that can subscribe to updates */
+#define MAX_CONSUMERS 4
+
+/* Highest sustained RTT rate: SWD at 4 MHz as used by the Makefile's JLinkRTTLogger targets, i.e. 4 Mbit/s */
+#define RTT_MAX_BYTES_PER_S 500000
+
+static const char snapshot_header[] = "Connectivity matrix for device ";
+static const char ranging_prefix[] = "RNG ";
+
+typedef enum
+{
+    UPDATE_CELL = 0, /* A cell of the live matrix changed value */
+    UPDATE_SNAPSHOT, /* A complete matrix snapshot was decoded */
+    UPDATE_RANGING   /* A ranging record was decoded */
+} update_kind_e;
+
+typedef struct
+{
+    update_kind_e kind;
+    int reporter; /* Device that printed the snapshot or measured the distance */
+    int row;
+    int col;
+    double value;
+    uint64_t ts_ms;
+} matrix_update_t;
+
+typedef void (*update_consumer_t)(const matrix_update_t *update, void *ctx);
+
+typedef struct
+{
+    double value;
+    uint64_t ts_ms;   /* Last time the value changed or was measured directly, 0 if never seen */
+    uint32_t updates; /* Number of changes */
+} matrix_cell_t;
+
+typedef struct
+{
+    /* Live matrix */
+    matrix_cell_t cells[MAX_NODES][MAX_NODES];
+    int num_nodes;
+
+    /* Consumers */
+    update_consumer_t consumers[MAX_CONSUMERS];
+    void *consumer_ctx[MAX_CONSUMERS];
+    int num_consumers;
+
+    /* Partial line carried over between chunks */
+    char line[MAX_LINE_LEN];
+    size_t line_len;
+
+    /* Snapshot being decoded: reporter, expected columns (from the first row) and next row */
+    int snap_reporter;
+    int snap_cols;
+    int snap_row;
+    double snap_values[MAX_NODES][MAX_NODES];
+
+    /* Time attached to the updates of the chunk being decoded */
+    uint64_t now_ms;
+
+    /* Statistics */
+    uint64_t bytes;
+    uint64_t lines;
+    uint64_t snapshots;
+    uint64_t ranging_records;
+    uint64_t other_lines;
+    uint64_t bad_lines;
+} decoder_t;
+
+static uint64_t monotonic_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static double monotonic_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void decoder_init(decoder_t *dec)
+{
+    memset(dec, 0, sizeof(*dec));
+    dec->snap_reporter = -1;
+}
+
+static void decoder_subscribe(decoder_t *dec, update_consumer_t consumer, void *ctx)
+{
+    if (dec->num_consumers < MAX_CONSUMERS)
+    {
+        dec->consumers[dec->num_consumers] = consumer;
+        dec->consumer_ctx[dec->num_consumers] = ctx;
+        dec->num_consumers++;
+    }
+}
+
+static void publish(decoder_t *dec, const matrix_update_t *update)
+{
+    int i;
+
+    for (i = 0; i < dec->num_consumers; i++)
+    {
+        dec->consumers[i](update, dec->consumer_ctx[i]);
+    }
+}
+
+/* Writes one cell, publishing an update when the value changed (or always when forced by a direct measurement) */
+static void set_cell(decoder_t *dec, int reporter, int row, int col, double value, int force)
+{
+    matrix_cell_t *cell = &dec->cells[row][col];
+    matrix_update_t update;
+
+    if (row >= dec->num_nodes)
+    {
+        dec->num_nodes = row + 1;
+    }
+    if (col >= dec->num_nodes)
+    {
+        dec->num_nodes = col + 1;
+    }
+
+    if (!force && cell->ts_ms && (cell->value == value || (isnan(cell->value) && isnan(value))))
+    {
+        return;
+    }
+
+    cell->value = value;
+    cell->ts_ms = dec->now_ms;
+    cell->updates++;
+
+    update.kind = UPDATE_CELL;
+    update.reporter = reporter;
+    update.row = row;
+    update.col = col;
+    update.value = value;
+    update.ts_ms = dec->now_ms;
+    publish(dec, &update);
+}
+
+/* Parses a non-negative decimal integer of at most max, returns the position after it or NULL. The value is
+ * bounded digit by digit, so that a long number cannot overflow into a negative index. */
+static const char *parse_int(const char *p, const char *end, int max, int *out)
+{
+    int value = 0;
+    const char *start = p;
+
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        if (value > (max - (*p - '0')) / 10)
+        {
+            return NULL;
+        }
+        value = value * 10 + (*p - '0');
+        p++;
+    }
+    if (p == start)
+    {
+        return NULL;
+    }
+    *out = value;
+    return p;
+}
+
+/* Parses a "%f"-style number. The fixed-point form printed by the firmware takes a fast path, anything else (nan, inf,
+ * exponents) falls back to strtod. Returns the position after the number or NULL. */
+static const char *parse_number(const char *p, const char *end, double *out)
+{
+    const char *start = p;
+    int negative = 0;
+    uint64_t mantissa = 0;
+    int frac_digits = 0;
+    int digits = 0;
+    static const double scale[] = { 1.0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = (*p == '-');
+        p++;
+    }
+    while (p < end && *p >= '0' && *p <= '9' && digits < 18)
+    {
+        mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+        p++;
+        digits++;
+    }
+    if (p < end && *p == '.')
+    {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9' && digits < 18)
+        {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            p++;
+            digits++;
+            frac_digits++;
+        }
+    }
+
+    if (digits > 0 && frac_digits < 10 && (p == end || *p == ' ' || *p == '\t'))
+    {
+        *out = (negative ? -(double)mantissa : (double)mantissa) / scale[frac_digits];
+        return p;
+    }
+    else
+    {
+        char tmp[64];
+        size_t len = 0;
+        char *stop;
+
+        p = start;
+        while (p < end && *p != ' ' && *p != '\t' && len < sizeof(tmp) - 1)
+        {
+            tmp[len++] = *p++;
+        }
+        tmp[len] = '\0';
+        *out = strtod(tmp, &stop);
+        return (stop == tmp) ? NULL : start + (stop - tmp);
+    }
+}
+
+static const char *skip_blanks(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+    {
+        p++;
+    }
+    return p;
+}
+
+static int starts_with(const char *p, const char *end, const char *prefix, size_t prefix_len)
+{
+    return ((size_t)(end - p) >= prefix_len) && (memcmp(p, prefix, prefix_len) == 0);
+}
+
+/* Decodes one matrix row: "<value> M      <value> M      ..." */
+static int decode_matrix_row(decoder_t *dec, const char *p, const char *end)
+{
+    int col = 0;
+
+    for (;;)
+    {
+        p = skip_blanks(p, end);
+        if (p == end)
+        {
+            break;
+        }
+        if (col >= MAX_NODES)
+        {
+            return -1;
+        }
+        p = parse_number(p, end, &dec->snap_values[dec->snap_row][col]);
+        if (!p)
+        {
+            return -1;
+        }
+        p = skip_blanks(p, end);
+        if (p == end || *p != 'M')
+        {
+            return -1;
+        }
+        p++;
+        col++;
+    }
+
+    if (dec->snap_cols == 0)
+    {
+        dec->snap_cols = col;
+    }
+    return (col == dec->snap_cols && col > 0) ? 0 : -1;
+}
+
+static void finish_snapshot(decoder_t *dec)
+{
+    matrix_update_t update;
+    int i, j;
+
+    for (i = 0; i < dec->snap_cols; i++)
+    {
+        for (j = 0; j < dec->snap_cols; j++)
+        {
+            set_cell(dec, dec->snap_reporter, i, j, dec->snap_values[i][j], 0);
+        }
+    }
+
+    dec->snapshots++;
+    update.kind = UPDATE_SNAPSHOT;
+    update.reporter = dec->snap_reporter;
+    update.row = dec->snap_cols;
+    update.col = dec->snap_cols;
+    update.value = 0;
+    update.ts_ms = dec->now_ms;
+    publish(dec, &update);
+
+    dec->snap_reporter = -1;
+}
+
+static void decode_line(decoder_t *dec, const char *p, const char *end)
+{
+    int a, b;
+    double value;
+
+    dec->lines++;
+
+    /* Strip the CR of CRLF line endings */
+    if (end > p && end[-1] == '\r')
+    {
+        end--;
+    }
+
+    /* Rows of a snapshot being decoded. The firmware prints the rows back to back, anything else aborts the snapshot. */
+    if (dec->snap_reporter >= 0)
+    {
+        if (decode_matrix_row(dec, p, end) == 0)
+        {
+            if (++dec->snap_row == dec->snap_cols)
+            {
+                finish_snapshot(dec);
+            }
+            return;
+        }
+        dec->bad_lines++;
+        dec->snap_reporter = -1;
+    }
+
+    if (starts_with(p, end, snapshot_header, sizeof(snapshot_header) - 1))
+    {
+        const char *q = parse_int(p + sizeof(snapshot_header) - 1, end, MAX_NODES - 1, &a);
+
+        if (q && q < end && *q == ':' && a >= 0 && a < MAX_NODES)
+        {
+            dec->snap_reporter = a;
+            dec->snap_cols = 0;
+            dec->snap_row = 0;
+        }
+        else
+        {
+            dec->bad_lines++;
+        }
+        return;
+    }
+
+    if (starts_with(p, end, ranging_prefix, sizeof(ranging_prefix) - 1))
+    {
+        const char *q = parse_int(p + sizeof(ranging_prefix) - 1, end, MAX_NODES - 1, &a);
+
+        q = q ? parse_int(skip_blanks(q, end), end, MAX_NODES - 1, &b) : NULL;
+        q = q ? parse_number(skip_blanks(q, end), end, &value) : NULL;
+        if (q && a >= 0 && a < MAX_NODES && b >= 0 && b < MAX_NODES)
+        {
+            matrix_update_t update;
+
+            dec->ranging_records++;
+            update.kind = UPDATE_RANGING;
+            update.reporter = a;
+            update.row = a;
+            update.col = b;
+            update.value = value;
+            update.ts_ms = dec->now_ms;
+            publish(dec, &update);
+
+            /* A direct measurement refreshes the cell even if the value is unchanged */
+            set_cell(dec, a, a, b, value, 1);
+        }
+        else
+        {
+            dec->bad_lines++;
+        }
+        return;
+    }
+
+    /* Blank lines, telemetry (EVC, AIR, ...) and banners are not part of the matrix */
+    dec->other_lines++;
+}
+
+/* Feeds a chunk of the stream. Lines may be split across chunks at any byte. */
+static void decoder_feed(decoder_t *dec, const char *data, size_t len)
+{
+    const char *p = data;
+    const char *end = data + len;
+
+    dec->bytes += len;
+
+    while (p < end)
+    {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+
+        if (!nl)
+        {
+            /* Keep the tail for the next chunk */
+            size_t tail = (size_t)(end - p);
+
+            if (dec->line_len + tail > sizeof(dec->line))
+            {
+                tail = sizeof(dec->line) - dec->line_len;
+            }
+            memcpy(dec->line + dec->line_len, p, tail);
+            dec->line_len += tail;
+            return;
+        }
+
+        if (dec->line_len)
+        {
+            size_t head = (size_t)(nl - p);
+
+            if (dec->line_len + head > sizeof(dec->line))
+            {
+                head = sizeof(dec->line) - dec->line_len;
+            }
+            memcpy(dec->line + dec->line_len, p, head);
+            decode_line(dec, dec->line, dec->line + dec->line_len + head);
+            dec->line_len = 0;
+        }
+        else
+        {
+            /* Fast path, the whole line is in the chunk */
+            decode_line(dec, p, nl);
+        }
+        p = nl + 1;
+    }
+}
+
+/* Default consumer: one JSON object per line on stdout */
+static void json_consumer(const matrix_update_t *update, void *ctx)
+{
+    (void)ctx;
+
+    switch (update->kind)
+    {
+    case UPDATE_CELL:
+        printf("{\"ev\":\"cell\",\"row\":%d,\"col\":%d,\"d\":%.3f,\"by\":%d,\"ts\":%llu}\n", update->row, update->col, update->value,
+            update->reporter, (unsigned long long)update->ts_ms);
+        break;
+    case UPDATE_RANGING:
+        printf("{\"ev\":\"range\",\"src\":%d,\"dst\":%d,\"d\":%.3f,\"ts\":%llu}\n", update->row, update->col, update->value,
+            (unsigned long long)update->ts_ms);
+        break;
+    case UPDATE_SNAPSHOT:
+        printf("{\"ev\":\"snapshot\",\"by\":%d,\"n\":%d,\"ts\":%llu}\n", update->reporter, update->row, (unsigned long long)update->ts_ms);
+        break;
+    }
+    fflush(stdout);
+}
+
+/* Consumer that prints the whole live matrix, with the age of every cell, after each snapshot */
+static void table_consumer(const matrix_update_t *update, void *ctx)
+{
+    const decoder_t *dec = (const decoder_t *)ctx;
+    int i, j;
+
+    if (update->kind != UPDATE_SNAPSHOT)
+    {
+        return;
+    }
+
+    printf("live matrix (%d nodes), value m / age ms:\n", dec->num_nodes);
+    for (i = 0; i < dec->num_nodes; i++)
+    {
+        for (j = 0; j < dec->num_nodes; j++)
+        {
+            const matrix_cell_t *cell = &dec->cells[i][j];
+
+            if (cell->ts_ms)
+            {
+                printf("%9.3f/%-6llu ", cell->value, (unsigned long long)(update->ts_ms - cell->ts_ms));
+            }
+            else
+            {
+                printf("%9s/%-6s ", "-", "-");
+            }
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+}
+
+/* Consumer used by the benchmark, only counts updates */
+static void counting_consumer(const matrix_update_t *update, void *ctx)
+{
+    (void)update;
+    (*(uint64_t *)ctx)++;
+}
+
+static int decode_stream(FILE *in, int follow, decoder_t *dec)
+{
+    static char buf[READ_CHUNK];
+
+    for (;;)
+    {
+        size_t n = fread(buf, 1, sizeof(buf), in);
+
+        if (n > 0)
+        {
+            dec->now_ms = monotonic_ms();
+            decoder_feed(dec, buf, n);
+            continue;
+        }
+        if (ferror(in))
+        {
+            fprintf(stderr, "read error: %s\n", strerror(errno));
+            return 1;
+        }
+        if (!follow)
+        {
+            return 0;
+        }
+
+        /* Wait for the logger to append more data */
+        struct timespec wait = { 0, 50000000 };
+
+        clearerr(in);
+        nanosleep(&wait, NULL);
+    }
+}
+
+/* Generates a synthetic log mixing ranging records, telemetry and matrix snapshots of a num_nodes network */
+static char *generate_synthetic_log(size_t target_len, int num_nodes, size_t *out_len)
+{
+    char *log = malloc(target_len + 4096);
+    size_t len = 0;
+    unsigned seed = 12345;
+    int reporter = 0;
+
+    if (!log)
+    {
+        return NULL;
+    }
+
+    while (len < target_len)
+    {
+        int i, j;
+
+        for (j = 0; j < num_nodes && len < target_len; j++)
+        {
+            if (j != reporter)
+            {
+                seed = seed * 1103515245 + 12345;
+                len += (size_t)sprintf(log + len, "RNG %d %d %.3f\n", reporter, j, 1.0 + (double)(seed >> 16 & 0x3FFF) / 1000.0);
+            }
+        }
+        len += (size_t)sprintf(log + len, "EVC t=%d crcg=3/s crcb=0/s phe=0/s pto=0/s rto=1/s sfdto=0/s txf=4/s hpw=0/s crc_err=0 miss=12\n",
+            (int)(len & 0xFFFF));
+
+        len += (size_t)sprintf(log + len, "\nConnectivity matrix for device %d:\n", reporter);
+        for (i = 0; i < num_nodes; i++)
+        {
+            for (j = 0; j < num_nodes; j++)
+            {
+                seed = seed * 1103515245 + 12345;
+                len += (size_t)sprintf(log + len, "%3.3f M      ", (i == j) ? 0.0 : 1.0 + (double)(seed >> 16 & 0x3FFF) / 1000.0);
+            }
+            len += (size_t)sprintf(log + len, "\n");
+        }
+        reporter = (reporter + 1) % num_nodes;
+    }
+
+    *out_len = len;
+    return log;
+}
+
+static int run_benchmark(size_t megabytes)
+{
+    static decoder_t dec;
+    size_t len = 0;
+    uint64_t updates = 0;
+    size_t off;
+    double start, elapsed, rate;
+    char *log = generate_synthetic_log(megabytes * 1024 * 1024, 16, &len);
+
+    if (!log)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    decoder_init(&dec);
+    decoder_subscribe(&dec, counting_consumer, &updates);
+
+    /* Feed in small chunks with arbitrary split points, as a live RTT stream would arrive */
+    start = monotonic_s();
+    for (off = 0; off < len; off += 4093)
+    {
+        size_t n = (len - off < 4093) ? len - off : 4093;
+
+        dec.now_ms = (uint64_t)off;
+        decoder_feed(&dec, log + off, n);
+    }
+    elapsed = monotonic_s() - start;
+    rate = (double)len / elapsed;
+
+    printf("decoded %.1f MB in %.3f s: %.1f MB/s, %.2f Mlines/s\n", (double)len / 1e6, elapsed, rate / 1e6, (double)dec.lines / elapsed / 1e6);
+    printf("snapshots=%llu ranging=%llu other=%llu bad=%llu updates=%llu\n", (unsigned long long)dec.snapshots,
+        (unsigned long long)dec.ranging_records, (unsigned long long)dec.other_lines, (unsigned long long)dec.bad_lines,
+        (unsigned long long)updates);
+    printf("%.0fx the maximum RTT rate (%d B/s)\n", rate / RTT_MAX_BYTES_PER_S, RTT_MAX_BYTES_PER_S);
+
+    free(log);
+    return dec.bad_lines ? 1 : 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+        "usage: %s [--follow] [--table] [--quiet] [FILE|-]\n"
+        "       %s --bench [MEGABYTES]\n"
+        "  --follow  keep reading as FILE grows (for make stream-debug-logs)\n"
+        "  --table   print the live matrix with cell ages after each snapshot\n"
+        "  --quiet   do not print JSON updates\n",
+        name, name);
+}
+
+int main(int argc, char **argv)
+{
+    static decoder_t dec;
+    const char *path = "-";
+    int follow = 0, table = 0, quiet = 0;
+    FILE *in;
+    int i, ret;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--bench") == 0)
+        {
+            return run_benchmark((i + 1 < argc) ? (size_t)atoi(argv[i + 1]) : 64);
+        }
+        else if (strcmp(argv[i], "--follow") == 0 || strcmp(argv[i], "-f") == 0)
+        {
+            follow = 1;
+        }
+        else if (strcmp(argv[i], "--table") == 0)
+        {
+            table = 1;
+        }
+        else if (strcmp(argv[i], "--quiet") == 0 || strcmp(argv[i], "-q") == 0)
+        {
+            quiet = 1;
+        }
+        else if (argv[i][0] == '-' && argv[i][1] != '\0')
+        {
+            usage(argv[0]);
+            return 2;
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+
+    in = (strcmp(path, "-") == 0) ? stdin : fopen(path, "rb");
+    if (!in)
+    {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    decoder_init(&dec);
+    if (!quiet)
+    {
+        decoder_subscribe(&dec, json_consumer, NULL);
+    }
+    if (table)
+    {
+        decoder_subscribe(&dec, table_consumer, &dec);
+    }
+
+    ret = decode_stream(in, follow, &dec);
+
+    fprintf(stderr, "lines=%llu snapshots=%llu ranging=%llu other=%llu bad=%llu\n", (unsigned long long)dec.lines,
+        (unsigned long long)dec.snapshots, (unsigned long long)dec.ranging_records, (unsigned long long)dec.other_lines,
+        (unsigned long long)dec.bad_lines);
+
+    if (in != stdin)
+    {
+        fclose(in);
+    }
+    return ret;
+}
@@ -0,0 +1,322 @@
+/**
+ * Host check that responders follow the token of Src/dist_matrix.c through the frame filter of row pulls
+ *
+ * Runs a ring of NUM_DEVICES nodes (3 by default) taking turns as initiator. The frames are built and parsed with the
+ * firmware's MHR (Src/ranging/ranging_profile.c) and frame encoders (Src/ranging/dm_frames.h), and go through a model
+ * of the DW IC frame filter set up for row pulls: a node only receives the frames addressed to it and broadcasts. Each
+ * node runs its own copy of the state of Src/ranging/sts_link.c, which is included here and swapped between nodes, and
+ * loads the STS IV of the initiator it follows before every reception, as the responder loop does. A poll whose STS was
+ * generated from another pair's IV cannot correlate and fails (STS mode 2 puts the STS in the poll itself).
+ *
+ * Checks that with the broadcast token, which names the next initiator in its payload, no poll fails its STS check,
+ * in particular the first poll of each new initiator. The same ring with the token addressed to the next initiator,
+ * as before, is run for comparison: the filter drops it at the other responders, whose first poll from each new
+ * initiator then fails.
+ *
+ * Build with `make tools`, then run Output/tools/token_follow_sim [ROUNDS]
+ *     cc -DNUM_DEVICES=4 ... (see the Makefile) to check another network size
+ */
+
+#ifndef NUM_DEVICES
+#define NUM_DEVICES 3
+#endif
+#ifndef DM_ROW_PULL
+#define DM_ROW_PULL 1
+#endif
+#ifndef DM_SP3_RANGING
+#define DM_SP3_RANGING 0
+#endif
+
+#include "../Src/ranging/sts_link.c"
+
+#include <dm_frames.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define POLL_FRAME_LEN  (DM_MHR_LEN + dm_poll_SIZE + FCS_LEN)
+#define TOKEN_FRAME_LEN (DM_MHR_LEN + dm_token_SIZE + FCS_LEN)
+
+/* Attempts of the initiator at each responder, as the firmware retries a lost exchange */
+#define MAX_ATTEMPTS 3
+
+static int failures;
+
+#define CHECK(cond)                                                                                                                                           \
+    do                                                                                                                                                        \
+    {                                                                                                                                                         \
+        if (!(cond))                                                                                                                                          \
+        {                                                                                                                                                     \
+            printf("FAIL line %d: %s\n", __LINE__, #cond);                                                                                                    \
+            failures++;                                                                                                                                       \
+        }                                                                                                                                                     \
+    } while (0)
+
+/* Stub DW IC: every STS that reaches read_quality() was generated from the loaded IV, sts_link_accept() rejects the
+ * others before, and correlates fully */
+void dwt_configurestsiv(dwt_sts_cp_iv_t *iv)
+{
+    (void)iv;
+}
+
+void dwt_configurestsloadiv(void)
+{
+}
+
+void dwt_configurestskey(dwt_sts_cp_key_t *key)
+{
+    (void)key;
+}
+
+int dwt_readstsquality(int16_t *quality)
+{
+    *quality = (int16_t)(32 << sts_length);
+    return 0;
+}
+
+int dwt_readstsstatus(uint16_t *status, int index)
+{
+    (void)index;
+    *status = 0;
+    return DWT_SUCCESS;
+}
+
+/* ranging_profile_print_airtime() is not used */
+uint32_t airtime_frame_duration_ns(const dwt_config_t *cfg, uint16_t frame_len)
+{
+    (void)cfg;
+    return frame_len;
+}
+
+/* State of sts_link.c and of the responder loop of each node */
+typedef struct
+{
+    uint32_t pair_count[STS_MAX_NODES];
+    uint8_t self_id;
+    uint8_t sts_length;
+    uint8_t shrink_rounds;
+    uint8_t loaded_peer;
+    uint32_t loaded_count;
+    sts_link_stats_t stats;
+    uint8_t cur_initiator;
+} node_t;
+
+static node_t nodes[NUM_DEVICES];
+static int active = -1;
+
+/* Makes sts_link.c work on the state of node id */
+static void switch_to(int id)
+{
+    node_t *n;
+
+    if (active >= 0)
+    {
+        n = &nodes[active];
+        memcpy(n->pair_count, pair_count, sizeof(pair_count));
+        n->self_id = self_id;
+        n->sts_length = sts_length;
+        n->shrink_rounds = shrink_rounds;
+        n->loaded_peer = loaded_peer;
+        n->loaded_count = loaded_count;
+        n->stats = stats;
+    }
+    n = &nodes[id];
+    memcpy(pair_count, n->pair_count, sizeof(pair_count));
+    self_id = n->self_id;
+    sts_length = n->sts_length;
+    shrink_rounds = n->shrink_rounds;
+    loaded_peer = n->loaded_peer;
+    loaded_count = n->loaded_count;
+    stats = n->stats;
+    active = id;
+}
+
+/* Frame filter of a node set up for row pulls: a data frame of the PAN addressed to it or broadcast */
+static int filter_passes(int id, const uint8_t *frame, uint16_t frame_len, ranging_addr_t *addr)
+{
+    return ranging_mhr_read(DM_RANGING_PROFILE, frame, frame_len - FCS_LEN, addr) && (addr->dest == id || addr->dest == DM_BROADCAST_ID);
+}
+
+/* Results of one run of the ring */
+typedef struct
+{
+    unsigned polls;
+    unsigned sts_failed;
+    unsigned first_failed; /* of the first poll of a new initiator to a responder */
+    unsigned tokens_dropped;
+} run_t;
+
+/*
+ * Responder id receives a poll (see the responder loop of dist_matrix.c), with the IV of the initiator it follows
+ * loaded beforehand. Returns the response header's STS verdict and counter, or 0 if the poll did not get through.
+ */
+static int respond(int id, const uint8_t *frame, uint16_t frame_len, dm_hdr_t *resp)
+{
+    ranging_addr_t rx_addr;
+    dm_hdr_t hdr;
+
+    switch_to(id);
+    sts_link_load(nodes[id].cur_initiator);
+    if (!filter_passes(id, frame, frame_len, &rx_addr))
+    {
+        return 0;
+    }
+    dm_hdr_get(&frame[DM_MHR_LEN], &hdr);
+    if (hdr.type != DM_TYPE_RANGING || frame_len != POLL_FRAME_LEN)
+    {
+        return 0;
+    }
+    nodes[id].cur_initiator = (uint8_t)rx_addr.src;
+    memset(resp, 0, sizeof(*resp));
+    resp->type = DM_TYPE_RESPONSE;
+    resp->sts_valid = (uint8_t)sts_link_accept((uint8_t)rx_addr.src, hdr.sts_count);
+    resp->sts_count = sts_link_last((uint8_t)rx_addr.src);
+    return 1;
+}
+
+/* Node id receives a token, and follows the next initiator it names. Returns that initiator, or -1 if filtered out */
+static int follow_token(int id, const uint8_t *frame, uint16_t frame_len, int broadcast)
+{
+    ranging_addr_t rx_addr;
+    dm_hdr_t hdr;
+    int next;
+
+    if (!filter_passes(id, frame, frame_len, &rx_addr))
+    {
+        return -1;
+    }
+    dm_hdr_get(&frame[DM_MHR_LEN], &hdr);
+    if (hdr.type != DM_TYPE_INITIATOR || frame_len != TOKEN_FRAME_LEN)
+    {
+        return -1;
+    }
+    next = broadcast ? dm_token_get_next(&frame[DM_MHR_LEN]) : (int)rx_addr.dest;
+    nodes[id].cur_initiator = (uint8_t)next;
+    return next;
+}
+
+/* Runs the ring for the given number of rounds, with the token broadcast or addressed to the next initiator */
+static run_t run_ring(int rounds, int broadcast)
+{
+    uint8_t frame[DM_MAX_FRAME_LEN];
+    uint8_t seq = 0;
+    run_t run = { 0 };
+    int id, round, turn;
+
+    memset(nodes, 0, sizeof(nodes));
+    active = -1;
+    for (id = 0; id < NUM_DEVICES; id++)
+    {
+        switch_to(id);
+        sts_link_init((uint8_t)id);
+    }
+
+    for (round = 0; round < rounds; round++)
+    {
+        for (turn = 0; turn < NUM_DEVICES; turn++)
+        {
+            int init = turn, next = (turn + 1) % NUM_DEVICES;
+            ranging_addr_t addr;
+            dm_hdr_t hdr;
+            int resp_id;
+
+            for (resp_id = 0; resp_id < NUM_DEVICES; resp_id++)
+            {
+                int attempt;
+
+                if (resp_id == init)
+                {
+                    continue;
+                }
+                for (attempt = 0; attempt < MAX_ATTEMPTS; attempt++)
+                {
+                    dm_poll_t poll;
+                    dm_hdr_t resp;
+                    int other;
+
+                    memset(&poll, 0, sizeof(poll));
+                    switch_to(init);
+                    poll.hdr.type = DM_TYPE_RANGING;
+                    poll.hdr.sts_count = sts_link_begin((uint8_t)resp_id);
+                    addr.src = (uint16_t)init;
+                    addr.dest = (uint16_t)resp_id;
+                    addr.seq = seq++;
+                    ranging_mhr_write(frame, DM_RANGING_PROFILE, &addr);
+                    dm_poll_put(&frame[DM_MHR_LEN], &poll);
+
+                    /* Every other node is listening, only the addressed one gets the poll */
+                    for (other = 0; other < NUM_DEVICES; other++)
+                    {
+                        if (other != init && other != resp_id)
+                        {
+                            CHECK(!respond(other, frame, POLL_FRAME_LEN, &resp));
+                        }
+                    }
+                    CHECK(respond(resp_id, frame, POLL_FRAME_LEN, &resp));
+                    run.polls++;
+
+                    switch_to(init);
+                    sts_link_sync((uint8_t)resp_id, resp.sts_count);
+                    if (sts_link_check(resp.sts_valid))
+                    {
+                        break;
+                    }
+                    run.sts_failed++;
+                    run.first_failed += (attempt == 0);
+                }
+            }
+
+            /* Pass the token as initiator() does, the initiator then follows the node it named */
+            switch_to(init);
+            nodes[init].cur_initiator = (uint8_t)next;
+            memset(&hdr, 0, sizeof(hdr));
+            hdr.type = DM_TYPE_INITIATOR;
+            addr.src = (uint16_t)init;
+            addr.dest = broadcast ? DM_BROADCAST_ID : (uint16_t)next;
+            addr.seq = seq++;
+            memset(frame, 0, sizeof(frame));
+            ranging_mhr_write(frame, DM_RANGING_PROFILE, &addr);
+            dm_token_set_hdr(&frame[DM_MHR_LEN], hdr);
+            dm_token_set_next(&frame[DM_MHR_LEN], (uint8_t)next);
+            for (id = 0; id < NUM_DEVICES; id++)
+            {
+                if (id != init)
+                {
+                    int named = follow_token(id, frame, TOKEN_FRAME_LEN, broadcast);
+
+                    CHECK(id != next || named == next);
+                    run.tokens_dropped += (named < 0);
+                }
+            }
+        }
+    }
+    return run;
+}
+
+static void print_run(const char *name, const run_t *run)
+{
+    printf("%-10s polls=%u sts_failed=%u (%u/1000) first_polls_failed=%u tokens_dropped=%u\n", name, run->polls, run->sts_failed,
+        run->polls ? run->sts_failed * 1000 / run->polls : 0, run->first_failed, run->tokens_dropped);
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = (argc > 1) ? atoi(argv[1]) : 100;
+    run_t broadcast, addressed;
+
+    printf("NUM_DEVICES %d, %d rounds, token of %d bytes\n", NUM_DEVICES, rounds, (int)TOKEN_FRAME_LEN);
+    broadcast = run_ring(rounds, 1);
+    addressed = run_ring(rounds, 0);
+    print_run("broadcast", &broadcast);
+    print_run("addressed", &addressed);
+
+    /* The broadcast token reaches every node, whose STS is loaded for the initiator's first poll */
+    CHECK(broadcast.sts_failed == 0);
+    CHECK(broadcast.tokens_dropped == 0);
+    /* The filter drops the addressed token at the other responders: each new initiator loses its first poll to them */
+    CHECK(NUM_DEVICES < 3 || addressed.first_failed > 0);
+
+    printf("%s: no STS failure when the initiator changes with the broadcast token\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,293 @@
+/**
+ * Converts trace records produced by Src/diagnostics/trace.c into Chrome trace / Perfetto JSON
+ *
+ * Inputs are binary record streams, either captured from the trace RTT channel:
+ *     JLinkRTTLogger -Device NRF52833_XXAA -if SWD -Speed 4000 -RTTChannel 1 Output/trace.bin
+ * or a debugger dump of trace_buffer (pass the value of trace_head with --ring so the records are put back in order).
+ * Several inputs can be given, each one becomes its own group of processes (one per node) so that a simulated
+ * timeline and a real one can be compared side by side. Load the output in https://ui.perfetto.dev or chrome://tracing.
+ *
+ * --simulate writes a virtual-time trace of a few ranging exchanges using the firmware's own trace macros, which is
+ * what a host build of the firmware modules produces.
+ *
+ * Build with `make tools`, then for example:
+ *     Output/tools/trace_to_perfetto Output/trace.bin > Output/trace.json
+ *     Output/tools/trace_to_perfetto --simulate 10 Output/sim.bin
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <trace.h>
+
+#define TRACE_EV_NAME(name) #name,
+
+static const char *const event_names[] = { TRACE_EVENT_LIST(TRACE_EV_NAME) };
+
+/* Record size on the wire */
+#define RECORD_SIZE 8
+
+/* Input groups are spaced by this many process ids, node ids are added to it */
+#define PID_STRIDE 1000
+
+typedef struct
+{
+    const char *label;
+    int group;
+    int node;
+    uint32_t clock_mhz;
+    uint32_t last_cycles;
+    int64_t time_cycles; /* Unwrapped time of the last record */
+    int started;
+    uint32_t seen_nodes[PID_STRIDE / 32];
+    uint64_t records;
+    uint64_t lost;
+} converter_t;
+
+static int first_event = 1;
+
+static void emit_separator(void)
+{
+    printf(first_event ? "\n" : ",\n");
+    first_event = 0;
+}
+
+static void decode_record(const uint8_t *raw, trace_record_t *rec)
+{
+    rec->cycles = (uint32_t)raw[0] | ((uint32_t)raw[1] << 8) | ((uint32_t)raw[2] << 16) | ((uint32_t)raw[3] << 24);
+    rec->event = raw[4];
+    rec->phase = raw[5];
+    rec->arg = (uint16_t)(raw[6] | (raw[7] << 8));
+}
+
+static void name_process(converter_t *conv)
+{
+    if (conv->node < 0 || conv->node >= PID_STRIDE || (conv->seen_nodes[conv->node / 32] & (1u << (conv->node % 32))))
+    {
+        return;
+    }
+    conv->seen_nodes[conv->node / 32] |= 1u << (conv->node % 32);
+
+    emit_separator();
+    printf("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s node %d\"}}", conv->group * PID_STRIDE + conv->node,
+        conv->label, conv->node);
+}
+
+static void convert_record(converter_t *conv, const trace_record_t *rec)
+{
+    double ts_us;
+    const char *ph;
+
+    /* Unwrap the 32-bit counter. Records of concurrent writers may be slightly out of order, hence the signed delta. */
+    if (!conv->started)
+    {
+        conv->time_cycles = rec->cycles;
+        conv->started = 1;
+    }
+    else
+    {
+        conv->time_cycles += (int32_t)(rec->cycles - conv->last_cycles);
+    }
+    conv->last_cycles = rec->cycles;
+
+    if (rec->event == TRACE_EV_META)
+    {
+        switch (rec->phase)
+        {
+        case TRACE_META_NODE:
+            conv->node = rec->arg;
+            name_process(conv);
+            break;
+        case TRACE_META_CLOCK_MHZ:
+            conv->clock_mhz = rec->arg ? rec->arg : conv->clock_mhz;
+            break;
+        case TRACE_META_LOST:
+            conv->lost += rec->arg;
+            emit_separator();
+            printf("{\"name\":\"LOST\",\"ph\":\"i\",\"s\":\"p\",\"ts\":%.3f,\"pid\":%d,\"tid\":0,\"args\":{\"records\":%u}}",
+                (double)conv->time_cycles / conv->clock_mhz, conv->group * PID_STRIDE + conv->node, rec->arg);
+            break;
+        }
+        return;
+    }
+
+    conv->records++;
+    ts_us = (double)conv->time_cycles / conv->clock_mhz;
+    ph = (rec->phase == TRACE_PH_BEGIN) ? "B" : (rec->phase == TRACE_PH_END) ? "E" : "i";
+
+    emit_separator();
+    if (rec->event < TRACE_EV_COUNT)
+    {
+        printf("{\"name\":\"%s\",\"cat\":\"fw\",\"ph\":\"%s\",", event_names[rec->event], ph);
+    }
+    else
+    {
+        printf("{\"name\":\"EV%u\",\"cat\":\"fw\",\"ph\":\"%s\",", rec->event, ph);
+    }
+    printf("%s\"ts\":%.3f,\"pid\":%d,\"tid\":0,\"args\":{\"arg\":%u}}", (rec->phase == TRACE_PH_INSTANT) ? "\"s\":\"t\"," : "", ts_us,
+        conv->group * PID_STRIDE + conv->node, rec->arg);
+}
+
+static int convert_file(const char *path, int group, long ring_head)
+{
+    converter_t conv;
+    FILE *in = fopen(path, "rb");
+    uint8_t *data;
+    long size, i, count, start;
+
+    if (!in)
+    {
+        perror(path);
+        return 1;
+    }
+    fseek(in, 0, SEEK_END);
+    size = ftell(in);
+    fseek(in, 0, SEEK_SET);
+    data = malloc(size > 0 ? (size_t)size : 1);
+    if (!data || fread(data, 1, (size_t)size, in) != (size_t)size)
+    {
+        fprintf(stderr, "%s: read error\n", path);
+        fclose(in);
+        free(data);
+        return 1;
+    }
+    fclose(in);
+
+    memset(&conv, 0, sizeof(conv));
+    conv.label = path;
+    conv.group = group;
+    conv.clock_mhz = TRACE_CLOCK_HZ / 1000000;
+
+    count = size / RECORD_SIZE;
+
+    /* A debug dump of trace_buffer holds the oldest record at trace_head % TRACE_BUFFER_LEN (once it has wrapped) */
+    start = 0;
+    if (ring_head >= 0)
+    {
+        if (ring_head < count)
+        {
+            count = ring_head;
+        }
+        else
+        {
+            start = ring_head % count;
+        }
+        name_process(&conv);
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        trace_record_t rec;
+
+        decode_record(&data[((start + i) % count) * RECORD_SIZE], &rec);
+        convert_record(&conv, &rec);
+    }
+
+    fprintf(stderr, "%s: %llu records, %llu lost, %.3f ms\n", path, (unsigned long long)conv.records, (unsigned long long)conv.lost,
+        conv.started ? (double)conv.time_cycles / conv.clock_mhz / 1000.0 : 0.0);
+    free(data);
+    return 0;
+}
+
+/* Virtual-time model of the connectivity matrix initiator, in microseconds (see dist_matrix.c) */
+#define SIM_US(us) TRACE_ADVANCE((uint32_t)(us) * (TRACE_CLOCK_HZ / 1000000))
+#define SIM_FRAME_LEN 104
+#define SIM_FRAME_US 290
+#define SIM_SPI_WRITE_US 15
+#define SIM_SPI_READ_US 15
+#define SIM_POLL_RX_TO_RESP_TX_DLY_US 650
+#define SIM_RNG_DELAY_US 1000000
+
+static int simulate(int exchanges, const char *path)
+{
+    FILE *out = fopen(path, "wb");
+    int i;
+
+    if (!out)
+    {
+        perror(path);
+        return 1;
+    }
+
+    trace_set_output(out);
+    trace_init(0);
+
+    for (i = 0; i < exchanges; i++)
+    {
+        TRACE_BEGIN(EXCHANGE, 1);
+        TRACE_BEGIN(SPI_WRITE, SIM_FRAME_LEN + 3);
+        SIM_US(SIM_SPI_WRITE_US);
+        TRACE_END(SPI_WRITE, SIM_FRAME_LEN + 3);
+        TRACE_INSTANT(TX_ARM, SIM_FRAME_LEN);
+        TRACE_BEGIN(RX_WAIT, 1);
+        SIM_US(SIM_FRAME_US + SIM_POLL_RX_TO_RESP_TX_DLY_US + SIM_FRAME_US);
+        TRACE_BEGIN(ISR, 0);
+        SIM_US(2);
+        TRACE_END(ISR, 0);
+        TRACE_END(RX_WAIT, 1);
+        TRACE_INSTANT(RX_DONE, SIM_FRAME_LEN);
+        TRACE_BEGIN(SPI_READ, SIM_FRAME_LEN + 2);
+        SIM_US(SIM_SPI_READ_US);
+        TRACE_END(SPI_READ, SIM_FRAME_LEN + 2);
+        TRACE_END(EXCHANGE, 1);
+
+        TRACE_BEGIN(BACKGROUND, 0);
+        trace_poll();
+        SIM_US(50);
+        TRACE_END(BACKGROUND, 0);
+        SIM_US(SIM_RNG_DELAY_US);
+    }
+    trace_poll();
+
+    fclose(out);
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+        "usage: %s [--ring TRACE_HEAD] FILE... > trace.json\n"
+        "       %s --simulate EXCHANGES FILE\n"
+        "  --ring      the next FILE is a debug dump of trace_buffer, TRACE_HEAD is the value of trace_head\n"
+        "  --simulate  write a virtual-time trace of EXCHANGES ranging exchanges to FILE\n",
+        name, name);
+}
+
+int main(int argc, char **argv)
+{
+    long ring_head = -1;
+    int group = 0;
+    int ret = 0;
+    int i;
+
+    if (argc >= 2 && strcmp(argv[1], "--simulate") == 0)
+    {
+        if (argc != 4)
+        {
+            usage(argv[0]);
+            return 2;
+        }
+        return simulate(atoi(argv[2]), argv[3]);
+    }
+    if (argc < 2)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--ring") == 0 && i + 1 < argc)
+        {
+            ring_head = strtol(argv[++i], NULL, 0);
+            continue;
+        }
+        ret |= convert_file(argv[i], group++, ring_head);
+        ring_head = -1;
+    }
+    printf("\n]}\n");
+
+    return ret;
+}